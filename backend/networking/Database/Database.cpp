@@ -2,6 +2,9 @@
 #include <fstream>
 #include <iostream>
 #include <filesystem>
+#include <cstring>
+#include "../Logging/Logger.hpp"
+#include "../Tracing/Trace.hpp"
 
 using namespace std;
 
@@ -21,17 +24,17 @@ TrainingDatabase::TrainingDatabase(const string& file, const string &probFile)
 
 
 bool TrainingDatabase::saveTrainingData(int epoch, double loss, const vector<double>& weights) {
+    TRACE_SPAN("db.saveTrainingData");
     ofstream file(fileName, ios::binary | ios::app);
     if (!file) {
-        cerr << "saveTrainingData: Error opening file for writing: " << fileName << endl;
+        LOG_ERROR("saveTrainingData: Error opening file for writing: %s", fileName.c_str());
         return false;
     }
 
     int numWeights = weights.size();
     
-    cout << "Writing record - Size in bytes: " 
-              << (sizeof(epoch) + sizeof(loss) + sizeof(numWeights) + numWeights * sizeof(double))
-              << endl;
+    LOG_DEBUG("Writing record - Size in bytes: %zu",
+              sizeof(epoch) + sizeof(loss) + sizeof(numWeights) + numWeights * sizeof(double));
     
     file.write(reinterpret_cast<const char*>(&epoch), sizeof(epoch));
     file.write(reinterpret_cast<const char*>(&loss), sizeof(loss));
@@ -39,22 +42,21 @@ bool TrainingDatabase::saveTrainingData(int epoch, double loss, const vector<dou
     file.write(reinterpret_cast<const char*>(weights.data()), numWeights * sizeof(double));
     
     if (!file) {
-        cerr << "saveTrainingData: Error writing data for epoch " << epoch << endl;
+        LOG_ERROR("saveTrainingData: Error writing data for epoch %d", epoch);
         return false;
     }
 
-    cout << "Saved training data - Epoch: " << epoch 
-              << ", Loss: " << loss 
-              << ", Weights: " << numWeights << endl;
+    LOG_INFO("Saved training data - Epoch: %d, Loss: %g, Weights: %d", epoch, loss, numWeights);
     
     file.close();
     return true;
 }
 
 vector<TrainingDatabase::TrainingRecord> TrainingDatabase::loadTrainingResults() {
+    TRACE_SPAN("db.loadTrainingResults");
     ifstream file(fileName, ios::binary);
     if (!file) {
-        cerr << "loadTrainingResults: Error opening file: " << fileName << endl;
+        LOG_ERROR("loadTrainingResults: Error opening file: %s", fileName.c_str());
         return {};
     }
 
@@ -62,13 +64,13 @@ vector<TrainingDatabase::TrainingRecord> TrainingDatabase::loadTrainingResults()
     streamsize fileSize = file.tellg();
     file.seekg(0, ios::beg);
 
-    cout << "Training data file size: " << fileSize << " bytes" << endl;
+    LOG_DEBUG("Training data file size: %lld bytes", static_cast<long long>(fileSize));
 
     const streamsize EXPECTED_RECORD_SIZE = sizeof(int) + sizeof(double) + sizeof(int) + (101770 * sizeof(double));
-    cout << "Expected record size: " << EXPECTED_RECORD_SIZE << " bytes" << endl;
+    LOG_DEBUG("Expected record size: %lld bytes", static_cast<long long>(EXPECTED_RECORD_SIZE));
 
     if (fileSize % EXPECTED_RECORD_SIZE != 0) {
-        cerr << "Warning: File size is not a multiple of expected record size" << endl;
+        LOG_WARN("File size is not a multiple of expected record size");
     }
 
     vector<TrainingRecord> records;
@@ -87,40 +89,44 @@ vector<TrainingDatabase::TrainingRecord> TrainingDatabase::loadTrainingResults()
             break;
         }
 
+        // A record cut short by an interrupted writer ends the history; it is never misread as the next record
+        streamsize weightsStart = file.tellg();
+        if (numWeights < 0 || static_cast<uintmax_t>(numWeights) * sizeof(double) > static_cast<uintmax_t>(fileSize - weightsStart)) {
+            LOG_WARN("Discarding truncated record for epoch %d at byte %lld of %s",
+                     record.epoch, static_cast<long long>(bytesRead), fileName.c_str());
+            break;
+        }
+
         record.weights.resize(numWeights);
         if (!file.read(reinterpret_cast<char*>(record.weights.data()), 
                       numWeights * sizeof(double))) {
-            cerr << "Error reading weights at epoch " << record.epoch << endl;
+            LOG_ERROR("Error reading weights at epoch %d", record.epoch);
             break;
         }
 
         bytesRead = file.tellg();
-        cout << "Loaded epoch " << record.epoch 
-                  << ", loss " << record.loss 
-                  << ", weights " << numWeights 
-                  << " (bytes read: " << bytesRead << ")" << endl;
-
-        if (!record.weights.empty()) {
-            cout << "First 3 weights: " 
-                     << record.weights[0] << " "
-                     << record.weights[1] << " "
-                     << record.weights[2] << endl;
+        LOG_DEBUG("Loaded epoch %d, loss %g, weights %d (bytes read: %lld)",
+                  record.epoch, record.loss, numWeights, static_cast<long long>(bytesRead));
+
+        if (record.weights.size() >= 3) {
+            LOG_TRACE("First 3 weights: %g %g %g", record.weights[0], record.weights[1], record.weights[2]);
         }
 
         records.push_back(record);
     }
 
-    cout << "Loaded " << records.size() << " training records" << endl;
+    LOG_DEBUG("Loaded %zu training records", records.size());
     file.close();
     return records;
 }
 
 vector<vector<double>> TrainingDatabase::loadProbabilitiesFromInference()
 {
+    TRACE_SPAN("db.loadProbabilitiesFromInference");
     ifstream probabilityDataFile(probabilityFileName, ios::binary);
     if (!probabilityDataFile)
     {
-        cerr << "loadProbabilityData: Error opening probabilities file for reading: " << probabilityFileName << endl;
+        LOG_ERROR("loadProbabilityData: Error opening probabilities file for reading: %s", probabilityFileName.c_str());
         return {};
     }
 
@@ -135,11 +141,53 @@ vector<vector<double>> TrainingDatabase::loadProbabilitiesFromInference()
         probabilityDataHistory.push_back(probabilities);
     }
     probabilityDataFile.close();
-    cout << "loadProbabilityData: Successfully loaded probability data from " << probabilityFileName << endl;
+    LOG_DEBUG("loadProbabilityData: Successfully loaded probability data from %s", probabilityFileName.c_str());
     return probabilityDataHistory;
 }
 
 pair<vector<TrainingDatabase::TrainingRecord>, vector<vector<double>>> 
 TrainingDatabase::loadAllTrainingData() {
     return {loadTrainingResults(), loadProbabilitiesFromInference()};
-}
\ No newline at end of file
+}
+
+uintmax_t TrainingDatabase::trainingDataBytes() const {
+    error_code error;
+    uintmax_t bytes = filesystem::file_size(fileName, error);
+    return error ? 0 : bytes;
+}
+
+uintmax_t TrainingDatabase::completeRecordBytes() {
+    ifstream file(fileName, ios::binary);
+    if (!file) {
+        return 0;
+    }
+
+    const uintmax_t fileSize = trainingDataBytes();
+    const uintmax_t recordHeaderSize = sizeof(int) + sizeof(double) + sizeof(int);
+    uintmax_t complete = 0;
+    while (complete + recordHeaderSize <= fileSize) {
+        char header[sizeof(int) + sizeof(double) + sizeof(int)];
+        if (!file.read(header, sizeof(header))) {
+            break;
+        }
+        int numWeights;
+        memcpy(&numWeights, header + sizeof(int) + sizeof(double), sizeof(numWeights));
+        if (numWeights < 0 || static_cast<uintmax_t>(numWeights) * sizeof(double) > fileSize - complete - recordHeaderSize) {
+            break;
+        }
+        complete += recordHeaderSize + static_cast<uintmax_t>(numWeights) * sizeof(double);
+        file.seekg(static_cast<streamoff>(complete));
+    }
+    return complete;
+}
+
+bool TrainingDatabase::truncateTrainingData(uintmax_t bytes) {
+    error_code error;
+    filesystem::resize_file(fileName, bytes, error);
+    if (error) {
+        LOG_ERROR("truncateTrainingData: cannot truncate %s to %llu bytes: %s",
+                  fileName.c_str(), static_cast<unsigned long long>(bytes), error.message().c_str());
+        return false;
+    }
+    return true;
+}
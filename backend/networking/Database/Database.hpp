@@ -5,24 +5,31 @@
 #include <fstream>
 #include <vector>
 #include <utility>
+#include <cstdint>
 
 class TrainingDatabase {
     std::string fileName;
     std::string probabilityFileName;
     static constexpr int MNIST_POSSIBLE_DIGIT_OUTPUTS = 10;
 
+public:
     struct TrainingRecord {
         int epoch;
         double loss;
         std::vector<double> weights;
     };
 
-public:
     TrainingDatabase(const std::string& file, const std::string &probFile); 
     bool saveTrainingData(int epoch, double loss, const std::vector<double>& weights);
     std::vector<TrainingRecord> loadTrainingResults();
     std::vector<std::vector<double>> loadProbabilitiesFromInference();
     std::pair<std::vector<TrainingRecord>, std::vector<std::vector<double>>> loadAllTrainingData();
+
+    std::uintmax_t trainingDataBytes() const;
+    // Bytes up to the end of the last complete record; a record cut short by a crash is not counted
+    std::uintmax_t completeRecordBytes();
+    // Drops everything after the first `bytes` bytes, e.g. a truncated record or records newer than a checkpoint
+    bool truncateTrainingData(std::uintmax_t bytes);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,466 @@
+#include "RingAllReduce.hpp"
+#include "../Logging/Logger.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sstream>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    // A peer that stops sending for this long is treated as lost
+    constexpr int EXCHANGE_TIMEOUT_MS = 60000;
+    constexpr uint32_t HANDSHAKE_MAGIC = 0x52494e47; // "RING"
+
+    // Round to nearest even; magnitudes past the largest half saturate to it instead of becoming infinity
+    uint16_t floatToHalf(float value)
+    {
+        constexpr uint32_t FLOAT_INFINITY = 0x7f800000;
+        constexpr uint32_t HALF_OVERFLOW = 0x477ff000;        // 65520.0f, which would round up to infinity
+        constexpr uint32_t HALF_NORMAL_MIN = 113u << 23;      // 2^-14
+        constexpr uint32_t SUBNORMAL_MAGIC = 126u << 23;      // 0.5f: adding it aligns a subnormal's bits for rounding
+        uint32_t bits = bit_cast<uint32_t>(value);
+        const uint32_t sign = bits & 0x80000000u;
+        bits ^= sign;
+
+        uint16_t half;
+        if (bits >= HALF_OVERFLOW)
+            half = bits > FLOAT_INFINITY ? 0x7e00 : (bits == FLOAT_INFINITY ? 0x7c00 : 0x7bff);
+        else if (bits < HALF_NORMAL_MIN)
+            half = static_cast<uint16_t>(bit_cast<uint32_t>(bit_cast<float>(bits) + bit_cast<float>(SUBNORMAL_MAGIC)) - SUBNORMAL_MAGIC);
+        else
+            half = static_cast<uint16_t>((bits + (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + ((bits >> 13) & 1)) >> 13);
+        return half | static_cast<uint16_t>(sign >> 16);
+    }
+
+    // Every half decoded once; 256 KiB, built on first use
+    const float *halfToFloatTable()
+    {
+        static const vector<float> table = []
+        {
+            vector<float> values(1 << 16);
+            for (uint32_t half = 0; half < values.size(); ++half)
+            {
+                const uint32_t sign = (half & 0x8000) << 16;
+                const uint32_t exponent = (half >> 10) & 0x1f;
+                const uint32_t mantissa = half & 0x3ff;
+                float value;
+                if (exponent == 0)
+                    value = ldexp(static_cast<float>(mantissa), -24);
+                else if (exponent == 31)
+                    value = bit_cast<float>(0x7f800000 | (mantissa << 13));
+                else
+                    value = bit_cast<float>(((exponent - 15 + 127) << 23) | (mantissa << 13));
+                values[half] = sign ? -value : value;
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    // Start of chunk `index` when `count` values are split into `chunks` nearly equal parts
+    size_t chunkStart(size_t count, size_t chunks, size_t index)
+    {
+        return count * index / chunks;
+    }
+
+    bool enableNoDelay(int socket)
+    {
+        int enabled = 1;
+        return setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled)) == 0;
+    }
+
+    bool hostAddress(const string &host, u_long &address)
+    {
+        in_addr parsed{};
+        if (inet_pton(AF_INET, host.c_str(), &parsed) != 1)
+            return false;
+        address = ntohl(parsed.s_addr);
+        return true;
+    }
+
+    int millisecondsUntil(chrono::steady_clock::time_point deadline)
+    {
+        auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        return static_cast<int>(max<long long>(0, remaining));
+    }
+}
+
+Distributed::RingAllReduce::RingAllReduce(RingConfig config) : config(move(config))
+{
+}
+
+Distributed::RingAllReduce::~RingAllReduce()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    if (communicator.joinable())
+        communicator.join();
+    if (receiveSocket >= 0)
+        close(receiveSocket);
+}
+
+/**
+ * @brief Listens on this trainer's port, connects to the next trainer (retrying until it is up) and accepts the
+ *        previous one. Each side sends its rank and world size so a misconfigured peer list fails here rather than
+ *        mid-training.
+ *
+ * @return False if the configuration is invalid or a neighbour did not show up within connectTimeout
+ */
+bool Distributed::RingAllReduce::connect()
+{
+    const size_t world = config.peers.size();
+    if (world == 0 || config.rank >= world)
+    {
+        LOG_ERROR("Rank %zu is not in a ring of %zu peer(s)", config.rank, world);
+        return false;
+    }
+    if (world == 1)
+        return true;
+
+    listener = make_unique<HDE::ListeningSocket>(AF_INET, SOCK_STREAM, 0, config.peers[config.rank].port, INADDR_ANY, 4);
+    if (!connectToNext() || !acceptPrevious())
+        return false;
+
+    communicator = thread(&RingAllReduce::runCommunicator, this);
+    LOG_INFO("Rank %zu joined a ring of %zu trainers%s", config.rank, world, config.compressFp16 ? " (fp16 gradients)" : "");
+    return true;
+}
+
+bool Distributed::RingAllReduce::connectToNext()
+{
+    const Peer &next = config.peers[(config.rank + 1) % config.peers.size()];
+    u_long address = 0;
+    if (!hostAddress(next.host, address))
+    {
+        LOG_ERROR("Peer address %s is not an IPv4 address", next.host.c_str());
+        return false;
+    }
+
+    const auto deadline = chrono::steady_clock::now() + config.connectTimeout;
+    int lastError = 0;
+    while (chrono::steady_clock::now() < deadline)
+    {
+        nextPeer = make_unique<HDE::ConnectingSocket>(AF_INET, SOCK_STREAM, 0, next.port, address, true);
+        lastError = nextPeer->getConnectErrno();
+        if (lastError == 0)
+        {
+            pollfd pending{nextPeer->getSock(), POLLOUT, 0};
+            if (poll(&pending, 1, millisecondsUntil(deadline)) == 1)
+            {
+                socklen_t length = sizeof(lastError);
+                getsockopt(nextPeer->getSock(), SOL_SOCKET, SO_ERROR, &lastError, &length);
+                if (lastError == 0)
+                    break;
+            }
+            else
+            {
+                lastError = ETIMEDOUT;
+            }
+        }
+        nextPeer.reset();
+        this_thread::sleep_for(chrono::milliseconds(100)); // the next trainer has not started listening yet
+    }
+    if (!nextPeer)
+    {
+        LOG_ERROR("Could not connect to %s:%d: %s", next.host.c_str(), next.port, strerror(lastError ? lastError : ETIMEDOUT));
+        return false;
+    }
+
+    sendSocket = nextPeer->getSock();
+    enableNoDelay(sendSocket);
+    const uint32_t hello[3] = {HANDSHAKE_MAGIC, static_cast<uint32_t>(config.rank), static_cast<uint32_t>(config.peers.size())};
+    return exchange(hello, sizeof(hello), nullptr, 0);
+}
+
+bool Distributed::RingAllReduce::acceptPrevious()
+{
+    const size_t world = config.peers.size();
+    const size_t previous = (config.rank + world - 1) % world;
+    const auto deadline = chrono::steady_clock::now() + config.connectTimeout;
+
+    pollfd incoming{listener->getSock(), POLLIN, 0};
+    if (poll(&incoming, 1, millisecondsUntil(deadline)) != 1)
+    {
+        LOG_ERROR("Rank %zu did not connect within %lld s", previous, static_cast<long long>(config.connectTimeout.count()));
+        return false;
+    }
+    receiveSocket = accept4(listener->getSock(), nullptr, nullptr, SOCK_NONBLOCK);
+    if (receiveSocket < 0)
+    {
+        LOG_ERROR("accept failed: %s", strerror(errno));
+        return false;
+    }
+    enableNoDelay(receiveSocket);
+
+    uint32_t hello[3] = {};
+    if (!exchange(nullptr, 0, hello, sizeof(hello)))
+        return false;
+    if (hello[0] != HANDSHAKE_MAGIC || hello[1] != previous || hello[2] != world)
+    {
+        LOG_ERROR("Expected rank %zu of %zu on the incoming connection, got rank %u of %u", previous, world, hello[1], hello[2]);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Sends to the next trainer and receives from the previous one at the same time, so neither side blocks on a
+ *        full socket buffer while its neighbour does the same
+ */
+bool Distributed::RingAllReduce::exchange(const void *sendData, size_t sendBytes, void *receiveData, size_t receiveBytes)
+{
+    const char *out = static_cast<const char *>(sendData);
+    char *in = static_cast<char *>(receiveData);
+    size_t sent = 0, received = 0;
+    while (sent < sendBytes || received < receiveBytes)
+    {
+        pollfd sockets[2];
+        nfds_t count = 0;
+        if (sent < sendBytes)
+            sockets[count++] = {sendSocket, POLLOUT, 0};
+        if (received < receiveBytes)
+            sockets[count++] = {receiveSocket, POLLIN, 0};
+
+        int ready = poll(sockets, count, EXCHANGE_TIMEOUT_MS);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+        {
+            LOG_ERROR("Ring exchange %s", ready == 0 ? "timed out" : strerror(errno));
+            return false;
+        }
+
+        for (nfds_t i = 0; i < count; ++i)
+        {
+            if (sockets[i].revents == 0)
+                continue;
+            if (sockets[i].fd == sendSocket)
+            {
+                ssize_t written = send(sendSocket, out + sent, sendBytes - sent, MSG_NOSIGNAL);
+                if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                {
+                    LOG_ERROR("Send to rank %zu failed: %s", (config.rank + 1) % config.peers.size(), strerror(errno));
+                    return false;
+                }
+                if (written > 0)
+                {
+                    sent += static_cast<size_t>(written);
+                    bytesSent.fetch_add(static_cast<uint64_t>(written), memory_order_relaxed);
+                }
+            }
+            else
+            {
+                ssize_t read = recv(receiveSocket, in + received, receiveBytes - received, 0);
+                if (read == 0 || (read < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                {
+                    LOG_ERROR("Rank %zu disconnected: %s", (config.rank + config.peers.size() - 1) % config.peers.size(),
+                              read == 0 ? "connection closed" : strerror(errno));
+                    return false;
+                }
+                if (read > 0)
+                    received += static_cast<size_t>(read);
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Ring all-reduce of `values`: N-1 reduce-scatter steps leave each trainer owning the full sum of one chunk,
+ *        then N-1 all-gather steps pass the owned chunks around the ring.
+ *
+ * @param compress  Exchange chunks as fp16. The owner of a chunk rounds its final sum to fp16 before the all-gather, so
+ *                  every trainer ends up with bit-identical values and the replicas do not drift apart.
+ */
+bool Distributed::RingAllReduce::reduce(double *values, size_t count, bool compress)
+{
+    const size_t world = config.peers.size();
+    const size_t rank = config.rank;
+    const size_t largestChunk = (count + world - 1) / world;
+    if (compress)
+    {
+        sendHalves.resize(max(sendHalves.size(), largestChunk));
+        receiveHalves.resize(max(receiveHalves.size(), largestChunk));
+    }
+    else
+    {
+        receiveBuffer.resize(max(receiveBuffer.size(), largestChunk));
+    }
+
+    auto step = [&](size_t sendChunk, size_t receiveChunk, bool accumulate)
+    {
+        double *out = values + chunkStart(count, world, sendChunk);
+        const size_t outCount = chunkStart(count, world, sendChunk + 1) - chunkStart(count, world, sendChunk);
+        double *in = values + chunkStart(count, world, receiveChunk);
+        const size_t inCount = chunkStart(count, world, receiveChunk + 1) - chunkStart(count, world, receiveChunk);
+
+        if (!compress)
+        {
+            if (!exchange(out, outCount * sizeof(double), receiveBuffer.data(), inCount * sizeof(double)))
+                return false;
+            for (size_t i = 0; i < inCount; ++i)
+                in[i] = accumulate ? in[i] + receiveBuffer[i] : receiveBuffer[i];
+            return true;
+        }
+
+        for (size_t i = 0; i < outCount; ++i)
+            sendHalves[i] = floatToHalf(static_cast<float>(out[i]));
+        if (!exchange(sendHalves.data(), outCount * sizeof(uint16_t), receiveHalves.data(), inCount * sizeof(uint16_t)))
+            return false;
+        const float *decode = halfToFloatTable();
+        for (size_t i = 0; i < inCount; ++i)
+        {
+            const double received = decode[receiveHalves[i]];
+            in[i] = accumulate ? in[i] + received : received;
+        }
+        return true;
+    };
+
+    for (size_t s = 0; s + 1 < world; ++s)
+    {
+        if (!step((rank + world - s) % world, (rank + world - s - 1) % world, true))
+            return false;
+    }
+
+    const size_t owned = (rank + 1) % world;
+    if (compress)
+    {
+        double *chunk = values + chunkStart(count, world, owned);
+        const size_t chunkCount = chunkStart(count, world, owned + 1) - chunkStart(count, world, owned);
+        const float *decode = halfToFloatTable();
+        for (size_t i = 0; i < chunkCount; ++i)
+            chunk[i] = decode[floatToHalf(static_cast<float>(chunk[i]))];
+    }
+
+    for (size_t s = 0; s + 1 < world; ++s)
+    {
+        if (!step((owned + world - s) % world, (owned + world - s - 1) % world, false))
+            return false;
+    }
+    return true;
+}
+
+void Distributed::RingAllReduce::runCommunicator()
+{
+    unique_lock<mutex> lock(queueMutex);
+    while (true)
+    {
+        queueChanged.wait(lock, [this]
+                          { return stopping || !pending.empty(); });
+        if (stopping)
+            return;
+        Range range = pending.front();
+        pending.pop_front();
+
+        lock.unlock();
+        auto start = chrono::steady_clock::now();
+        bool reduced = reduce(range.values, range.count, range.compress);
+        communicationNanoseconds.fetch_add(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(),
+                                           memory_order_relaxed);
+        lock.lock();
+
+        if (!reduced)
+        {
+            failed = true;
+            pending.clear();
+            inFlight = 0;
+        }
+        else
+        {
+            --inFlight;
+        }
+        queueChanged.notify_all();
+    }
+}
+
+bool Distributed::RingAllReduce::allReduce(double *values, size_t count)
+{
+    if (config.peers.size() == 1)
+        return true;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        if (failed)
+            return false;
+        pending.push_back({values, count, false});
+        ++inFlight;
+    }
+    queueChanged.notify_all();
+    return finishStep();
+}
+
+bool Distributed::RingAllReduce::broadcastFromRankZero(double *values, size_t count)
+{
+    if (config.rank != 0)
+        fill(values, values + count, 0.0); // x + 0 + ... + 0 is exactly x
+    return allReduce(values, count);
+}
+
+// Queues gradients[begin, end) for the communication thread; every trainer reports the same ranges in the same order
+void Distributed::RingAllReduce::gradientsReady(double *gradients, size_t begin, size_t end)
+{
+    if (config.peers.size() == 1 || begin == end)
+        return;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        if (failed)
+            return;
+        pending.push_back({gradients + begin, end - begin, config.compressFp16});
+        ++inFlight;
+    }
+    queueChanged.notify_all();
+}
+
+bool Distributed::RingAllReduce::finishStep()
+{
+    if (config.peers.size() == 1)
+        return true;
+    auto start = chrono::steady_clock::now();
+    unique_lock<mutex> lock(queueMutex);
+    queueChanged.wait(lock, [this]
+                      { return inFlight == 0; });
+    waitNanoseconds += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    return !failed;
+}
+
+bool Distributed::RingAllReduce::hasFailed()
+{
+    lock_guard<mutex> lock(queueMutex);
+    return failed;
+}
+
+bool Distributed::parsePeers(const string &list, vector<Peer> &peers)
+{
+    vector<Peer> parsed;
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ','))
+    {
+        size_t colon = item.rfind(':');
+        if (colon == string::npos)
+            return false;
+        Peer peer;
+        peer.host = item.substr(0, colon);
+        char *end = nullptr;
+        long port = strtol(item.c_str() + colon + 1, &end, 10);
+        u_long address = 0;
+        if (end == item.c_str() + colon + 1 || *end != '\0' || port <= 0 || port > 65535 || !hostAddress(peer.host, address))
+            return false;
+        peer.port = static_cast<int>(port);
+        parsed.push_back(peer);
+    }
+    if (parsed.empty())
+        return false;
+    peers = move(parsed);
+    return true;
+}
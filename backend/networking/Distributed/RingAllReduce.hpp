@@ -0,0 +1,111 @@
+#ifndef RING_ALL_REDUCE_HPP
+#define RING_ALL_REDUCE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../NN/ff_neural_net.hpp"
+#include "../Sockets/ListeningSocket.hpp"
+#include "../Sockets/ConnectingSocket.hpp"
+
+namespace Distributed
+{
+    struct Peer
+    {
+        std::string host; // IPv4 address, e.g. 127.0.0.1
+        int port;
+    };
+
+    struct RingConfig
+    {
+        size_t rank = 0;
+        std::vector<Peer> peers;   // every trainer in ring order; this one listens on peers[rank].port
+        bool compressFp16 = false; // send gradients as IEEE half precision, a quarter of the bytes of double
+        std::chrono::seconds connectTimeout{30};
+    };
+
+    /**
+     * @brief Data-parallel gradient sum over a ring of TCP connections: each trainer sends to the next and receives from
+     *        the previous. An all-reduce is a reduce-scatter then an all-gather of 1/N-sized chunks, so every trainer
+     *        sends 2(N-1)/N of the buffer whatever the number of trainers.
+     *        As a GradientReducer, ranges reported during the backward pass are reduced on a communication thread while
+     *        the backward pass continues.
+     */
+    class RingAllReduce : public GradientReducer
+    {
+        RingConfig config;
+        std::unique_ptr<HDE::ListeningSocket> listener;
+        std::unique_ptr<HDE::ConnectingSocket> nextPeer;
+        int sendSocket = -1;    // to the next trainer
+        int receiveSocket = -1; // from the previous trainer
+
+        std::vector<double> receiveBuffer;
+        std::vector<uint16_t> sendHalves, receiveHalves;
+
+        std::mutex queueMutex;
+        std::condition_variable queueChanged;
+        struct Range
+        {
+            double *values;
+            size_t count;
+            bool compress;
+        };
+        std::deque<Range> pending; // ranges waiting for the communication thread
+        size_t inFlight = 0;       // ranges queued or being reduced
+        bool stopping = false;
+        bool failed = false;
+        std::thread communicator;
+
+        std::atomic<uint64_t> bytesSent{0};
+        std::atomic<uint64_t> communicationNanoseconds{0};
+        uint64_t waitNanoseconds = 0; // time finishStep() spent blocked: communication the backward pass did not hide
+
+        bool connectToNext();
+        bool acceptPrevious();
+        bool exchange(const void *sendData, size_t sendBytes, void *receiveData, size_t receiveBytes);
+        bool reduce(double *values, size_t count, bool compress);
+        void runCommunicator();
+
+    public:
+        explicit RingAllReduce(RingConfig config);
+        ~RingAllReduce() override;
+        RingAllReduce(const RingAllReduce &) = delete;
+        RingAllReduce &operator=(const RingAllReduce &) = delete;
+
+        // Builds the ring; false (with the reason logged) if a neighbour cannot be reached within connectTimeout
+        bool connect();
+
+        /**
+         * @brief Replaces `values` on every trainer with their element-wise sum over all trainers (exact, never compressed).
+         *        Not to be mixed with a step in progress.
+         *
+         * @return False if a connection failed; the ring is unusable afterwards
+         */
+        bool allReduce(double *values, size_t count);
+        // Replaces `values` on every trainer with rank 0's, e.g. so all trainers start from the same parameters
+        bool broadcastFromRankZero(double *values, size_t count);
+
+        size_t worldSize() const override { return config.peers.size(); }
+        bool synchronizeParameters(double *parameters, size_t count) override { return broadcastFromRankZero(parameters, count); }
+        void gradientsReady(double *gradients, size_t begin, size_t end) override;
+        bool finishStep() override;
+
+        size_t getRank() const { return config.rank; }
+        bool hasFailed();
+        uint64_t getBytesSent() const { return bytesSent.load(std::memory_order_relaxed); }
+        double getCommunicationSeconds() const { return communicationNanoseconds.load(std::memory_order_relaxed) * 1e-9; }
+        double getExposedCommunicationSeconds() const { return waitNanoseconds * 1e-9; }
+    };
+
+    // Comma-separated host:port list, e.g. "127.0.0.1:9100,127.0.0.1:9101"
+    bool parsePeers(const std::string &list, std::vector<Peer> &peers);
+}
+
+#endif
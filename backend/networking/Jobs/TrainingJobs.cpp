@@ -0,0 +1,537 @@
+#include "TrainingJobs.hpp"
+#include "../NN/mnist/mnist_loader.hpp"
+#include "../NN/utils/numa.hpp"
+#include "../Logging/Logger.hpp"
+#include "../Metrics/Metrics.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    constexpr size_t MNIST_POSSIBLE_DIGIT_OUTPUTS = 10;
+    // Progress events are sent at most this often, plus once per epoch
+    constexpr chrono::milliseconds PUBLISH_INTERVAL{250};
+
+    Metrics::Gauge &runningJobs()
+    {
+        static Metrics::Gauge &gauge = Metrics::Registry::instance().gauge("training_jobs_running", "Training jobs currently training.");
+        return gauge;
+    }
+
+    Metrics::Gauge &queuedJobs()
+    {
+        static Metrics::Gauge &gauge = Metrics::Registry::instance().gauge("training_jobs_queued", "Training jobs waiting for a training thread.");
+        return gauge;
+    }
+
+    // Start of the value for `"key":` in a flat JSON object, or nullptr when the key is absent
+    const char *findValue(const string &json, const string &key)
+    {
+        size_t position = json.find("\"" + key + "\"");
+        if (position == string::npos)
+            return nullptr;
+        const char *cursor = json.c_str() + position + key.size() + 2;
+        while (isspace(static_cast<unsigned char>(*cursor)))
+            ++cursor;
+        if (*cursor != ':')
+            return nullptr;
+        ++cursor;
+        while (isspace(static_cast<unsigned char>(*cursor)))
+            ++cursor;
+        return cursor;
+    }
+
+    // 1 if the key holds a number (stored in `value`), 0 if it is absent, -1 if it is malformed
+    int readNumber(const string &json, const string &key, double &value)
+    {
+        const char *cursor = findValue(json, key);
+        if (!cursor)
+            return 0;
+        char *end = nullptr;
+        value = strtod(cursor, &end);
+        return end == cursor ? -1 : 1;
+    }
+
+    int readString(const string &json, const string &key, string &value)
+    {
+        const char *cursor = findValue(json, key);
+        if (!cursor)
+            return 0;
+        if (*cursor != '"')
+            return -1;
+        const char *end = strchr(cursor + 1, '"');
+        if (!end)
+            return -1;
+        value.assign(cursor + 1, end);
+        return 1;
+    }
+
+    // Sends without blocking: a client that cannot keep up is dropped rather than stalling training
+    bool sendEvent(int clientSocket, const string &event, size_t &bytesSent)
+    {
+        ssize_t sent = send(clientSocket, event.data(), event.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent > 0)
+            bytesSent += static_cast<size_t>(sent);
+        return sent == static_cast<ssize_t>(event.size());
+    }
+
+    // Runs the calling training thread on its CPU, at low priority
+    void configureTrainingThread(const Jobs::PoolConfig &config, unsigned index)
+    {
+        if (!config.cpus.empty())
+            NNUtils::pinCurrentThread({config.cpus[index % config.cpus.size()]});
+
+        sched_param param{};
+        int error = pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+        if (error != 0)
+            LOG_WARN("Could not switch training thread %u to SCHED_BATCH: %s", index, strerror(error));
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), config.niceness) != 0)
+            LOG_WARN("Could not set training thread %u niceness to %d: %s", index, config.niceness, strerror(errno));
+    }
+}
+
+Jobs::PoolConfig Jobs::poolConfigFromEnvironment()
+{
+    PoolConfig config;
+    if (const char *workers = getenv("TRAINING_WORKERS"))
+        config.workers = max<unsigned long>(1, strtoul(workers, nullptr, 10));
+    if (const char *cpus = getenv("TRAINING_CPUS"))
+    {
+        if (!NNUtils::parseCpuSpec(cpus, config.cpus))
+        {
+            LOG_WARN("Ignoring invalid TRAINING_CPUS \"%s\"; expected e.g. 2,3 or node1", cpus);
+            config.cpus.clear();
+        }
+    }
+    if (const char *niceness = getenv("TRAINING_NICE"))
+        config.niceness = atoi(niceness);
+    if (const char *directory = getenv("TRAINING_JOB_DIR"))
+        config.outputDirectory = directory;
+    if (const char *retained = getenv("TRAINING_RETAIN_JOBS"))
+        config.retainedJobs = strtoul(retained, nullptr, 10);
+    return config;
+}
+
+bool Jobs::parseJobConfig(const string &json, JobConfig &config, string &error)
+{
+    // train.out's settings
+    config = JobConfig{};
+    config.training.epochs = 5;
+    config.training.batchSize = 16;
+    config.training.optimizer.type = NNOptim::OptimizerType::AdamW;
+    config.training.optimizer.learningRate = 0.002;
+    config.training.optimizer.weightDecay = 1e-4;
+    config.training.schedule.type = NNOptim::ScheduleType::Cosine;
+    config.training.schedule.warmupSteps = 20;
+
+    struct NumberField
+    {
+        const char *key;
+        double minimum, maximum;
+        function<void(double)> apply;
+    };
+    const NumberField numbers[] = {
+        {"epochs", 1, 1000, [&](double v) { config.training.epochs = static_cast<int>(v); }},
+        {"batchSize", 1, 60000, [&](double v) { config.training.batchSize = static_cast<size_t>(v); }},
+        {"trainCount", 1, 60000, [&](double v) { config.trainCount = static_cast<int>(v); }},
+        {"hiddenSize", 1, 4096, [&](double v) { config.hiddenSize = static_cast<size_t>(v); }},
+        {"warmupSteps", 0, 1e9, [&](double v) { config.training.schedule.warmupSteps = static_cast<uint64_t>(v); }},
+        {"learningRate", 1e-12, 10, [&](double v) { config.training.optimizer.learningRate = v; }},
+        {"weightDecay", 0, 1, [&](double v) { config.training.optimizer.weightDecay = v; }},
+    };
+    for (const NumberField &field : numbers)
+    {
+        double value;
+        int found = readNumber(json, field.key, value);
+        if (found < 0 || (found > 0 && !(value >= field.minimum && value <= field.maximum)))
+        {
+            char message[128];
+            snprintf(message, sizeof(message), "%s must be a number between %g and %g", field.key, field.minimum, field.maximum);
+            error = message;
+            return false;
+        }
+        if (found > 0)
+            field.apply(value);
+    }
+
+    string name;
+    int found = readString(json, "optimizer", name);
+    if (found < 0 || (found > 0 && !NNOptim::parseOptimizerType(name, config.training.optimizer.type)))
+    {
+        error = "optimizer must be one of sgd, momentum, nesterov, adam, adamw";
+        return false;
+    }
+    found = readString(json, "schedule", name);
+    if (found < 0 || (found > 0 && !NNOptim::parseScheduleType(name, config.training.schedule.type)))
+    {
+        error = "schedule must be one of constant, step, exponential, cosine";
+        return false;
+    }
+    config.training.schedule.totalEpochs = config.training.epochs;
+    return true;
+}
+
+const char *Jobs::jobStateName(JobState state)
+{
+    switch (state)
+    {
+    case JobState::Queued:
+        return "queued";
+    case JobState::Running:
+        return "running";
+    case JobState::Completed:
+        return "completed";
+    case JobState::Cancelled:
+        return "cancelled";
+    case JobState::Failed:
+        return "failed";
+    }
+    return "unknown";
+}
+
+bool Jobs::avoidCpus(const vector<int> &cpus)
+{
+    if (cpus.empty())
+        return true;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return false;
+    for (int cpu : cpus)
+        CPU_CLR(cpu, &allowed);
+    if (CPU_COUNT(&allowed) == 0)
+    {
+        LOG_WARN("Training CPUs cover every CPU; request threads will share them with training");
+        return false;
+    }
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+    if (error != 0)
+    {
+        LOG_WARN("Could not move request threads off the training CPUs: %s", strerror(error));
+        return false;
+    }
+    return true;
+}
+
+Jobs::TrainingJob::TrainingJob(uint64_t id, JobConfig config, const string &outputDirectory)
+    : id{id}, config{move(config)},
+      weightsFile{outputDirectory + "/job_" + to_string(id) + "_weights.dat"},
+      trainingDataFile{outputDirectory + "/job_" + to_string(id) + "_training_data.dat"}
+{
+    progress.epochs = this->config.training.epochs;
+}
+
+Jobs::JobState Jobs::TrainingJob::getState() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return state;
+}
+
+string Jobs::TrainingJob::toJson() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return toJsonLocked();
+}
+
+string Jobs::TrainingJob::toJsonLocked() const
+{
+    char numbers[96];
+    snprintf(numbers, sizeof(numbers), ",\"loss\":%.9g,\"learningRate\":%.9g", progress.loss, progress.learningRate);
+    string json = "{\"id\":" + to_string(id) + ",\"state\":\"" + jobStateName(state) +
+                  "\",\"epoch\":" + to_string(progress.epoch) + ",\"epochs\":" + to_string(progress.epochs) +
+                  ",\"samples\":" + to_string(progress.samples) + ",\"samplesPerEpoch\":" + to_string(progress.samplesPerEpoch) +
+                  numbers + ",\"submittedAt\":" + to_string(chrono::duration_cast<chrono::seconds>(submittedAt.time_since_epoch()).count()) +
+                  ",\"trainingDataFile\":\"" + trainingDataFile + "\"";
+    if (state == JobState::Completed)
+        json += ",\"weightsFile\":\"" + weightsFile + "\"";
+    if (!error.empty())
+        json += ",\"error\":\"" + error + "\"";
+    return json + "}";
+}
+
+// Sends one event with the job's current state to every subscriber, dropping those that cannot take it
+void Jobs::TrainingJob::publishLocked(const char *event)
+{
+    lastPublished = chrono::steady_clock::now();
+    if (subscribers.empty())
+        return;
+    const string message = string("event: ") + event + "\ndata: " + toJsonLocked() + "\n\n";
+    for (size_t i = 0; i < subscribers.size();)
+    {
+        Subscriber &subscriber = subscribers[i];
+        if (sendEvent(subscriber.socket, message, subscriber.bytesSent))
+        {
+            ++i;
+            continue;
+        }
+        close(subscriber.socket);
+        subscriber.onClose(subscriber.bytesSent);
+        subscribers.erase(subscribers.begin() + i);
+    }
+}
+
+void Jobs::TrainingJob::closeSubscribersLocked()
+{
+    for (Subscriber &subscriber : subscribers)
+    {
+        close(subscriber.socket);
+        subscriber.onClose(subscriber.bytesSent);
+    }
+    subscribers.clear();
+}
+
+// Runs on the training thread after every optimizer step; returns false once the job is cancelled
+bool Jobs::TrainingJob::onProgress(const TrainingProgress &update)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        progress = update;
+        if (update.epochComplete || chrono::steady_clock::now() - lastPublished >= PUBLISH_INTERVAL)
+            publishLocked("progress");
+    }
+    return !cancelRequested.load(memory_order_relaxed);
+}
+
+void Jobs::TrainingJob::finish(JobState finalState, const string &message)
+{
+    lock_guard<std::mutex> lock(mutex);
+    state = finalState;
+    error = message;
+    publishLocked("done");
+    closeSubscribersLocked();
+    Metrics::Registry::instance()
+        .counter("training_jobs_finished_total", "Training jobs that finished, by final state.", string("state=\"") + jobStateName(finalState) + "\"")
+        .add();
+    if (finalState == JobState::Failed)
+        LOG_ERROR("Training job %llu failed: %s", static_cast<unsigned long long>(id), message.c_str());
+    else
+        LOG_INFO("Training job %llu %s", static_cast<unsigned long long>(id), jobStateName(finalState));
+}
+
+Jobs::JobManager::JobManager(PoolConfig config) : config{move(config)}
+{
+    error_code error;
+    filesystem::create_directories(this->config.outputDirectory, error);
+    if (error)
+        LOG_ERROR("Could not create training job directory %s: %s", this->config.outputDirectory.c_str(), error.message().c_str());
+
+    for (unsigned i = 0; i < this->config.workers; ++i)
+        workers.emplace_back(&JobManager::runWorker, this, i);
+}
+
+// Running jobs stop after their current optimizer step; queued jobs are cancelled
+Jobs::JobManager::~JobManager()
+{
+    deque<shared_ptr<TrainingJob>> abandoned;
+    {
+        lock_guard<mutex> lock(jobsMutex);
+        stopping = true;
+        abandoned.swap(queue);
+        for (auto &[id, job] : jobs)
+            job->cancelRequested.store(true, memory_order_relaxed);
+    }
+    jobQueued.notify_all();
+    for (thread &worker : workers)
+        worker.join();
+    for (shared_ptr<TrainingJob> &job : abandoned)
+        job->finish(JobState::Cancelled);
+}
+
+shared_ptr<Jobs::TrainingJob> Jobs::JobManager::submit(JobConfig jobConfig)
+{
+    shared_ptr<TrainingJob> job;
+    {
+        lock_guard<mutex> lock(jobsMutex);
+        evictFinishedLocked();
+        job = make_shared<TrainingJob>(nextId++, move(jobConfig), config.outputDirectory);
+        jobs.emplace(job->getId(), job);
+        queue.push_back(job);
+        queuedJobs().set(static_cast<double>(queue.size()));
+    }
+    jobQueued.notify_one();
+    LOG_INFO("Training job %llu queued: %d epochs over %d images", static_cast<unsigned long long>(job->getId()),
+             job->config.training.epochs, job->config.trainCount);
+    return job;
+}
+
+// Only submit() grows the map, so pruning there keeps it at config.retainedJobs finished jobs plus the active ones.
+// Ids increase with submission, so the map walks oldest first.
+void Jobs::JobManager::evictFinishedLocked()
+{
+    size_t finished = 0;
+    for (auto &[id, job] : jobs)
+    {
+        JobState state = job->getState();
+        finished += state != JobState::Queued && state != JobState::Running;
+    }
+    for (auto it = jobs.begin(); it != jobs.end() && finished > config.retainedJobs;)
+    {
+        JobState state = it->second->getState();
+        if (state == JobState::Queued || state == JobState::Running)
+        {
+            ++it;
+            continue;
+        }
+        it = jobs.erase(it);
+        --finished;
+    }
+}
+
+shared_ptr<Jobs::TrainingJob> Jobs::JobManager::find(uint64_t id)
+{
+    lock_guard<mutex> lock(jobsMutex);
+    auto it = jobs.find(id);
+    return it == jobs.end() ? nullptr : it->second;
+}
+
+bool Jobs::JobManager::cancel(uint64_t id)
+{
+    shared_ptr<TrainingJob> job;
+    bool wasQueued = false;
+    {
+        lock_guard<mutex> lock(jobsMutex);
+        auto it = jobs.find(id);
+        if (it == jobs.end())
+            return false;
+        job = it->second;
+        JobState state = job->getState();
+        if (state != JobState::Queued && state != JobState::Running)
+            return false;
+        job->cancelRequested.store(true, memory_order_relaxed);
+        for (auto queued = queue.begin(); queued != queue.end(); ++queued)
+        {
+            if (queued->get() == job.get())
+            {
+                queue.erase(queued);
+                queuedJobs().set(static_cast<double>(queue.size()));
+                wasQueued = true;
+                break;
+            }
+        }
+    }
+    if (wasQueued)
+        job->finish(JobState::Cancelled);
+    return true;
+}
+
+bool Jobs::JobManager::subscribe(uint64_t id, int clientSocket, function<void(size_t bytesSent)> onClose)
+{
+    shared_ptr<TrainingJob> job = find(id);
+    if (!job)
+        return false;
+
+    static const string headers =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Access-Control-Allow-Origin: http://localhost:3000\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+
+    lock_guard<mutex> lock(job->mutex);
+    TrainingJob::Subscriber subscriber{clientSocket, 0, move(onClose)};
+    const bool finished = job->state != JobState::Queued && job->state != JobState::Running;
+    const string snapshot = string("event: ") + (finished ? "done" : "progress") + "\ndata: " + job->toJsonLocked() + "\n\n";
+    if (!sendEvent(clientSocket, headers, subscriber.bytesSent) || !sendEvent(clientSocket, snapshot, subscriber.bytesSent) || finished)
+    {
+        close(clientSocket);
+        subscriber.onClose(subscriber.bytesSent);
+        return true;
+    }
+    job->subscribers.push_back(move(subscriber));
+    return true;
+}
+
+string Jobs::JobManager::listJson()
+{
+    lock_guard<mutex> lock(jobsMutex);
+    string json = "[";
+    for (auto &[id, job] : jobs)
+    {
+        json += (json.size() > 1 ? "," : "");
+        json += job->toJson();
+    }
+    return json + "]";
+}
+
+void Jobs::JobManager::runWorker(unsigned index)
+{
+    configureTrainingThread(config, index);
+    while (true)
+    {
+        shared_ptr<TrainingJob> job;
+        {
+            unique_lock<mutex> lock(jobsMutex);
+            jobQueued.wait(lock, [&]
+                           { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+            job = move(queue.front());
+            queue.pop_front();
+            queuedJobs().set(static_cast<double>(queue.size()));
+        }
+        runningJobs().add(1);
+        runJob(*job);
+        runningJobs().add(-1);
+    }
+}
+
+void Jobs::JobManager::runJob(TrainingJob &job)
+{
+    if (job.cancelRequested.load(memory_order_relaxed))
+    {
+        job.finish(JobState::Cancelled);
+        return;
+    }
+    {
+        lock_guard<mutex> lock(job.mutex);
+        job.state = JobState::Running;
+        job.publishLocked("progress");
+    }
+
+    const JobConfig &jobConfig = job.config;
+    vector<vector<uint8_t>> images = loadMNISTImages(jobConfig.imagesFile, jobConfig.trainCount);
+    vector<uint8_t> labels = loadMNISTLabels(jobConfig.labelsFile, static_cast<int>(images.size()));
+    if (images.empty() || labels.size() != images.size())
+    {
+        job.finish(JobState::Failed, "could not load training data from " + jobConfig.imagesFile);
+        return;
+    }
+    {
+        lock_guard<mutex> lock(job.mutex);
+        job.progress.samplesPerEpoch = images.size();
+    }
+
+    // Job ids restart with the server, so start from an empty checkpoint file
+    ofstream(job.trainingDataFile, ios::binary | ios::trunc);
+    TrainingConfig training = jobConfig.training;
+    training.trainingDataFile = job.trainingDataFile;
+    training.probabilitiesFile = config.outputDirectory + "/probabilities.dat";
+    training.onProgress = [&job](const TrainingProgress &progress)
+    {
+        return job.onProgress(progress);
+    };
+
+    // Built here, on the pinned training thread, so the parameters, gradients, optimizer state and workspace are all
+    // first touched (and so placed) on its NUMA node
+    FFNeuralNet net(images.front().size(), jobConfig.hiddenSize, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+    const TrainingResult result = net.train(images, labels, training);
+    // onProgress only stops training once the job is cancelled
+    if (result == TrainingResult::Stopped)
+        job.finish(JobState::Cancelled);
+    else if (result == TrainingResult::Failed)
+        job.finish(JobState::Failed, "training failed; see the server log for the cause");
+    else if (!net.saveFinalWeights(job.weightsFile))
+        job.finish(JobState::Failed, "could not save weights to " + job.weightsFile);
+    else
+        job.finish(JobState::Completed);
+}
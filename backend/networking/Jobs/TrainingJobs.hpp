@@ -0,0 +1,147 @@
+#ifndef TRAINING_JOBS_HPP
+#define TRAINING_JOBS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../NN/ff_neural_net.hpp"
+
+namespace Jobs
+{
+    enum class JobState
+    {
+        Queued,
+        Running,
+        Completed,
+        Cancelled,
+        Failed
+    };
+
+    // What to train, as posted to POST /jobs
+    struct JobConfig
+    {
+        std::string imagesFile = "../../data/mnist/train-images.idx3-ubyte";
+        std::string labelsFile = "../../data/mnist/train-labels.idx1-ubyte";
+        int trainCount = 1000;
+        size_t hiddenSize = 128;
+        TrainingConfig training; // epochs, batch size, optimizer and schedule; output files are set per job
+    };
+
+    // The training thread pool, configured from TRAINING_WORKERS, TRAINING_CPUS, TRAINING_NICE and TRAINING_RETAIN_JOBS
+    struct PoolConfig
+    {
+        unsigned workers = 1;  // jobs that train at the same time; the rest wait in order
+        std::vector<int> cpus; // worker i is pinned to cpus[i % cpus.size()]; empty leaves workers unpinned
+        int niceness = 10;     // training threads also run SCHED_BATCH, so request threads win every wakeup
+        std::string outputDirectory = "./NN/mnist/data/jobs";
+        size_t retainedJobs = 100; // finished jobs kept for GET /jobs; older ones are forgotten (their files stay)
+    };
+
+    PoolConfig poolConfigFromEnvironment();
+
+    class TrainingJob
+    {
+        friend class JobManager;
+
+        // A client streaming this job's progress as server-sent events
+        struct Subscriber
+        {
+            int socket;
+            size_t bytesSent;
+            std::function<void(size_t bytesSent)> onClose;
+        };
+
+        const uint64_t id;
+        const JobConfig config;
+        const std::string weightsFile;      // final weights, written when the job completes
+        const std::string trainingDataFile; // per-epoch checkpoints, through TrainingDatabase
+        const std::chrono::system_clock::time_point submittedAt = std::chrono::system_clock::now();
+        std::atomic<bool> cancelRequested{false};
+
+        mutable std::mutex mutex;
+        JobState state = JobState::Queued;
+        TrainingProgress progress;
+        std::string error;
+        std::chrono::steady_clock::time_point lastPublished;
+        std::vector<Subscriber> subscribers;
+
+        std::string toJsonLocked() const;
+        void publishLocked(const char *event);
+        void closeSubscribersLocked();
+        bool onProgress(const TrainingProgress &update);
+        void finish(JobState finalState, const std::string &message = "");
+
+    public:
+        TrainingJob(uint64_t id, JobConfig config, const std::string &outputDirectory);
+
+        uint64_t getId() const { return id; }
+        JobState getState() const;
+        std::string toJson() const;
+    };
+
+    /**
+     * @brief Runs training jobs posted over HTTP on a dedicated thread pool. Its threads are pinned to their own CPUs
+     *        (the server keeps its other threads off them) and run at low priority, so serving latency stays flat
+     *        while a job trains. Each job checkpoints every epoch through TrainingDatabase and saves its final weights.
+     */
+    class JobManager
+    {
+        PoolConfig config;
+        std::mutex jobsMutex;
+        std::condition_variable jobQueued;
+        std::map<uint64_t, std::shared_ptr<TrainingJob>> jobs;
+        std::deque<std::shared_ptr<TrainingJob>> queue;
+        uint64_t nextId = 1;
+        bool stopping = false;
+        std::vector<std::thread> workers;
+
+        void runWorker(unsigned index);
+        void evictFinishedLocked();
+        void runJob(TrainingJob &job);
+
+    public:
+        explicit JobManager(PoolConfig config);
+        ~JobManager();
+        JobManager(const JobManager &) = delete;
+        JobManager &operator=(const JobManager &) = delete;
+
+        std::shared_ptr<TrainingJob> submit(JobConfig jobConfig);
+        std::shared_ptr<TrainingJob> find(uint64_t id);
+        // A queued job is dropped; a running one stops after its current optimizer step. False for unknown or finished jobs
+        bool cancel(uint64_t id);
+        /**
+         * @brief Streams a job's progress to a client as server-sent events ("progress", then one final "done")
+         *
+         * @param onClose  Called with the bytes sent once the job finishes (or the client goes away) and the socket is closed
+         *
+         * @return False for an unknown job; the socket is then left to the caller
+         */
+        bool subscribe(uint64_t id, int clientSocket, std::function<void(size_t bytesSent)> onClose);
+
+        const std::vector<int> &getCpus() const { return config.cpus; }
+        // JSON array describing every job, for GET /jobs
+        std::string listJson();
+    };
+
+    /**
+     * @brief Parses a POST /jobs body: a flat JSON object with any of epochs, batchSize, learningRate, optimizer, schedule,
+     *        weightDecay, warmupSteps, hiddenSize and trainCount. Missing keys keep train.out's defaults.
+     *
+     * @return False with `error` set if a value is malformed or out of range
+     */
+    bool parseJobConfig(const std::string &json, JobConfig &config, std::string &error);
+    const char *jobStateName(JobState state);
+    // Keeps the calling thread, and threads it starts later, off `cpus` (if any CPU is left)
+    bool avoidCpus(const std::vector<int> &cpus);
+}
+
+#endif
@@ -0,0 +1,382 @@
+#include "LoadGenerator.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    const int MAX_EVENTS = 256;
+    const size_t READ_CHUNK = 64 * 1024;
+    const size_t MAX_HEADER_BYTES = 16 * 1024;
+
+    double toMs(double ns)
+    {
+        return ns / 1e6;
+    }
+}
+
+HDE::LoadGenerator::LoadGenerator(const LoadConfig &config) : config{config}
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+    {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+}
+
+HDE::LoadGenerator::~LoadGenerator()
+{
+    close(epollFd);
+}
+
+string HDE::LoadGenerator::buildRequest(const LoadTarget &target, const vector<string> &headers)
+{
+    string request = target.method + " " + target.path + " HTTP/1.1\r\n"
+                                                         "Host: localhost\r\n"
+                                                         "Connection: close\r\n";
+    for (const string &header : headers)
+        request += header + "\r\n";
+    if (!target.body.empty())
+    {
+        request += "Content-Type: application/octet-stream\r\n";
+        request += "Content-Length: " + to_string(target.body.size()) + "\r\n";
+    }
+    request += "\r\n" + target.body;
+    return request;
+}
+
+/**
+ * @brief Runs every configured target one after another
+ *
+ * @return One result per target, in configuration order
+ */
+vector<HDE::LoadResult> HDE::LoadGenerator::run()
+{
+    vector<LoadResult> results;
+    for (const LoadTarget &target : config.targets)
+    {
+        results.push_back(runTarget(target));
+    }
+    return results;
+}
+
+bool HDE::LoadGenerator::startRequest(Slot &slot, size_t slotIndex, Clock::time_point intendedStart)
+{
+    resetSlot(slot);
+    slot.intendedStart = intendedStart;
+    slot.actualStart = Clock::now();
+    slot.socket = make_unique<ConnectingSocket>(AF_INET, SOCK_STREAM, 0, config.port, config.address, true);
+    if (slot.socket->getConnectErrno() != 0)
+    {
+        resetSlot(slot);
+        return false;
+    }
+
+    slot.state = slot.socket->getConnection() == 0 ? SlotState::Sending : SlotState::Connecting;
+
+    struct epoll_event event = {};
+    event.events = EPOLLOUT;
+    event.data.u64 = slotIndex;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, slot.socket->getSock(), &event) < 0)
+    {
+        resetSlot(slot);
+        return false;
+    }
+    return true;
+}
+
+// Returns true once the whole request has been written
+bool HDE::LoadGenerator::onWritable(Slot &slot, const string &request)
+{
+    while (slot.sent < request.size())
+    {
+        ssize_t sent = send(slot.socket->getSock(), request.data() + slot.sent, request.size() - slot.sent, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        slot.sent += static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+/**
+ * @brief Reads whatever is available for a response in flight
+ *
+ * @return 1 when the response is complete, 0 if more data is expected, -1 on error
+ */
+int HDE::LoadGenerator::onReadable(Slot &slot, uint64_t &bytesReceived)
+{
+    static thread_local char chunk[READ_CHUNK];
+    while (true)
+    {
+        ssize_t received = recv(slot.socket->getSock(), chunk, sizeof(chunk), 0);
+        if (received < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (received == 0)
+        {
+            // The server closes after each response, so EOF after a status line marks the end of the body
+            return slot.status > 0 ? 1 : -1;
+        }
+
+        bytesReceived += static_cast<uint64_t>(received);
+        slot.received += static_cast<size_t>(received);
+
+        if (slot.headerEnd == 0)
+        {
+            size_t copy = min(static_cast<size_t>(received), MAX_HEADER_BYTES - min(MAX_HEADER_BYTES, slot.header.size()));
+            slot.header.append(chunk, copy);
+            size_t end = slot.header.find("\r\n\r\n");
+            if (end != string::npos)
+            {
+                slot.headerEnd = end + 4;
+                if (slot.header.compare(0, 5, "HTTP/") == 0 && slot.header.size() > 12)
+                    slot.status = atoi(slot.header.c_str() + 9);
+
+                const char *lengthHeader = strcasestr(slot.header.c_str(), "\r\nContent-Length:");
+                if (lengthHeader && lengthHeader < slot.header.c_str() + end)
+                    slot.contentLength = atol(lengthHeader + strlen("\r\nContent-Length:"));
+            }
+            else if (slot.header.size() >= MAX_HEADER_BYTES)
+            {
+                return -1;
+            }
+        }
+
+        if (slot.headerEnd > 0 && slot.contentLength >= 0 &&
+            slot.received >= slot.headerEnd + static_cast<size_t>(slot.contentLength))
+        {
+            return 1;
+        }
+    }
+}
+
+void HDE::LoadGenerator::resetSlot(Slot &slot)
+{
+    slot.socket.reset(); // closing the descriptor also removes it from the epoll set
+    slot.state = SlotState::Idle;
+    slot.sent = 0;
+    slot.received = 0;
+    slot.headerEnd = 0;
+    slot.contentLength = -1;
+    slot.status = 0;
+    slot.header.clear();
+}
+
+/**
+ * @brief Drives one target for warmup + duration seconds and summarizes the measured part
+ *
+ * @param target  Request to send repeatedly
+ *
+ * @return Throughput and latency percentiles for requests whose intended start fell after the warmup
+ */
+HDE::LoadResult HDE::LoadGenerator::runTarget(const LoadTarget &target)
+{
+    const string request = buildRequest(target, config.headers);
+    const bool openLoop = config.rate > 0.0;
+    const auto interval = chrono::duration<double>(openLoop ? 1.0 / config.rate : 0.0);
+
+    LoadResult result;
+    result.target = target.name;
+    result.openLoop = openLoop;
+
+    auto histogram = make_unique<Metrics::Histogram>();
+    vector<Slot> slots(max(1, config.connections));
+    deque<Clock::time_point> pending;
+
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point measureStart = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(config.warmupSeconds));
+    const Clock::time_point end = measureStart + chrono::duration_cast<Clock::duration>(chrono::duration<double>(config.durationSeconds));
+    const auto timeout = chrono::milliseconds(config.timeoutMs);
+    uint64_t scheduled = 0;
+    Clock::time_point nextSend = start;
+    double maxNs = 0.0;
+
+    auto measured = [&](const Slot &slot)
+    { return slot.intendedStart >= measureStart; };
+
+    auto record = [&](Clock::time_point from, Clock::time_point to)
+    {
+        double ns = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(to - from).count());
+        histogram->record(static_cast<uint64_t>(ns));
+        maxNs = max(maxNs, ns);
+    };
+
+    auto fail = [&](Slot &slot)
+    {
+        if (measured(slot))
+            ++result.errors;
+        resetSlot(slot);
+    };
+
+    struct epoll_event events[MAX_EVENTS];
+    while (true)
+    {
+        Clock::time_point now = Clock::now();
+        if (now >= end)
+            break;
+
+        if (openLoop)
+        {
+            while (nextSend <= now && nextSend < end)
+            {
+                pending.push_back(nextSend);
+                ++scheduled;
+                nextSend = start + chrono::duration_cast<Clock::duration>(interval * static_cast<double>(scheduled));
+            }
+        }
+
+        for (size_t i = 0; i < slots.size(); ++i)
+        {
+            Slot &slot = slots[i];
+            if (slot.state != SlotState::Idle)
+            {
+                if (now - slot.actualStart > timeout)
+                {
+                    // A timed-out request took at least this long; leaving it out would hide the slowest requests
+                    if (measured(slot))
+                    {
+                        ++result.timeouts;
+                        record(openLoop ? slot.intendedStart : slot.actualStart, now);
+                    }
+                    resetSlot(slot);
+                }
+                continue;
+            }
+
+            Clock::time_point intended = now;
+            if (openLoop)
+            {
+                if (pending.empty())
+                    continue;
+                intended = pending.front();
+                pending.pop_front();
+            }
+            if (!startRequest(slot, i, intended))
+            {
+                if (intended >= measureStart)
+                    ++result.errors;
+            }
+        }
+
+        int waitMs = 10;
+        if (openLoop)
+        {
+            auto untilNext = chrono::duration_cast<chrono::milliseconds>(nextSend - Clock::now()).count();
+            waitMs = static_cast<int>(max<long>(0, min<long>(untilNext, 10)));
+        }
+
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, waitMs);
+        for (int e = 0; e < ready; ++e)
+        {
+            Slot &slot = slots[events[e].data.u64];
+            if (slot.state == SlotState::Idle)
+                continue;
+
+            if (slot.state == SlotState::Connecting)
+            {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(slot.socket->getSock(), SOL_SOCKET, SO_ERROR, &error, &length);
+                if (error != 0)
+                {
+                    fail(slot);
+                    continue;
+                }
+                slot.state = SlotState::Sending;
+            }
+
+            if (slot.state == SlotState::Sending)
+            {
+                if (events[e].events & (EPOLLERR | EPOLLHUP))
+                {
+                    fail(slot);
+                    continue;
+                }
+                if (onWritable(slot, request))
+                {
+                    slot.state = SlotState::Receiving;
+                    struct epoll_event event = {};
+                    event.events = EPOLLIN;
+                    event.data.u64 = events[e].data.u64;
+                    epoll_ctl(epollFd, EPOLL_CTL_MOD, slot.socket->getSock(), &event);
+                }
+                continue;
+            }
+
+            uint64_t bytes = 0;
+            int status = onReadable(slot, bytes);
+            if (measured(slot))
+                result.bytesReceived += bytes;
+            if (status < 0 || (status > 0 && (slot.status < 200 || slot.status >= 300)))
+            {
+                fail(slot);
+            }
+            else if (status > 0)
+            {
+                if (measured(slot))
+                {
+                    // Open loop: measure from the intended start so queueing behind a slow server is counted
+                    record(openLoop ? slot.intendedStart : slot.actualStart, Clock::now());
+                    ++result.completed;
+                }
+                resetSlot(slot);
+            }
+        }
+    }
+
+    // Open loop: requests still in flight or never sent when the run ended waited at least until the end. They are
+    // recorded at that latency, so a saturated server shows up in the percentiles instead of only in the counts.
+    for (Slot &slot : slots)
+    {
+        if (openLoop && slot.state != SlotState::Idle && measured(slot))
+            record(slot.intendedStart, end);
+        resetSlot(slot);
+    }
+    for (Clock::time_point intended : pending)
+    {
+        if (intended < measureStart)
+            continue;
+        record(intended, end);
+        ++result.unsent;
+    }
+
+    result.seconds = config.durationSeconds;
+    result.requestsPerSecond = config.durationSeconds > 0.0 ? result.completed / config.durationSeconds : 0.0;
+    result.p50Ms = toMs(histogram->percentile(0.50));
+    result.p99Ms = toMs(histogram->percentile(0.99));
+    result.p999Ms = toMs(histogram->percentile(0.999));
+    result.maxMs = toMs(maxNs);
+    return result;
+}
+
+string HDE::LoadGenerator::toJson(const LoadResult &result, const LoadConfig &config)
+{
+    char json[512];
+    snprintf(json, sizeof(json),
+             "{\"target\":\"%s\",\"mode\":\"%s\",\"rate\":%.1f,\"connections\":%d,\"seconds\":%.1f,"
+             "\"completed\":%llu,\"errors\":%llu,\"timeouts\":%llu,\"unsent\":%llu,\"bytes_received\":%llu,"
+             "\"requests_per_sec\":%.1f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"p999_ms\":%.3f,\"max_ms\":%.3f}",
+             result.target.c_str(), result.openLoop ? "open" : "closed", config.rate, config.connections, result.seconds,
+             static_cast<unsigned long long>(result.completed), static_cast<unsigned long long>(result.errors),
+             static_cast<unsigned long long>(result.timeouts), static_cast<unsigned long long>(result.unsent),
+             static_cast<unsigned long long>(result.bytesReceived),
+             result.requestsPerSecond, result.p50Ms, result.p99Ms, result.p999Ms, result.maxMs);
+    return json;
+}
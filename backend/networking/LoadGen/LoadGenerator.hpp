@@ -0,0 +1,107 @@
+#ifndef LOAD_GENERATOR_HPP
+#define LOAD_GENERATOR_HPP
+
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../Sockets/ConnectingSocket.hpp"
+#include "../Metrics/Metrics.hpp"
+
+namespace HDE
+{
+    struct LoadTarget
+    {
+        std::string name;
+        std::string method;
+        std::string path;
+        std::string body;
+    };
+
+    struct LoadConfig
+    {
+        u_long address = INADDR_LOOPBACK;
+        int port = 8080;
+        std::vector<LoadTarget> targets;
+        std::vector<std::string> headers; // extra request headers, e.g. "Accept-Encoding: gzip"
+        int connections = 32;          // requests in flight at once, each on its own non-blocking connection
+        double rate = 0.0;             // requests/sec; 0 runs closed-loop (each connection fires as soon as it is free)
+        double durationSeconds = 10.0; // measured time per target
+        double warmupSeconds = 1.0;    // time per target before latencies are recorded
+        int timeoutMs = 5000;
+    };
+
+    struct LoadResult
+    {
+        std::string target;
+        bool openLoop;
+        uint64_t completed = 0;
+        uint64_t errors = 0;
+        uint64_t timeouts = 0;
+        uint64_t unsent = 0; // measured open-loop requests (due after the warmup) still waiting for a free connection
+                             // when the run ended; recorded in the percentiles at their wait until the end of the run
+        uint64_t bytesReceived = 0;
+        double seconds = 0.0;
+        double requestsPerSecond = 0.0;
+        double p50Ms = 0.0;
+        double p99Ms = 0.0;
+        double p999Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    /**
+     * @brief HTTP load generator that drives a server over many non-blocking ConnectingSockets from one epoll loop.
+     *
+     * Closed-loop mode measures service time: each connection sends its next request when the previous one finishes.
+     * Open-loop mode sends at a fixed rate and measures latency from each request's *intended* send time, so time a
+     * request spends waiting for a free connection behind a stalled server is counted (coordinated-omission correction).
+     * Requests that time out, are still in flight at the end, or were never sent are recorded at the latency they had
+     * reached (timeout or end of run), so the percentiles are lower bounds rather than omitting the slowest requests.
+     * The server closes every connection after responding, so each request uses a fresh connection.
+     */
+    class LoadGenerator
+    {
+        using Clock = std::chrono::steady_clock;
+
+        enum class SlotState
+        {
+            Idle,
+            Connecting,
+            Sending,
+            Receiving
+        };
+
+        struct Slot
+        {
+            std::unique_ptr<ConnectingSocket> socket;
+            SlotState state = SlotState::Idle;
+            Clock::time_point intendedStart;
+            Clock::time_point actualStart;
+            size_t sent = 0;
+            size_t received = 0;
+            size_t headerEnd = 0;
+            long contentLength = -1;
+            int status = 0;
+            std::string header;
+        };
+
+        LoadConfig config;
+        int epollFd;
+
+        LoadResult runTarget(const LoadTarget &target);
+        bool startRequest(Slot &slot, size_t slotIndex, Clock::time_point intendedStart);
+        bool onWritable(Slot &slot, const std::string &request);
+        int onReadable(Slot &slot, uint64_t &bytesReceived);
+        void resetSlot(Slot &slot);
+
+    public:
+        LoadGenerator(const LoadConfig &config);
+        ~LoadGenerator();
+        std::vector<LoadResult> run();
+        static std::string buildRequest(const LoadTarget &target, const std::vector<std::string> &headers = {});
+        static std::string toJson(const LoadResult &result, const LoadConfig &config);
+    };
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include "LoadGenerator.hpp"
+
+using namespace std;
+
+void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --port N           server port (default 8080)\n"
+            "  --host IPV4        server address (default 127.0.0.1)\n"
+            "  --connections N    concurrent connections (default 32)\n"
+            "  --rate R           open-loop requests/sec, latency corrected for coordinated omission\n"
+            "                     (default 0 = closed loop)\n"
+            "  --duration S       measured seconds per target (default 10)\n"
+            "  --warmup S         unmeasured seconds per target (default 1)\n"
+            "  --target SPEC      NAME=METHOD:PATH[@BODY_FILE], repeatable (default history=GET:/)\n"
+            "  --header H         extra request header, e.g. \"Accept-Encoding: gzip\", repeatable\n"
+            "Prints one JSON line per target on stdout and a summary on stderr.\n",
+            program);
+}
+
+bool parseTarget(const string &spec, HDE::LoadTarget &target)
+{
+    size_t equals = spec.find('=');
+    size_t colon = spec.find(':', equals == string::npos ? 0 : equals);
+    if (equals == string::npos || colon == string::npos)
+        return false;
+
+    target.name = spec.substr(0, equals);
+    target.method = spec.substr(equals + 1, colon - equals - 1);
+    string rest = spec.substr(colon + 1);
+
+    size_t at = rest.find('@');
+    target.path = rest.substr(0, at);
+    if (at != string::npos)
+    {
+        ifstream bodyFile(rest.substr(at + 1), ios::binary);
+        if (!bodyFile)
+            return false;
+        stringstream body;
+        body << bodyFile.rdbuf();
+        target.body = body.str();
+    }
+    return !target.name.empty() && !target.method.empty() && !target.path.empty();
+}
+
+int main(int argc, char *argv[])
+{
+    HDE::LoadConfig config;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--help" || arg == "-h" || !value)
+        {
+            printUsage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+        ++i;
+
+        if (arg == "--port")
+            config.port = atoi(value);
+        else if (arg == "--host")
+        {
+            struct in_addr parsed;
+            if (inet_pton(AF_INET, value, &parsed) != 1)
+            {
+                fprintf(stderr, "Invalid IPv4 address: %s\n", value);
+                return 1;
+            }
+            config.address = ntohl(parsed.s_addr);
+        }
+        else if (arg == "--connections")
+            config.connections = atoi(value);
+        else if (arg == "--rate")
+            config.rate = atof(value);
+        else if (arg == "--duration")
+            config.durationSeconds = atof(value);
+        else if (arg == "--warmup")
+            config.warmupSeconds = atof(value);
+        else if (arg == "--header")
+        {
+            if (!strchr(value, ':'))
+            {
+                fprintf(stderr, "Invalid header (expected Name: value): %s\n", value);
+                return 1;
+            }
+            config.headers.push_back(value);
+        }
+        else if (arg == "--target")
+        {
+            HDE::LoadTarget target;
+            if (!parseTarget(value, target))
+            {
+                fprintf(stderr, "Invalid target: %s\n", value);
+                return 1;
+            }
+            config.targets.push_back(target);
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.targets.empty())
+        config.targets.push_back({"history", "GET", "/", ""});
+
+    // Every in-flight request holds a descriptor, so make sure the connection count fits
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < static_cast<rlim_t>(config.connections) + 64)
+    {
+        limit.rlim_cur = min<rlim_t>(limit.rlim_max, static_cast<rlim_t>(config.connections) + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    HDE::LoadGenerator generator(config);
+    for (const HDE::LoadResult &result : generator.run())
+    {
+        fprintf(stderr, "%-12s %s loop: %.1f req/s, p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms (%llu ok, %llu errors, %llu timeouts, %llu unsent)\n",
+                result.target.c_str(), result.openLoop ? "open" : "closed", result.requestsPerSecond,
+                result.p50Ms, result.p99Ms, result.p999Ms, result.maxMs,
+                static_cast<unsigned long long>(result.completed), static_cast<unsigned long long>(result.errors),
+                static_cast<unsigned long long>(result.timeouts), static_cast<unsigned long long>(result.unsent));
+        printf("%s\n", HDE::LoadGenerator::toJson(result, config).c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,368 @@
+#include "Logger.hpp"
+#include <chrono>
+#include <cctype>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    const char *levelName(Logging::Level level)
+    {
+        switch (level)
+        {
+        case Logging::Level::Trace:
+            return "TRACE";
+        case Logging::Level::Debug:
+            return "DEBUG";
+        case Logging::Level::Info:
+            return "INFO";
+        case Logging::Level::Warn:
+            return "WARN";
+        case Logging::Level::Error:
+            return "ERROR";
+        default:
+            return "OFF";
+        }
+    }
+
+    uint64_t wallClockNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    // Marks the calling thread's ring as abandoned when the thread exits so the writer can reclaim it once drained
+    struct ThreadRingHandle
+    {
+        Logging::RingBuffer *ring = nullptr;
+        ~ThreadRingHandle()
+        {
+            if (ring)
+                ring->abandon();
+            ring = nullptr;
+        }
+    };
+
+    thread_local ThreadRingHandle threadRingHandle;
+}
+
+Logging::Record *Logging::RingBuffer::tryAcquire()
+{
+    uint64_t currentHead = head.load(memory_order_relaxed);
+    if (currentHead - tail.load(memory_order_acquire) >= RING_CAPACITY)
+    {
+        dropped.fetch_add(1, memory_order_relaxed);
+        return nullptr;
+    }
+    return &slots[currentHead & (RING_CAPACITY - 1)];
+}
+
+void Logging::RingBuffer::publish()
+{
+    head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+const Logging::Record *Logging::RingBuffer::peek()
+{
+    uint64_t currentTail = tail.load(memory_order_relaxed);
+    if (currentTail == head.load(memory_order_acquire))
+        return nullptr;
+    return &slots[currentTail & (RING_CAPACITY - 1)];
+}
+
+void Logging::RingBuffer::release()
+{
+    tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+uint64_t Logging::RingBuffer::takeDropped()
+{
+    return dropped.exchange(0, memory_order_relaxed);
+}
+
+void Logging::RingBuffer::abandon()
+{
+    abandoned.store(true, memory_order_release);
+}
+
+bool Logging::RingBuffer::isAbandoned() const
+{
+    return abandoned.load(memory_order_acquire);
+}
+
+bool Logging::RingBuffer::isEmpty() const
+{
+    return tail.load(memory_order_acquire) == head.load(memory_order_acquire);
+}
+
+/**
+ * @brief Creates the process-wide logger and starts the background writer thread.
+ *        The runtime level defaults to INFO and can be overridden with the LOG_LEVEL environment variable.
+ */
+Logging::Logger::Logger() : runtimeLevel{Level::Info}, sink{stdout}, ownsSink{false}, format{SinkFormat::Text}
+{
+    if (const char *envLevel = getenv("LOG_LEVEL"))
+    {
+        Level parsed;
+        if (parseLevel(envLevel, parsed))
+            runtimeLevel.store(parsed, memory_order_relaxed);
+    }
+    writer = thread(&Logger::drainLoop, this);
+}
+
+Logging::Logger::~Logger()
+{
+    running.store(false, memory_order_release);
+    if (writer.joinable())
+        writer.join();
+    drainOnce();
+    lock_guard<mutex> lock(sinkMutex);
+    fflush(sink);
+    if (ownsSink)
+        fclose(sink);
+}
+
+Logging::Logger &Logging::Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+/**
+ * @brief Returns the calling thread's ring, registering a new one on first use.
+ *        Registration takes a mutex once per thread; every later log call is lock-free.
+ */
+Logging::RingBuffer &Logging::Logger::threadRing()
+{
+    if (threadRingHandle.ring)
+        return *threadRingHandle.ring;
+
+    auto ring = make_unique<RingBuffer>();
+    ring->threadId = nextThreadId.fetch_add(1, memory_order_relaxed);
+    threadRingHandle.ring = ring.get();
+
+    lock_guard<mutex> lock(registryMutex);
+    rings.push_back(move(ring));
+    return *threadRingHandle.ring;
+}
+
+bool Logging::Logger::isEnabled(Level level) const
+{
+    return level >= runtimeLevel.load(memory_order_relaxed);
+}
+
+void Logging::Logger::setLevel(Level level)
+{
+    runtimeLevel.store(level, memory_order_relaxed);
+}
+
+Logging::Level Logging::Logger::getLevel() const
+{
+    return runtimeLevel.load(memory_order_relaxed);
+}
+
+bool Logging::Logger::setSink(const string &path, SinkFormat newFormat)
+{
+    FILE *file = fopen(path.c_str(), newFormat == SinkFormat::Binary ? "ab" : "a");
+    if (!file)
+        return false;
+
+    flush();
+    lock_guard<mutex> lock(sinkMutex);
+    if (ownsSink)
+        fclose(sink);
+    sink = file;
+    ownsSink = true;
+    format = newFormat;
+    return true;
+}
+
+void Logging::Logger::setSink(FILE *stream, SinkFormat newFormat)
+{
+    flush();
+    lock_guard<mutex> lock(sinkMutex);
+    if (ownsSink)
+        fclose(sink);
+    sink = stream;
+    ownsSink = false;
+    format = newFormat;
+}
+
+/**
+ * @brief Blocks until every record published before this call has reached the sink.
+ */
+void Logging::Logger::flush()
+{
+    uint64_t ticket = flushRequests.fetch_add(1, memory_order_acq_rel) + 1;
+    while (flushesCompleted.load(memory_order_acquire) < ticket && running.load(memory_order_acquire))
+    {
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+}
+
+void Logging::Logger::drainLoop()
+{
+    while (running.load(memory_order_acquire))
+    {
+        uint64_t pendingFlush = flushRequests.load(memory_order_acquire);
+        size_t written = drainOnce();
+
+        if (pendingFlush > flushesCompleted.load(memory_order_relaxed))
+        {
+            flushesCompleted.store(pendingFlush, memory_order_release);
+        }
+        if (written == 0)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+}
+
+/**
+ * @brief Drains every registered ring into the sink and reclaims rings whose threads have exited.
+ *
+ * @return Number of records written
+ */
+size_t Logging::Logger::drainOnce()
+{
+    vector<RingBuffer *> snapshot;
+    {
+        lock_guard<mutex> lock(registryMutex);
+        snapshot.reserve(rings.size());
+        for (auto &ring : rings)
+            snapshot.push_back(ring.get());
+    }
+
+    size_t written = 0;
+    {
+        lock_guard<mutex> lock(sinkMutex);
+        for (RingBuffer *ring : snapshot)
+        {
+            while (const Record *record = ring->peek())
+            {
+                writeRecord(*record);
+                ring->release();
+                ++written;
+            }
+            if (uint64_t dropped = ring->takeDropped())
+            {
+                writeDropNotice(ring->threadId, dropped);
+            }
+        }
+        if (written > 0)
+            fflush(sink);
+    }
+
+    lock_guard<mutex> lock(registryMutex);
+    rings.erase(remove_if(rings.begin(), rings.end(),
+                          [](const unique_ptr<RingBuffer> &ring)
+                          { return ring->isAbandoned() && ring->isEmpty(); }),
+                rings.end());
+    return written;
+}
+
+void Logging::Logger::writeRecord(const Record &record)
+{
+    if (format == SinkFormat::Binary)
+    {
+        fwrite(&record, offsetof(Record, message), 1, sink);
+        fwrite(record.message, 1, record.length, sink);
+        return;
+    }
+
+    time_t seconds = static_cast<time_t>(record.timestampNs / 1000000000ull);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    fprintf(sink, "%s.%06u [%s] [t%u] %.*s%s\n",
+            timestamp,
+            static_cast<unsigned>((record.timestampNs % 1000000000ull) / 1000),
+            levelName(record.level),
+            record.threadId,
+            static_cast<int>(record.length),
+            record.message,
+            record.truncated ? "..." : "");
+}
+
+void Logging::Logger::writeDropNotice(uint32_t threadId, uint64_t count)
+{
+    Record notice{};
+    notice.timestampNs = wallClockNs();
+    notice.threadId = threadId;
+    notice.level = Level::Warn;
+    int length = snprintf(notice.message, MESSAGE_CAPACITY, "logger dropped %llu records (ring full)",
+                          static_cast<unsigned long long>(count));
+    notice.length = static_cast<uint16_t>(min<int>(length, MESSAGE_CAPACITY - 1));
+    writeRecord(notice);
+}
+
+/**
+ * @brief Formats a message straight into a slot of the calling thread's ring. Never blocks and never allocates
+ *        after the thread's first call; if the ring is full the record is dropped and counted.
+ *
+ * @param level   Severity of the record
+ * @param format  printf-style format string
+ */
+void Logging::log(Level level, const char *format, ...)
+{
+    RingBuffer &ring = Logger::instance().threadRing();
+    Record *record = ring.tryAcquire();
+    if (!record)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(record->message, MESSAGE_CAPACITY, format, args);
+    va_end(args);
+
+    if (length < 0)
+        length = 0;
+    record->truncated = static_cast<size_t>(length) >= MESSAGE_CAPACITY;
+    record->length = static_cast<uint16_t>(min<size_t>(length, MESSAGE_CAPACITY - 1));
+    record->timestampNs = wallClockNs();
+    record->threadId = ring.threadId;
+    record->level = level;
+    ring.publish();
+}
+
+void Logging::setLevel(Level level)
+{
+    Logger::instance().setLevel(level);
+}
+
+bool Logging::parseLevel(const string &name, Level &level)
+{
+    string lower(name);
+    transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+              { return static_cast<char>(tolower(c)); });
+
+    if (lower == "trace")
+        level = Level::Trace;
+    else if (lower == "debug")
+        level = Level::Debug;
+    else if (lower == "info")
+        level = Level::Info;
+    else if (lower == "warn" || lower == "warning")
+        level = Level::Warn;
+    else if (lower == "error")
+        level = Level::Error;
+    else if (lower == "off")
+        level = Level::Off;
+    else
+        return false;
+    return true;
+}
+
+void Logging::flush()
+{
+    Logger::instance().flush();
+}
@@ -0,0 +1,144 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Levels below LOG_COMPILED_LEVEL are stripped at compile time, e.g. -DLOG_COMPILED_LEVEL=2 removes TRACE and DEBUG
+// call sites entirely (their arguments are never evaluated). 0 = TRACE, 1 = DEBUG, 2 = INFO, 3 = WARN, 4 = ERROR.
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 1
+#endif
+
+namespace Logging
+{
+    enum class Level : uint8_t
+    {
+        Trace = 0,
+        Debug = 1,
+        Info = 2,
+        Warn = 3,
+        Error = 4,
+        Off = 5
+    };
+
+    enum class SinkFormat
+    {
+        Text,  // one human readable line per record
+        Binary // raw Record headers followed by the message bytes
+    };
+
+    static constexpr size_t MESSAGE_CAPACITY = 232;
+    static constexpr size_t RING_CAPACITY = 1024; // records per thread, must be a power of two
+
+    // Fixed-size record so a slot can be formatted in place without allocating
+    struct Record
+    {
+        uint64_t timestampNs;
+        uint32_t threadId;
+        Level level;
+        uint8_t truncated;
+        uint16_t length;
+        char message[MESSAGE_CAPACITY];
+    };
+
+    /**
+     * @brief Single-producer/single-consumer ring owned by one logging thread and drained by the background writer.
+     *        The producer only writes `head`, the consumer only writes `tail`, so no locks are needed.
+     */
+    class RingBuffer
+    {
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        alignas(64) std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> abandoned{false};
+        Record slots[RING_CAPACITY];
+
+    public:
+        uint32_t threadId;
+
+        Record *tryAcquire();
+        void publish();
+        const Record *peek();
+        void release();
+
+        uint64_t takeDropped();
+        void abandon();
+        bool isAbandoned() const;
+        bool isEmpty() const;
+    };
+
+    class Logger
+    {
+        std::atomic<Level> runtimeLevel;
+        std::mutex registryMutex;
+        std::vector<std::unique_ptr<RingBuffer>> rings;
+        std::atomic<uint32_t> nextThreadId{1};
+
+        std::mutex sinkMutex;
+        FILE *sink;
+        bool ownsSink;
+        SinkFormat format;
+
+        std::atomic<bool> running{true};
+        std::atomic<uint64_t> flushRequests{0};
+        std::atomic<uint64_t> flushesCompleted{0};
+        std::thread writer;
+
+        Logger();
+        void drainLoop();
+        size_t drainOnce();
+        void writeRecord(const Record &record);
+        void writeDropNotice(uint32_t threadId, uint64_t count);
+
+    public:
+        ~Logger();
+        Logger(const Logger &) = delete;
+        Logger &operator=(const Logger &) = delete;
+
+        static Logger &instance();
+
+        RingBuffer &threadRing();
+        bool isEnabled(Level level) const;
+        void setLevel(Level level);
+        Level getLevel() const;
+        bool setSink(const std::string &path, SinkFormat format);
+        void setSink(FILE *stream, SinkFormat format);
+        void flush();
+    };
+
+    void log(Level level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    inline bool isEnabled(Level level)
+    {
+        return Logger::instance().isEnabled(level);
+    }
+
+    void setLevel(Level level);
+    bool parseLevel(const std::string &name, Level &level);
+    void flush();
+}
+
+#define LOG_AT(level, ...)                                                   \
+    do                                                                       \
+    {                                                                        \
+        if constexpr (static_cast<int>(level) >= LOG_COMPILED_LEVEL)         \
+        {                                                                    \
+            if (::Logging::isEnabled(level))                                 \
+                ::Logging::log(level, __VA_ARGS__);                          \
+        }                                                                    \
+    } while (0)
+
+#define LOG_TRACE(...) LOG_AT(::Logging::Level::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(::Logging::Level::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(::Logging::Level::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(::Logging::Level::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(::Logging::Level::Error, __VA_ARGS__)
+
+#endif
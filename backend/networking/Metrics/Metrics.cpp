@@ -0,0 +1,300 @@
+#include "Metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+using namespace std;
+
+namespace
+{
+    // Cumulative `le` boundaries exported for every histogram, in seconds, before snapping to bucket edges
+    const double EXPORTED_BOUNDS_SECONDS[] = {
+        0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+        0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0};
+
+    /**
+     * @brief EXPORTED_BOUNDS_SECONDS moved to the nearest internal bucket edge (at most 1/32 away), as inclusive
+     *        nanosecond bounds. Every internal bucket then lies wholly under or over each exported one, so the
+     *        cumulative counts are exact: samples are whole nanoseconds, so "< edge" is "<= edge - 1".
+     */
+    const vector<uint64_t> &exportedBoundsNs()
+    {
+        static const vector<uint64_t> bounds = []
+        {
+            vector<uint64_t> snapped;
+            for (double bound : EXPORTED_BOUNDS_SECONDS)
+            {
+                const uint64_t boundNs = static_cast<uint64_t>(bound * 1e9);
+                const int index = Metrics::Histogram::bucketIndex(boundNs);
+                const uint64_t upper = Metrics::Histogram::bucketUpperBound(index);
+                const uint64_t lower = index > 0 ? Metrics::Histogram::bucketUpperBound(index - 1) : 0;
+                snapped.push_back((boundNs - lower < upper - boundNs ? lower : upper) - 1);
+            }
+            return snapped;
+        }();
+        return bounds;
+    }
+
+    string formatDouble(double value, int precision = 9)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.*g", precision, value);
+        return text;
+    }
+
+    string withLabels(const string &labels, const string &extra = "")
+    {
+        if (labels.empty() && extra.empty())
+            return "";
+        if (labels.empty())
+            return "{" + extra + "}";
+        if (extra.empty())
+            return "{" + labels + "}";
+        return "{" + labels + "," + extra + "}";
+    }
+}
+
+size_t Metrics::threadShard()
+{
+    static atomic<size_t> nextShard{0};
+    thread_local size_t shard = nextShard.fetch_add(1, memory_order_relaxed) % SHARD_COUNT;
+    return shard;
+}
+
+void Metrics::Counter::add(uint64_t amount)
+{
+    shards[threadShard()].value.fetch_add(amount, memory_order_relaxed);
+}
+
+uint64_t Metrics::Counter::value() const
+{
+    uint64_t total = 0;
+    for (const Shard &shard : shards)
+        total += shard.value.load(memory_order_relaxed);
+    return total;
+}
+
+void Metrics::Gauge::set(double value)
+{
+    current.store(value, memory_order_relaxed);
+}
+
+void Metrics::Gauge::add(double delta)
+{
+    current.fetch_add(delta, memory_order_relaxed);
+}
+
+double Metrics::Gauge::value() const
+{
+    return current.load(memory_order_relaxed);
+}
+
+Metrics::Histogram::Shard::Shard()
+{
+    for (auto &bucket : buckets)
+        bucket.store(0, memory_order_relaxed);
+}
+
+int Metrics::Histogram::bucketIndex(uint64_t valueNs)
+{
+    if (valueNs < static_cast<uint64_t>(SUB_BUCKETS))
+        return static_cast<int>(valueNs);
+
+    int exponent = 63 - __builtin_clzll(valueNs);
+    if (exponent > MAX_EXPONENT)
+        return BUCKET_COUNT - 1;
+
+    int subBucket = static_cast<int>((valueNs >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + subBucket;
+}
+
+// Exclusive upper bound of a bucket in nanoseconds
+uint64_t Metrics::Histogram::bucketUpperBound(int index)
+{
+    if (index < SUB_BUCKETS)
+        return static_cast<uint64_t>(index) + 1;
+
+    int exponent = index / SUB_BUCKETS - 1 + SUB_BUCKET_BITS;
+    uint64_t subBucket = static_cast<uint64_t>(index % SUB_BUCKETS);
+    uint64_t width = 1ull << (exponent - SUB_BUCKET_BITS);
+    return (static_cast<uint64_t>(SUB_BUCKETS) + subBucket + 1) * width;
+}
+
+void Metrics::Histogram::record(uint64_t valueNs)
+{
+    Shard &shard = shards[threadShard()];
+    shard.buckets[bucketIndex(valueNs)].fetch_add(1, memory_order_relaxed);
+    shard.count.fetch_add(1, memory_order_relaxed);
+    shard.sumNs.fetch_add(valueNs, memory_order_relaxed);
+}
+
+void Metrics::Histogram::recordDuration(chrono::steady_clock::duration duration)
+{
+    auto ns = chrono::duration_cast<chrono::nanoseconds>(duration).count();
+    record(ns > 0 ? static_cast<uint64_t>(ns) : 0);
+}
+
+uint64_t Metrics::Histogram::snapshot(vector<uint64_t> &buckets, uint64_t &sumNs) const
+{
+    buckets.assign(BUCKET_COUNT, 0);
+    sumNs = 0;
+    uint64_t count = 0;
+    for (const Shard &shard : shards)
+    {
+        for (int i = 0; i < BUCKET_COUNT; ++i)
+            buckets[i] += shard.buckets[i].load(memory_order_relaxed);
+        count += shard.count.load(memory_order_relaxed);
+        sumNs += shard.sumNs.load(memory_order_relaxed);
+    }
+    return count;
+}
+
+/**
+ * @brief Estimates a quantile from the merged buckets
+ *
+ * @param quantile  Value in [0, 1], e.g. 0.99 for p99
+ *
+ * @return Upper bound (in nanoseconds) of the bucket holding the quantile, or 0 if nothing was recorded
+ */
+double Metrics::Histogram::percentile(double quantile) const
+{
+    vector<uint64_t> buckets;
+    uint64_t sumNs;
+    snapshot(buckets, sumNs);
+
+    uint64_t total = 0;
+    for (uint64_t count : buckets)
+        total += count;
+    if (total == 0)
+        return 0.0;
+
+    uint64_t target = static_cast<uint64_t>(quantile * static_cast<double>(total));
+    target = min(max<uint64_t>(target, 1), total);
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= target)
+            return static_cast<double>(bucketUpperBound(i));
+    }
+    return static_cast<double>(bucketUpperBound(BUCKET_COUNT - 1));
+}
+
+Metrics::Registry &Metrics::Registry::instance()
+{
+    static Registry registry;
+    return registry;
+}
+
+void *Metrics::Registry::find(const string &name, const string &labels, Type type)
+{
+    for (const Entry &entry : entries)
+    {
+        if (entry.name == name && entry.labels == labels && entry.type == type)
+            return entry.metric;
+    }
+    return nullptr;
+}
+
+Metrics::Counter &Metrics::Registry::counter(const string &name, const string &help, const string &labels)
+{
+    lock_guard<mutex> lock(registryMutex);
+    if (void *existing = find(name, labels, Type::Counter))
+        return *static_cast<Counter *>(existing);
+
+    Counter &created = counters.emplace_back();
+    entries.push_back({name, help, labels, Type::Counter, &created});
+    return created;
+}
+
+Metrics::Gauge &Metrics::Registry::gauge(const string &name, const string &help, const string &labels)
+{
+    lock_guard<mutex> lock(registryMutex);
+    if (void *existing = find(name, labels, Type::Gauge))
+        return *static_cast<Gauge *>(existing);
+
+    Gauge &created = gauges.emplace_back();
+    entries.push_back({name, help, labels, Type::Gauge, &created});
+    return created;
+}
+
+Metrics::Histogram &Metrics::Registry::histogram(const string &name, const string &help, const string &labels)
+{
+    lock_guard<mutex> lock(registryMutex);
+    if (void *existing = find(name, labels, Type::Histogram))
+        return *static_cast<Histogram *>(existing);
+
+    Histogram &created = histograms.emplace_back();
+    entries.push_back({name, help, labels, Type::Histogram, &created});
+    return created;
+}
+
+/**
+ * @brief Renders every registered metric in the Prometheus text exposition format (version 0.0.4).
+ *        Histogram durations are exported in seconds with a fixed set of cumulative buckets, whose `le` values are
+ *        the usual Prometheus boundaries moved onto the internal bucket edges (e.g. 0.009961471 for 0.01), so every
+ *        bucket count is exact.
+ */
+string Metrics::Registry::render()
+{
+    vector<Entry> snapshot;
+    {
+        lock_guard<mutex> lock(registryMutex);
+        snapshot = entries;
+    }
+    stable_sort(snapshot.begin(), snapshot.end(), [](const Entry &a, const Entry &b)
+                { return a.name < b.name; });
+
+    string output;
+    string previousName;
+    vector<uint64_t> buckets;
+    for (const Entry &entry : snapshot)
+    {
+        if (entry.name != previousName)
+        {
+            const char *typeName = entry.type == Type::Counter ? "counter" : entry.type == Type::Gauge ? "gauge"
+                                                                                                        : "histogram";
+            output += "# HELP " + entry.name + " " + entry.help + "\n";
+            output += "# TYPE " + entry.name + " " + typeName + "\n";
+            previousName = entry.name;
+        }
+
+        if (entry.type == Type::Counter)
+        {
+            output += entry.name + withLabels(entry.labels) + " " + to_string(static_cast<Counter *>(entry.metric)->value()) + "\n";
+        }
+        else if (entry.type == Type::Gauge)
+        {
+            output += entry.name + withLabels(entry.labels) + " " + formatDouble(static_cast<Gauge *>(entry.metric)->value()) + "\n";
+        }
+        else
+        {
+            uint64_t sumNs;
+            uint64_t count = static_cast<Histogram *>(entry.metric)->snapshot(buckets, sumNs);
+
+            int bucket = 0;
+            uint64_t cumulative = 0;
+            for (uint64_t boundNs : exportedBoundsNs())
+            {
+                while (bucket < Histogram::BUCKET_COUNT && Histogram::bucketUpperBound(bucket) <= boundNs + 1)
+                    cumulative += buckets[bucket++];
+                // 12 digits keep whole nanoseconds up to the 60 s bound
+                output += entry.name + "_bucket" + withLabels(entry.labels, "le=\"" + formatDouble(boundNs / 1e9, 12) + "\"") + " " + to_string(cumulative) + "\n";
+            }
+            output += entry.name + "_bucket" + withLabels(entry.labels, "le=\"+Inf\"") + " " + to_string(count) + "\n";
+            output += entry.name + "_sum" + withLabels(entry.labels) + " " + formatDouble(static_cast<double>(sumNs) / 1e9) + "\n";
+            output += entry.name + "_count" + withLabels(entry.labels) + " " + to_string(count) + "\n";
+        }
+    }
+    return output;
+}
+
+// Writes the exposition to a file, e.g. for the node_exporter textfile collector after an offline training run
+bool Metrics::Registry::writeToFile(const string &path)
+{
+    ofstream file(path, ios::trunc);
+    if (!file)
+        return false;
+    file << render();
+    return static_cast<bool>(file);
+}
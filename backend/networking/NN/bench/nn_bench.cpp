@@ -0,0 +1,1521 @@
+#include "../ff_neural_net.hpp"
+#include "../static_ff_net.hpp"
+#include "../sparse/sparse_ff_net.hpp"
+#include "../sweep/hyperparameter_sweep.hpp"
+#include "../utils/numa.hpp"
+#include "../utils/work_stealing_pool.hpp"
+#include "../data/streaming_dataset.hpp"
+#include "../mnist/mnist_loader.hpp"
+#include "../../Database/Database.hpp"
+#include "../../Logging/Logger.hpp"
+#include "../../Servers/HttpParser.hpp"
+#include "../../Servers/TrainingJson.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <new>
+#include <random>
+#include <sched.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Every heap allocation in the process goes through these replacements so each benchmark can report allocations/op
+static atomic<uint64_t> allocationCount{0};
+
+// GCC cannot tell that malloc/free below back the replaced operator new/delete
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void *ptr = malloc(size ? size : 1))
+        return ptr;
+    throw bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+// Over-aligned types (workspace arenas, StaticFFNet parameters) use the aligned forms
+void *operator new(size_t size, align_val_t alignment)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    const size_t align = static_cast<size_t>(alignment);
+    if (void *ptr = aligned_alloc(align, (max<size_t>(size, 1) + align - 1) / align * align))
+        return ptr;
+    throw bad_alloc();
+}
+
+void *operator new[](size_t size, align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void *ptr, align_val_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, align_val_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t, align_val_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, align_val_t) noexcept
+{
+    free(ptr);
+}
+
+const int MNIST_IMAGE_SIZE = 28 * 28;
+const int MNIST_POSSIBLE_DIGIT_OUTPUTS = 10;
+const double MIN_BENCH_SECONDS = 0.25;
+const string BENCH_DIR = "bench/tmp";
+
+/**
+ * @brief Runs `op` until at least MIN_BENCH_SECONDS have elapsed and prints one JSON line with the results
+ *
+ * @param name        Benchmark name
+ * @param size        Problem size label, e.g. "128x784"
+ * @param bytesPerOp  Bytes of memory the operation must touch, used to report GB/s (0 to omit)
+ * @param op          Operation under test
+ */
+template <typename Op>
+void runBenchmark(const string &name, const string &size, double bytesPerOp, Op &&op)
+{
+    op(); // warm caches and any lazily created state
+
+    uint64_t iterations = 1;
+    double elapsedSeconds = 0.0;
+    uint64_t allocations = 0;
+    while (true)
+    {
+        uint64_t allocationsBefore = allocationCount.load(memory_order_relaxed);
+        auto start = chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i)
+            op();
+        elapsedSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        allocations = allocationCount.load(memory_order_relaxed) - allocationsBefore;
+
+        if (elapsedSeconds >= MIN_BENCH_SECONDS)
+            break;
+        double scale = elapsedSeconds > 0.0 ? MIN_BENCH_SECONDS / elapsedSeconds * 1.2 : 10.0;
+        iterations = max<uint64_t>(iterations + 1, static_cast<uint64_t>(iterations * min(scale, 10.0)));
+    }
+
+    double nsPerOp = elapsedSeconds * 1e9 / iterations;
+    double gbPerSecond = bytesPerOp > 0.0 ? bytesPerOp / nsPerOp : 0.0;
+    printf("{\"benchmark\":\"%s\",\"size\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.1f,\"gb_per_s\":%.3f,\"allocs_per_op\":%.2f}\n",
+           name.c_str(), size.c_str(), static_cast<unsigned long long>(iterations), nsPerOp, gbPerSecond,
+           static_cast<double>(allocations) / iterations);
+    fflush(stdout);
+}
+
+// Synthetic MNIST-like images: ~19% nonzero pixels, matching the density of the real digits
+vector<vector<uint8_t>> makeImages(size_t count, mt19937 &gen, double density = 0.19)
+{
+    uniform_int_distribution<int> pixel(1, 255);
+    bernoulli_distribution inked(density);
+    vector<vector<uint8_t>> images(count, vector<uint8_t>(MNIST_IMAGE_SIZE));
+    for (auto &image : images)
+        for (auto &value : image)
+            value = inked(gen) ? static_cast<uint8_t>(pixel(gen)) : 0;
+    return images;
+}
+
+vector<double> makeVector(size_t size, mt19937 &gen)
+{
+    uniform_real_distribution<double> dist(-1.0, 1.0);
+    vector<double> values(size);
+    for (auto &value : values)
+        value = dist(gen);
+    return values;
+}
+
+// Heap allocations made by one call of `op`
+template <typename Op>
+uint64_t countAllocations(Op &&op)
+{
+    uint64_t before = allocationCount.load(memory_order_relaxed);
+    op();
+    return allocationCount.load(memory_order_relaxed) - before;
+}
+
+// Gradient of the cross-entropy loss with respect to `logits` for the given label
+vector<double> outputErrorFor(const vector<double> &logits, int label)
+{
+    vector<double> outputError(logits.size());
+    double loss;
+    NNUtils::ActivationFunctions::softmaxCrossEntropy(logits.data(), 1, logits.size(), &label, outputError.data(), &loss);
+    return outputError;
+}
+
+string dims(size_t rows, size_t cols)
+{
+    return to_string(rows) + "x" + to_string(cols);
+}
+
+class FFNeuralNetBenchmark
+{
+public:
+    static void layerActivation(mt19937 &gen)
+    {
+        const pair<int, int> shapes[] = {{10, 128}, {64, 784}, {128, 784}, {256, 784}};
+        for (auto [rows, cols] : shapes)
+        {
+            FFNeuralNet net(cols, rows, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            vector<double> input = makeVector(cols, gen);
+            vector<double> out(rows);
+            double bytes = (static_cast<double>(rows) * cols + cols + rows) * sizeof(double);
+            runBenchmark("computeLayerActivation", dims(rows, cols), bytes, [&]
+                         {
+                             net.computeLayerActivation(input.data(), cols, net.inputToHiddenLayerWeights(), net.hiddenLayerBiases(),
+                                                        rows, NNUtils::ActivationFunctions::relu, out.data());
+                             asm volatile("" : : "r"(out.data()) : "memory"); });
+        }
+    }
+
+    static void softmax(mt19937 &gen)
+    {
+        for (size_t size : {10, 100, 1000})
+        {
+            vector<double> logits = makeVector(size, gen);
+            runBenchmark("softmax", to_string(size), 2.0 * size * sizeof(double), [&]
+                         {
+                             vector<double> probs = NNUtils::ActivationFunctions::softmax(logits);
+                             asm volatile("" : : "r"(probs.data()) : "memory"); });
+        }
+    }
+
+    /**
+     * @brief Checks the FastMath error bounds documented in utils.hpp against the long double libm functions, over
+     *        random and edge-case inputs, and times them against std::exp and std::log
+     *
+     * @return False if an error bound is exceeded
+     */
+    static bool fastMath(mt19937 &gen)
+    {
+        uniform_real_distribution<double> expInput(-708.0, 0.0);
+        uniform_real_distribution<double> logExponent(-1000.0, 1000.0);
+        uniform_real_distribution<double> nearOne(0.5, 2.0);
+        vector<double> expInputs = {0.0, -0.0, -1e-300, -0.34657359027997264, -0.34657359027997270, -1.0, -708.0};
+        vector<double> logInputs = {1.0, 0.5, 2.0, 0.70710678118654752, 1.41421356237309505, 10.0, numeric_limits<double>::min(), numeric_limits<double>::max()};
+        for (int i = 0; i < 1 << 20; ++i)
+        {
+            expInputs.push_back(i % 2 ? expInput(gen) : expInput(gen) / 708.0);
+            logInputs.push_back(i % 2 ? pow(2.0, logExponent(gen)) : nearOne(gen));
+        }
+
+        double maxExpError = 0.0, maxLogError = 0.0;
+        for (double x : expInputs)
+        {
+            const long double expected = expl(static_cast<long double>(x));
+            maxExpError = max(maxExpError, static_cast<double>(fabsl((NNUtils::FastMath::expNonPositive(x) - expected) / expected)));
+        }
+        for (double x : logInputs)
+        {
+            // Relative to max(1, |log x|): absolute near x = 1, relative where the result is large
+            const long double expected = logl(static_cast<long double>(x));
+            const long double error = fabsl(NNUtils::FastMath::logPositive(x) - expected) / max(1.0L, fabsl(expected));
+            maxLogError = max(maxLogError, static_cast<double>(error));
+        }
+        const bool belowFloor = NNUtils::FastMath::expNonPositive(-709.0) == 0.0 &&
+                                NNUtils::FastMath::expNonPositive(-numeric_limits<double>::infinity()) == 0.0;
+        printf("{\"benchmark\":\"fastMath\",\"size\":\"accuracy\",\"exp_max_rel_error\":%.3g,\"log_max_error\":%.3g}\n",
+               maxExpError, maxLogError);
+        const bool ok = maxExpError < 1e-15 && maxLogError < 1e-15 && belowFloor;
+        if (!ok)
+            LOG_ERROR("FastMath exceeds its error bounds: exp %g, log %g, exp below -708 %s zero",
+                      maxExpError, maxLogError, belowFloor ? "is" : "is not");
+
+        const size_t count = 1024;
+        vector<double> x(expInputs.begin(), expInputs.begin() + count);
+        vector<double> y(count);
+        runBenchmark("fastMath/exp", to_string(count), 2.0 * count * sizeof(double), [&]
+                     {
+                         NNUtils::FastMath::exp(x.data(), y.data(), count);
+                         asm volatile("" : : "r"(y.data()) : "memory"); });
+        runBenchmark("fastMath/std::exp", to_string(count), 2.0 * count * sizeof(double), [&]
+                     {
+                         for (size_t i = 0; i < count; ++i)
+                             y[i] = exp(x[i]);
+                         asm volatile("" : : "r"(y.data()) : "memory"); });
+        x.assign(logInputs.begin(), logInputs.begin() + count);
+        runBenchmark("fastMath/log", to_string(count), 2.0 * count * sizeof(double), [&]
+                     {
+                         NNUtils::FastMath::log(x.data(), y.data(), count);
+                         asm volatile("" : : "r"(y.data()) : "memory"); });
+        runBenchmark("fastMath/std::log", to_string(count), 2.0 * count * sizeof(double), [&]
+                     {
+                         for (size_t i = 0; i < count; ++i)
+                             y[i] = log(x[i]);
+                         asm volatile("" : : "r"(y.data()) : "memory"); });
+        return ok;
+    }
+
+    /**
+     * @brief Checks the fused softmax/cross-entropy/gradient kernel against the libm computation, including logits far
+     *        enough apart that the label's probability underflows, and times it against the separate passes
+     *        (allocating softmax, -log(probability), output error) that training used before
+     *
+     * @return False if a probability, gradient or loss is off by more than 4e-15 relative, or a loss is not finite
+     */
+    static bool softmaxCrossEntropy(mt19937 &gen)
+    {
+        const size_t classes = MNIST_POSSIBLE_DIGIT_OUTPUTS;
+        const size_t rows = 64;
+        vector<int> labels(rows);
+        for (size_t r = 0; r < rows; ++r)
+            labels[r] = static_cast<int>(r % classes);
+
+        // Libm reference for one row in long double, from the same double-rounded z - max the kernel sees
+        auto reference = [&](const double *z, int label, long double *probabilities)
+        {
+            const double maxLogit = *max_element(z, z + classes);
+            long double sum = 0.0L;
+            for (size_t i = 0; i < classes; ++i)
+                sum += probabilities[i] = expl(z[i] - maxLogit);
+            for (size_t i = 0; i < classes; ++i)
+                probabilities[i] /= sum;
+            return logl(sum) - (z[label] - maxLogit);
+        };
+
+        bool ok = true;
+        double maxError = 0.0;
+        for (double scale : {1.0, 30.0, 1000.0})
+        {
+            vector<double> logits = makeVector(rows * classes, gen);
+            for (double &logit : logits)
+                logit *= scale;
+            vector<double> gradient(rows * classes), probabilities(rows * classes), losses(rows);
+            NNUtils::ActivationFunctions::softmaxCrossEntropy(logits.data(), rows, classes, labels.data(), gradient.data(), losses.data());
+            NNUtils::ActivationFunctions::softmaxCrossEntropy(logits.data(), rows, classes, nullptr, probabilities.data(), nullptr);
+            for (size_t r = 0; r < rows; ++r)
+            {
+                long double expected[MNIST_POSSIBLE_DIGIT_OUTPUTS];
+                const long double loss = reference(logits.data() + r * classes, labels[r], expected);
+                ok = ok && isfinite(losses[r]);
+                maxError = max(maxError, static_cast<double>(fabsl(losses[r] - loss) / max(1.0L, loss)));
+                for (size_t i = 0; i < classes; ++i)
+                {
+                    const long double oneHot = static_cast<int>(i) == labels[r] ? 1.0L : 0.0L;
+                    // Relative to the probability, or scaled absolute error for probabilities below 1e-290, which
+                    // includes those flushed to zero because their exp() is below exp(-708)
+                    const long double floor = max<long double>(expected[i], 1e-290L);
+                    maxError = max(maxError, static_cast<double>(fabsl(probabilities[r * classes + i] - expected[i]) / floor));
+                    maxError = max(maxError, static_cast<double>(fabsl(gradient[r * classes + i] - (expected[i] - oneHot)) /
+                                                                 max(floor, oneHot)));
+                }
+            }
+        }
+        printf("{\"benchmark\":\"softmaxCrossEntropy\",\"size\":\"accuracy\",\"max_rel_error\":%.3g}\n", maxError);
+        ok = ok && maxError < 4e-15;
+        if (!ok)
+            LOG_ERROR("softmaxCrossEntropy differs from libm by %g or returned a non-finite loss", maxError);
+
+        vector<double> logits = makeVector(rows * classes, gen);
+        vector<double> gradient(rows * classes), losses(rows);
+        double bytes = 2.0 * classes * sizeof(double);
+        size_t next = 0;
+        // What trainSample did before: allocating softmax, then -log(probability), then the output error
+        runBenchmark("softmaxCrossEntropy/separate", to_string(classes), bytes, [&]
+                     {
+                         const size_t r = next++ % rows;
+                         vector<double> row(logits.begin() + r * classes, logits.begin() + (r + 1) * classes);
+                         const double maxLogit = *max_element(row.begin(), row.end());
+                         vector<double> probabilities(classes);
+                         double sum = 0.0;
+                         for (size_t i = 0; i < classes; ++i)
+                             sum += probabilities[i] = exp(row[i] - maxLogit);
+                         for (size_t i = 0; i < classes; ++i)
+                             probabilities[i] /= sum;
+                         losses[r] = -log(probabilities[labels[r]]);
+                         for (size_t i = 0; i < classes; ++i)
+                             gradient[r * classes + i] = probabilities[i] - (static_cast<int>(i) == labels[r] ? 1.0 : 0.0);
+                         asm volatile("" : : "r"(gradient.data()), "r"(losses.data()) : "memory"); });
+        runBenchmark("softmaxCrossEntropy/fused", to_string(classes), bytes, [&]
+                     {
+                         const size_t r = next++ % rows;
+                         NNUtils::ActivationFunctions::softmaxCrossEntropy(logits.data() + r * classes, 1, classes, &labels[r],
+                                                                            gradient.data() + r * classes, &losses[r]);
+                         asm volatile("" : : "r"(gradient.data()), "r"(losses.data()) : "memory"); });
+        // one op is the whole batch; divide ns_per_op by 64 to compare
+        runBenchmark("softmaxCrossEntropy/fused", to_string(classes) + "/64", bytes * rows, [&]
+                     {
+                         NNUtils::ActivationFunctions::softmaxCrossEntropy(logits.data(), rows, classes, labels.data(),
+                                                                            gradient.data(), losses.data());
+                         asm volatile("" : : "r"(gradient.data()), "r"(losses.data()) : "memory"); });
+        return ok;
+    }
+
+    static void backpropagation(mt19937 &gen)
+    {
+        for (int hidden : {64, 128, 256})
+        {
+            FFNeuralNet net(MNIST_IMAGE_SIZE, hidden, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            vector<double> input = makeVector(MNIST_IMAGE_SIZE, gen);
+            vector<double> hiddenActivation = makeVector(hidden, gen);
+            vector<double> outputError = outputErrorFor(makeVector(MNIST_POSSIBLE_DIGIT_OUTPUTS, gen), 3);
+            FFNeuralNet::Workspace workspace = net.makeWorkspace();
+            // every gradient is read and written once
+            double bytes = 2.0 * net.gradients.size() * sizeof(double);
+            runBenchmark("applyBackpropagation", dims(MNIST_IMAGE_SIZE, hidden), bytes, [&]
+                         { net.applyBackpropagation(input.data(), hiddenActivation.data(), outputError.data(), workspace); });
+        }
+    }
+
+    static void optimizerStep()
+    {
+        const NNOptim::OptimizerType types[] = {NNOptim::OptimizerType::SGD, NNOptim::OptimizerType::Momentum,
+                                                NNOptim::OptimizerType::Nesterov, NNOptim::OptimizerType::Adam,
+                                                NNOptim::OptimizerType::AdamW};
+        for (int hidden : {128, 256})
+        {
+            FFNeuralNet net(MNIST_IMAGE_SIZE, hidden, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            net.gradients.assign(net.parameterCount(), 0.0);
+            for (NNOptim::OptimizerType type : types)
+            {
+                NNOptim::OptimizerConfig config;
+                config.type = type;
+                config.learningRate = 1e-9;
+                unique_ptr<NNOptim::Optimizer> optimizer = NNOptim::makeOptimizer(config, net.parameters.size());
+                size_t stateVectors = optimizer->stateBuffers().size();
+                // parameters and state are read and written, gradients read and cleared
+                double bytes = (2.0 + 2.0 + 2.0 * stateVectors) * net.parameters.size() * sizeof(double);
+                // the kernels are branch-free, so stepping on the already-cleared gradients costs the same as real ones
+                runBenchmark(string("optimizerStep/") + NNOptim::optimizerName(type), dims(MNIST_IMAGE_SIZE, hidden), bytes, [&]
+                             { optimizer->step(net.parameters.data(), net.gradients.data(), net.parameters.size(), config.learningRate, 1.0); });
+            }
+        }
+    }
+
+    static void forwardPass(mt19937 &gen)
+    {
+        vector<vector<uint8_t>> images = makeImages(64, gen);
+        for (int hidden : {64, 128, 256})
+        {
+            FFNeuralNet net(MNIST_IMAGE_SIZE, hidden, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            double bytes = static_cast<double>(net.extractNetworkParameters().size()) * sizeof(double) + MNIST_IMAGE_SIZE;
+            size_t next = 0;
+            runBenchmark("performForwardPass", dims(MNIST_IMAGE_SIZE, hidden), bytes, [&]
+                         {
+                             vector<double> probs = net.performForwardPass(images[next++ % images.size()]);
+                             asm volatile("" : : "r"(probs.data()) : "memory"); });
+
+            FFNeuralNet::Workspace workspace = net.makeWorkspace(images.size());
+            runBenchmark("performForwardPass/workspace", dims(MNIST_IMAGE_SIZE, hidden), bytes, [&]
+                         {
+                             const double *probs = net.performForwardPass(images[next++ % images.size()].data(), workspace);
+                             asm volatile("" : : "r"(probs) : "memory"); });
+
+            // one op is a batch of 64 images; divide ns_per_op by 64 to compare with performForwardPass
+            vector<double> batchProbabilities(images.size() * MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            runBenchmark("performForwardPassBatch", dims(MNIST_IMAGE_SIZE, hidden) + "/64", bytes * images.size(), [&]
+                         {
+                             net.performForwardPassBatch(images, 0, images.size(), batchProbabilities.data(), workspace);
+                             asm volatile("" : : "r"(batchProbabilities.data()) : "memory"); });
+        }
+    }
+
+    // Dense vs sparse first-layer kernels across input densities; the crossover sets SPARSE_DENSITY_THRESHOLD
+    static void sparseInput(mt19937 &gen)
+    {
+        const pair<FFNeuralNet::InputMode, const char *> modes[] = {{FFNeuralNet::InputMode::Dense, "dense"},
+                                                                   {FFNeuralNet::InputMode::Sparse, "sparse"}};
+        for (double density : {0.1, 0.19, 0.35, 0.5, 0.7})
+        {
+            vector<vector<uint8_t>> images = makeImages(64, gen, density);
+            vector<uint8_t> labels(images.size());
+            for (size_t i = 0; i < labels.size(); ++i)
+                labels[i] = static_cast<uint8_t>(i % MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            char size[32];
+            snprintf(size, sizeof(size), "784x128/d%.2f", density);
+
+            for (auto [mode, modeName] : modes)
+            {
+                FFNeuralNet net(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+                net.setInputMode(mode);
+                size_t next = 0;
+                runBenchmark(string("sparseInput/forward/") + modeName, size, 0, [&]
+                             {
+                                 vector<double> probs = net.performForwardPass(images[next++ % images.size()]);
+                                 asm volatile("" : : "r"(probs.data()) : "memory"); });
+
+                FFNeuralNet::Workspace workspace = net.makeWorkspace();
+                SparseInput &sparse = workspace.sparseInput;
+                vector<double> input(MNIST_IMAGE_SIZE);
+                vector<double> hiddenActivation = makeVector(128, gen);
+                vector<double> outputError = outputErrorFor(makeVector(MNIST_POSSIBLE_DIGIT_OUTPUTS, gen), 3);
+                runBenchmark(string("sparseInput/trainStep/") + modeName, size, 0, [&]
+                             {
+                                 const vector<uint8_t> &image = images[next++ % images.size()];
+                                 if (mode == FFNeuralNet::InputMode::Sparse)
+                                 {
+                                     FFNeuralNet::compactInput(image.data(), image.size(), sparse);
+                                     net.computeHiddenActivationGather(sparse, workspace.hidden);
+                                     asm volatile("" : : "r"(workspace.hidden) : "memory");
+                                     net.applyBackpropagation(input.data(), hiddenActivation.data(), outputError.data(), workspace, &sparse);
+                                 }
+                                 else
+                                 {
+                                     for (size_t i = 0; i < input.size(); ++i)
+                                         input[i] = image[i] / 255.0;
+                                     net.computeLayerActivation(input.data(), input.size(), net.inputToHiddenLayerWeights(), net.hiddenLayerBiases(),
+                                                                128, NNUtils::ActivationFunctions::relu, workspace.hidden);
+                                     asm volatile("" : : "r"(workspace.hidden) : "memory");
+                                     net.applyBackpropagation(input.data(), hiddenActivation.data(), outputError.data(), workspace);
+                                 } });
+            }
+        }
+    }
+
+    // Save/load/map throughput, then a check that a mapped model runs sparse inputs from the file's transposed first
+    // layer (no private copy) with the same results as a loaded one
+    static bool modelFile(mt19937 &gen)
+    {
+        const string modelPath = BENCH_DIR + "/model.dat";
+        bool ok = true;
+        for (int hidden : {128, 256})
+        {
+            FFNeuralNet net(MNIST_IMAGE_SIZE, hidden, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            double bytes = static_cast<double>(net.parameterCount()) * sizeof(double);
+            runBenchmark("modelFile/save", dims(MNIST_IMAGE_SIZE, hidden), bytes, [&]
+                         { net.saveFinalWeights(modelPath); });
+
+            FFNeuralNet loaded(MNIST_IMAGE_SIZE, hidden, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            runBenchmark("modelFile/load", dims(MNIST_IMAGE_SIZE, hidden), bytes, [&]
+                         { loaded.loadPretrainedWeights(modelPath); });
+            runBenchmark("modelFile/map", dims(MNIST_IMAGE_SIZE, hidden), bytes, [&]
+                         { loaded.mapPretrainedWeights(modelPath); });
+
+            FFNeuralNet mapped(MNIST_IMAGE_SIZE, hidden, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            loaded.setInputMode(FFNeuralNet::InputMode::Sparse);
+            mapped.setInputMode(FFNeuralNet::InputMode::Sparse);
+            bool same = loaded.loadPretrainedWeights(modelPath) && mapped.mapPretrainedWeights(modelPath);
+            for (const auto &image : makeImages(16, gen))
+                same = same && loaded.performForwardPass(image) == mapped.performForwardPass(image);
+            const bool shared = mapped.transposedInputWeights->weights.empty();
+            printf("{\"benchmark\":\"modelFile/check\",\"size\":\"%s\",\"same_predictions\":%s,\"shared_transposed\":%s}\n",
+                   dims(MNIST_IMAGE_SIZE, hidden).c_str(), same ? "true" : "false", shared ? "true" : "false");
+            ok = ok && same && shared;
+        }
+        filesystem::remove(modelPath);
+        return ok;
+    }
+
+    // Compile-time specialized network against FFNeuralNet with the same parameters; the double variant must match exactly
+    static void staticForwardPass(mt19937 &gen)
+    {
+        vector<vector<uint8_t>> images = makeImages(64, gen);
+        FFNeuralNet net(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        StaticFFNet<MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS> staticNet;
+        StaticFFNet<MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS, NNUtils::ActivationFunctions::Relu, float> staticFloatNet;
+        staticNet.setParameters(net.getParameters());
+        staticFloatNet.setParameters(net.getParameters());
+
+        double maxDoubleError = 0.0, maxFloatError = 0.0;
+        for (const auto &image : images)
+        {
+            vector<double> expected = net.performForwardPass(image);
+            auto probabilities = staticNet.performForwardPass(image);
+            auto floatProbabilities = staticFloatNet.performForwardPass(image);
+            for (size_t i = 0; i < expected.size(); ++i)
+            {
+                maxDoubleError = max(maxDoubleError, fabs(probabilities[i] - expected[i]));
+                maxFloatError = max(maxFloatError, fabs(floatProbabilities[i] - expected[i]));
+            }
+        }
+        if (maxDoubleError != 0.0 || maxFloatError > 1e-5)
+            LOG_ERROR("StaticFFNet differs from FFNeuralNet: double %g, float %g", maxDoubleError, maxFloatError);
+
+        size_t next = 0;
+        double bytes = static_cast<double>(net.parameterCount()) * sizeof(double) + MNIST_IMAGE_SIZE;
+        runBenchmark("staticForwardPass/dynamic", "784x128", bytes, [&]
+                     {
+                         vector<double> probs = net.performForwardPass(images[next++ % images.size()]);
+                         asm volatile("" : : "r"(probs.data()) : "memory"); });
+        runBenchmark("staticForwardPass/double", "784x128", bytes, [&]
+                     {
+                         auto probs = staticNet.performForwardPass(images[next++ % images.size()]);
+                         asm volatile("" : : "r"(probs.data()) : "memory"); });
+        runBenchmark("staticForwardPass/float", "784x128", bytes / 2, [&]
+                     {
+                         auto probs = staticFloatNet.performForwardPass(images[next++ % images.size()]);
+                         asm volatile("" : : "r"(probs.data()) : "memory"); });
+
+        const string modelPath = BENCH_DIR + "/static_model.dat";
+        StaticFFNet<MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS> reloaded;
+        FFNeuralNet dynamicReloaded(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        bool roundTrip = staticNet.saveFinalWeights(modelPath) && reloaded.loadPretrainedWeights(modelPath) &&
+                         dynamicReloaded.loadPretrainedWeights(modelPath);
+        vector<double> reloadedParameters = reloaded.getParameters();
+        if (!roundTrip || reloadedParameters != staticNet.getParameters() ||
+            !equal(reloadedParameters.begin(), reloadedParameters.end(), dynamicReloaded.getParameters()))
+            LOG_ERROR("StaticFFNet model file round trip failed");
+        filesystem::remove(modelPath);
+    }
+
+    /**
+     * @brief SparseFFNet batched inference in both layouts against one image at a time, with batches of 32 like the
+     *        server's default. CSR shares weight reads across the batch; block-sparse runs per image from scratch.
+     *
+     * @return False if a batch result differs from the single-image one in any bit
+     */
+    static bool batchInference(mt19937 &gen)
+    {
+        const size_t BATCH = 32;
+        vector<vector<uint8_t>> images = makeImages(BATCH, gen);
+        bool ok = true;
+
+        FFNeuralNet net(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        // 90% of the first layer pruned, as prune.out exports by default
+        vector<double> parameters(net.getParameters(), net.getParameters() + net.parameterCount());
+        vector<uint8_t> mask(MNIST_IMAGE_SIZE * 128);
+        NNSparse::pruneBlocksByMagnitude(parameters.data(), 128, MNIST_IMAGE_SIZE, 0.9, mask.data());
+        vector<double> probabilities(BATCH * MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        vector<double> scratch;
+        for (NNModel::Layout layout : {NNModel::Layout::CSR, NNModel::Layout::BlockSparse})
+        {
+            const char *name = layout == NNModel::Layout::CSR ? "csr" : "block";
+            NNSparse::SparseFFNet sparse(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS, parameters.data(), layout);
+            sparse.performForwardPassBatch(images, 0, BATCH, probabilities.data(), scratch);
+            for (size_t b = 0; b < BATCH; ++b)
+            {
+                vector<double> single = sparse.performForwardPass(images[b]);
+                ok = ok && equal(single.begin(), single.end(), probabilities.begin() + b * MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            }
+            const double bytes = static_cast<double>(sparse.modelBytes());
+            runBenchmark(string("batchInference/") + name + "/single", "784x128x32", bytes, [&]
+                         {
+                             for (size_t b = 0; b < BATCH; ++b)
+                             {
+                                 const double *single = sparse.performForwardPass(images[b].data(), scratch);
+                                 asm volatile("" : : "r"(single) : "memory");
+                             } });
+            runBenchmark(string("batchInference/") + name + "/batch", "784x128x32", bytes, [&]
+                         {
+                             sparse.performForwardPassBatch(images, 0, BATCH, probabilities.data(), scratch);
+                             asm volatile("" : : "r"(probabilities.data()) : "memory"); });
+        }
+        printf("{\"benchmark\":\"batchInference/check\",\"size\":\"784x128x32\",\"bitwise_equal\":%s}\n", ok ? "true" : "false");
+        return ok;
+    }
+
+    /**
+     * @brief Checks that steady-state inference and training make no heap allocations: each loop runs once to build
+     *        lazy state (transposed weights, gradients, optimizer state), then again while allocations are counted
+     *
+     * @return False if any loop allocated; the offending loop is logged
+     */
+    static bool steadyStateAllocations(mt19937 &gen)
+    {
+        // Sparse and dense images, so both first-layer kernels run
+        vector<vector<uint8_t>> images = makeImages(48, gen);
+        vector<vector<uint8_t>> denseImages = makeImages(16, gen, 0.7);
+        images.insert(images.end(), denseImages.begin(), denseImages.end());
+        vector<uint8_t> labels(images.size());
+        for (size_t i = 0; i < labels.size(); ++i)
+            labels[i] = static_cast<uint8_t>(i % MNIST_POSSIBLE_DIGIT_OUTPUTS);
+
+        FFNeuralNet net(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        FFNeuralNet::Workspace workspace = net.makeWorkspace(images.size());
+        vector<double> batchProbabilities(images.size() * MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        NNOptim::OptimizerConfig config;
+        config.type = NNOptim::OptimizerType::Adam;
+        net.optimizer = NNOptim::makeOptimizer(config, net.parameterCount());
+
+        // Same per-sample body as FFNeuralNet::train, with an optimizer step every 8 samples
+        auto trainingPass = [&]
+        {
+            double loss = 0.0;
+            for (size_t i = 0; i < images.size(); ++i)
+            {
+                loss += net.trainSample(images[i].data(), labels[i], workspace);
+                if ((i + 1) % 8 == 0)
+                    net.optimizer->step(net.parameters.data(), net.gradients.data(), net.parameters.size(), config.learningRate, 1.0 / 8);
+            }
+            asm volatile("" : : "r"(&loss) : "memory");
+        };
+        auto inferencePass = [&]
+        {
+            for (const auto &image : images)
+            {
+                const double *probs = net.performForwardPass(image.data(), workspace);
+                asm volatile("" : : "r"(probs) : "memory");
+            }
+        };
+        auto batchPass = [&]
+        { net.performForwardPassBatch(images, 0, images.size(), batchProbabilities.data(), workspace); };
+        // The served sparse layouts, one image at a time
+        const NNSparse::SparseFFNet csrNet(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS, net.getParameters(), NNModel::Layout::CSR);
+        const NNSparse::SparseFFNet blockNet(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS, net.getParameters(), NNModel::Layout::BlockSparse);
+        vector<double> sparseScratch;
+        auto sparsePass = [&]
+        {
+            for (const auto &image : images)
+            {
+                for (const NNSparse::SparseFFNet *sparse : {&csrNet, &blockNet})
+                {
+                    const double *probs = sparse->performForwardPass(image.data(), sparseScratch);
+                    asm volatile("" : : "r"(probs) : "memory");
+                }
+            }
+        };
+
+        const pair<const char *, function<void()>> loops[] = {
+            {"training", trainingPass}, {"inference", inferencePass}, {"batch inference", batchPass},
+            {"sparse inference", sparsePass}};
+        bool ok = true;
+        for (const auto &[name, loop] : loops)
+        {
+            loop();
+            uint64_t allocations = countAllocations(loop);
+            printf("{\"benchmark\":\"steadyStateAllocations\",\"size\":\"%s\",\"images\":%zu,\"allocations\":%llu}\n",
+                   name, images.size(), static_cast<unsigned long long>(allocations));
+            if (allocations != 0)
+            {
+                LOG_ERROR("Steady-state %s made %llu heap allocations for %zu images; expected none",
+                          name, static_cast<unsigned long long>(allocations), images.size());
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    static void trainingEpoch(mt19937 &gen)
+    {
+        const string historyFile = BENCH_DIR + "/epoch_history.dat";
+        for (size_t samples : {100, 1000})
+        {
+            vector<vector<uint8_t>> images = makeImages(samples, gen);
+            vector<uint8_t> labels(samples);
+            for (size_t i = 0; i < samples; ++i)
+                labels[i] = static_cast<uint8_t>(i % MNIST_POSSIBLE_DIGIT_OUTPUTS);
+
+            FFNeuralNet net(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            double bytes = 3.0 * net.extractNetworkParameters().size() * sizeof(double) * samples;
+            runBenchmark("trainEpoch", to_string(samples) + "x784x128", bytes, [&]
+                         {
+                             filesystem::remove(historyFile);
+                             net.train(images, labels, 1, 0.001, historyFile); });
+
+            TrainingConfig config;
+            config.epochs = 1;
+            config.batchSize = 32;
+            config.optimizer.type = NNOptim::OptimizerType::Adam;
+            config.trainingDataFile = historyFile;
+            runBenchmark("trainEpoch/adam-b32", to_string(samples) + "x784x128", bytes, [&]
+                         {
+                             filesystem::remove(historyFile);
+                             net.train(images, labels, config); });
+        }
+        filesystem::remove(historyFile);
+    }
+
+    /**
+     * @brief Checks that an interrupted run resumed from its checkpoint ends bitwise identical to an uninterrupted run:
+     *        the interrupted run stops mid-epoch, garbage is appended to its history as if a record write was cut short,
+     *        and a network with different initial weights resumes it. Also times one checkpoint write.
+     *
+     * @return False if the parameters or the history differ, or the checkpoint is left behind
+     */
+    static bool trainResume(mt19937 &gen)
+    {
+        vector<vector<uint8_t>> images = makeImages(200, gen);
+        vector<uint8_t> labels(images.size());
+        for (size_t i = 0; i < labels.size(); ++i)
+            labels[i] = static_cast<uint8_t>(gen() % MNIST_POSSIBLE_DIGIT_OUTPUTS);
+
+        FFNeuralNet reference(MNIST_IMAGE_SIZE, 64, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        const vector<double> initial = reference.extractNetworkParameters();
+        TrainingConfig config;
+        config.epochs = 3;
+        config.batchSize = 8;
+        config.optimizer.type = NNOptim::OptimizerType::AdamW;
+        config.schedule.type = NNOptim::ScheduleType::Cosine;
+        config.schedule.totalEpochs = config.epochs;
+        config.checkpointEverySteps = 5;
+        config.shuffle = true;
+        config.trainingDataFile = BENCH_DIR + "/resume_reference.dat";
+        config.probabilitiesFile = BENCH_DIR + "/resume_probabilities.dat";
+        config.checkpointFile = BENCH_DIR + "/resume_reference.ckpt";
+        reference.train(images, labels, config);
+
+        // Stopped at step 37, two steps after the checkpoint at step 35 in the middle of epoch 2
+        FFNeuralNet interrupted(MNIST_IMAGE_SIZE, 64, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        interrupted.setParameters(initial);
+        config.trainingDataFile = BENCH_DIR + "/resume_history.dat";
+        config.checkpointFile = BENCH_DIR + "/resume.ckpt";
+        config.onProgress = [](const TrainingProgress &progress)
+        { return progress.epochComplete || progress.epoch < 2 || progress.samples < 12 * 8; };
+        const bool stopped = interrupted.train(images, labels, config) == TrainingResult::Stopped;
+        {
+            ofstream history(config.trainingDataFile, ios::binary | ios::app);
+            history.write("partial record", 14);
+        }
+
+        FFNeuralNet resumed(MNIST_IMAGE_SIZE, 64, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        config.onProgress = nullptr;
+        const bool finished = resumed.train(images, labels, config) == TrainingResult::Completed;
+
+        auto readFile = [](const string &path)
+        {
+            ifstream file(path, ios::binary);
+            return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        };
+        const bool sameParameters = resumed.extractNetworkParameters() == reference.extractNetworkParameters();
+        const bool sameHistory = readFile(config.trainingDataFile) == readFile(BENCH_DIR + "/resume_reference.dat");
+        const bool checkpointRemoved = !filesystem::exists(config.checkpointFile);
+        printf("{\"benchmark\":\"trainResume\",\"size\":\"%zux784x64\",\"stopped\":%s,\"finished\":%s,"
+               "\"same_parameters\":%s,\"same_history\":%s,\"checkpoint_removed\":%s}\n",
+               images.size(), stopped ? "true" : "false", finished ? "true" : "false", sameParameters ? "true" : "false",
+               sameHistory ? "true" : "false", checkpointRemoved ? "true" : "false");
+        fflush(stdout);
+
+        // Parameters and both Adam moments, written and fsynced
+        TrainingDatabase db(config.trainingDataFile, config.probabilitiesFile);
+        mt19937_64 shuffler(config.shuffleSeed);
+        runBenchmark("trainResume/checkpoint", dims(MNIST_IMAGE_SIZE, 64), 3.0 * resumed.parameterCount() * sizeof(double), [&]
+                     { resumed.writeCheckpoint(config, images.size(), config.batchSize, {1, 0, 0.0}, shuffler, db); });
+
+        for (const string name : {"resume_reference.dat", "resume_history.dat", "resume_probabilities.dat", "resume.ckpt"})
+            filesystem::remove(BENCH_DIR + "/" + name);
+        if (!stopped || !finished || !sameParameters || !sameHistory || !checkpointRemoved)
+        {
+            LOG_ERROR("Resumed training differs from an uninterrupted run");
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Batch inference and training throughput for every (CPU node, memory node) pair. The parameters and gradients
+     *        are bound to the memory node and the benchmark thread runs on the CPU node's CPUs, so on a multi-socket host
+     *        the cpuN-memM rows with N != M show what cross-socket traffic on the weights costs. A 1024-wide hidden layer
+     *        and the dense kernels make every pass stream about 6.4 MB of weights, more than fits in cache.
+     *        A single-node host only has the local row.
+     */
+    static void numaPlacement(mt19937 &gen)
+    {
+        const NNUtils::CpuTopology &topology = NNUtils::CpuTopology::instance();
+        cpu_set_t originalCpus;
+        sched_getaffinity(0, sizeof(originalCpus), &originalCpus);
+
+        const size_t hiddenSize = 1024;
+        vector<vector<uint8_t>> images = makeImages(64, gen);
+        vector<uint8_t> labels(images.size());
+        for (size_t i = 0; i < labels.size(); ++i)
+            labels[i] = static_cast<uint8_t>(i % MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        vector<double> probabilities(images.size() * MNIST_POSSIBLE_DIGIT_OUTPUTS);
+
+        for (size_t memoryNode = 0; memoryNode < topology.nodeCount(); ++memoryNode)
+        {
+            FFNeuralNet net(MNIST_IMAGE_SIZE, hiddenSize, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            net.setInputMode(FFNeuralNet::InputMode::Dense);
+            net.gradients.assign(net.parameterCount(), 0.0);
+            NNOptim::OptimizerConfig config;
+            net.optimizer = NNOptim::makeOptimizer(config, net.parameterCount());
+            const double bytes = static_cast<double>(net.parameterCount() * sizeof(double));
+            if (!NNUtils::bindToNode(net.parameters.data(), bytes, static_cast<int>(memoryNode)) ||
+                !NNUtils::bindToNode(net.gradients.data(), bytes, static_cast<int>(memoryNode)))
+                LOG_ERROR("Could not bind parameters to NUMA node %zu; rows for it show first-touch placement", memoryNode);
+
+            for (size_t cpuNode = 0; cpuNode < topology.nodeCount(); ++cpuNode)
+            {
+                if (topology.cpusOfNode(cpuNode).empty() || !NNUtils::pinCurrentThread(topology.cpusOfNode(cpuNode)))
+                    continue;
+                // Per-thread scratch belongs with the thread, as it does in the server and trainer
+                FFNeuralNet::Workspace workspace = net.makeWorkspace(images.size());
+                const string size = "cpu" + to_string(cpuNode) + "-mem" + to_string(memoryNode) + " " +
+                                    dims(MNIST_IMAGE_SIZE, hiddenSize);
+
+                // Each image streams the weights once (and training reads them again and writes the gradients)
+                runBenchmark("numaPlacement/inference", size, bytes * images.size(), [&]
+                             { net.performForwardPassBatch(images, 0, images.size(), probabilities.data(), workspace); });
+                runBenchmark("numaPlacement/training", size, 3 * bytes * images.size(), [&]
+                             {
+                                 double loss = 0.0;
+                                 for (size_t i = 0; i < images.size(); ++i)
+                                 {
+                                     loss += net.trainSample(images[i].data(), labels[i], workspace);
+                                     if ((i + 1) % 16 == 0)
+                                         net.optimizer->step(net.parameters.data(), net.gradients.data(), net.parameters.size(), config.learningRate, 1.0 / 16);
+                                 }
+                                 asm volatile("" : : "r"(&loss) : "memory"); });
+            }
+        }
+        sched_setaffinity(0, sizeof(originalCpus), &originalCpus);
+    }
+};
+
+void trainingDatabase(mt19937 &gen)
+{
+    const string historyFile = BENCH_DIR + "/db_history.dat";
+    const string probabilityFile = BENCH_DIR + "/db_probabilities.dat";
+    for (size_t numWeights : {7960, 101770, 203530})
+    {
+        vector<double> weights = makeVector(numWeights, gen);
+        double recordBytes = static_cast<double>(numWeights) * sizeof(double);
+
+        filesystem::remove(historyFile);
+        {
+            TrainingDatabase db(historyFile, probabilityFile);
+            int epoch = 0;
+            runBenchmark("TrainingDatabase::saveTrainingData", to_string(numWeights), recordBytes, [&]
+                         {
+                             if (epoch % 16 == 0)
+                                 filesystem::resize_file(historyFile, 0);
+                             db.saveTrainingData(++epoch, 0.5, weights); });
+        }
+
+        filesystem::remove(historyFile);
+        TrainingDatabase db(historyFile, probabilityFile);
+        const int records = 10;
+        for (int epoch = 1; epoch <= records; ++epoch)
+            db.saveTrainingData(epoch, 0.5, weights);
+        runBenchmark("TrainingDatabase::loadTrainingResults", to_string(records) + "x" + to_string(numWeights), recordBytes * records, [&]
+                     {
+                         auto loaded = db.loadTrainingResults();
+                         asm volatile("" : : "r"(loaded.data()) : "memory"); });
+    }
+    filesystem::remove(historyFile);
+    filesystem::remove(probabilityFile);
+}
+
+/**
+ * @brief Runs a tree of tasks on NNUtils::WorkStealingPool, as the sweep runner does: the tasks all start on worker 0 and
+ *        each pushes its children onto its own worker, so the other workers only get work by stealing. Checks that
+ *        every task runs exactly once and times the scheduling overhead per task.
+ *
+ * @return False if a task was lost or ran twice
+ */
+bool workStealingPool()
+{
+    const size_t workers = 4;
+    const uint32_t tasks = 1 << 14;
+    bool ok = true;
+    uint64_t steals = 0;
+    runBenchmark("workStealingPool", to_string(workers) + "x" + to_string(tasks), 0, [&]
+                 {
+                     vector<atomic<uint32_t>> runs(tasks);
+                     NNUtils::WorkStealingPool<uint32_t> pool(workers);
+                     pool.push(0, 1);
+                     pool.run([&](uint32_t &task, size_t worker)
+                              {
+                                  runs[task - 1].fetch_add(1, memory_order_relaxed);
+                                  for (uint32_t child : {2 * task, 2 * task + 1})
+                                      if (child <= tasks)
+                                          pool.push(worker, child); });
+                     for (const atomic<uint32_t> &count : runs)
+                         ok = ok && count.load(memory_order_relaxed) == 1;
+                     steals = pool.steals(); });
+    printf("{\"benchmark\":\"workStealingPool/check\",\"size\":\"%zux%u\",\"all_ran_once\":%s,\"steals\":%llu}\n",
+           workers, tasks, ok ? "true" : "false", static_cast<unsigned long long>(steals));
+    if (!ok)
+        LOG_ERROR("WorkStealingPool lost a task or ran one twice");
+    return ok;
+}
+
+/**
+ * @brief Runs a two-trial sweep, fewer trials than the ASHA reduction factor, so no rung can promote by ranking alone
+ *
+ * @return False unless exactly one trial completed its budget and saved its weights
+ */
+bool sweepSmallGrid(mt19937 &gen)
+{
+    vector<vector<uint8_t>> images = makeImages(120, gen);
+    vector<uint8_t> labels(images.size());
+    for (size_t i = 0; i < labels.size(); ++i)
+        labels[i] = static_cast<uint8_t>(gen() % MNIST_POSSIBLE_DIGIT_OUTPUTS);
+    const vector<vector<uint8_t>> validationImages(images.begin() + 100, images.end());
+    const vector<uint8_t> validationLabels(labels.begin() + 100, labels.end());
+    images.resize(100);
+    labels.resize(100);
+
+    NNSweep::SweepConfig config;
+    config.trials = {{32, 0.002, 3}, {64, 0.002, 3}};
+    config.training.batchSize = 16;
+    config.training.optimizer.type = NNOptim::OptimizerType::AdamW;
+    config.training.schedule.type = NNOptim::ScheduleType::Cosine;
+    config.outputDirectory = BENCH_DIR + "/sweep";
+    NNSweep::SweepSummary summary = NNSweep::runSweep(images, labels, validationImages, validationLabels, config);
+
+    size_t completed = 0;
+    bool weightsSaved = true;
+    for (const NNSweep::TrialResult &trial : summary.trials)
+    {
+        if (trial.state != NNSweep::TrialState::Completed)
+            continue;
+        ++completed;
+        weightsSaved = weightsSaved && filesystem::exists(trial.weightsFile);
+    }
+    const bool ok = completed == 1 && weightsSaved;
+    printf("{\"benchmark\":\"sweepSmallGrid/check\",\"size\":\"%zux3\",\"completed\":%zu,\"weights_saved\":%s,"
+           "\"epochs_trained\":%llu}\n",
+           summary.trials.size(), completed, weightsSaved ? "true" : "false",
+           static_cast<unsigned long long>(summary.epochsTrained));
+    if (!ok)
+        LOG_ERROR("A sweep smaller than the reduction factor ended without exactly one completed trial");
+    return ok;
+}
+
+/**
+ * @brief Streams a synthetic IDX dataset through NNData::StreamingDataset. Checks that every epoch (in file order, with
+ *        shard shuffling only, and with a shuffle buffer) hands out each sample exactly once with its label, that a
+ *        shuffled epoch is reproducible from the generator state, and that the buffers stay a small fraction of the
+ *        file. Then times an epoch with the file in the page cache ("warm") and after dropping it ("cold", disk
+ *        bandwidth), against loading the same file into memory.
+ *
+ * @return False if a check fails
+ */
+bool streamingDataset(mt19937 &gen)
+{
+    const string imagesFile = BENCH_DIR + "/stream-images.idx3-ubyte";
+    const string labelsFile = BENCH_DIR + "/stream-labels.idx1-ubyte";
+    const uint32_t count = 65536;
+    // Each image's first four pixels hold its index, so the checks can tell which sample they were given
+    {
+        vector<vector<uint8_t>> images = makeImages(256, gen);
+        ofstream imageOut(imagesFile, ios::binary), labelOut(labelsFile, ios::binary);
+        const uint32_t imageHeader[4] = {__builtin_bswap32(0x803), __builtin_bswap32(count), __builtin_bswap32(28), __builtin_bswap32(28)};
+        const uint32_t labelHeader[2] = {__builtin_bswap32(0x801), __builtin_bswap32(count)};
+        imageOut.write(reinterpret_cast<const char *>(imageHeader), sizeof(imageHeader));
+        labelOut.write(reinterpret_cast<const char *>(labelHeader), sizeof(labelHeader));
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            vector<uint8_t> &image = images[i % images.size()];
+            memcpy(image.data(), &i, sizeof(i));
+            imageOut.write(reinterpret_cast<const char *>(image.data()), MNIST_IMAGE_SIZE);
+            const char label = static_cast<char>(i % MNIST_POSSIBLE_DIGIT_OUTPUTS);
+            labelOut.write(&label, 1);
+        }
+    }
+    const double fileBytes = static_cast<double>(count) * (MNIST_IMAGE_SIZE + 1);
+
+    // Indices in the order one epoch handed them out; empty if a sample was wrong, repeated or missing
+    auto readEpoch = [&](NNData::StreamingDataset &dataset, mt19937_64 *shuffler)
+    {
+        vector<uint32_t> order;
+        vector<bool> seen(count, false);
+        const uint8_t *pixels;
+        uint8_t label;
+        dataset.beginEpoch(shuffler);
+        while (dataset.next(pixels, label))
+        {
+            uint32_t index;
+            memcpy(&index, pixels, sizeof(index));
+            if (index >= count || seen[index] || label != index % MNIST_POSSIBLE_DIGIT_OUTPUTS)
+                return vector<uint32_t>();
+            seen[index] = true;
+            order.push_back(index);
+        }
+        return order.size() == count ? order : vector<uint32_t>();
+    };
+
+    bool ok = true;
+    const pair<const char *, size_t> modes[] = {{"file-order", 0}, {"shard-shuffle", 0}, {"shuffle-buffer", 8192}};
+    for (const auto &[mode, shuffleBuffer] : modes)
+    {
+        NNData::StreamingConfig streaming;
+        streaming.shuffleBufferSamples = shuffleBuffer;
+        NNData::StreamingDataset dataset(streaming);
+        if (!dataset.open(imagesFile, labelsFile))
+            return false;
+        const bool shuffled = string(mode) != "file-order";
+        mt19937_64 shuffler(7);
+        const vector<uint32_t> first = readEpoch(dataset, shuffled ? &shuffler : nullptr);
+        mt19937_64 replay(7);
+        const vector<uint32_t> again = readEpoch(dataset, shuffled ? &replay : nullptr);
+        const vector<uint32_t> next = readEpoch(dataset, shuffled ? &shuffler : nullptr);
+        size_t inPlace = 0;
+        for (size_t i = 0; i < first.size(); ++i)
+            inPlace += first[i] == i;
+
+        const bool complete = !first.empty() && !next.empty();
+        const bool reproducible = first == again;
+        // Shard shuffling alone keeps each shard's samples in file order; a shard may even stay where it was
+        const size_t maxInPlace = shuffleBuffer > 0 ? count / 100 : count / 2;
+        const bool orderOk = shuffled ? inPlace < maxInPlace && first != next : inPlace == count;
+        const bool bounded = dataset.bufferBytes() < fileBytes / 2;
+        printf("{\"benchmark\":\"streamingDataset/check\",\"size\":\"%s %ux784\",\"shards\":%zu,\"buffer_bytes\":%zu,"
+               "\"file_bytes\":%.0f,\"complete\":%s,\"reproducible\":%s,\"order_ok\":%s}\n",
+               mode, count, dataset.shardCount(), dataset.bufferBytes(), fileBytes, complete ? "true" : "false",
+               reproducible ? "true" : "false", orderOk ? "true" : "false");
+        if (!complete || !reproducible || !orderOk || !bounded)
+        {
+            LOG_ERROR("StreamingDataset %s epoch failed its checks", mode);
+            ok = false;
+        }
+
+        // Pixels plus labels per epoch; cold drops the files from the page cache first, so the reader hits the disk
+        for (const bool cold : {false, true})
+        {
+            runBenchmark(string("streamingDataset/") + (cold ? "cold" : "warm"), string(mode) + " " + to_string(count) + "x784", fileBytes, [&]
+                         {
+                             if (cold)
+                             {
+                                 for (const string &file : {imagesFile, labelsFile})
+                                 {
+                                     int fd = open(file.c_str(), O_RDONLY);
+                                     fdatasync(fd);
+                                     posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                                     close(fd);
+                                 }
+                             }
+                             const uint8_t *pixels;
+                             uint8_t label;
+                             uint64_t sum = 0;
+                             dataset.beginEpoch(shuffled ? &shuffler : nullptr);
+                             while (dataset.next(pixels, label))
+                                 sum += pixels[5] + label;
+                             asm volatile("" : : "r"(sum) : "memory"); });
+        }
+    }
+
+    runBenchmark("streamingDataset/loadMNISTImages", to_string(count) + "x784", fileBytes, [&]
+                 {
+                     auto images = loadMNISTImages(imagesFile, count);
+                     asm volatile("" : : "r"(images.data()) : "memory"); });
+    filesystem::remove(imagesFile);
+    filesystem::remove(labelsFile);
+    return ok;
+}
+
+void jsonRendering(mt19937 &gen)
+{
+    vector<vector<double>> probabilities(10, vector<double>(MNIST_POSSIBLE_DIGIT_OUTPUTS, 0.1));
+    for (size_t numRecords : {1, 10})
+    {
+        for (size_t numWeights : {7960, 101770})
+        {
+            vector<TrainingDatabase::TrainingRecord> records(numRecords);
+            for (size_t i = 0; i < numRecords; ++i)
+                records[i] = {static_cast<int>(i + 1), 0.5, makeVector(numWeights, gen)};
+
+            size_t outputBytes = HDE::renderTrainingJson(records, probabilities).size();
+            runBenchmark("renderTrainingJson", dims(numRecords, numWeights), static_cast<double>(outputBytes), [&]
+                         {
+                             string json = HDE::renderTrainingJson(records, probabilities);
+                             asm volatile("" : : "r"(json.data()) : "memory"); });
+        }
+    }
+}
+
+const string SMALL_REQUEST = "GET /models HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\n\r\n";
+
+// What a browser sends for a page: ~700 bytes of headers
+const string BROWSER_REQUEST =
+    "GET /jobs/12/events HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "Accept: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Origin: http://localhost:3000\r\n"
+    "Sec-Fetch-Site: same-site\r\n"
+    "Sec-Fetch-Mode: cors\r\n"
+    "Sec-Fetch-Dest: empty\r\n"
+    "Referer: http://localhost:3000/\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "\r\n";
+
+string predictJson(mt19937 &gen)
+{
+    const vector<uint8_t> image = makeImages(1, gen)[0];
+    string body = "{\"pixels\": [";
+    for (const uint8_t pixel : image)
+        body += to_string(pixel) + ",";
+    body.back() = ']';
+    return body + "}";
+}
+
+string predictRequest(const string &body)
+{
+    return "POST /models/mnist/predict HTTP/1.1\r\nHost: localhost:8080\r\nContent-Type: application/json\r\nContent-Length: " +
+           to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+string chunkedRequest(const string &body, size_t chunkBytes)
+{
+    string request = "POST /jobs HTTP/1.1\r\nHost: localhost:8080\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n";
+    char size[32];
+    for (size_t offset = 0; offset < body.size(); offset += chunkBytes)
+    {
+        const size_t length = min(chunkBytes, body.size() - offset);
+        snprintf(size, sizeof(size), "%zx\r\n", length);
+        request += size + body.substr(offset, length) + "\r\n";
+    }
+    return request + "0\r\n\r\n";
+}
+
+class HttpParserBenchmark
+{
+public:
+    static void parse(mt19937 &gen)
+    {
+        const string body = predictJson(gen);
+        const pair<const char *, string> requests[] = {
+            {"small", SMALL_REQUEST}, {"browser", BROWSER_REQUEST}, {"predict", predictRequest(body)}};
+        HDE::HttpParser parser;
+        for (const auto &[name, request] : requests)
+        {
+            string buffer = request;
+            runBenchmark("HttpParser::parse", name, static_cast<double>(buffer.size()), [&]
+                         {
+                             parser.reset();
+                             parser.parse(buffer.data(), buffer.size());
+                             asm volatile("" : : "r"(&parser) : "memory"); });
+        }
+
+        // Resuming costs little: each byte is still scanned once
+        string browser = BROWSER_REQUEST;
+        runBenchmark("HttpParser::parse", "browser/16-byte-reads", static_cast<double>(browser.size()), [&]
+                     {
+                         parser.reset();
+                         for (size_t length = 16; parser.getState() == HDE::HttpParser::State::Incomplete; length += 16)
+                             parser.parse(browser.data(), min(length, browser.size()));
+                         asm volatile("" : : "r"(&parser) : "memory"); });
+
+        // Decoding moves the body in place, so each run starts from a fresh copy (included in the time)
+        const string chunked = chunkedRequest(body, 256);
+        string buffer = chunked;
+        runBenchmark("HttpParser::parse", "chunked/256", static_cast<double>(chunked.size()), [&]
+                     {
+                         memcpy(buffer.data(), chunked.data(), chunked.size());
+                         parser.reset();
+                         parser.parse(buffer.data(), buffer.size());
+                         asm volatile("" : : "r"(&parser) : "memory"); });
+    }
+
+    /**
+     * @brief Differential fuzzing: random valid requests (any mix of CRLF and LF, optional whitespace, Content-Length
+     *        or chunked bodies with extensions and trailers) must parse to what was generated, and random mutations of
+     *        them must parse the same whether they arrive in one piece or split at random points across moving buffers.
+     *        Parsing must never allocate.
+     *
+     * @return False on any mismatch or allocation
+     */
+    static bool fuzz(mt19937 &gen)
+    {
+        const size_t validCases = 3000, mutatedCases = 30000;
+        uint64_t allocations = 0;
+        size_t failures[2] = {0, 0}; // valid, mutated
+        size_t outcomes[3] = {0, 0, 0};
+
+        auto check = [&](const string &kind, const string &raw, const string &expected, const string &actual, bool mutated)
+        {
+            if (expected == actual)
+                return;
+            if (++failures[mutated] <= 3)
+                LOG_ERROR("HttpParser %s mismatch for %zu-byte request:\n%s\nexpected: %s\nactual:   %s",
+                          kind.c_str(), raw.size(), raw.c_str(), expected.c_str(), actual.c_str());
+        };
+
+        for (size_t i = 0; i < validCases + mutatedCases; ++i)
+        {
+            string expected;
+            string raw = generateRequest(gen, expected);
+            if (i >= validCases)
+                mutate(raw, gen);
+
+            HDE::HttpParser parser;
+            string whole = raw;
+            allocations += countAllocations([&]
+                                            { parser.parse(whole.data(), whole.size()); });
+            const string oneShot = summarize(parser);
+            if (i < validCases)
+                check("valid request", raw, expected, oneShot, false);
+            else
+                ++outcomes[static_cast<int>(parser.getState())];
+
+            // Every step hands the parser a new buffer: the bytes it saw last time, possibly decoded, then new ones
+            parser.reset();
+            vector<char> buffer;
+            const bool byteAtATime = i % 50 == 0;
+            for (size_t length = 0; length < raw.size() && parser.getState() == HDE::HttpParser::State::Incomplete;)
+            {
+                const size_t next = byteAtATime ? length + 1 : uniform_int_distribution<size_t>(length + 1, raw.size())(gen);
+                vector<char> moved(buffer.begin(), buffer.end());
+                moved.insert(moved.end(), raw.begin() + static_cast<ptrdiff_t>(length), raw.begin() + static_cast<ptrdiff_t>(next));
+                buffer.swap(moved);
+                length = next;
+                allocations += countAllocations([&]
+                                                { parser.parse(buffer.data(), buffer.size()); });
+            }
+            check("split request", raw, oneShot, summarize(parser), i >= validCases);
+        }
+
+        printf("{\"benchmark\":\"HttpParserFuzz\",\"size\":\"valid\",\"cases\":%zu,\"failures\":%zu}\n", validCases, failures[0]);
+        printf("{\"benchmark\":\"HttpParserFuzz\",\"size\":\"mutated\",\"cases\":%zu,\"failures\":%zu,\"complete\":%zu,\"rejected\":%zu,\"incomplete\":%zu,\"allocations\":%llu}\n",
+               mutatedCases, failures[1], outcomes[static_cast<int>(HDE::HttpParser::State::Complete)],
+               outcomes[static_cast<int>(HDE::HttpParser::State::Error)], outcomes[static_cast<int>(HDE::HttpParser::State::Incomplete)],
+               static_cast<unsigned long long>(allocations));
+        if (allocations != 0)
+            LOG_ERROR("HttpParser made %llu heap allocations; expected none", static_cast<unsigned long long>(allocations));
+        return failures[0] == 0 && failures[1] == 0 && allocations == 0;
+    }
+
+private:
+    // Everything the parser reports, as one comparable string
+    static string summarize(const HDE::HttpParser &parser)
+    {
+        string summary = to_string(static_cast<int>(parser.getState())) + " " + to_string(parser.getErrorStatus());
+        if (parser.getState() != HDE::HttpParser::State::Complete)
+            return summary;
+        // Appended piece by piece: "literal" + temporary string trips a false -Wrestrict in GCC 12
+        for (string_view part : {parser.getMethod(), parser.getTarget(), parser.getVersion()})
+        {
+            summary += '|';
+            summary += part;
+        }
+        for (size_t i = 0; i < parser.getHeaderCount(); ++i)
+        {
+            HDE::HttpHeader header = parser.getHeader(i);
+            summary += '|';
+            summary += header.name;
+            summary += ':';
+            summary += header.value;
+        }
+        summary += "|body=";
+        summary += parser.getBody();
+        summary += '|';
+        summary += to_string(parser.getConsumed());
+        return summary;
+    }
+
+    static string randomString(mt19937 &gen, string_view alphabet, size_t minLength, size_t maxLength)
+    {
+        string text(uniform_int_distribution<size_t>(minLength, maxLength)(gen), ' ');
+        uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+        for (char &c : text)
+            c = alphabet[pick(gen)];
+        return text;
+    }
+
+    static string randomCase(string text, mt19937 &gen)
+    {
+        for (char &c : text)
+            if (gen() & 1)
+                c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        return text;
+    }
+
+    // A valid request, with the summary the parser should produce for it in `expected`
+    static string generateRequest(mt19937 &gen, string &expected)
+    {
+        const string_view methods[] = {"GET", "POST", "PUT", "DELETE", "OPTIONS", "PATCH"};
+        const string_view tokenChars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!#$%&'*+-.^_`|~";
+        const string_view targetChars = "abcdefghijklmnopqrstuvwxyz0123456789/_?=&%-.";
+        string valueChars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 \t\"(),/:;<=>?@[]{}\x80\xff";
+        auto eol = [&]
+        { return gen() % 4 == 0 ? "\n" : "\r\n"; };
+        auto whitespace = [&]
+        { return randomString(gen, " \t", 0, 2); };
+
+        const string method(methods[gen() % size(methods)]);
+        string target = "/";
+        target += randomString(gen, targetChars, 0, 40);
+        const string version = gen() % 4 == 0 ? "HTTP/1.0" : "HTTP/1.1";
+        string raw = gen() % 10 == 0 ? eol() : "";
+        raw += method + " " + target + " " + version + eol();
+        expected = "1 0|" + method + "|" + target + "|" + version;
+
+        const size_t headerCount = gen() % 20;
+        for (size_t i = 0; i < headerCount; ++i)
+        {
+            string name = randomString(gen, tokenChars, 1, 20);
+            if (HDE::equalsIgnoringCase(name, "content-length") || HDE::equalsIgnoringCase(name, "transfer-encoding"))
+                continue;
+            string value = randomString(gen, valueChars, 0, 60);
+            while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+                value.erase(value.begin());
+            while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+                value.pop_back();
+            raw += name + ":" + whitespace() + value + whitespace() + eol();
+            expected += "|" + name + ":" + value;
+        }
+
+        uniform_int_distribution<int> byte(0, 255);
+        string body(uniform_int_distribution<size_t>(0, 3000)(gen), '\0');
+        for (char &c : body)
+            c = static_cast<char>(byte(gen));
+
+        const int framing = static_cast<int>(gen() % 3);
+        if (framing == 0)
+        {
+            body.clear();
+            raw += eol();
+        }
+        else if (framing == 1)
+        {
+            const string name = randomCase("content-length", gen);
+            const string value = string(gen() % 3, '0') + to_string(body.size());
+            raw += name + ":" + whitespace() + value + whitespace() + eol() + eol() + body;
+            expected += "|" + name + ":" + value;
+        }
+        else
+        {
+            const string name = randomCase("transfer-encoding", gen);
+            const string value = randomCase("chunked", gen);
+            raw += name + ": " + value + eol() + eol();
+            expected += "|" + name + ":" + value;
+            for (size_t offset = 0; offset < body.size();)
+            {
+                const size_t length = min(uniform_int_distribution<size_t>(1, 700)(gen), body.size() - offset);
+                char size[32];
+                snprintf(size, sizeof(size), gen() & 1 ? "%zx" : "%zX", length);
+                raw += string(gen() % 2, '0') + size + (gen() % 4 == 0 ? ";name=\"value\"" : "") + eol();
+                raw += body.substr(offset, length) + eol();
+                offset += length;
+            }
+            raw += string("0") + eol();
+            if (gen() % 4 == 0)
+                raw += "Trailer-Field: " + randomString(gen, valueChars, 0, 20) + eol();
+            raw += eol();
+        }
+        expected += "|body=" + body + "|" + to_string(raw.size());
+        return raw;
+    }
+
+    // Flips, inserts, deletes or truncates a few bytes, favouring the bytes the syntax hinges on
+    static void mutate(string &raw, mt19937 &gen)
+    {
+        const string_view interesting = "\r\n :;\t\0-0fF"sv;
+        const int mutations = 1 + static_cast<int>(gen() % 4);
+        for (int m = 0; m < mutations && !raw.empty(); ++m)
+        {
+            const size_t position = gen() % raw.size();
+            const char value = gen() % 2 ? interesting[gen() % interesting.size()] : static_cast<char>(gen());
+            switch (gen() % 4)
+            {
+            case 0:
+                raw[position] = value;
+                break;
+            case 1:
+                raw.insert(raw.begin() + static_cast<ptrdiff_t>(position), value);
+                break;
+            case 2:
+                raw.erase(position, 1);
+                break;
+            default:
+                raw.resize(position);
+                break;
+            }
+        }
+    }
+};
+
+/**
+ * Prints one JSON object per benchmark and size, e.g.
+ * {"benchmark":"softmax","size":"10","iterations":4194304,"ns_per_op":61.2,"gb_per_s":2.614,"allocs_per_op":1.00}
+ * An optional argument restricts the run to benchmarks whose name contains it.
+ * Exits with status 1 if fastMath or softmaxCrossEntropy exceed their error bounds, if steadyStateAllocations finds
+ * a heap allocation in the inference or training loops, if modelFile finds a mapped model that copies its transposed
+ * first layer or predicts differently, if batchInference finds a batched result that differs from a single-image
+ * one, if trainResume finds a resumed run that differs from an uninterrupted one, if
+ * streamingDataset loses, repeats or mislabels a sample, if workStealingPool loses a task, if sweepSmallGrid ends
+ * without a completed trial, or if
+ * HttpParserFuzz finds a mismatch or an allocation.
+ */
+int main(int argc, char *argv[])
+{
+    // Keep stdout machine-readable
+    Logging::Logger::instance().setSink(stderr, Logging::SinkFormat::Text);
+    Logging::setLevel(Logging::Level::Error);
+    filesystem::create_directories(BENCH_DIR);
+
+    string filter = argc > 1 ? argv[1] : "";
+    auto selected = [&](const string &name)
+    { return filter.empty() || name.find(filter) != string::npos; };
+
+    mt19937 gen(42);
+    bool ok = true;
+    if (selected("computeLayerActivation"))
+        FFNeuralNetBenchmark::layerActivation(gen);
+    if (selected("softmax"))
+        FFNeuralNetBenchmark::softmax(gen);
+    if (selected("fastMath"))
+        ok = FFNeuralNetBenchmark::fastMath(gen) && ok;
+    if (selected("softmaxCrossEntropy"))
+        ok = FFNeuralNetBenchmark::softmaxCrossEntropy(gen) && ok;
+    if (selected("applyBackpropagation"))
+        FFNeuralNetBenchmark::backpropagation(gen);
+    if (selected("optimizerStep"))
+        FFNeuralNetBenchmark::optimizerStep();
+    if (selected("performForwardPass"))
+        FFNeuralNetBenchmark::forwardPass(gen);
+    if (selected("sparseInput"))
+        FFNeuralNetBenchmark::sparseInput(gen);
+    if (selected("modelFile"))
+        ok = FFNeuralNetBenchmark::modelFile(gen) && ok;
+    if (selected("staticForwardPass"))
+        FFNeuralNetBenchmark::staticForwardPass(gen);
+    if (selected("batchInference"))
+        ok = FFNeuralNetBenchmark::batchInference(gen) && ok;
+    if (selected("steadyStateAllocations"))
+        ok = FFNeuralNetBenchmark::steadyStateAllocations(gen) && ok;
+    if (selected("trainEpoch"))
+        FFNeuralNetBenchmark::trainingEpoch(gen);
+    if (selected("trainResume"))
+        ok = FFNeuralNetBenchmark::trainResume(gen) && ok;
+    if (selected("numaPlacement"))
+        FFNeuralNetBenchmark::numaPlacement(gen);
+    if (selected("TrainingDatabase"))
+        trainingDatabase(gen);
+    if (selected("streamingDataset"))
+        ok = streamingDataset(gen) && ok;
+    if (selected("workStealingPool"))
+        ok = workStealingPool() && ok;
+    if (selected("sweepSmallGrid"))
+        ok = sweepSmallGrid(gen) && ok;
+    if (selected("renderTrainingJson"))
+        jsonRendering(gen);
+    if (selected("HttpParser::parse"))
+        HttpParserBenchmark::parse(gen);
+    if (selected("HttpParserFuzz"))
+        ok = HttpParserBenchmark::fuzz(gen) && ok;
+
+    filesystem::remove_all(BENCH_DIR);
+    return ok ? 0 : 1;
+}
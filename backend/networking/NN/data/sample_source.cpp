@@ -0,0 +1,29 @@
+#include "sample_source.hpp"
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+NNData::InMemorySamples::InMemorySamples(const vector<vector<uint8_t>> &images, const vector<uint8_t> &labels)
+    : images{images}, labels{labels}, order(min(images.size(), labels.size()))
+{
+}
+
+bool NNData::InMemorySamples::beginEpoch(mt19937_64 *shuffler)
+{
+    iota(order.begin(), order.end(), size_t{0});
+    if (shuffler)
+        shuffle(order.begin(), order.end(), *shuffler);
+    position = 0;
+    return true;
+}
+
+bool NNData::InMemorySamples::next(const uint8_t *&pixels, uint8_t &label)
+{
+    if (position == order.size())
+        return false;
+    const size_t sample = order[position++];
+    pixels = images[sample].data();
+    label = labels[sample];
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef NN_SAMPLE_SOURCE_HPP
+#define NN_SAMPLE_SOURCE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace NNData
+{
+    /**
+     * @brief Training samples, read one epoch at a time from first to last. FFNeuralNet::train pulls every sample
+     *        through this interface, so the dataset may be held in memory or streamed from disk.
+     */
+    class SampleSource
+    {
+    public:
+        virtual ~SampleSource() = default;
+        // Samples per epoch
+        virtual size_t size() const = 0;
+        // Pixels per sample
+        virtual size_t sampleBytes() const = 0;
+
+        /**
+         * @brief Starts a new epoch, abandoning whatever is left of the current one
+         *
+         * @param shuffler  Generator a shuffling source draws the epoch's order from, or nullptr for file order.
+         *                  Starting from the same generator state gives the same order, which is how checkpoints resume.
+         * @return False if the data cannot be read
+         */
+        virtual bool beginEpoch(std::mt19937_64 *shuffler) = 0;
+
+        // The epoch's next sample; `pixels` stays valid until the following call. False after the last sample or on a read error.
+        virtual bool next(const uint8_t *&pixels, uint8_t &label) = 0;
+    };
+
+    // Samples already in memory and owned by the caller; a shuffled epoch visits them in a random permutation
+    class InMemorySamples : public SampleSource
+    {
+        const std::vector<std::vector<uint8_t>> &images;
+        const std::vector<uint8_t> &labels;
+        std::vector<size_t> order;
+        size_t position = 0;
+
+    public:
+        InMemorySamples(const std::vector<std::vector<uint8_t>> &images, const std::vector<uint8_t> &labels);
+        size_t size() const override { return order.size(); }
+        size_t sampleBytes() const override { return images.empty() ? 0 : images[0].size(); }
+        bool beginEpoch(std::mt19937_64 *shuffler) override;
+        bool next(const uint8_t *&pixels, uint8_t &label) override;
+    };
+}
+
+#endif
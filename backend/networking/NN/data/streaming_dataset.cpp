@@ -0,0 +1,322 @@
+#include "streaming_dataset.hpp"
+#include "../../Logging/Logger.hpp"
+#include "../../Tracing/Trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <numeric>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    constexpr uint32_t IDX_IMAGES_MAGIC = 0x803; // unsigned bytes, 3 dimensions
+    constexpr uint32_t IDX_LABELS_MAGIC = 0x801; // unsigned bytes, 1 dimension
+    constexpr off_t IDX_IMAGES_HEADER_BYTES = 16;
+    constexpr off_t IDX_LABELS_HEADER_BYTES = 8;
+
+    // Reads `count` big-endian 32-bit header fields at the start of an IDX file
+    bool readHeader(int fd, uint32_t *fields, size_t count)
+    {
+        if (pread(fd, fields, count * sizeof(uint32_t), 0) != static_cast<ssize_t>(count * sizeof(uint32_t)))
+            return false;
+        for (size_t i = 0; i < count; ++i)
+            fields[i] = __builtin_bswap32(fields[i]);
+        return true;
+    }
+
+    bool readFully(int fd, uint8_t *data, size_t bytes, off_t offset)
+    {
+        while (bytes > 0)
+        {
+            ssize_t result = pread(fd, data, bytes, offset);
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result <= 0)
+                return false;
+            data += result;
+            bytes -= static_cast<size_t>(result);
+            offset += result;
+        }
+        return true;
+    }
+
+    uint64_t fileSize(int fd)
+    {
+        struct stat info;
+        return fstat(fd, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+    }
+}
+
+NNData::StreamingDataset::StreamingDataset(StreamingConfig config)
+    : config(config),
+      bytesRead(Metrics::Registry::instance().counter("nn_dataset_bytes_read_total", "Bytes of training images and labels read by streaming datasets.")),
+      shardWait(Metrics::Registry::instance().histogram("nn_dataset_shard_wait_seconds", "Time training waited for the reader to finish the next shard of a streaming dataset."))
+{
+    this->config.shardSamples = max<size_t>(1, config.shardSamples);
+    this->config.readaheadShards = max<size_t>(1, config.readaheadShards);
+}
+
+NNData::StreamingDataset::~StreamingDataset()
+{
+    close();
+}
+
+/**
+ * @brief Opens an IDX image file (magic 0x803) and label file (magic 0x801) and checks that both hold every sample
+ *        their headers announce
+ *
+ * @param imagesFile  IDX images, e.g. train-images.idx3-ubyte
+ * @param labelsFile  IDX labels, e.g. train-labels.idx1-ubyte
+ *
+ * @return True if both files are usable; the dataset then has min(image count, label count, maxSamples) samples
+ */
+bool NNData::StreamingDataset::open(const string &imagesFile, const string &labelsFile)
+{
+    close();
+    imagesFd = ::open(imagesFile.c_str(), O_RDONLY | O_CLOEXEC);
+    labelsFd = ::open(labelsFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (imagesFd < 0 || labelsFd < 0)
+    {
+        LOG_ERROR("StreamingDataset: cannot open %s: %s", (imagesFd < 0 ? imagesFile : labelsFile).c_str(), strerror(errno));
+        close();
+        return false;
+    }
+
+    uint32_t imageHeader[4], labelHeader[2];
+    if (!readHeader(imagesFd, imageHeader, 4) || imageHeader[0] != IDX_IMAGES_MAGIC ||
+        !readHeader(labelsFd, labelHeader, 2) || labelHeader[0] != IDX_LABELS_MAGIC)
+    {
+        LOG_ERROR("StreamingDataset: %s or %s is not an IDX image/label file", imagesFile.c_str(), labelsFile.c_str());
+        close();
+        return false;
+    }
+
+    pixelsPerSample = static_cast<size_t>(imageHeader[2]) * imageHeader[3];
+    samples = min<size_t>(imageHeader[1], labelHeader[1]);
+    if (config.maxSamples > 0)
+        samples = min(samples, config.maxSamples);
+    if (pixelsPerSample == 0 ||
+        fileSize(imagesFd) < IDX_IMAGES_HEADER_BYTES + static_cast<uint64_t>(samples) * pixelsPerSample ||
+        fileSize(labelsFd) < IDX_LABELS_HEADER_BYTES + static_cast<uint64_t>(samples))
+    {
+        LOG_ERROR("StreamingDataset: %s or %s is shorter than its header says", imagesFile.c_str(), labelsFile.c_str());
+        close();
+        return false;
+    }
+    this->imagesFile = imagesFile;
+
+    // Each shard is read front to back, so a larger kernel readahead window helps even when shards are shuffled
+    posix_fadvise(imagesFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(labelsFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    const size_t shardSamples = min(config.shardSamples, max<size_t>(1, samples));
+    ring.assign(config.readaheadShards + 1, Shard{});
+    for (Shard &shard : ring)
+    {
+        shard.pixels.resize(shardSamples * pixelsPerSample);
+        shard.labels.resize(shardSamples);
+    }
+    shardOrder.resize((samples + shardSamples - 1) / shardSamples);
+    const size_t mixSamples = config.shuffleBufferSamples > 1 ? config.shuffleBufferSamples : 0;
+    mixPixels.resize(mixSamples * pixelsPerSample);
+    mixLabels.resize(mixSamples);
+    emitted.resize(pixelsPerSample);
+    config.shardSamples = shardSamples;
+
+    LOG_INFO("Streaming %zu samples of %zu pixels from %s in %zu shards, buffers %zu KiB",
+             samples, pixelsPerSample, imagesFile.c_str(), shardOrder.size(), bufferBytes() / 1024);
+    return true;
+}
+
+void NNData::StreamingDataset::close()
+{
+    stopReading();
+    if (imagesFd >= 0)
+        ::close(imagesFd);
+    if (labelsFd >= 0)
+        ::close(labelsFd);
+    imagesFd = labelsFd = -1;
+    samples = 0;
+    shardOrder.clear();
+}
+
+size_t NNData::StreamingDataset::bufferBytes() const
+{
+    size_t bytes = mixPixels.size() + mixLabels.size() + emitted.size();
+    for (const Shard &shard : ring)
+        bytes += shard.pixels.size() + shard.labels.size();
+    return bytes;
+}
+
+void NNData::StreamingDataset::stopReading()
+{
+    if (!reader.joinable())
+        return;
+    {
+        lock_guard<mutex> lock(ringMutex);
+        stopReader = true;
+    }
+    ringChanged.notify_all();
+    reader.join();
+}
+
+/**
+ * @brief Starts an epoch: fixes the shard order, seeds the shuffle buffer and starts the reader thread
+ *
+ * @param shuffler  Generator for the shard order and the shuffle buffer's seed, or nullptr to read in file order
+ */
+bool NNData::StreamingDataset::beginEpoch(mt19937_64 *shuffler)
+{
+    if (imagesFd < 0)
+        return false;
+    stopReading();
+
+    iota(shardOrder.begin(), shardOrder.end(), 0u);
+    mixing = shuffler && !mixLabels.empty();
+    if (shuffler)
+    {
+        shuffle(shardOrder.begin(), shardOrder.end(), *shuffler);
+        mixer.seed((*shuffler)());
+    }
+    produced = consumed = 0;
+    stopReader = readFailed = false;
+    current = nullptr;
+    currentIndex = 0;
+    mixCount = 0;
+    sourceDone = false;
+    reader = thread(&StreamingDataset::readShards, this);
+    return true;
+}
+
+// Reader thread: reads the epoch's shards in order, each into the next ring slot once training has released it
+void NNData::StreamingDataset::readShards()
+{
+    for (size_t k = 0; k < shardOrder.size(); ++k)
+    {
+        {
+            unique_lock<mutex> lock(ringMutex);
+            ringChanged.wait(lock, [&]
+                             { return stopReader || k - consumed < ring.size(); });
+            if (stopReader)
+                return;
+        }
+        if (k + 1 < shardOrder.size())
+            prefetchShard(shardOrder[k + 1]);
+        const bool ok = readShard(shardOrder[k], ring[k % ring.size()]);
+        {
+            lock_guard<mutex> lock(ringMutex);
+            if (ok)
+                produced = k + 1;
+            else
+                readFailed = true;
+        }
+        ringChanged.notify_all();
+        if (!ok)
+            return;
+    }
+}
+
+bool NNData::StreamingDataset::readShard(uint32_t shard, Shard &buffer)
+{
+    TRACE_SPAN("dataset.readShard");
+    const size_t first = static_cast<size_t>(shard) * config.shardSamples;
+    buffer.count = min(config.shardSamples, samples - first);
+    const size_t pixelBytes = buffer.count * pixelsPerSample;
+    errno = 0;
+    if (!readFully(imagesFd, buffer.pixels.data(), pixelBytes, IDX_IMAGES_HEADER_BYTES + static_cast<off_t>(first * pixelsPerSample)) ||
+        !readFully(labelsFd, buffer.labels.data(), buffer.count, IDX_LABELS_HEADER_BYTES + static_cast<off_t>(first)))
+    {
+        LOG_ERROR("StreamingDataset: failed to read shard %u of %s: %s", shard, imagesFile.c_str(), errno ? strerror(errno) : "unexpected end of file");
+        return false;
+    }
+    bytesRead.add(pixelBytes + buffer.count);
+    return true;
+}
+
+// Asks the kernel to start reading a shard in the background while the current one is being read
+void NNData::StreamingDataset::prefetchShard(uint32_t shard) const
+{
+    const size_t first = static_cast<size_t>(shard) * config.shardSamples;
+    const size_t count = min(config.shardSamples, samples - first);
+    posix_fadvise(imagesFd, IDX_IMAGES_HEADER_BYTES + static_cast<off_t>(first * pixelsPerSample), static_cast<off_t>(count * pixelsPerSample), POSIX_FADV_WILLNEED);
+    posix_fadvise(labelsFd, IDX_LABELS_HEADER_BYTES + static_cast<off_t>(first), static_cast<off_t>(count), POSIX_FADV_WILLNEED);
+}
+
+// Next sample in shard order; releases each shard to the reader once every sample in it has been handed out
+bool NNData::StreamingDataset::nextFromShards(const uint8_t *&pixels, uint8_t &label)
+{
+    while (!current || currentIndex == current->count)
+    {
+        unique_lock<mutex> lock(ringMutex);
+        if (current)
+        {
+            ++consumed;
+            current = nullptr;
+            ringChanged.notify_all();
+        }
+        if (consumed == shardOrder.size())
+            return false;
+        if (produced <= consumed && !readFailed)
+        {
+            Metrics::ScopedTimer timer(shardWait);
+            ringChanged.wait(lock, [&]
+                             { return produced > consumed || readFailed; });
+        }
+        if (produced <= consumed)
+            return false;
+        current = &ring[consumed % ring.size()];
+        currentIndex = 0;
+    }
+    pixels = current->pixels.data() + currentIndex * pixelsPerSample;
+    label = current->labels[currentIndex];
+    ++currentIndex;
+    return true;
+}
+
+bool NNData::StreamingDataset::next(const uint8_t *&pixels, uint8_t &label)
+{
+    if (!mixing)
+        return nextFromShards(pixels, label);
+
+    const size_t capacity = mixLabels.size();
+    const uint8_t *incoming;
+    uint8_t incomingLabel;
+    // Fill the shuffle buffer before handing out the first sample of the epoch
+    while (!sourceDone && mixCount < capacity)
+    {
+        if (!nextFromShards(incoming, incomingLabel))
+        {
+            sourceDone = true;
+            break;
+        }
+        memcpy(mixPixels.data() + mixCount * pixelsPerSample, incoming, pixelsPerSample);
+        mixLabels[mixCount++] = incomingLabel;
+    }
+    if (mixCount == 0)
+        return false;
+
+    // Hand out a random waiting sample and put the next incoming one (or, at the end, the last waiting one) in its place
+    const size_t pick = uniform_int_distribution<size_t>(0, mixCount - 1)(mixer);
+    uint8_t *slot = mixPixels.data() + pick * pixelsPerSample;
+    memcpy(emitted.data(), slot, pixelsPerSample);
+    label = mixLabels[pick];
+    if (!sourceDone && nextFromShards(incoming, incomingLabel))
+    {
+        memcpy(slot, incoming, pixelsPerSample);
+        mixLabels[pick] = incomingLabel;
+    }
+    else
+    {
+        sourceDone = true;
+        --mixCount;
+        memcpy(slot, mixPixels.data() + mixCount * pixelsPerSample, pixelsPerSample);
+        mixLabels[pick] = mixLabels[mixCount];
+    }
+    pixels = emitted.data();
+    return true;
+}
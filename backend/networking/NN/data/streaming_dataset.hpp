@@ -0,0 +1,103 @@
+#ifndef NN_STREAMING_DATASET_HPP
+#define NN_STREAMING_DATASET_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sample_source.hpp"
+#include "../../Metrics/Metrics.hpp"
+
+namespace NNData
+{
+    struct StreamingConfig
+    {
+        size_t shardSamples = 4096;         // samples per shard, the unit that is read (one pread per file) and shuffled
+        size_t readaheadShards = 2;         // shards the reader thread may have ready ahead of training
+        size_t shuffleBufferSamples = 8192; // samples mixed across shard boundaries in a shuffled epoch; 0 or 1 disables
+        size_t maxSamples = 0;              // use only the first maxSamples samples; 0 for all
+    };
+
+    /**
+     * @brief Out-of-core dataset over an IDX image file and its IDX label file, e.g. MNIST or EMNIST. The samples are
+     *        split into shards of consecutive samples. A reader thread reads each epoch's shards in large sequential
+     *        preads into a fixed ring of buffers, at most readaheadShards ahead of training, with the kernel asked to
+     *        prefetch the shard after that. A shuffled epoch visits the shards in a random order and passes the samples
+     *        through a shuffle buffer, which mixes them across shard boundaries.
+     *
+     *        Memory use is bufferBytes() whatever the size of the dataset. Not thread-safe: one trainer per dataset.
+     */
+    class StreamingDataset : public SampleSource
+    {
+        struct Shard
+        {
+            std::vector<uint8_t> pixels;
+            std::vector<uint8_t> labels;
+            size_t count = 0;
+        };
+
+        StreamingConfig config;
+        int imagesFd = -1;
+        int labelsFd = -1;
+        std::string imagesFile;
+        size_t samples = 0;
+        size_t pixelsPerSample = 0;
+
+        // The reader fills the k-th shard of the epoch into ring[k % ring.size()]; training releases it when done
+        std::vector<Shard> ring;
+        std::vector<uint32_t> shardOrder;
+        std::thread reader;
+        std::mutex ringMutex;
+        std::condition_variable ringChanged;
+        size_t produced = 0; // shards of this epoch read so far
+        size_t consumed = 0; // shards of this epoch training has finished with
+        bool stopReader = false;
+        bool readFailed = false;
+
+        const Shard *current = nullptr;
+        size_t currentIndex = 0;
+
+        // Shuffle buffer: `mixCount` samples waiting in mixPixels/mixLabels; next() hands out a random one
+        bool mixing = false;
+        bool sourceDone = false;
+        std::mt19937_64 mixer;
+        std::vector<uint8_t> mixPixels;
+        std::vector<uint8_t> mixLabels;
+        size_t mixCount = 0;
+        std::vector<uint8_t> emitted;
+
+        Metrics::Counter &bytesRead;
+        Metrics::Histogram &shardWait;
+
+        void readShards();
+        bool readShard(uint32_t shard, Shard &buffer);
+        void prefetchShard(uint32_t shard) const;
+        void stopReading();
+        bool nextFromShards(const uint8_t *&pixels, uint8_t &label);
+
+    public:
+        explicit StreamingDataset(StreamingConfig config = {});
+        ~StreamingDataset();
+        StreamingDataset(const StreamingDataset &) = delete;
+        StreamingDataset &operator=(const StreamingDataset &) = delete;
+
+        // Opens and checks both IDX files and allocates the buffers; logs the error and returns false if either is unusable
+        bool open(const std::string &imagesFile, const std::string &labelsFile);
+        void close();
+
+        size_t size() const override { return samples; }
+        size_t sampleBytes() const override { return pixelsPerSample; }
+        size_t shardCount() const { return shardOrder.size(); }
+        // Shard buffers, shuffle buffer and the handed-out sample
+        size_t bufferBytes() const;
+
+        bool beginEpoch(std::mt19937_64 *shuffler) override;
+        bool next(const uint8_t *&pixels, uint8_t &label) override;
+    };
+}
+
+#endif
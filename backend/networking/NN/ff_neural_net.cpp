@@ -1,98 +1,339 @@
 #include "ff_neural_net.hpp"
 #include "../Database/Database.hpp"
+#include "../Logging/Logger.hpp"
+#include "../Metrics/Metrics.hpp"
+#include "../Tracing/Trace.hpp"
+#include "model/checkpoint.hpp"
+#include <algorithm>
 #include <vector>
 #include <cmath>
 #include <functional>
 #include <fstream>
 #include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <sstream>
 
 using namespace std;
 
+/**
+ * @brief Workspace buffers for one network topology, all carved from a single arena allocation
+ *
+ * @param inputSize      Number of neurons in the input layer
+ * @param hiddenSize     Number of neurons in the hidden layer
+ * @param outputSize     Number of neurons in the output layer
+ * @param batchCapacity  Largest batch passed to performForwardPassBatch with this workspace
+ */
+FFNeuralNet::Workspace::Workspace(size_t inputSize, size_t hiddenSize, size_t outputSize, size_t batchCapacity)
+    : inputSize{inputSize}, hiddenSize{hiddenSize}, outputSize{outputSize}, batchCapacity{max<size_t>(1, batchCapacity)},
+      arena{NNUtils::Arena::bytesFor<double>(this->batchCapacity * inputSize) +
+            NNUtils::Arena::bytesFor<uint32_t>(inputSize) + NNUtils::Arena::bytesFor<double>(inputSize) +
+            NNUtils::Arena::bytesFor<double>(this->batchCapacity * hiddenSize) +
+            3 * NNUtils::Arena::bytesFor<double>(outputSize) + NNUtils::Arena::bytesFor<double>(hiddenSize) +
+            NNUtils::Arena::bytesFor<size_t>(this->batchCapacity)}
+{
+    inputNormalized = arena.allocate<double>(this->batchCapacity * inputSize);
+    sparseInput.indices = arena.allocate<uint32_t>(inputSize);
+    sparseInput.values = arena.allocate<double>(inputSize);
+    hidden = arena.allocate<double>(this->batchCapacity * hiddenSize);
+    logits = arena.allocate<double>(outputSize);
+    probabilities = arena.allocate<double>(outputSize);
+    outputError = arena.allocate<double>(outputSize);
+    hiddenError = arena.allocate<double>(hiddenSize);
+    denseImages = arena.allocate<size_t>(this->batchCapacity);
+}
+
+bool FFNeuralNet::Workspace::fits(const FFNeuralNet &net, size_t batchSize) const
+{
+    return inputSize == net.inputSize && hiddenSize == net.hiddenSize && outputSize == net.outputSize && batchSize <= batchCapacity;
+}
+
+/**
+ * @brief Workspace of the calling thread for the convenience forward passes, recreated only when the topology or a
+ *        larger batch needs more room
+ *
+ * @param batchSize  Number of images the caller is about to run
+ */
+FFNeuralNet::Workspace &FFNeuralNet::threadWorkspace(size_t batchSize) const
+{
+    thread_local unique_ptr<Workspace> workspace;
+    if (!workspace || !workspace->fits(*this, batchSize))
+        workspace = make_unique<Workspace>(inputSize, hiddenSize, outputSize, batchSize);
+    return *workspace;
+}
+
 /**
  * @brief Forward pass for a single layer
  *
  * @param input                 Input vector from the previous layer (or input layer)
- * @param weights               Weight matrix with dimensions: (current layer size x previous layer size)
+ * @param inputCount            Number of entries in `input`
+ * @param weights               Row-major weight matrix with dimensions: (current layer size x previous layer size)
  * @param biases                Bias vector for the current layer
+ * @param outputSize            Number of neurons in the current layer
  * @param activationFunction    Activation function to be applied to the weighted sum + bias for each row of the weight matrix
+ * @param output                Receives the `outputSize` activations of the current layer
+ */
+void FFNeuralNet::computeLayerActivation(
+    const double *input,
+    size_t inputCount,
+    const double *weights,
+    const double *biases,
+    size_t outputSize,
+    function<double(double)> activationFunction,
+    double *output) const
+{
+    const size_t cols = inputCount;
+    for (size_t i = 0; i < outputSize; ++i)
+    {
+        const double *row = weights + i * cols;
+        double sum = 0.0;
+        for (size_t j = 0; j < cols; ++j)
+        {
+            sum += row[j] * input[j];
+        }
+        output[i] = activationFunction(sum + biases[i]);
+    }
+}
+
+/**
+ * @brief Collects the nonzero pixels of an image, so the first layer only touches their weight columns
  *
- * @return Output vector for the current layer
+ * @param input   Image as pixel bytes
+ * @param size    Number of pixels
+ * @param sparse  Receives the nonzero indices and their normalized values; its buffers must hold `size` entries
  */
-vector<double> FFNeuralNet::computeLayerActivation(
-    const vector<double> &input,
-    const vector<vector<double>> &weights,
-    vector<double> &biases,
-    function<double(double)> activationFunction)
+void FFNeuralNet::compactInput(const uint8_t *input, size_t size, SparseInput &sparse)
 {
-    vector<double> output(weights.size(), 0.0);
-    for (size_t i = 0; i < weights.size(); ++i)
+    size_t count = 0;
+    for (size_t i = 0; i < size; ++i)
     {
-        for (size_t j = 0; j < input.size(); ++j)
+        if (input[i] != 0)
         {
-            output[i] += weights[i][j] * input[j];
+            sparse.indices[count] = static_cast<uint32_t>(i);
+            sparse.values[count] = static_cast<double>(input[i]) / 255.0;
+            ++count;
         }
-        output[i] += biases[i];
-        output[i] = activationFunction(output[i]);
     }
-    return output;
+    sparse.count = count;
+}
+
+bool FFNeuralNet::useSparseInput(size_t nonzeros) const
+{
+    switch (inputMode)
+    {
+    case InputMode::Dense:
+        return false;
+    case InputMode::Sparse:
+        return true;
+    case InputMode::Auto:
+    default:
+        return static_cast<double>(nonzeros) <= SPARSE_DENSITY_THRESHOLD * static_cast<double>(inputSize);
+    }
 }
 
 /**
- * @brief Backpropagation algorithm to update weights and biases
+ * @brief Input-to-hidden weights in (input x hidden) order: the mapped model file's own copy if it has one, otherwise
+ *        built from the current parameters on first use
  *
- * @param inputNormalized      Normalized input vector used in the forward pass
- * @param hiddenToOutputLayerActivation    Output vector of the hidden layer from the forward pass
- * @param outputLayerProbability    Output probability vector from the output layer (after softmax) from the forward pass
- * @param actualLabel            Correct class label for the input
- * @param learningRate         Control magnitude of weight and bias updates
+ * @return Pointer to inputSize * hiddenSize weights, where pixel i's weights are at [i * hiddenSize, (i + 1) * hiddenSize)
  */
-void FFNeuralNet::applyBackpropagation(
-    const vector<double> &inputNormalized,
-    const vector<double> &hiddenToOutputLayerActivation,
-    const vector<double> &outputLayerProbability,
-    int actualLabel,
-    double learningRate)
+const double *FFNeuralNet::transposedHiddenWeights() const
 {
-    vector<double> output_error(outputLayerProbability.size());
+    if (mappedModel && mappedModel->transposedFirstLayer())
+        return mappedModel->transposedFirstLayer();
+
+    TransposedWeights &cache = *transposedInputWeights;
+    if (cache.ready.load(memory_order_acquire))
+        return cache.weights.data();
 
-    for (size_t j = 0; j < outputLayerProbability.size(); ++j)
+    lock_guard<mutex> lock(cache.buildMutex);
+    if (!cache.ready.load(memory_order_relaxed))
     {
-        // dL/dz
-        output_error[j] = outputLayerProbability[j] - (j == actualLabel ? 1.0 : 0.0);
+        const double *weights = inputToHiddenLayerWeights();
+        cache.weights.resize(inputSize * hiddenSize);
+        for (size_t j = 0; j < hiddenSize; ++j)
+        {
+            for (size_t i = 0; i < inputSize; ++i)
+            {
+                cache.weights[i * hiddenSize + j] = weights[j * inputSize + i];
+            }
+        }
+        cache.ready.store(true, memory_order_release);
     }
+    return cache.weights.data();
+}
 
-    // Gradients descent to update weights and biases in Lth layer (hidden-to-output) weights and biases
-    for (size_t j = 0; j < hiddenToOutputLayerWeights.size(); ++j)
+/**
+ * @brief Hidden layer for a sparse input using the transposed weights: one contiguous, vectorizable
+ *        hidden-sized update per nonzero pixel
+ *
+ * @param input   Nonzero pixels of the image
+ * @param hidden  Receives the hidden layer activations (after ReLU)
+ */
+void FFNeuralNet::computeHiddenActivationSparse(const SparseInput &input, double *hidden) const
+{
+    const double *transposed = transposedHiddenWeights();
+    const double *biases = hiddenLayerBiases();
+    double *__restrict out = hidden;
+    copy(biases, biases + hiddenSize, out);
+    for (size_t k = 0; k < input.count; ++k)
     {
-        for (size_t k = 0; k < hiddenToOutputLayerActivation.size(); ++k)
+        const double *__restrict column = transposed + static_cast<size_t>(input.indices[k]) * hiddenSize;
+        const double value = input.values[k];
+        for (size_t j = 0; j < hiddenSize; ++j)
         {
-            hiddenToOutputLayerWeights[j][k] -= learningRate * output_error[j] * hiddenToOutputLayerActivation[k];
+            out[j] += value * column[j];
         }
-        outputLayerBiases[j] -= learningRate * output_error[j];
     }
+    for (size_t j = 0; j < hiddenSize; ++j)
+    {
+        out[j] = NNUtils::ActivationFunctions::relu(out[j]);
+    }
+}
 
-    vector<double> hidden_error(hiddenToOutputLayerActivation.size(), 0.0);
-    for (size_t j = 0; j < hiddenToOutputLayerActivation.size(); ++j)
+/**
+ * @brief Hidden layer for a sparse input that reads the row-major weights directly. Used in training, where the
+ *        weights change every step and keeping a transposed copy current would cost a full pass per update.
+ *
+ * @param input   Nonzero pixels of the image
+ * @param hidden  Receives the hidden layer activations (after ReLU)
+ */
+void FFNeuralNet::computeHiddenActivationGather(const SparseInput &input, double *hidden) const
+{
+    const double *weights = inputToHiddenLayerWeights();
+    const double *biases = hiddenLayerBiases();
+    const size_t nonzeros = input.count;
+    for (size_t j = 0; j < hiddenSize; ++j)
     {
-        hidden_error[j] = 0.0;
+        const double *row = weights + j * inputSize;
+        double sum = 0.0;
+        for (size_t k = 0; k < nonzeros; ++k)
+        {
+            sum += row[input.indices[k]] * input.values[k];
+        }
+        hidden[j] = NNUtils::ActivationFunctions::relu(sum + biases[j]);
+    }
+}
+
+/**
+ * @brief Output layer logits for one image
+ *
+ * @param hidden  Hidden layer activations
+ * @param logits  Receives the outputSize logits
+ */
+void FFNeuralNet::computeOutputLogits(const double *hidden, double *logits) const
+{
+    computeLayerActivation(hidden, hiddenSize, hiddenToOutputLayerWeights(), outputLayerBiases(), outputSize,
+                           [](double x)
+                           { return x; },
+                           logits);
+}
 
-        for (size_t k = 0; k < outputLayerProbability.size(); ++k)
+/**
+ * @brief Output layer and softmax for one image
+ *
+ * @param hidden     Hidden layer activations
+ * @param workspace  Receives the logits and the probabilities
+ */
+void FFNeuralNet::computeOutputProbabilities(const double *hidden, Workspace &workspace) const
+{
+    computeOutputLogits(hidden, workspace.logits);
+    NNUtils::ActivationFunctions::softmax(workspace.logits, workspace.probabilities, outputSize);
+}
+
+/**
+ * @brief Backpropagation: accumulates the gradient of the cross-entropy loss for one sample into `gradients`.
+ *        Parameters are not modified here; the optimizer applies (and clears) the accumulated gradients.
+ *
+ * @param inputNormalized      Normalized input vector used in the forward pass
+ * @param hiddenToOutputLayerActivation    Output vector of the hidden layer from the forward pass
+ * @param outputError          Gradient of the loss with respect to the output logits, softmax - one_hot(label), as
+ *                             computed by NNUtils::ActivationFunctions::softmaxCrossEntropy
+ * @param workspace            Scratch space for the hidden layer errors
+ * @param sparseInput          Nonzero pixels of the input; when given, `inputNormalized` is not used and only the
+ *                             weight gradients of nonzero pixels are updated (the others are zero)
+ * @param reducer              Set for the last sample of a data-parallel step: told about each gradient range as soon
+ *                             as it is final (output layer, then buckets of input-to-hidden rows, then hidden biases)
+ */
+void FFNeuralNet::applyBackpropagation(
+    const double *inputNormalized,
+    const double *hiddenToOutputLayerActivation,
+    const double *outputError,
+    Workspace &workspace,
+    const SparseInput *sparseInput,
+    GradientReducer *reducer)
+{
+    if (gradients.size() != parameterCount())
+        gradients.assign(parameterCount(), 0.0);
+
+    double *gradInputToHidden = gradients.data();
+    double *gradHiddenToOutput = gradInputToHidden + hiddenSize * inputSize;
+    double *gradHiddenBiases = gradHiddenToOutput + outputSize * hiddenSize;
+    double *gradOutputBiases = gradHiddenBiases + hiddenSize;
+    const double *outputWeights = hiddenToOutputLayerWeights();
+
+    // Lth layer (hidden-to-output) weight and bias gradients
+    for (size_t j = 0; j < outputSize; ++j)
+    {
+        double *row = gradHiddenToOutput + j * hiddenSize;
+        for (size_t k = 0; k < hiddenSize; ++k)
         {
-            hidden_error[j] += output_error[k] * hiddenToOutputLayerWeights[k][j];
+            row[k] += outputError[j] * hiddenToOutputLayerActivation[k];
         }
-        hidden_error[j] *= NNUtils::ActivationFunctions::reluDerivative(hiddenToOutputLayerActivation[j]);
+        gradOutputBiases[j] += outputError[j];
+    }
+    if (reducer)
+    {
+        reducer->gradientsReady(gradients.data(), gradHiddenToOutput - gradients.data(), gradHiddenBiases - gradients.data());
+        reducer->gradientsReady(gradients.data(), gradOutputBiases - gradients.data(), parameterCount());
     }
 
-    // Gradients descent to update weights and biases in (L-1)th layer (input-to-hidden)
-    for (size_t j = 0; j < inputToHiddenLayerWeights.size(); ++j)
+    double *hidden_error = workspace.hiddenError;
+    fill(hidden_error, hidden_error + hiddenSize, 0.0);
+    for (size_t j = 0; j < outputSize; ++j)
     {
-        for (size_t k = 0; k < inputNormalized.size(); ++k)
+        const double *row = outputWeights + j * hiddenSize;
+        for (size_t k = 0; k < hiddenSize; ++k)
         {
-            // since we have 1 hidden layer, the activation in (L-2) layer is the input normalized
-            inputToHiddenLayerWeights[j][k] -= learningRate * hidden_error[j] * inputNormalized[k];
+            hidden_error[k] += outputError[j] * row[k];
         }
-        hiddenLayerBiases[j] -= learningRate * hidden_error[j];
     }
+
+    // (L-1)th layer (input-to-hidden) gradients; since we have 1 hidden layer, the activation in (L-2) layer is the input normalized
+    const size_t rowsPerBucket = max<size_t>(1, GRADIENT_BUCKET_VALUES / inputSize);
+    size_t bucketStart = 0;
+    for (size_t j = 0; j < hiddenSize; ++j)
+    {
+        hidden_error[j] *= NNUtils::ActivationFunctions::reluDerivative(hiddenToOutputLayerActivation[j]);
+        // An inactive ReLU unit's whole weight row has zero gradient
+        if (hidden_error[j] != 0.0)
+        {
+            double *row = gradInputToHidden + j * inputSize;
+            if (sparseInput)
+            {
+                for (size_t k = 0; k < sparseInput->count; ++k)
+                {
+                    row[sparseInput->indices[k]] += hidden_error[j] * sparseInput->values[k];
+                }
+            }
+            else
+            {
+                for (size_t k = 0; k < inputSize; ++k)
+                {
+                    row[k] += hidden_error[j] * inputNormalized[k];
+                }
+            }
+            gradHiddenBiases[j] += hidden_error[j];
+        }
+
+        if (reducer && (j + 1 - bucketStart == rowsPerBucket || j + 1 == hiddenSize))
+        {
+            reducer->gradientsReady(gradients.data(), bucketStart * inputSize, (j + 1) * inputSize);
+            bucketStart = j + 1;
+        }
+    }
+    if (reducer)
+        reducer->gradientsReady(gradients.data(), gradHiddenBiases - gradients.data(), gradOutputBiases - gradients.data());
 }
 
 /**
@@ -102,15 +343,17 @@ void FFNeuralNet::applyBackpropagation(
  * @param hiddenSize Number of neurons in the hidden layer
  * @param outputSize Number of neurons in the output layer / number of output classes
  */
-FFNeuralNet::FFNeuralNet(int inputSize, int hiddenSize, int outputSize) : inputToHiddenLayerWeights(hiddenSize, vector<double>(inputSize)),
-                                                                          hiddenToOutputLayerWeights(outputSize, vector<double>(hiddenSize)),
-                                                                          hiddenLayerBiases(hiddenSize),
-                                                                          outputLayerBiases(outputSize)
+FFNeuralNet::FFNeuralNet(int inputSize, int hiddenSize, int outputSize) : inputSize(inputSize),
+                                                                          hiddenSize(hiddenSize),
+                                                                          outputSize(outputSize),
+                                                                          parameters(parameterCount()),
+                                                                          transposedInputWeights(make_unique<TransposedWeights>())
 {
-    NNUtils::initializeWeights(inputToHiddenLayerWeights, -0.5, 0.5);
-    NNUtils::initializeWeights(hiddenToOutputLayerWeights, -0.5, 0.5);
-    NNUtils::initializeBiases(hiddenLayerBiases);
-    NNUtils::initializeBiases(outputLayerBiases);
+    parameterView = parameters.data();
+    NNUtils::initializeWeights(inputToHiddenLayerWeights(), this->hiddenSize * this->inputSize, -0.5, 0.5);
+    NNUtils::initializeWeights(hiddenToOutputLayerWeights(), this->outputSize * this->hiddenSize, -0.5, 0.5);
+    NNUtils::initializeBiases(hiddenLayerBiases(), this->hiddenSize);
+    NNUtils::initializeBiases(outputLayerBiases(), this->outputSize);
 }
 
 /**
@@ -120,180 +363,712 @@ FFNeuralNet::FFNeuralNet(int inputSize, int hiddenSize, int outputSize) : inputT
  *
  * @return Output vector containing probabilities for each class after softmax activation (vector size = # output neurons/classes)
  */
-vector<double> FFNeuralNet::performForwardPass(const vector<uint8_t> &input_bytes)
+vector<double> FFNeuralNet::performForwardPass(const vector<uint8_t> &input_bytes) const
+{
+    const double *probabilities = performForwardPass(input_bytes.data(), threadWorkspace(1));
+    return vector<double>(probabilities, probabilities + outputSize);
+}
+
+/**
+ * @brief Complete forward pass for inference without heap allocations
+ *
+ * @param input_bytes Image as inputSize pixel bytes
+ * @param workspace   Scratch space for the layer activations (see makeWorkspace)
+ *
+ * @return The outputSize probabilities after softmax, stored in `workspace`
+ */
+const double *FFNeuralNet::performForwardPass(const uint8_t *input_bytes, Workspace &workspace) const
+{
+    static Metrics::Histogram &forwardPassTime = Metrics::Registry::instance().histogram(
+        "nn_forward_pass_seconds", "Time spent in one inference forward pass.");
+    Metrics::ScopedTimer timer(forwardPassTime);
+    TRACE_SPAN("nn.forward");
+    if (!workspace.fits(*this))
+    {
+        LOG_ERROR("performForwardPass: workspace was made for a different network");
+        return nullptr;
+    }
+
+    SparseInput &sparseInput = workspace.sparseInput;
+    compactInput(input_bytes, inputSize, sparseInput);
+    if (useSparseInput(sparseInput.count))
+    {
+        computeHiddenActivationSparse(sparseInput, workspace.hidden);
+    }
+    else
+    {
+        for (size_t i = 0; i < inputSize; ++i)
+        {
+            workspace.inputNormalized[i] = static_cast<double>(input_bytes[i]) / 255.0;
+        }
+
+        computeLayerActivation(
+            workspace.inputNormalized, inputSize,
+            inputToHiddenLayerWeights(),
+            hiddenLayerBiases(), hiddenSize, NNUtils::ActivationFunctions::relu,
+            workspace.hidden);
+    }
+
+    computeOutputProbabilities(workspace.hidden, workspace);
+    return workspace.probabilities;
+}
+
+/**
+ * @brief Batched forward pass for inference in a per-thread workspace
+ *
+ * @param images          Images as flattened vectors of pixel bytes
+ * @param first           Index of the first image in the batch
+ * @param count           Number of images in the batch
+ * @param probabilities   Output, row-major (count x output size): softmax probabilities for each image
+ */
+void FFNeuralNet::performForwardPassBatch(const vector<vector<uint8_t>> &images,
+                                          size_t first, size_t count,
+                                          double *probabilities) const
+{
+    performForwardPassBatch(images, first, count, probabilities, threadWorkspace(count));
+}
+
+/**
+ * @brief Batched forward pass for inference. Each weight row is loaded once and applied to every image in the
+ *        batch while it is still in cache, instead of streaming the whole weight matrix once per image.
+ *
+ * @param images          Images as flattened vectors of pixel bytes
+ * @param first           Index of the first image in the batch
+ * @param count           Number of images in the batch; at most the workspace's batch capacity
+ * @param probabilities   Output, row-major (count x output size): softmax probabilities for each image
+ * @param workspace       Scratch space made with makeWorkspace(batch capacity)
+ */
+void FFNeuralNet::performForwardPassBatch(const vector<vector<uint8_t>> &images,
+                                          size_t first, size_t count,
+                                          double *probabilities,
+                                          Workspace &workspace) const
 {
-    vector<double> inputNormalized(input_bytes.size());
-    for (size_t i = 0; i < input_bytes.size(); ++i)
+    TRACE_SPAN("nn.forward_batch");
+    if (!workspace.fits(*this, count))
     {
-        inputNormalized[i] = static_cast<double>(input_bytes[i]) / 255.0;
+        LOG_ERROR("performForwardPassBatch: workspace does not fit a batch of %zu for this network", count);
+        return;
     }
 
-    vector<double> hiddenToOutputLayerActivation = computeLayerActivation(
-        inputNormalized,
-        inputToHiddenLayerWeights,
-        hiddenLayerBiases, NNUtils::ActivationFunctions::relu);
+    // Sparse images go straight through the transposed weights; the rest are normalized for the blocked dense kernel
+    double *hiddenActivation = workspace.hidden;
+    size_t *denseImages = workspace.denseImages;
+    size_t denseCount = 0;
+    SparseInput &sparseInput = workspace.sparseInput;
+    for (size_t b = 0; b < count; ++b)
+    {
+        compactInput(images[first + b].data(), inputSize, sparseInput);
+        if (useSparseInput(sparseInput.count))
+        {
+            computeHiddenActivationSparse(sparseInput, hiddenActivation + b * hiddenSize);
+        }
+        else
+        {
+            denseImages[denseCount++] = b;
+        }
+    }
 
-    vector<double> output_layer_logits = computeLayerActivation(
-        hiddenToOutputLayerActivation,
-        hiddenToOutputLayerWeights,
-        outputLayerBiases,
-        [](double x)
-        { return x; });
+    double *inputNormalized = workspace.inputNormalized;
+    for (size_t d = 0; d < denseCount; ++d)
+    {
+        const vector<uint8_t> &image = images[first + denseImages[d]];
+        double *row = inputNormalized + d * inputSize;
+        for (size_t i = 0; i < inputSize; ++i)
+        {
+            row[i] = static_cast<double>(image[i]) / 255.0;
+        }
+    }
 
-    return NNUtils::ActivationFunctions::softmax(output_layer_logits);
+    const double *weights = inputToHiddenLayerWeights();
+    const double *biases = hiddenLayerBiases();
+    for (size_t j = 0; j < hiddenSize; ++j)
+    {
+        const double *weightRow = weights + j * inputSize;
+        size_t d = 0;
+        // Four images at a time: independent accumulators keep the FP adders busy and each weight is loaded once for all four
+        for (; d + 4 <= denseCount; d += 4)
+        {
+            const double *input0 = inputNormalized + d * inputSize;
+            const double *input1 = input0 + inputSize;
+            const double *input2 = input1 + inputSize;
+            const double *input3 = input2 + inputSize;
+            double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+            for (size_t i = 0; i < inputSize; ++i)
+            {
+                double w = weightRow[i];
+                sum0 += w * input0[i];
+                sum1 += w * input1[i];
+                sum2 += w * input2[i];
+                sum3 += w * input3[i];
+            }
+            hiddenActivation[denseImages[d] * hiddenSize + j] = NNUtils::ActivationFunctions::relu(sum0 + biases[j]);
+            hiddenActivation[denseImages[d + 1] * hiddenSize + j] = NNUtils::ActivationFunctions::relu(sum1 + biases[j]);
+            hiddenActivation[denseImages[d + 2] * hiddenSize + j] = NNUtils::ActivationFunctions::relu(sum2 + biases[j]);
+            hiddenActivation[denseImages[d + 3] * hiddenSize + j] = NNUtils::ActivationFunctions::relu(sum3 + biases[j]);
+        }
+        for (; d < denseCount; ++d)
+        {
+            const double *input = inputNormalized + d * inputSize;
+            double sum = 0.0;
+            for (size_t i = 0; i < inputSize; ++i)
+            {
+                sum += weightRow[i] * input[i];
+            }
+            hiddenActivation[denseImages[d] * hiddenSize + j] = NNUtils::ActivationFunctions::relu(sum + biases[j]);
+        }
+    }
+
+    // Logits straight into the caller's buffer, then one softmax pass over the whole batch in place
+    for (size_t b = 0; b < count; ++b)
+    {
+        computeOutputLogits(hiddenActivation + b * hiddenSize, probabilities + b * outputSize);
+    }
+    NNUtils::ActivationFunctions::softmaxCrossEntropy(probabilities, count, outputSize, nullptr, probabilities, nullptr);
 }
 
 /**
- * @brief Helper function to flatten network parameters (weights and biases) into a single vector.
+ * @brief Copy of the network parameters (weights and biases) in their persisted order.
  *
  * @return A vector of doubles containing all weights and biases of the network.
  */
 vector<double> FFNeuralNet::extractNetworkParameters() const
 {
-    vector<double> params;
-    for (const auto &row : inputToHiddenLayerWeights)
+    return vector<double>(parameterView, parameterView + parameterCount());
+}
+
+/**
+ * @brief Forward and backward pass for one training sample; accumulates its gradients into `gradients`
+ *
+ * @param image      Image as pixel bytes
+ * @param label      Correct class label
+ * @param workspace  Scratch space for the activations and errors
+ *
+ * @return Cross-entropy loss of the sample
+ */
+double FFNeuralNet::trainSample(const uint8_t *image, int label, Workspace &workspace, GradientReducer *reducer)
+{
+    SparseInput &sparseInput = workspace.sparseInput;
+    compactInput(image, inputSize, sparseInput);
+    const bool sparse = useSparseInput(sparseInput.count);
     {
-        params.insert(params.end(), row.begin(), row.end());
+        TRACE_SPAN("train.forward");
+        if (sparse)
+        {
+            computeHiddenActivationGather(sparseInput, workspace.hidden);
+        }
+        else
+        {
+            for (size_t j = 0; j < inputSize; ++j)
+            {
+                workspace.inputNormalized[j] = static_cast<double>(image[j]) / 255.0;
+            }
+            computeLayerActivation(
+                workspace.inputNormalized, inputSize,
+                inputToHiddenLayerWeights(),
+                hiddenLayerBiases(), hiddenSize, NNUtils::ActivationFunctions::relu,
+                workspace.hidden);
+        }
+        computeOutputLogits(workspace.hidden, workspace.logits);
     }
-    for (const auto &row : hiddenToOutputLayerWeights)
+
+    // Loss and dL/dz straight from the logits; training never needs the probabilities themselves
+    double loss;
+    NNUtils::ActivationFunctions::softmaxCrossEntropy(workspace.logits, 1, outputSize, &label, workspace.outputError, &loss);
     {
-        params.insert(params.end(), row.begin(), row.end());
+        TRACE_SPAN("train.backward");
+        applyBackpropagation(workspace.inputNormalized, workspace.hidden, workspace.outputError, workspace,
+                             sparse ? &sparseInput : nullptr, reducer);
     }
-    params.insert(params.end(), hiddenLayerBiases.begin(), hiddenLayerBiases.end());
-    params.insert(params.end(), outputLayerBiases.begin(), outputLayerBiases.end());
-    return params;
+    return loss;
 }
 
 /**
- * @brief Using training images and labels to train NN using gradient descent/backpropagation
+ * @brief Using training images and labels to train NN with plain per-sample gradient descent
  *
  * @param images        2D vector of unsigned 8-bit integers representing training images, where each inner vector is a flattened image
  * @param labels        Vector of unsigned 8-bit integers representing labels for the training images.
  * @param epochs        Number of training epochs
  * @param learningRate Controls step size of weight and bias updates in gradient descent
+ * @param trainingDataFile  Training database file that receives each epoch's loss and parameters
  */
 void FFNeuralNet::train(const vector<vector<uint8_t>> &images,
                         const vector<uint8_t> &labels,
-                        int epochs, double learningRate)
+                        int epochs, double learningRate,
+                        const string &trainingDataFile)
 {
-    TrainingDatabase db("mnist/data/training_data.dat", "mnist/data/probabilities.dat");
-
-    size_t numSamples = images.size();
-    for (int epoch = 0; epoch < epochs; ++epoch)
-    {
-        double totalLoss = 0.0;
-
-        for (size_t i = 0; i < numSamples; ++i)
-        {
-            vector<double> inputNormalized(images[i].size());
-            for (size_t j = 0; j < images[i].size(); ++j)
-            {
-                inputNormalized[j] = static_cast<double>(images[i][j]) / 255.0;
-            }
-
-            vector<double> hiddenToOutputLayerActivation = computeLayerActivation(
-                inputNormalized,
-                inputToHiddenLayerWeights,
-                hiddenLayerBiases, NNUtils::ActivationFunctions::relu);
+    TrainingConfig config;
+    config.epochs = epochs;
+    config.optimizer.type = NNOptim::OptimizerType::SGD;
+    config.optimizer.learningRate = learningRate;
+    config.trainingDataFile = trainingDataFile;
+    train(images, labels, config);
+}
 
-            vector<double> outputLayerProbability = NNUtils::ActivationFunctions::softmax(computeLayerActivation(
-                hiddenToOutputLayerActivation,
-                hiddenToOutputLayerWeights,
-                outputLayerBiases,
-                [](double x)
-                { return x; }));
+/**
+ * @brief Using training images and labels to train NN with backpropagation and the configured optimizer
+ *
+ * @param images        2D vector of unsigned 8-bit integers representing training images, where each inner vector is a flattened image
+ * @param labels        Vector of unsigned 8-bit integers representing labels for the training images.
+ * @param config        Epochs, batch size, optimizer, learning-rate schedule, training database files and progress callback
+ *
+ * @return Stopped if config.onProgress stopped training; Failed if config.gradientReducer lost a peer or
+ *         config.checkpointFile could not be resumed. Either way the current epoch is not checkpointed
+ */
+TrainingResult FFNeuralNet::train(const vector<vector<uint8_t>> &images,
+                        const vector<uint8_t> &labels,
+                        const TrainingConfig &config)
+{
+    NNData::InMemorySamples samples(images, labels);
+    return train(samples, config);
+}
 
-            int actualLabel = labels[i];
-            double loss = -log(outputLayerProbability[actualLabel]);
-            totalLoss += loss;
+/**
+ * @brief Trains on samples pulled from a sample source one epoch at a time, so the dataset need not fit in memory
+ *
+ * @param samples  Source of every epoch's samples; shuffled epochs draw their order from the checkpointed generator
+ * @param config   Epochs, batch size, optimizer, learning-rate schedule, training database files and progress callback
+ *
+ * @return Stopped if config.onProgress stopped training; Failed if config.gradientReducer lost a peer,
+ *         config.checkpointFile could not be resumed or the source failed to deliver an epoch. Either way the current
+ *         epoch is not checkpointed
+ */
+TrainingResult FFNeuralNet::train(NNData::SampleSource &samples, const TrainingConfig &config)
+{
+    if (samples.size() > 0 && samples.sampleBytes() != inputSize)
+    {
+        LOG_ERROR("Training samples have %zu pixels, but the network's input layer has %zu", samples.sampleBytes(), inputSize);
+        return TrainingResult::Failed;
+    }
+    TrainingDatabase db(config.trainingDataFile, config.probabilitiesFile);
 
-            applyBackpropagation(inputNormalized, hiddenToOutputLayerActivation, outputLayerProbability, actualLabel, learningRate);
-        }
+    Metrics::Registry &registry = Metrics::Registry::instance();
+    Metrics::Histogram &epochTime = registry.histogram("nn_epoch_duration_seconds", "Wall time of one training epoch, excluding the checkpoint write.");
+    Metrics::Histogram &checkpointTime = registry.histogram("nn_checkpoint_write_seconds", "Time spent persisting one epoch's parameters to the training database and, when resumable, the training checkpoint.");
+    Metrics::Gauge &samplesPerSecond = registry.gauge("nn_training_samples_per_second", "Training throughput of the most recent epoch.");
+    Metrics::Counter &samplesTrained = registry.counter("nn_training_samples_total", "Training samples processed.");
 
-        double averageLoss = totalLoss / numSamples;
-        cout << "Epoch " << epoch + 1 << " - Loss: " << averageLoss << endl;
+    mutableParameters(); // training never writes through to a mapped model file
+    if (gradients.size() != parameters.size())
+        gradients.assign(parameters.size(), 0.0);
 
-        vector<double> currentParams = extractNetworkParameters();
-        db.saveTrainingData(epoch + 1, averageLoss, currentParams);
+    // Optimizer state carries over between train() calls as long as the optimizer configuration is unchanged
+    if (!optimizer || !(optimizerConfig == config.optimizer))
+    {
+        optimizer = NNOptim::makeOptimizer(config.optimizer, parameters.size());
+        optimizerConfig = config.optimizer;
     }
-}
+    const size_t batchSize = max<size_t>(1, config.batchSize);
+    const size_t numSamples = samples.size();
 
-void FFNeuralNet::saveFinalWeights(const string &filename)
-{
-    ofstream file(filename, ios::binary);
-    if (!file.is_open())
+    // The sample order of each epoch is drawn from `shuffler`; epochShuffler keeps its state from the start of the
+    // current epoch, so a mid-epoch checkpoint can reproduce the order
+    mt19937_64 shuffler(config.shuffleSeed);
+    mt19937_64 epochShuffler = shuffler;
+    ResumePoint resume;
+    if (!restoreCheckpoint(config, numSamples, batchSize, db, resume, shuffler))
+        return TrainingResult::Failed;
+
+    if (config.gradientReducer && !config.gradientReducer->synchronizeParameters(parameters.data(), parameters.size()))
     {
-        cerr << "Error opening file for saving weights: " << filename << endl;
-        return;
+        LOG_ERROR("Could not synchronize initial parameters with the other trainers");
+        return TrainingResult::Failed;
     }
-    try
+
+    Workspace workspace = makeWorkspace(); // every per-sample buffer; the loop below makes no heap allocations
+    TrainingProgress progress;
+    progress.epochs = config.epochs;
+    progress.samplesPerEpoch = numSamples;
+    for (int epoch = resume.epoch; epoch < config.epochs; ++epoch)
     {
-        for (const auto &row : inputToHiddenLayerWeights)
+        TRACE_SPAN("train.epoch");
+        const bool resumingEpoch = epoch == resume.epoch && resume.nextSample > 0;
+        double totalLoss = resumingEpoch ? resume.lossSum : 0.0;
+        auto epochStart = chrono::steady_clock::now();
+        size_t batchFill = 0;
+
+        epochShuffler = shuffler;
+        const uint8_t *pixels = nullptr;
+        uint8_t label = 0;
+        bool delivered = samples.beginEpoch(config.shuffle ? &shuffler : nullptr);
+        // A resumed epoch replays the same order up to where the checkpoint was taken
+        for (size_t skipped = 0; delivered && resumingEpoch && skipped < resume.nextSample; ++skipped)
+            delivered = samples.next(pixels, label);
+
+        for (size_t i = resumingEpoch ? resume.nextSample : 0; i < numSamples; ++i)
         {
-            for (double w : row)
+            TRACE_SPAN("train.sample");
+            if (!delivered || !samples.next(pixels, label))
             {
-                file.write(reinterpret_cast<const char *>(&w), sizeof(double));
+                LOG_ERROR("Training data ended after %zu of %zu samples in epoch %d; stopping training", i, numSamples, epoch + 1);
+                return TrainingResult::Failed;
             }
-        }
-        for (const auto &row : hiddenToOutputLayerWeights)
-        {
-            for (double w : row)
+            if (label >= outputSize)
             {
-                file.write(reinterpret_cast<const char *>(&w), sizeof(double));
+                LOG_ERROR("Training sample %zu of epoch %d has label %u, but the network has %zu outputs", i, epoch + 1, label, outputSize);
+                return TrainingResult::Failed;
+            }
+            const bool lastOfStep = batchFill + 1 == batchSize || i + 1 == numSamples;
+            totalLoss += trainSample(pixels, label, workspace, lastOfStep ? config.gradientReducer : nullptr);
+
+            if (++batchFill == batchSize || i + 1 == numSamples)
+            {
+                TRACE_SPAN("train.update");
+                size_t stepSamples = batchFill;
+                if (config.gradientReducer)
+                {
+                    TRACE_SPAN("train.allreduce");
+                    if (!config.gradientReducer->finishStep())
+                    {
+                        LOG_ERROR("Gradient synchronization failed at epoch %d; stopping training", epoch + 1);
+                        return TrainingResult::Failed;
+                    }
+                    stepSamples *= config.gradientReducer->worldSize();
+                }
+                double rate = config.schedule.rate(config.optimizer.learningRate, epoch, optimizer->stepCount());
+                optimizer->step(parameters.data(), gradients.data(), parameters.size(), rate, 1.0 / static_cast<double>(stepSamples));
+                batchFill = 0;
+                if (!parameterMask.empty())
+                {
+                    for (size_t p = 0; p < parameters.size(); ++p)
+                        parameters[p] = parameterMask[p] ? parameters[p] : 0.0;
+                }
+
+                // The epoch's last step is covered by the end-of-epoch checkpoint
+                if (!config.checkpointFile.empty() && config.checkpointEverySteps > 0 &&
+                    optimizer->stepCount() % config.checkpointEverySteps == 0 && i + 1 < numSamples)
+                {
+                    TRACE_SPAN("train.checkpoint");
+                    Metrics::ScopedTimer checkpointTimer(checkpointTime);
+                    writeCheckpoint(config, numSamples, batchSize, {epoch, i + 1, totalLoss}, epochShuffler, db);
+                }
+
+                if (config.onProgress)
+                {
+                    progress.epoch = epoch + 1;
+                    progress.samples = i + 1;
+                    progress.loss = totalLoss / static_cast<double>(i + 1);
+                    progress.learningRate = rate;
+                    progress.epochComplete = false;
+                    if (!config.onProgress(progress))
+                        return TrainingResult::Stopped;
+                }
             }
         }
-        for (double b : hiddenLayerBiases)
+
+        auto epochDuration = chrono::steady_clock::now() - epochStart;
+        epochTime.recordDuration(epochDuration);
+        samplesTrained.add(numSamples);
+        samplesPerSecond.set(numSamples / chrono::duration<double>(epochDuration).count());
+
+        double averageLoss = totalLoss / numSamples;
+        LOG_INFO("Epoch %d - Loss: %g", epoch + 1, averageLoss);
+
         {
-            file.write(reinterpret_cast<const char *>(&b), sizeof(double));
+            TRACE_SPAN("train.checkpoint");
+            Metrics::ScopedTimer checkpointTimer(checkpointTime);
+            db.saveTrainingData(epoch + 1, averageLoss, parameters);
+            if (!config.checkpointFile.empty())
+                writeCheckpoint(config, numSamples, batchSize, {epoch + 1, 0, 0.0}, shuffler, db);
         }
-        for (double b : outputLayerBiases)
+
+        if (config.onProgress)
         {
-            file.write(reinterpret_cast<const char *>(&b), sizeof(double));
+            progress.epoch = epoch + 1;
+            progress.samples = numSamples;
+            progress.loss = averageLoss;
+            progress.epochComplete = true;
+            if (!config.onProgress(progress))
+                return TrainingResult::Stopped;
         }
     }
-    catch (const exception &e)
+
+    if (!config.checkpointFile.empty())
     {
-        cerr << "Error writing weights to file: " << e.what() << endl;
+        error_code error;
+        filesystem::remove(config.checkpointFile, error);
     }
-    file.close();
+    return TrainingResult::Completed;
 }
 
-void FFNeuralNet::loadPretrainedWeights(const string &filename)
+/**
+ * @brief Prepares the training database and, if config.checkpointFile exists, restores the run it holds: parameters,
+ *        optimizer state and step count, shuffle generator, and position in the epoch. History records written after
+ *        the checkpoint (by a run that crashed before its next checkpoint) and a record cut short by a crash are
+ *        dropped, so the history matches the restored state.
+ *
+ * @param config      Training configuration; the checkpoint must match its optimizer type
+ * @param numSamples  Samples per epoch; must match the checkpoint if it stopped mid-epoch
+ * @param batchSize   Samples per optimizer step; must match the checkpoint if it stopped mid-epoch
+ * @param db          Training database of this run
+ * @param resume      Receives where training continues
+ * @param shuffler    Receives the shuffle generator's state at the start of epoch resume.epoch
+ *
+ * @return False if the checkpoint exists but is unreadable or belongs to a different run
+ */
+bool FFNeuralNet::restoreCheckpoint(const TrainingConfig &config, size_t numSamples, size_t batchSize, TrainingDatabase &db,
+                                    ResumePoint &resume, mt19937_64 &shuffler)
 {
-    ifstream file(filename, ios::binary);
-    if (!file.is_open())
+    const uintmax_t historyBytes = db.trainingDataBytes();
+    if (config.checkpointFile.empty() || !filesystem::exists(config.checkpointFile))
+    {
+        const uintmax_t completeBytes = db.completeRecordBytes();
+        if (completeBytes < historyBytes)
+        {
+            LOG_WARN("Discarding %llu bytes of an incomplete record at the end of %s",
+                     static_cast<unsigned long long>(historyBytes - completeBytes), config.trainingDataFile.c_str());
+            db.truncateTrainingData(completeBytes);
+        }
+        return true;
+    }
+
+    NNModel::CheckpointState state;
+    vector<double> restoredParameters;
+    vector<vector<double>> restoredState;
+    if (!NNModel::readCheckpoint(config.checkpointFile, state, restoredParameters, restoredState))
     {
-        cerr << "Error opening weight file for loading: " << filename << endl;
+        LOG_ERROR("Cannot resume from %s; delete it to start training over", config.checkpointFile.c_str());
+        return false;
+    }
+
+    vector<vector<double> *> optimizerState = optimizer->stateBuffers();
+    const vector<uint32_t> layerSizes = {static_cast<uint32_t>(inputSize), static_cast<uint32_t>(hiddenSize), static_cast<uint32_t>(outputSize)};
+    const bool midEpoch = state.nextSample > 0;
+    if (state.layerSizes != layerSizes || restoredParameters.size() != parameters.size() ||
+        state.optimizerType != static_cast<uint32_t>(config.optimizer.type) || restoredState.size() != optimizerState.size() ||
+        (midEpoch && (state.samplesPerEpoch != numSamples || state.batchSize != batchSize || state.nextSample >= numSamples)))
+    {
+        LOG_ERROR("Checkpoint %s is from a different run (topology, optimizer, dataset size or batch size changed); "
+                  "delete it to start training over",
+                  config.checkpointFile.c_str());
+        return false;
+    }
+
+    istringstream rngState(state.rngState);
+    rngState >> shuffler;
+    if (!rngState)
+    {
+        LOG_ERROR("Checkpoint %s has an unreadable shuffle state", config.checkpointFile.c_str());
+        return false;
+    }
+
+    parameters = move(restoredParameters);
+    parameterView = parameters.data();
+    transposedInputWeights->ready.store(false, memory_order_relaxed);
+    for (size_t i = 0; i < optimizerState.size(); ++i)
+        *optimizerState[i] = move(restoredState[i]);
+    optimizer->setStepCount(state.optimizerSteps);
+    resume = {static_cast<int>(state.epoch), static_cast<size_t>(state.nextSample), state.lossSum};
+
+    if (historyBytes > state.historyBytes)
+    {
+        LOG_WARN("Discarding %llu bytes of %s written after the checkpoint",
+                 static_cast<unsigned long long>(historyBytes - state.historyBytes), config.trainingDataFile.c_str());
+        db.truncateTrainingData(state.historyBytes);
+    }
+    else if (historyBytes < state.historyBytes)
+    {
+        LOG_WARN("%s is shorter than when %s was written; its latest records are lost",
+                 config.trainingDataFile.c_str(), config.checkpointFile.c_str());
+        db.truncateTrainingData(db.completeRecordBytes());
+    }
+    LOG_INFO("Resuming training from %s: epoch %d, sample %zu of %zu, optimizer step %llu",
+             config.checkpointFile.c_str(), resume.epoch + 1, resume.nextSample, numSamples,
+             static_cast<unsigned long long>(state.optimizerSteps));
+    return true;
+}
+
+/**
+ * @brief Writes config.checkpointFile for the current parameters and optimizer state
+ *
+ * @param point     Epochs completed, samples of the next epoch already trained and their summed loss
+ * @param shuffler  Shuffle generator as it was at the start of epoch point.epoch
+ * @param db        Training database, whose current size the checkpoint records
+ *
+ * @return True if the checkpoint was replaced; otherwise the previous one is left in place
+ */
+bool FFNeuralNet::writeCheckpoint(const TrainingConfig &config, size_t numSamples, size_t batchSize, const ResumePoint &point,
+                                  const mt19937_64 &shuffler, TrainingDatabase &db)
+{
+    NNModel::CheckpointState state;
+    state.layerSizes = {static_cast<uint32_t>(inputSize), static_cast<uint32_t>(hiddenSize), static_cast<uint32_t>(outputSize)};
+    state.optimizerType = static_cast<uint32_t>(config.optimizer.type);
+    state.epoch = static_cast<uint32_t>(point.epoch);
+    state.nextSample = point.nextSample;
+    state.samplesPerEpoch = numSamples;
+    state.batchSize = batchSize;
+    state.lossSum = point.lossSum;
+    state.optimizerSteps = optimizer->stepCount();
+    state.historyBytes = db.trainingDataBytes();
+    ostringstream rngState;
+    rngState << shuffler;
+    state.rngState = rngState.str();
+
+    vector<const vector<double> *> optimizerState;
+    for (vector<double> *buffer : optimizer->stateBuffers())
+        optimizerState.push_back(buffer);
+    if (!NNModel::writeCheckpoint(config.checkpointFile, state, parameters.data(), parameters.size(), optimizerState))
+    {
+        LOG_ERROR("Could not write checkpoint %s; a crash now resumes from the previous one", config.checkpointFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Replaces every parameter (e.g. with pruned weights)
+ *
+ * @param values  Parameters in persisted order; ignored unless it has parameterCount() entries
+ */
+void FFNeuralNet::setParameters(const vector<double> &values)
+{
+    if (values.size() != parameterCount())
+    {
+        LOG_ERROR("setParameters: got %zu values, expected %zu", values.size(), parameterCount());
         return;
     }
-    try
+    mappedModel.reset();
+    parameters = values;
+    parameterView = parameters.data();
+    transposedInputWeights->ready.store(false, memory_order_relaxed);
+}
+
+/**
+ * @brief Keeps pruned parameters at zero while training: after every optimizer step, parameters whose mask entry is 0 are reset
+ *
+ * @param mask  One entry per parameter (persisted order), or empty to train every parameter
+ */
+void FFNeuralNet::setParameterMask(vector<uint8_t> mask)
+{
+    if (!mask.empty() && mask.size() != parameterCount())
     {
-        for (auto &row : inputToHiddenLayerWeights)
-        {
-            for (double &w : row)
-            {
-                file.read(reinterpret_cast<char *>(&w), sizeof(double));
-            }
-        }
-        for (auto &row : hiddenToOutputLayerWeights)
-        {
-            for (double &w : row)
-            {
-                file.read(reinterpret_cast<char *>(&w), sizeof(double));
-            }
-        }
-        for (double &b : hiddenLayerBiases)
-        {
-            file.read(reinterpret_cast<char *>(&b), sizeof(double));
-        }
-        for (double &b : outputLayerBiases)
+        LOG_ERROR("setParameterMask: got %zu entries, expected %zu", mask.size(), parameterCount());
+        return;
+    }
+    parameterMask = move(mask);
+}
+
+/**
+ * @brief Copies a mapped model file into privately owned parameters so they can be modified
+ */
+void FFNeuralNet::detachMappedWeights()
+{
+    if (!mappedModel)
+        return;
+    parameters.assign(parameterView, parameterView + parameterCount());
+    parameterView = parameters.data();
+    mappedModel.reset();
+}
+
+/**
+ * @brief Checks that a model file matches this network's topology
+ *
+ * @param model     Opened model file
+ * @param filename  File name for error messages
+ *
+ * @return True if the parameters can be used by this network
+ */
+bool FFNeuralNet::acceptsModel(const NNModel::MappedModel &model, const string &filename) const
+{
+    if (model.isLegacy())
+    {
+        if (model.parameterCount() != parameterCount())
         {
-            file.read(reinterpret_cast<char *>(&b), sizeof(double));
+            LOG_ERROR("Weight file %s has no header and %zu values, but a %zux%zux%zu network needs %zu",
+                      filename.c_str(), model.parameterCount(), inputSize, hiddenSize, outputSize, parameterCount());
+            return false;
         }
+        LOG_WARN("Weight file %s uses the legacy headerless format; re-save it to add topology and checksum", filename.c_str());
+        return true;
+    }
+
+    if (model.layout() != NNModel::Layout::Dense)
+    {
+        LOG_ERROR("Model file %s stores a sparse first layer; load it with NNSparse::SparseFFNet", filename.c_str());
+        return false;
     }
-    catch (const exception &e)
+
+    const vector<uint32_t> expected = {static_cast<uint32_t>(inputSize), static_cast<uint32_t>(hiddenSize), static_cast<uint32_t>(outputSize)};
+    if (model.layerSizes() != expected || model.parameterCount() != parameterCount())
     {
-        cerr << "Error reading weights from file: " << e.what() << endl;
+        string topology;
+        for (uint32_t size : model.layerSizes())
+        {
+            if (!topology.empty())
+                topology += 'x';
+            topology += to_string(size);
+        }
+        LOG_ERROR("Model file %s has topology %s, expected %zux%zux%zu",
+                  filename.c_str(), topology.c_str(), inputSize, hiddenSize, outputSize);
+        return false;
     }
-    file.close();
-}
\ No newline at end of file
+    return true;
+}
+
+/**
+ * @brief Saves the weights and biases as a model file (header, topology, checksum, one bulk write). The transposed
+ *        first layer is stored too, so networks that map the file run sparse inputs without a private copy.
+ *
+ * @param filename  Destination file
+ *
+ * @return True if the file was written
+ */
+bool FFNeuralNet::saveFinalWeights(const string &filename)
+{
+    const vector<uint32_t> layerSizes = {static_cast<uint32_t>(inputSize), static_cast<uint32_t>(hiddenSize), static_cast<uint32_t>(outputSize)};
+    return NNModel::writeModelFile(filename, layerSizes, parameterView, parameterCount(), transposedHiddenWeights());
+}
+
+/**
+ * @brief Loads weights and biases from a model file (or a legacy headerless file) into this network's own buffer
+ *
+ * @param filename  Model file
+ *
+ * @return True if the file matched the network topology and was loaded; the network is unchanged otherwise
+ */
+bool FFNeuralNet::loadPretrainedWeights(const string &filename)
+{
+    NNModel::MappedModel model;
+    if (!model.open(filename) || !acceptsModel(model, filename))
+        return false;
+
+    mappedModel.reset();
+    parameters.assign(model.parameters(), model.parameters() + parameterCount());
+    parameterView = parameters.data();
+    transposedInputWeights->ready.store(false, memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Uses the weights and biases of a model file in place from a read-only shared mapping
+ *
+ * @param filename  Model file
+ *
+ * @return True if the file matched the network topology and is now in use; the network is unchanged otherwise
+ */
+bool FFNeuralNet::mapPretrainedWeights(const string &filename)
+{
+    auto model = make_shared<NNModel::MappedModel>();
+    if (!model->open(filename))
+        return false;
+    return useMappedWeights(move(model), filename);
+}
+
+/**
+ * @brief Reads the parameters from an already mapped model file, which can be shared by several networks
+ *
+ * @param model     Opened model file
+ * @param filename  File name for error messages
+ *
+ * @return True if the model matched the network topology
+ */
+bool FFNeuralNet::useMappedWeights(shared_ptr<const NNModel::MappedModel> model, const string &filename)
+{
+    if (!model || !acceptsModel(*model, filename))
+        return false;
+
+    mappedModel = move(model);
+    parameterView = mappedModel->parameters();
+    vector<double>().swap(parameters); // release the private copy
+    transposedInputWeights->ready.store(false, memory_order_relaxed);
+    return true;
+}
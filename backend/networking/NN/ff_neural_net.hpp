@@ -2,42 +2,279 @@
 #define FF_NEURAL_NET_HPP
 
 #include <vector>
+#include <string>
 #include <functional>
-#include "../utils/utils.hpp"
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include "utils/utils.hpp"
+#include "utils/arena.hpp"
+#include "optim/optimizers.hpp"
+#include "model/model_file.hpp"
+#include "data/sample_source.hpp"
+
+class TrainingDatabase;
+
+// How a train() call ended
+enum class TrainingResult
+{
+    Completed, // every epoch trained and checkpointed
+    Stopped,   // TrainingConfig::onProgress returned false
+    Failed     // bad samples, a lost gradient-reducer peer or an unusable checkpoint; the cause is logged
+};
+
+// Where a train() call is, reported to TrainingConfig::onProgress
+struct TrainingProgress
+{
+    int epoch = 0; // 1-based
+    int epochs = 0;
+    size_t samples = 0; // trained so far in this epoch
+    size_t samplesPerEpoch = 0;
+    double loss = 0.0;         // average loss over the epoch so far
+    double learningRate = 0.0; // rate of the most recent optimizer step
+    bool epochComplete = false; // the epoch finished and its checkpoint was written
+};
+
+/**
+ * @brief Sums gradients across data-parallel trainers, e.g. Distributed::RingAllReduce. During the backward pass of
+ *        each step's last sample, train() reports ranges of the gradient buffer as they become final, always in the same
+ *        order, so a reducer can communicate them while the rest of the backward pass runs.
+ */
+class GradientReducer
+{
+public:
+    virtual ~GradientReducer() = default;
+    // Trainers whose gradients are summed, this one included
+    virtual size_t worldSize() const = 0;
+    // Called once before training so every trainer starts from the same parameters
+    virtual bool synchronizeParameters(double *parameters, size_t count) = 0;
+    // gradients[begin, end) holds this trainer's final gradients for the current step
+    virtual void gradientsReady(double *gradients, size_t begin, size_t end) = 0;
+    // Returns once every reported range holds the sum over all trainers; false if a peer was lost
+    virtual bool finishStep() = 0;
+};
+
+struct TrainingConfig
+{
+    int epochs = 10;
+    size_t batchSize = 1; // samples whose gradients are averaged into one optimizer step
+    NNOptim::OptimizerConfig optimizer;
+    NNOptim::LearningRateSchedule schedule;
+    std::string trainingDataFile = "mnist/data/training_data.dat";
+    std::string probabilitiesFile = "mnist/data/probabilities.dat";
+    // Optional; called after every optimizer step and every epoch checkpoint. Returning false stops training.
+    std::function<bool(const TrainingProgress &)> onProgress;
+    // Optional; makes this a data-parallel trainer whose steps average the gradients of every peer's batch.
+    // Every peer must run the same number of steps.
+    GradientReducer *gradientReducer = nullptr;
+    // Optional; makes the run resumable. train() continues from this checkpoint if it exists, rewrites it after every
+    // epoch (and every checkpointEverySteps optimizer steps) and deletes it once the last epoch is done.
+    std::string checkpointFile;
+    uint64_t checkpointEverySteps = 0; // 0 checkpoints only at the end of each epoch
+    // Visit the samples in a new random order every epoch; the generator's state is part of the checkpoint
+    bool shuffle = false;
+    uint64_t shuffleSeed = 1;
+};
+
+// Nonzero entries of one input image, compacted once per sample into workspace memory
+struct SparseInput
+{
+    uint32_t *indices = nullptr;
+    double *values = nullptr; // normalized to [0, 1]
+    size_t count = 0;
+};
 
 class FFNeuralNet
 {
-    std::vector<std::vector<double>> inputToHiddenLayerWeights;
-    std::vector<std::vector<double>> hiddenToOutputLayerWeights;
-    std::vector<double> hiddenLayerBiases;
-    std::vector<double> outputLayerBiases;
+public:
+    enum class InputMode
+    {
+        Auto,   // sparse when the sample's measured density is at most SPARSE_DENSITY_THRESHOLD
+        Dense,
+        Sparse
+    };
+
+    // Above this fraction of nonzero pixels the dense kernels are faster (see the sparseInput benchmark)
+    static constexpr double SPARSE_DENSITY_THRESHOLD = 0.5;
+    // Input-to-hidden gradient rows are handed to a GradientReducer in buckets of about this many values
+    static constexpr size_t GRADIENT_BUCKET_VALUES = 16384;
+
+    /**
+     * @brief Scratch memory for forward and backward passes, carved once from an arena sized from the topology (and
+     *        the largest batch), so steady-state inference and training make no heap allocations.
+     *        A workspace is not thread-safe: keep one per thread or per request.
+     */
+    class Workspace
+    {
+        friend class FFNeuralNet;
+        friend class FFNeuralNetBenchmark;
 
-    std::vector<double> computeLayerActivation(
-        const std::vector<double> &input,
-        const std::vector<std::vector<double>> &weights,
-        std::vector<double> &biases,
-        std::function<double(double)> activationFunction);
+        size_t inputSize;
+        size_t hiddenSize;
+        size_t outputSize;
+        size_t batchCapacity;
+        NNUtils::Arena arena;
+
+        double *inputNormalized; // batchCapacity x inputSize
+        SparseInput sparseInput;  // nonzero pixels of the current image
+        double *hidden;          // batchCapacity x hiddenSize
+        double *logits;          // outputSize
+        double *probabilities;   // outputSize
+        double *outputError;     // outputSize
+        double *hiddenError;     // hiddenSize
+        size_t *denseImages;     // batchCapacity
+
+    public:
+        Workspace(size_t inputSize, size_t hiddenSize, size_t outputSize, size_t batchCapacity = 1);
+        bool fits(const FFNeuralNet &net, size_t batchSize = 1) const;
+        size_t bytes() const { return arena.bytesUsed(); }
+    };
+
+private:
+    // Microbenchmarks in bench/ time the private layer kernels directly
+    friend class FFNeuralNetBenchmark;
+
+    size_t inputSize;
+    size_t hiddenSize;
+    size_t outputSize;
+
+    // All weights and biases in one buffer, in the order they are persisted:
+    // input-to-hidden weights (hidden x input, row-major), hidden-to-output weights (output x hidden), hidden biases, output biases
+    std::vector<double> parameters;
+    // Read-only view of the parameters: `parameters`, or a model file mapped with mapPretrainedWeights (then `parameters` is empty)
+    const double *parameterView = nullptr;
+    std::shared_ptr<const NNModel::MappedModel> mappedModel;
+    // Gradients accumulated by applyBackpropagation, laid out exactly like `parameters` (allocated on first use)
+    std::vector<double> gradients;
+
+    std::unique_ptr<NNOptim::Optimizer> optimizer;
+    NNOptim::OptimizerConfig optimizerConfig;
+
+    InputMode inputMode = InputMode::Auto;
+    // 0 marks pruned parameters that train() keeps at zero; empty when nothing is pruned
+    std::vector<uint8_t> parameterMask;
+
+    // Input-to-hidden weights transposed to (input x hidden), so a nonzero pixel's weights are one contiguous column.
+    // Built on first sparse inference and rebuilt after the parameters change. Not used for a mapped model file that
+    // stores its own transposed copy (see saveFinalWeights), which stays shared through the page cache.
+    struct TransposedWeights
+    {
+        std::mutex buildMutex;
+        std::atomic<bool> ready{false};
+        std::vector<double> weights;
+    };
+    std::unique_ptr<TransposedWeights> transposedInputWeights;
+
+    // Writable parameters; a network reading a mapped model file first copies it into `parameters`
+    double *mutableParameters()
+    {
+        if (mappedModel)
+            detachMappedWeights();
+        transposedInputWeights->ready.store(false, std::memory_order_relaxed);
+        return parameters.data();
+    }
+    void detachMappedWeights();
+    bool acceptsModel(const NNModel::MappedModel &model, const std::string &filename) const;
+
+    double *inputToHiddenLayerWeights() { return mutableParameters(); }
+    double *hiddenToOutputLayerWeights() { return mutableParameters() + hiddenSize * inputSize; }
+    double *hiddenLayerBiases() { return hiddenToOutputLayerWeights() + outputSize * hiddenSize; }
+    double *outputLayerBiases() { return hiddenLayerBiases() + hiddenSize; }
+    const double *inputToHiddenLayerWeights() const { return parameterView; }
+    const double *hiddenToOutputLayerWeights() const { return parameterView + hiddenSize * inputSize; }
+    const double *hiddenLayerBiases() const { return hiddenToOutputLayerWeights() + outputSize * hiddenSize; }
+    const double *outputLayerBiases() const { return hiddenLayerBiases() + hiddenSize; }
+
+    void computeLayerActivation(
+        const double *input,
+        size_t inputCount,
+        const double *weights,
+        const double *biases,
+        size_t outputSize,
+        std::function<double(double)> activationFunction,
+        double *output) const;
 
     void applyBackpropagation(
-        const std::vector<double> &inputNormalized,
-        const std::vector<double> &hiddenToOutputLayerActivation,
-        const std::vector<double> &outputLayerProbability,
-        int actualLabel,
-        double learningRate);
+        const double *inputNormalized,
+        const double *hiddenToOutputLayerActivation,
+        const double *outputError,
+        Workspace &workspace,
+        const SparseInput *sparseInput = nullptr,
+        GradientReducer *reducer = nullptr);
+
+    static void compactInput(const uint8_t *input, size_t size, SparseInput &sparse);
+    bool useSparseInput(size_t nonzeros) const;
+    const double *transposedHiddenWeights() const;
+    void computeHiddenActivationSparse(const SparseInput &input, double *hidden) const;
+    void computeHiddenActivationGather(const SparseInput &input, double *hidden) const;
+    void computeOutputLogits(const double *hidden, double *logits) const;
+    void computeOutputProbabilities(const double *hidden, Workspace &workspace) const;
+    double trainSample(const uint8_t *image, int label, Workspace &workspace, GradientReducer *reducer = nullptr);
+    Workspace &threadWorkspace(size_t batchSize) const;
 
     std::vector<double> extractNetworkParameters() const;
 
+    // Where a resumed train() call starts: epochs already done and how far into the next one it got
+    struct ResumePoint
+    {
+        int epoch = 0;
+        size_t nextSample = 0;
+        double lossSum = 0.0;
+    };
+    bool restoreCheckpoint(const TrainingConfig &config, size_t numSamples, size_t batchSize, TrainingDatabase &db,
+                           ResumePoint &resume, std::mt19937_64 &shuffler);
+    bool writeCheckpoint(const TrainingConfig &config, size_t numSamples, size_t batchSize, const ResumePoint &point,
+                         const std::mt19937_64 &shuffler, TrainingDatabase &db);
+
 public:
     FFNeuralNet(int inputSize, int hiddenSize, int outputSize);
-    std::vector<double> performForwardPass(const std::vector<uint8_t> &input);
+    Workspace makeWorkspace(size_t batchCapacity = 1) const { return Workspace(inputSize, hiddenSize, outputSize, batchCapacity); }
+
+    // Convenience forms: run in a per-thread workspace and return a new vector
+    std::vector<double> performForwardPass(const std::vector<uint8_t> &input) const;
+    void performForwardPassBatch(
+        const std::vector<std::vector<uint8_t>> &images,
+        size_t first, size_t count,
+        double *probabilities) const;
+
+    // Allocation-free forms; the returned probabilities live in `workspace` until its next use
+    const double *performForwardPass(const uint8_t *input, Workspace &workspace) const;
+    void performForwardPassBatch(
+        const std::vector<std::vector<uint8_t>> &images,
+        size_t first, size_t count,
+        double *probabilities,
+        Workspace &workspace) const;
+    size_t getInputSize() const { return inputSize; }
+    size_t getOutputSize() const { return outputSize; }
+    void setInputMode(InputMode mode) { inputMode = mode; }
+    const double *getParameters() const { return parameterView; }
+    void setParameters(const std::vector<double> &values);
+    void setParameterMask(std::vector<uint8_t> mask);
+    size_t parameterCount() const { return hiddenSize * inputSize + outputSize * hiddenSize + hiddenSize + outputSize; }
+
+    TrainingResult train(
+        const std::vector<std::vector<uint8_t>> &images,
+        const std::vector<uint8_t> &labels,
+        const TrainingConfig &config);
+    // Same, reading each epoch from `samples`, e.g. an NNData::StreamingDataset for data larger than memory
+    TrainingResult train(NNData::SampleSource &samples, const TrainingConfig &config);
 
+    // Plain per-sample SGD, kept for existing callers
     void train(
         const std::vector<std::vector<uint8_t>> &images,
         const std::vector<uint8_t> &labels,
-        int epochs, double learningRate);
+        int epochs, double learningRate,
+        const std::string &trainingDataFile = "mnist/data/training_data.dat");
 
-    void saveFinalWeights(const std::string &fileName);
-    void loadPretrainedWeights(const std::string &filename);
+    bool saveFinalWeights(const std::string &fileName);
+    // Copies the weights in; the network can keep training from them
+    bool loadPretrainedWeights(const std::string &filename);
+    // Uses the weights in place from a read-only shared mapping (zero-copy); training later takes a private copy.
+    // Files saved before the transposed first layer was stored build a private one on first sparse inference.
+    bool mapPretrainedWeights(const std::string &filename);
+    bool useMappedWeights(std::shared_ptr<const NNModel::MappedModel> model, const std::string &filename);
 };
 
-#endif
\ No newline at end of file
+#endif
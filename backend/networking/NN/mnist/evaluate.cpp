@@ -0,0 +1,205 @@
+#include "mnist_loader.hpp"
+#include "../ff_neural_net.hpp"
+#include "../../Logging/Logger.hpp"
+#include "../../Metrics/Metrics.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+const string MNIST_TEST_IMAGES_PATH = "../../../data/mnist/t10k-images-idx3-ubyte/t10k-images-idx3-ubyte";
+const string MNIST_TEST_LABELS_PATH = "../../../data/mnist/t10k-labels-idx1-ubyte/t10k-labels-idx1-ubyte";
+const int MNIST_TEST_IMAGES = 10000;
+const int MNIST_IMAGE_SIZE = 28 * 28;
+const int HIDDEN_LAYER_SIZE = 128;
+const int MNIST_POSSIBLE_DIGIT_OUTPUTS = 10;
+const string WEIGHTS_FILE = "mnist/data/weights.dat";
+const string PROBABILITIES_FILE = "mnist/data/probabilities.dat";
+const string METRICS_FILE = "mnist/data/evaluate_metrics.prom";
+
+struct EvaluateOptions
+{
+    string weightsFile = WEIGHTS_FILE;
+    int count = MNIST_TEST_IMAGES;
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    size_t batchSize = 64;
+    bool writeProbabilities = false;
+    double minAccuracy = -1.0; // exit with status 2 when accuracy falls below this
+};
+
+void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --weights FILE          weights to evaluate (default %s)\n"
+            "  --count N               test images to evaluate (default all %d)\n"
+            "  --threads N             inference threads (default: hardware concurrency)\n"
+            "  --batch N               images per forward-pass batch (default 64)\n"
+            "  --write-probabilities   write every probability vector to %s\n"
+            "  --min-accuracy A        exit with status 2 if accuracy is below A (0-1)\n",
+            program, WEIGHTS_FILE.c_str(), MNIST_TEST_IMAGES, PROBABILITIES_FILE.c_str());
+}
+
+bool parseOptions(int argc, char *argv[], EvaluateOptions &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--write-probabilities")
+        {
+            options.writeProbabilities = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        if (arg == "--weights")
+            options.weightsFile = value;
+        else if (arg == "--count")
+            options.count = atoi(value);
+        else if (arg == "--threads")
+            options.threads = static_cast<unsigned>(max(1, atoi(value)));
+        else if (arg == "--batch")
+            options.batchSize = static_cast<size_t>(max(1, atoi(value)));
+        else if (arg == "--min-accuracy")
+            options.minAccuracy = atof(value);
+        else
+            return false;
+    }
+    return options.count > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    EvaluateOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    vector<vector<uint8_t>> images = loadMNISTImages(MNIST_TEST_IMAGES_PATH, options.count);
+    vector<uint8_t> labels = loadMNISTLabels(MNIST_TEST_LABELS_PATH, static_cast<int>(images.size()));
+    const size_t numImages = images.size();
+    if (numImages == 0 || labels.size() != numImages)
+        return 1;
+    for (size_t i = 0; i < numImages; ++i)
+    {
+        if (images[i].size() != MNIST_IMAGE_SIZE || labels[i] >= MNIST_POSSIBLE_DIGIT_OUTPUTS)
+        {
+            LOG_ERROR("Invalid test sample at index %zu", i);
+            return 1;
+        }
+    }
+
+    FFNeuralNet net(MNIST_IMAGE_SIZE, HIDDEN_LAYER_SIZE, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+    if (!net.mapPretrainedWeights(options.weightsFile))
+        return 1;
+
+    const size_t classes = MNIST_POSSIBLE_DIGIT_OUTPUTS;
+    // Each batch writes its own slice, so the whole set can be persisted with one write
+    vector<double> probabilities(numImages * classes);
+    // confusion[actual * classes + predicted], one matrix per thread and summed afterwards
+    vector<vector<uint64_t>> confusionPerThread(options.threads, vector<uint64_t>(classes * classes, 0));
+    atomic<size_t> nextBatch{0};
+    const size_t numBatches = (numImages + options.batchSize - 1) / options.batchSize;
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned t = 0; t < options.threads; ++t)
+    {
+        workers.emplace_back([&, t]
+                             {
+            vector<uint64_t> &confusion = confusionPerThread[t];
+            FFNeuralNet::Workspace workspace = net.makeWorkspace(options.batchSize);
+            for (size_t batch = nextBatch++; batch < numBatches; batch = nextBatch++)
+            {
+                size_t first = batch * options.batchSize;
+                size_t count = min(options.batchSize, numImages - first);
+                double *output = probabilities.data() + first * classes;
+                net.performForwardPassBatch(images, first, count, output, workspace);
+
+                for (size_t b = 0; b < count; ++b)
+                {
+                    const double *row = output + b * classes;
+                    size_t predicted = max_element(row, row + classes) - row;
+                    ++confusion[labels[first + b] * classes + predicted];
+                }
+            } });
+    }
+    for (thread &worker : workers)
+        worker.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<uint64_t> confusion(classes * classes, 0);
+    for (const vector<uint64_t> &partial : confusionPerThread)
+        for (size_t i = 0; i < confusion.size(); ++i)
+            confusion[i] += partial[i];
+
+    uint64_t correct = 0;
+    for (size_t c = 0; c < classes; ++c)
+        correct += confusion[c * classes + c];
+    double accuracy = static_cast<double>(correct) / numImages;
+
+    printf("Evaluated %zu images in %.3f s: %.1f images/sec (%u threads, batch %zu)\n",
+           numImages, seconds, numImages / seconds, options.threads, options.batchSize);
+    printf("Accuracy: %.4f (%llu/%zu)\n\n", accuracy, static_cast<unsigned long long>(correct), numImages);
+
+    printf("Confusion matrix (rows = actual, columns = predicted)\n      ");
+    for (size_t p = 0; p < classes; ++p)
+        printf("%6zu", p);
+    printf("\n");
+    for (size_t a = 0; a < classes; ++a)
+    {
+        printf("%6zu", a);
+        for (size_t p = 0; p < classes; ++p)
+            printf("%6llu", static_cast<unsigned long long>(confusion[a * classes + p]));
+        printf("\n");
+    }
+
+    printf("\nclass  precision  recall  support\n");
+    for (size_t c = 0; c < classes; ++c)
+    {
+        uint64_t truePositives = confusion[c * classes + c];
+        uint64_t predictedAsClass = 0, actualClass = 0;
+        for (size_t o = 0; o < classes; ++o)
+        {
+            predictedAsClass += confusion[o * classes + c];
+            actualClass += confusion[c * classes + o];
+        }
+        printf("%5zu  %9.4f  %6.4f  %7llu\n", c,
+               predictedAsClass ? static_cast<double>(truePositives) / predictedAsClass : 0.0,
+               actualClass ? static_cast<double>(truePositives) / actualClass : 0.0,
+               static_cast<unsigned long long>(actualClass));
+    }
+
+    Metrics::Registry &registry = Metrics::Registry::instance();
+    registry.gauge("nn_evaluation_accuracy", "Accuracy on the evaluated test images.").set(accuracy);
+    registry.gauge("nn_evaluation_images_per_second", "Batched multi-threaded inference throughput.").set(numImages / seconds);
+    registry.writeToFile(METRICS_FILE);
+
+    if (options.writeProbabilities)
+    {
+        ofstream probFile(PROBABILITIES_FILE, ios::binary | ios::trunc);
+        probFile.write(reinterpret_cast<const char *>(probabilities.data()), probabilities.size() * sizeof(double));
+        if (!probFile)
+        {
+            LOG_ERROR("Error writing %s", PROBABILITIES_FILE.c_str());
+            return 1;
+        }
+    }
+
+    if (options.minAccuracy >= 0.0 && accuracy < options.minAccuracy)
+    {
+        LOG_ERROR("Accuracy %.4f is below the required %.4f", accuracy, options.minAccuracy);
+        return 2;
+    }
+    return 0;
+}
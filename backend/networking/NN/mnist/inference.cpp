@@ -1,5 +1,7 @@
 #include "mnist_loader.hpp"
-#include "../ff_neural_net.hpp"
+#include "../static_ff_net.hpp"
+#include "../../Logging/Logger.hpp"
+#include "../../Metrics/Metrics.hpp"
 #include <iostream>
 #include <fstream>
 
@@ -9,19 +11,28 @@ const int MNIST_IMAGE_ROWS = 28;
 const int MNIST_IMAGE_COLS = 28;
 const int MNIST_IMAGE_SIZE = MNIST_IMAGE_ROWS * MNIST_IMAGE_COLS;
 const int MNIST_POSSIBLE_DIGIT_OUTPUTS = 10;
+const int HIDDEN_LAYER_SIZE = 128;
+
+// The production topology is fixed, so inference uses the compile-time specialized network
+using MnistNet = StaticFFNet<MNIST_IMAGE_SIZE, HIDDEN_LAYER_SIZE, MNIST_POSSIBLE_DIGIT_OUTPUTS>;
 
 int main()
 {
     std::vector<std::vector<uint8_t>> test_images = loadMNISTImages("../../../data/mnist/t10k-images-idx3-ubyte/t10k-images-idx3-ubyte", 10);
-    std::cout << "Number of images loaded: " << test_images.size() << std::endl;
+    LOG_INFO("Number of images loaded: %zu", test_images.size());
+    if (test_images.empty())
+        return 1;
 
-    FFNeuralNet net(MNIST_IMAGE_SIZE, 128, MNIST_POSSIBLE_DIGIT_OUTPUTS);
-    net.loadPretrainedWeights("mnist/data/weights.dat");
+    MnistNet net;
+    if (!net.loadPretrainedWeights("mnist/data/weights.dat"))
+        return 1;
+    Metrics::Histogram &forwardPassTime = Metrics::Registry::instance().histogram(
+        "nn_forward_pass_seconds", "Time spent in one inference forward pass.");
 
     std::ofstream prob_file("mnist/data/probabilities.dat", std::ios::binary);
     if (!prob_file.is_open())
     {
-        std::cerr << "Error opening probabilities.dat for writing!" << std::endl;
+        LOG_ERROR("Error opening probabilities.dat for writing!");
         return 1;
     }
 
@@ -29,18 +40,23 @@ int main()
     {
         if (test_images[i].size() != MNIST_IMAGE_SIZE)
         {
-            std::cerr << "Invalid image size at index " << i << ": " << test_images[i].size() << std::endl;
+            LOG_ERROR("Invalid image size at index %zu: %zu", i, test_images[i].size());
             continue;
         }
 
-        std::vector<double> probabilityOutputs = net.performForwardPass(test_images[i]);
-        for (int i = 0; i < probabilityOutputs.size(); ++i)
+        MnistNet::Probabilities probabilityOutputs;
+        {
+            Metrics::ScopedTimer timer(forwardPassTime);
+            probabilityOutputs = net.performForwardPass(test_images[i]);
+        }
+        for (size_t digit = 0; digit < probabilityOutputs.size(); ++digit)
         {
-            cout << probabilityOutputs.data()[i];
+            LOG_DEBUG("Image %zu - P(%zu) = %f", i, digit, probabilityOutputs[digit]);
         }
         prob_file.write(reinterpret_cast<const char *>(probabilityOutputs.data()), probabilityOutputs.size() * sizeof(double));
     }
 
     prob_file.close();
+    Metrics::Registry::instance().writeToFile("mnist/data/inference_metrics.prom");
     return 0;
 }
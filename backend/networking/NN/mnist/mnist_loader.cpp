@@ -1,19 +1,20 @@
 #include "mnist_loader.hpp"
 #include <fstream>
 #include <iostream>
+#include "../../Logging/Logger.hpp"
 
 std::vector<std::vector<uint8_t>> loadMNISTImages(const std::string &fileName, int num_images)
 {
     std::ifstream file(fileName, std::ios::binary);
     if (!file.is_open())
     {
-        std::cerr << "loadMNISTImages - Error: Could not open: " << fileName << std::endl;
-        exit(1);
+        LOG_ERROR("loadMNISTImages - Error: Could not open: %s", fileName.c_str());
+        return {};
     }
 
     file.seekg(0, std::ios::end);
     std::streampos fileSize = file.tellg();
-    std::cout << "File size: " << fileSize << " bytes" << std::endl;
+    LOG_DEBUG("File size: %lld bytes", static_cast<long long>(fileSize));
     file.seekg(0, std::ios::beg); // move read pointer back to beginning
 
     uint32_t magic = 0, n_images = 0, n_rows = 0, n_cols = 0;
@@ -30,8 +31,8 @@ std::vector<std::vector<uint8_t>> loadMNISTImages(const std::string &fileName, i
 
     if (magic != 0x803)
     {
-        std::cerr << "Invalid MNIST image file!" << std::endl;
-        exit(1);
+        LOG_ERROR("Invalid MNIST image file: %s", fileName.c_str());
+        return {};
     }
 
     num_images = std::min(num_images, static_cast<int>(n_images));
@@ -45,13 +46,13 @@ std::vector<std::vector<uint8_t>> loadMNISTImages(const std::string &fileName, i
 
         if (!file)
         {
-            std::cerr << "Error reading image " << i << std::endl;
-            exit(1);
+            LOG_ERROR("Error reading image %d", i);
+            return {};
         }
     }
     file.close();
 
-    std::cout << "Loaded " << num_images << " images of size " << n_rows << "x" << n_cols << std::endl;
+    LOG_INFO("Loaded %d images of size %ux%u", num_images, n_rows, n_cols);
     return images;
 }
 
@@ -60,13 +61,18 @@ std::vector<uint8_t> loadMNISTLabels(const std::string &fileName, int num_images
     std::ifstream file(fileName, std::ios::binary);
     if (!file.is_open())
     {
-        std::cerr << "Error: Could not open " << fileName << std::endl;
-        exit(1);
+        LOG_ERROR("Error: Could not open %s", fileName.c_str());
+        return {};
     }
 
     file.ignore(8); // Skip header
     std::vector<uint8_t> labels(num_images);
     file.read(reinterpret_cast<char *>(labels.data()), num_images);
+    if (!file)
+    {
+        LOG_ERROR("Error: %s has fewer than %d labels", fileName.c_str(), num_images);
+        return {};
+    }
 
     file.close();
     return labels;
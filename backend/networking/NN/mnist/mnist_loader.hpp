@@ -5,6 +5,7 @@
 #include <string>
 #include <cstdint>
 
+// Both loaders log the error and return an empty vector if the file is missing or malformed
 std::vector<std::vector<uint8_t>> loadMNISTImages(const std::string &fileName, int num_images);
 std::vector<uint8_t> loadMNISTLabels(const std::string &fileName, int num_images);
 
@@ -0,0 +1,216 @@
+#include "mnist_loader.hpp"
+#include "../ff_neural_net.hpp"
+#include "../sparse/sparse_ff_net.hpp"
+#include "../../Logging/Logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const string MNIST_TRAIN_IMAGES_PATH = "../../../data/mnist/train-images.idx3-ubyte";
+const string MNIST_TRAIN_LABELS_PATH = "../../../data/mnist/train-labels.idx1-ubyte";
+const string MNIST_TEST_IMAGES_PATH = "../../../data/mnist/t10k-images-idx3-ubyte/t10k-images-idx3-ubyte";
+const string MNIST_TEST_LABELS_PATH = "../../../data/mnist/t10k-labels-idx1-ubyte/t10k-labels-idx1-ubyte";
+const int MNIST_IMAGE_SIZE = 28 * 28;
+const int HIDDEN_LAYER_SIZE = 128;
+const int MNIST_POSSIBLE_DIGIT_OUTPUTS = 10;
+const string WEIGHTS_FILE = "mnist/data/weights.dat";
+const string PRUNED_WEIGHTS_FILE = "mnist/data/weights_pruned.dat";
+const string FINETUNE_HISTORY_FILE = "mnist/data/prune_finetune.dat";
+
+struct PruneOptions
+{
+    string weightsFile = WEIGHTS_FILE;
+    string outputFile = PRUNED_WEIGHTS_FILE;
+    vector<double> sparsities = {0.5, 0.7, 0.8, 0.9, 0.95};
+    NNModel::Layout format = NNModel::Layout::CSR;
+    int finetuneEpochs = 0;
+    int trainCount = 1000;
+    int testCount = 10000;
+    double minAccuracy = -1.0; // export the sparsest model at or above this accuracy
+};
+
+struct PruneResult
+{
+    double sparsity;
+    double accuracy;
+    double denseUs;  // FFNeuralNet with the pruned weights
+    double sparseUs; // SparseFFNet in the chosen format
+    size_t modelBytes;
+    NNSparse::SparseFFNet model;
+};
+
+void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --weights FILE          dense model to prune (default %s)\n"
+            "  --sparsity LIST         comma-separated target sparsities of the first layer (default 0.5,0.7,0.8,0.9,0.95)\n"
+            "  --format csr|block      csr: prune individual weights; block: prune %ux1 blocks for the vectorized kernel (default csr)\n"
+            "  --finetune-epochs N     fine-tune the remaining weights with Adam after pruning (default 0)\n"
+            "  --train-count N         training images used for fine-tuning (default 1000)\n"
+            "  --test-count N          test images used for accuracy and latency (default 10000)\n"
+            "  --min-accuracy A        export the sparsest model with accuracy >= A (default: the last sparsity)\n"
+            "  --output FILE           exported sparse model (default %s)\n",
+            program, WEIGHTS_FILE.c_str(), NNSparse::BLOCK_ROWS, PRUNED_WEIGHTS_FILE.c_str());
+}
+
+bool parseOptions(int argc, char *argv[], PruneOptions &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        string value = argv[++i];
+        if (arg == "--weights")
+            options.weightsFile = value;
+        else if (arg == "--output")
+            options.outputFile = value;
+        else if (arg == "--sparsity")
+        {
+            options.sparsities.clear();
+            stringstream list(value);
+            string item;
+            while (getline(list, item, ','))
+                options.sparsities.push_back(atof(item.c_str()));
+        }
+        else if (arg == "--format")
+        {
+            if (value == "csr")
+                options.format = NNModel::Layout::CSR;
+            else if (value == "block")
+                options.format = NNModel::Layout::BlockSparse;
+            else
+                return false;
+        }
+        else if (arg == "--finetune-epochs")
+            options.finetuneEpochs = atoi(value.c_str());
+        else if (arg == "--train-count")
+            options.trainCount = atoi(value.c_str());
+        else if (arg == "--test-count")
+            options.testCount = atoi(value.c_str());
+        else if (arg == "--min-accuracy")
+            options.minAccuracy = atof(value.c_str());
+        else
+            return false;
+    }
+    return !options.sparsities.empty();
+}
+
+// Mean single-image latency in microseconds over the test set, and the accuracy of the predictions
+template <typename Net>
+double measure(const Net &net, const vector<vector<uint8_t>> &images, const vector<uint8_t> &labels, double &accuracy)
+{
+    size_t correct = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        vector<double> probabilities = net.performForwardPass(images[i]);
+        size_t predicted = max_element(probabilities.begin(), probabilities.end()) - probabilities.begin();
+        correct += predicted == labels[i];
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    accuracy = static_cast<double>(correct) / images.size();
+    return seconds * 1e6 / images.size();
+}
+
+int main(int argc, char *argv[])
+{
+    PruneOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    vector<vector<uint8_t>> testImages = loadMNISTImages(MNIST_TEST_IMAGES_PATH, options.testCount);
+    vector<uint8_t> testLabels = loadMNISTLabels(MNIST_TEST_LABELS_PATH, static_cast<int>(testImages.size()));
+    vector<vector<uint8_t>> trainImages;
+    vector<uint8_t> trainLabels;
+    if (options.finetuneEpochs > 0)
+    {
+        trainImages = loadMNISTImages(MNIST_TRAIN_IMAGES_PATH, options.trainCount);
+        trainLabels = loadMNISTLabels(MNIST_TRAIN_LABELS_PATH, static_cast<int>(trainImages.size()));
+        if (trainImages.empty() || trainLabels.size() != trainImages.size())
+            return 1;
+    }
+    if (testImages.empty() || testLabels.size() != testImages.size())
+        return 1;
+
+    FFNeuralNet baseline(MNIST_IMAGE_SIZE, HIDDEN_LAYER_SIZE, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+    if (!baseline.loadPretrainedWeights(options.weightsFile))
+        return 1;
+    const vector<double> trained(baseline.getParameters(), baseline.getParameters() + baseline.parameterCount());
+    const size_t firstLayerCount = static_cast<size_t>(HIDDEN_LAYER_SIZE) * MNIST_IMAGE_SIZE;
+    const char *formatName = options.format == NNModel::Layout::BlockSparse ? "block" : "csr";
+
+    double baselineAccuracy;
+    double baselineUs = measure(baseline, testImages, testLabels, baselineAccuracy);
+    printf("dense baseline: accuracy %.4f, %.2f us/image, %zu bytes\n\n", baselineAccuracy, baselineUs, trained.size() * sizeof(double));
+    printf("sparsity  format  finetune  accuracy  dense us/img  sparse us/img  speedup  model bytes\n");
+
+    vector<PruneResult> results;
+    for (double sparsity : options.sparsities)
+    {
+        vector<double> parameters = trained;
+        vector<uint8_t> mask(parameters.size(), 1);
+        if (options.format == NNModel::Layout::BlockSparse)
+            NNSparse::pruneBlocksByMagnitude(parameters.data(), HIDDEN_LAYER_SIZE, MNIST_IMAGE_SIZE, sparsity, mask.data());
+        else
+            NNSparse::pruneByMagnitude(parameters.data(), firstLayerCount, sparsity, mask.data());
+
+        FFNeuralNet pruned(MNIST_IMAGE_SIZE, HIDDEN_LAYER_SIZE, MNIST_POSSIBLE_DIGIT_OUTPUTS);
+        pruned.setParameters(parameters);
+        if (options.finetuneEpochs > 0)
+        {
+            TrainingConfig config;
+            config.epochs = options.finetuneEpochs;
+            config.batchSize = 16;
+            config.optimizer.type = NNOptim::OptimizerType::Adam;
+            config.optimizer.learningRate = 0.0005;
+            config.trainingDataFile = FINETUNE_HISTORY_FILE;
+            pruned.setParameterMask(mask);
+            pruned.train(trainImages, trainLabels, config);
+            filesystem::remove(FINETUNE_HISTORY_FILE);
+        }
+
+        NNSparse::SparseFFNet sparse(MNIST_IMAGE_SIZE, HIDDEN_LAYER_SIZE, MNIST_POSSIBLE_DIGIT_OUTPUTS, pruned.getParameters(), options.format);
+        double denseAccuracy, sparseAccuracy;
+        double denseUs = measure(pruned, testImages, testLabels, denseAccuracy);
+        double sparseUs = measure(sparse, testImages, testLabels, sparseAccuracy);
+        if (denseAccuracy != sparseAccuracy)
+            LOG_WARN("Sparse and dense predictions differ at sparsity %.2f: %.4f vs %.4f", sparsity, sparseAccuracy, denseAccuracy);
+
+        printf("%8.2f  %6s  %8d  %8.4f  %12.2f  %13.2f  %6.2fx  %11zu\n", sparsity, formatName, options.finetuneEpochs,
+               sparseAccuracy, denseUs, sparseUs, baselineUs / sparseUs, sparse.modelBytes());
+        results.push_back({sparsity, sparseAccuracy, denseUs, sparseUs, sparse.modelBytes(), move(sparse)});
+    }
+
+    const PruneResult *chosen = nullptr;
+    for (const PruneResult &result : results)
+    {
+        bool meetsFloor = options.minAccuracy < 0.0 || result.accuracy >= options.minAccuracy;
+        if (meetsFloor && (!chosen || result.sparsity > chosen->sparsity || options.minAccuracy < 0.0))
+            chosen = &result;
+    }
+    if (!chosen)
+    {
+        LOG_ERROR("No pruned model reaches accuracy %.4f; nothing exported", options.minAccuracy);
+        return 2;
+    }
+    if (!chosen->model.save(options.outputFile))
+        return 1;
+    printf("\nexported sparsity %.2f (%s, accuracy %.4f) to %s\n", chosen->sparsity, formatName, chosen->accuracy, options.outputFile.c_str());
+
+    NNSparse::SparseFFNet reloaded;
+    if (!reloaded.load(options.outputFile))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include "mnist_loader.hpp"
+#include "../sweep/hyperparameter_sweep.hpp"
+#include "../../Logging/Logger.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+const string MNIST_TRAIN_IMAGES_PATH = "../../../data/mnist/train-images.idx3-ubyte";
+const string MNIST_TRAIN_LABELS_PATH = "../../../data/mnist/train-labels.idx1-ubyte";
+const string SWEEP_DIRECTORY = "mnist/data/sweep";
+
+struct SweepOptions
+{
+    vector<size_t> hiddenSizes = {64, 128, 256};
+    vector<double> learningRates = {0.0005, 0.002, 0.008};
+    vector<int> epochs = {9};
+    int trainCount = 5000;
+    int validationCount = 1000; // taken from after the training images
+    size_t batchSize = 16;
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    int minEpochs = 1;
+    int reduction = 3;
+    string outputDirectory = SWEEP_DIRECTORY;
+};
+
+void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --hidden LIST         hidden layer sizes, comma-separated (default 64,128,256)\n"
+            "  --learning-rate LIST  AdamW learning rates (default 0.0005,0.002,0.008)\n"
+            "  --epochs LIST         epoch budgets (default 9)\n"
+            "  --train-count N       training images (default 5000)\n"
+            "  --validation N        validation images, read after the training images (default 1000)\n"
+            "  --batch N             samples per optimizer step (default 16)\n"
+            "  --threads N           trials trained at the same time (default: hardware concurrency)\n"
+            "  --min-epochs N        epochs before a trial is first compared with the others (default 1)\n"
+            "  --reduction N         keep the best 1/N of the trials at each comparison (default 3)\n"
+            "  --no-early-stopping   train every trial for its whole budget\n"
+            "  --output DIR          per-trial histories and weights (default %s)\n",
+            program, SWEEP_DIRECTORY.c_str());
+}
+
+// Appends every comma-separated value of `list` parsed by `parse`; false if the list is empty or has a bad value
+template <typename T, typename Parse>
+bool parseList(const char *list, vector<T> &values, Parse parse)
+{
+    values.clear();
+    string text = list;
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find(',', start);
+        if (end == string::npos)
+            end = text.size();
+        string item = text.substr(start, end - start);
+        char *parsedEnd = nullptr;
+        T value = parse(item.c_str(), &parsedEnd);
+        if (item.empty() || *parsedEnd != '\0' || !(value > T(0)))
+            return false;
+        values.push_back(value);
+        start = end + 1;
+    }
+    return !values.empty();
+}
+
+bool parseOptions(int argc, char *argv[], SweepOptions &options)
+{
+    auto parseSize = [](const char *text, char **end)
+    { return static_cast<size_t>(strtoull(text, end, 10)); };
+    auto parseInt = [](const char *text, char **end)
+    { return static_cast<int>(strtol(text, end, 10)); };
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--no-early-stopping")
+        {
+            options.minEpochs = 0;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        bool valid = true;
+        if (arg == "--hidden")
+            valid = parseList(value, options.hiddenSizes, parseSize);
+        else if (arg == "--learning-rate")
+            valid = parseList(value, options.learningRates, strtod);
+        else if (arg == "--epochs")
+            valid = parseList(value, options.epochs, parseInt);
+        else if (arg == "--train-count")
+            options.trainCount = atoi(value);
+        else if (arg == "--validation")
+            options.validationCount = atoi(value);
+        else if (arg == "--batch")
+            options.batchSize = static_cast<size_t>(max(1, atoi(value)));
+        else if (arg == "--threads")
+            options.threads = static_cast<unsigned>(max(1, atoi(value)));
+        else if (arg == "--min-epochs")
+            options.minEpochs = max(1, atoi(value));
+        else if (arg == "--reduction")
+            options.reduction = max(2, atoi(value));
+        else if (arg == "--output")
+            options.outputDirectory = value;
+        else
+            return false;
+        if (!valid)
+            return false;
+    }
+    return options.trainCount > 0 && options.validationCount > 0;
+}
+
+/**
+ * @brief Trains every combination of --hidden, --learning-rate and --epochs in this process and prints one JSON line
+ *        per trial, then a summary line naming the trial with the lowest validation loss. MNIST is loaded once and
+ *        shared read-only by all trials. Exits with status 1 if the data cannot be loaded or any trial fails.
+ */
+int main(int argc, char *argv[])
+{
+    SweepOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const int total = options.trainCount + options.validationCount;
+    vector<vector<uint8_t>> trainImages = loadMNISTImages(MNIST_TRAIN_IMAGES_PATH, total);
+    vector<uint8_t> trainLabels = loadMNISTLabels(MNIST_TRAIN_LABELS_PATH, static_cast<int>(trainImages.size()));
+    if (trainImages.size() != static_cast<size_t>(total) || trainLabels.size() != trainImages.size())
+    {
+        LOG_ERROR("Need %d training and validation images in %s", total, MNIST_TRAIN_IMAGES_PATH.c_str());
+        return 1;
+    }
+    vector<vector<uint8_t>> validationImages(make_move_iterator(trainImages.begin() + options.trainCount),
+                                             make_move_iterator(trainImages.end()));
+    vector<uint8_t> validationLabels(trainLabels.begin() + options.trainCount, trainLabels.end());
+    trainImages.resize(options.trainCount);
+    trainLabels.resize(options.trainCount);
+
+    NNSweep::SweepConfig config;
+    for (size_t hidden : options.hiddenSizes)
+        for (double learningRate : options.learningRates)
+            for (int epochs : options.epochs)
+                config.trials.push_back({hidden, learningRate, epochs});
+    // The same optimizer, schedule and sample order as train.out; only the grid's values differ
+    config.training.batchSize = options.batchSize;
+    config.training.optimizer.type = NNOptim::OptimizerType::AdamW;
+    config.training.optimizer.weightDecay = 1e-4;
+    config.training.schedule.type = NNOptim::ScheduleType::Cosine;
+    config.training.schedule.warmupSteps = 20;
+    config.training.shuffle = true;
+    config.training.shuffleSeed = 42;
+    config.workers = options.threads;
+    config.minEpochs = options.minEpochs;
+    config.reduction = options.reduction;
+    config.outputDirectory = options.outputDirectory;
+
+    NNSweep::SweepSummary summary = NNSweep::runSweep(trainImages, trainLabels, validationImages, validationLabels, config);
+    bool ok = !summary.trials.empty();
+    const NNSweep::TrialResult *best = nullptr;
+    for (const NNSweep::TrialResult &trial : summary.trials)
+    {
+        printf("{\"trial\":%zu,\"hidden\":%zu,\"learning_rate\":%g,\"epochs\":%d,\"state\":\"%s\",\"epochs_trained\":%d,"
+               "\"validation_loss\":%.5f,\"validation_accuracy\":%.4f,\"seconds\":%.2f,\"history\":\"%s\"}\n",
+               trial.id, trial.config.hiddenSize, trial.config.learningRate, trial.config.epochs,
+               NNSweep::trialStateName(trial.state), trial.epochsTrained, trial.validationLoss, trial.validationAccuracy,
+               trial.seconds, trial.trainingDataFile.c_str());
+        ok = ok && trial.state != NNSweep::TrialState::Failed;
+        if (trial.state == NNSweep::TrialState::Completed && (!best || trial.validationLoss < best->validationLoss))
+            best = &trial;
+    }
+    printf("{\"sweep\":\"summary\",\"trials\":%zu,\"threads\":%u,\"epochs_trained\":%llu,\"epoch_budget\":%llu,"
+           "\"steals\":%llu,\"seconds\":%.2f,\"best_trial\":%lld,\"best_weights\":\"%s\"}\n",
+           summary.trials.size(), config.workers, static_cast<unsigned long long>(summary.epochsTrained),
+           static_cast<unsigned long long>(summary.epochBudget), static_cast<unsigned long long>(summary.steals),
+           summary.seconds, best ? static_cast<long long>(best->id) : -1LL, best ? best->weightsFile.c_str() : "");
+    return ok ? 0 : 1;
+}
@@ -1,22 +1,128 @@
 #include "mnist_loader.hpp"
 #include "../ff_neural_net.hpp"
+#include "../data/streaming_dataset.hpp"
+#include "../../Metrics/Metrics.hpp"
+#include "../../Tracing/Trace.hpp"
+#include <cstdio>
+#include <cstdlib>
 
 const std::string MNIST_TRAIN_IMAGES_PATH = "../../../data/mnist/train-images.idx3-ubyte";
 const std::string MNIST_TRAIN_LABELS_PATH = "../../../data/mnist/train-labels.idx1-ubyte";
 const int NUM_TRAINING_IMAGES = 1000;
-const int INPUT_LAYER_SIZE = 28 * 28; 
+const int INPUT_LAYER_SIZE = 28 * 28;
 const int HIDDEN_LAYER_SIZE = 128;
 const int OUTPUT_LAYER_SIZE = 10; // (0-9)
-const int NUM_EPOCHS = 10;
-const double LEARNING_RATE = 0.001;
+const int NUM_EPOCHS = 5;
+const size_t BATCH_SIZE = 16;
+const double LEARNING_RATE = 0.002;
 const std::string FINAL_WEIGHTS_FILE = "mnist/data/weights.dat";
+const std::string METRICS_FILE = "mnist/data/train_metrics.prom";
+const std::string TRACE_FILE = "mnist/data/train_trace.json";
+// An interrupted run continues from here when train.out is started again
+const std::string CHECKPOINT_FILE = "mnist/data/training_checkpoint.dat";
+const uint64_t CHECKPOINT_EVERY_STEPS = 16;
+const uint64_t SHUFFLE_SEED = 42;
 
-int main() {
-    std::vector<std::vector<uint8_t>> images = loadMNISTImages(MNIST_TRAIN_IMAGES_PATH, NUM_TRAINING_IMAGES);
-    std::vector<uint8_t> labels = loadMNISTLabels(MNIST_TRAIN_LABELS_PATH, NUM_TRAINING_IMAGES);
+struct TrainOptions
+{
+    bool stream = false; // read the samples from disk every epoch instead of loading them
+    std::string imagesFile = MNIST_TRAIN_IMAGES_PATH;
+    std::string labelsFile = MNIST_TRAIN_LABELS_PATH;
+    size_t count = NUM_TRAINING_IMAGES; // 0 with --stream: every sample in the file
+    NNData::StreamingConfig streaming;
+};
+
+void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --stream              stream the samples from disk each epoch (default: load %d into memory)\n"
+            "  --images FILE         IDX image file (default %s)\n"
+            "  --labels FILE         IDX label file (default %s)\n"
+            "  --count N             samples to train on; 0 streams them all (default %d)\n"
+            "  --shard N             samples per shard when streaming (default %zu)\n"
+            "  --shuffle-buffer N    samples mixed across shards when streaming (default %zu)\n",
+            program, NUM_TRAINING_IMAGES, MNIST_TRAIN_IMAGES_PATH.c_str(), MNIST_TRAIN_LABELS_PATH.c_str(),
+            NUM_TRAINING_IMAGES, NNData::StreamingConfig{}.shardSamples, NNData::StreamingConfig{}.shuffleBufferSamples);
+}
+
+bool parseOptions(int argc, char *argv[], TrainOptions &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--stream")
+        {
+            options.stream = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        if (arg == "--images")
+            options.imagesFile = value;
+        else if (arg == "--labels")
+            options.labelsFile = value;
+        else if (arg == "--count")
+            options.count = strtoull(value, nullptr, 10);
+        else if (arg == "--shard")
+            options.streaming.shardSamples = strtoull(value, nullptr, 10);
+        else if (arg == "--shuffle-buffer")
+            options.streaming.shuffleBufferSamples = strtoull(value, nullptr, 10);
+        else
+            return false;
+    }
+    return options.stream || options.count > 0;
+}
+
+int main(int argc, char *argv[]) {
+    TrainOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Either the whole training set in memory, or a bounded window of it streamed from disk every epoch
+    std::vector<std::vector<uint8_t>> images;
+    std::vector<uint8_t> labels;
+    options.streaming.maxSamples = options.count;
+    NNData::StreamingDataset dataset(options.streaming);
+    if (options.stream)
+    {
+        if (!dataset.open(options.imagesFile, options.labelsFile))
+            return 1;
+    }
+    else
+    {
+        images = loadMNISTImages(options.imagesFile, static_cast<int>(options.count));
+        labels = loadMNISTLabels(options.labelsFile, static_cast<int>(images.size()));
+        if (images.empty() || labels.size() != images.size())
+            return 1;
+    }
+    NNData::InMemorySamples loaded(images, labels);
+    NNData::SampleSource &samples = options.stream ? static_cast<NNData::SampleSource &>(dataset) : loaded;
 
     FFNeuralNet net(INPUT_LAYER_SIZE, HIDDEN_LAYER_SIZE, OUTPUT_LAYER_SIZE);
-    net.train(images, labels, NUM_EPOCHS, LEARNING_RATE);
-    net.saveFinalWeights(FINAL_WEIGHTS_FILE);
+    TrainingConfig config;
+    config.epochs = NUM_EPOCHS;
+    config.batchSize = BATCH_SIZE;
+    config.optimizer.type = NNOptim::OptimizerType::AdamW;
+    config.optimizer.learningRate = LEARNING_RATE;
+    config.optimizer.weightDecay = 1e-4;
+    config.schedule.type = NNOptim::ScheduleType::Cosine;
+    config.schedule.totalEpochs = NUM_EPOCHS;
+    config.schedule.warmupSteps = 20;
+    config.checkpointFile = CHECKPOINT_FILE;
+    config.checkpointEverySteps = CHECKPOINT_EVERY_STEPS;
+    config.shuffle = true;
+    config.shuffleSeed = SHUFFLE_SEED;
+    if (net.train(samples, config) != TrainingResult::Completed)
+        return 1;
+    if (!net.saveFinalWeights(FINAL_WEIGHTS_FILE))
+        return 1;
+    Metrics::Registry::instance().writeToFile(METRICS_FILE);
+    if (Tracing::getSampleRate() > 0)
+        Tracing::writeChromeTrace(TRACE_FILE);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,156 @@
+#include "mnist_loader.hpp"
+#include "../ff_neural_net.hpp"
+#include "../../Distributed/RingAllReduce.hpp"
+#include "../../Logging/Logger.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const string MNIST_TRAIN_IMAGES_PATH = "../../../data/mnist/train-images.idx3-ubyte";
+const string MNIST_TRAIN_LABELS_PATH = "../../../data/mnist/train-labels.idx1-ubyte";
+const int INPUT_LAYER_SIZE = 28 * 28;
+const int HIDDEN_LAYER_SIZE = 128;
+const int OUTPUT_LAYER_SIZE = 10;
+const double LEARNING_RATE = 0.002;
+const string FINAL_WEIGHTS_FILE = "mnist/data/weights.dat";
+
+struct DistributedOptions
+{
+    size_t rank = 0;
+    vector<Distributed::Peer> peers;
+    bool compressFp16 = false;
+    int epochs = 5;
+    int trainCount = 6000; // split evenly across the trainers
+    size_t batchSize = 16; // per trainer; one step averages batchSize x trainers samples
+    string outputFile = FINAL_WEIGHTS_FILE;
+};
+
+void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s --rank R --peers HOST:PORT,HOST:PORT,... [options]\n"
+            "  --rank R            this trainer's position in --peers; it listens on that entry's port\n"
+            "  --peers LIST        every trainer in ring order (IPv4 addresses), identical on all trainers\n"
+            "  --fp16              exchange gradients as fp16\n"
+            "  --epochs N          training epochs (default 5)\n"
+            "  --train-count N     training images shared by all trainers (default 6000)\n"
+            "  --batch N           samples per trainer per step (default 16)\n"
+            "  --output FILE       where rank 0 saves the weights (default %s)\n",
+            program, FINAL_WEIGHTS_FILE.c_str());
+}
+
+bool parseOptions(int argc, char *argv[], DistributedOptions &options)
+{
+    bool hasPeers = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--fp16")
+        {
+            options.compressFp16 = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        if (arg == "--rank")
+            options.rank = static_cast<size_t>(max(0, atoi(value)));
+        else if (arg == "--peers")
+            hasPeers = Distributed::parsePeers(value, options.peers);
+        else if (arg == "--epochs")
+            options.epochs = atoi(value);
+        else if (arg == "--train-count")
+            options.trainCount = atoi(value);
+        else if (arg == "--batch")
+            options.batchSize = static_cast<size_t>(max(1, atoi(value)));
+        else if (arg == "--output")
+            options.outputFile = value;
+        else
+            return false;
+    }
+    return hasPeers && options.rank < options.peers.size() && options.epochs > 0 &&
+           options.trainCount >= static_cast<int>(options.peers.size());
+}
+
+/**
+ * @brief One data-parallel trainer. Start one process per entry of --peers (on any hosts); each trains on its own
+ *        shard and the ring all-reduce keeps their parameters identical, so rank 0 alone saves the model and prints
+ *        a JSON summary line.
+ */
+int main(int argc, char *argv[])
+{
+    DistributedOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    const size_t world = options.peers.size();
+
+    vector<vector<uint8_t>> images = loadMNISTImages(MNIST_TRAIN_IMAGES_PATH, options.trainCount);
+    vector<uint8_t> labels = loadMNISTLabels(MNIST_TRAIN_LABELS_PATH, static_cast<int>(images.size()));
+    if (images.empty() || labels.size() != images.size())
+        return 1;
+
+    // Equal shards keep every trainer at the same number of steps; the remainder is left out
+    const size_t shardSize = images.size() / world;
+    const size_t shardStart = options.rank * shardSize;
+    vector<vector<uint8_t>> shardImages(images.begin() + shardStart, images.begin() + shardStart + shardSize);
+    vector<uint8_t> shardLabels(labels.begin() + shardStart, labels.begin() + shardStart + shardSize);
+
+    Distributed::RingConfig ringConfig;
+    ringConfig.rank = options.rank;
+    ringConfig.peers = options.peers;
+    ringConfig.compressFp16 = options.compressFp16;
+    Distributed::RingAllReduce ring(ringConfig);
+    if (!ring.connect())
+        return 1;
+
+    FFNeuralNet net(INPUT_LAYER_SIZE, HIDDEN_LAYER_SIZE, OUTPUT_LAYER_SIZE);
+    TrainingConfig config;
+    config.epochs = options.epochs;
+    config.batchSize = options.batchSize;
+    config.optimizer.type = NNOptim::OptimizerType::AdamW;
+    config.optimizer.learningRate = LEARNING_RATE;
+    config.optimizer.weightDecay = 1e-4;
+    config.schedule.type = NNOptim::ScheduleType::Cosine;
+    config.schedule.totalEpochs = options.epochs;
+    config.schedule.warmupSteps = 20;
+    config.gradientReducer = &ring;
+    if (options.rank != 0)
+    {
+        const string suffix = "_rank" + to_string(options.rank) + ".dat";
+        config.trainingDataFile = "mnist/data/training_data" + suffix;
+        config.probabilitiesFile = "mnist/data/probabilities" + suffix;
+    }
+
+    double finalLoss = 0.0;
+    config.onProgress = [&finalLoss](const TrainingProgress &progress)
+    {
+        if (progress.epochComplete)
+            finalLoss = progress.loss;
+        return true;
+    };
+
+    auto start = chrono::steady_clock::now();
+    const bool trained = net.train(shardImages, shardLabels, config) == TrainingResult::Completed;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!trained)
+        return 1;
+    if (options.rank != 0)
+        return 0;
+
+    if (!net.saveFinalWeights(options.outputFile))
+        return 1;
+    const size_t samples = shardSize * world * static_cast<size_t>(options.epochs);
+    printf("{\"world\":%zu,\"fp16\":%s,\"samples\":%zu,\"batch_per_trainer\":%zu,\"seconds\":%.3f,\"samples_per_s\":%.1f,"
+           "\"loss\":%.5f,\"comm_seconds\":%.3f,\"exposed_comm_seconds\":%.3f,\"bytes_sent\":%llu}\n",
+           world, options.compressFp16 ? "true" : "false", samples, options.batchSize, seconds, samples / seconds,
+           finalLoss, ring.getCommunicationSeconds(), ring.getExposedCommunicationSeconds(),
+           static_cast<unsigned long long>(ring.getBytesSent()));
+    return 0;
+}
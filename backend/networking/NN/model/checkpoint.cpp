@@ -0,0 +1,183 @@
+#include "checkpoint.hpp"
+#include "../../Logging/Logger.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    // checksum() of each section, folded together in order
+    uint64_t sectionChecksum(const NNModel::FilePart *parts, size_t count)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < count; ++i)
+            hash = (hash ^ NNModel::checksum(parts[i].data, parts[i].bytes)) * 1099511628211ULL;
+        return hash;
+    }
+
+    bool readFully(int fd, void *data, size_t bytes)
+    {
+        char *out = static_cast<char *>(data);
+        while (bytes > 0)
+        {
+            ssize_t result = ::read(fd, out, bytes);
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result <= 0)
+                return false;
+            out += result;
+            bytes -= static_cast<size_t>(result);
+        }
+        return true;
+    }
+}
+
+/**
+ * @brief Writes the checkpoint header and every section in a single write, then renames it into place
+ *
+ * @param path            Destination file, replaced atomically
+ * @param state           Position in the run and shuffle generator state
+ * @param parameters      Flat parameter buffer
+ * @param parameterCount  Number of parameters
+ * @param optimizerState  The optimizer's state buffers, each parameterCount long
+ *
+ * @return True if the complete checkpoint was written and renamed into place
+ */
+bool NNModel::writeCheckpoint(const string &path, const CheckpointState &state, const double *parameters, size_t parameterCount,
+                              const vector<const vector<double> *> &optimizerState)
+{
+    const vector<uint32_t> &layerSizes = state.layerSizes;
+    if (layerSizes.size() < 2 || layerSizes.size() > MAX_LAYERS || optimizerState.size() > 8)
+    {
+        LOG_ERROR("writeCheckpoint: unsupported layer count %zu or %zu optimizer state buffers", layerSizes.size(), optimizerState.size());
+        return false;
+    }
+
+    CheckpointHeader header = {};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.headerSize = sizeof(CheckpointHeader);
+    header.layerCount = static_cast<uint32_t>(layerSizes.size());
+    for (size_t i = 0; i < layerSizes.size(); ++i)
+        header.layerSizes[i] = layerSizes[i];
+    header.optimizerType = state.optimizerType;
+    header.stateBufferCount = static_cast<uint32_t>(optimizerState.size());
+    header.parameterCount = parameterCount;
+    header.epoch = state.epoch;
+    header.nextSample = state.nextSample;
+    header.samplesPerEpoch = state.samplesPerEpoch;
+    header.batchSize = state.batchSize;
+    header.lossSum = state.lossSum;
+    header.optimizerSteps = state.optimizerSteps;
+    header.historyBytes = state.historyBytes;
+    header.rngStateBytes = state.rngState.size();
+
+    FilePart parts[11];
+    size_t count = 0;
+    parts[count++] = {&header, sizeof(header)};
+    parts[count++] = {parameters, parameterCount * sizeof(double)};
+    for (const vector<double> *buffer : optimizerState)
+    {
+        if (buffer->size() != parameterCount)
+        {
+            LOG_ERROR("writeCheckpoint: optimizer state has %zu values, expected %zu", buffer->size(), parameterCount);
+            return false;
+        }
+        parts[count++] = {buffer->data(), parameterCount * sizeof(double)};
+    }
+    parts[count++] = {state.rngState.data(), state.rngState.size()};
+    header.checksum = sectionChecksum(parts, count); // computed with the field still zero
+    return writeFileAtomically(path, parts, count);
+}
+
+/**
+ * @brief Reads a checkpoint written by writeCheckpoint, checking its size against the header before reading the
+ *        sections and its checksum after
+ *
+ * @param path            Checkpoint file
+ * @param state           Receives the position in the run
+ * @param parameters      Receives the parameters
+ * @param optimizerState  Receives the optimizer's state buffers
+ *
+ * @return True if the whole checkpoint was read and verified; the outputs are unspecified otherwise
+ */
+bool NNModel::readCheckpoint(const string &path, CheckpointState &state, vector<double> &parameters,
+                             vector<vector<double>> &optimizerState)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("readCheckpoint: cannot open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat info;
+    CheckpointHeader header;
+    if (fstat(fd, &info) != 0 || !readFully(fd, &header, sizeof(header)) ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+    {
+        LOG_ERROR("readCheckpoint: %s is not a training checkpoint", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    if (header.version != CHECKPOINT_VERSION || header.headerSize != sizeof(CheckpointHeader) ||
+        header.layerCount < 2 || header.layerCount > MAX_LAYERS || header.stateBufferCount > 8)
+    {
+        LOG_ERROR("readCheckpoint: %s has unsupported version %u or layout", path.c_str(), header.version);
+        ::close(fd);
+        return false;
+    }
+
+    const uint64_t expectedBytes = sizeof(header) + (1 + header.stateBufferCount) * header.parameterCount * sizeof(double) + header.rngStateBytes;
+    if (header.parameterCount > static_cast<uint64_t>(info.st_size) || header.rngStateBytes > static_cast<uint64_t>(info.st_size) ||
+        static_cast<uint64_t>(info.st_size) != expectedBytes)
+    {
+        LOG_ERROR("readCheckpoint: %s is %lld bytes, expected %llu; it was truncated", path.c_str(),
+                  static_cast<long long>(info.st_size), static_cast<unsigned long long>(expectedBytes));
+        ::close(fd);
+        return false;
+    }
+
+    parameters.resize(header.parameterCount);
+    optimizerState.assign(header.stateBufferCount, vector<double>(header.parameterCount));
+    state.rngState.resize(header.rngStateBytes);
+    bool ok = readFully(fd, parameters.data(), parameters.size() * sizeof(double));
+    for (vector<double> &buffer : optimizerState)
+        ok = ok && readFully(fd, buffer.data(), buffer.size() * sizeof(double));
+    ok = ok && readFully(fd, state.rngState.data(), state.rngState.size());
+    ::close(fd);
+    if (!ok)
+    {
+        LOG_ERROR("readCheckpoint: error reading %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    FilePart parts[11];
+    size_t count = 0;
+    const uint64_t storedChecksum = header.checksum;
+    header.checksum = 0;
+    parts[count++] = {&header, sizeof(header)};
+    parts[count++] = {parameters.data(), parameters.size() * sizeof(double)};
+    for (const vector<double> &buffer : optimizerState)
+        parts[count++] = {buffer.data(), buffer.size() * sizeof(double)};
+    parts[count++] = {state.rngState.data(), state.rngState.size()};
+    if (sectionChecksum(parts, count) != storedChecksum)
+    {
+        LOG_ERROR("readCheckpoint: checksum mismatch in %s", path.c_str());
+        return false;
+    }
+
+    state.layerSizes.assign(header.layerSizes, header.layerSizes + header.layerCount);
+    state.optimizerType = header.optimizerType;
+    state.epoch = header.epoch;
+    state.nextSample = header.nextSample;
+    state.samplesPerEpoch = header.samplesPerEpoch;
+    state.batchSize = header.batchSize;
+    state.lossSum = header.lossSum;
+    state.optimizerSteps = header.optimizerSteps;
+    state.historyBytes = header.historyBytes;
+    return true;
+}
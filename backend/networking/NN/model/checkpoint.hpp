@@ -0,0 +1,82 @@
+#ifndef NN_CHECKPOINT_HPP
+#define NN_CHECKPOINT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "model_file.hpp"
+
+/*
+ * Training checkpoint layout (little-endian), everything FFNeuralNet::train needs to continue a run exactly:
+ *
+ *   CheckpointHeader (160 bytes)   magic, version, topology, optimizer, position in the run, section sizes, checksum
+ *   parameters                     parameterCount doubles, in FFNeuralNet order
+ *   optimizer state                stateBufferCount vectors of parameterCount doubles (velocity, or Adam's two moments)
+ *   RNG state                      rngStateBytes of text, the shuffle generator as written by operator<<
+ *
+ * The checksum covers the header (with the checksum field zeroed) and every section. Checkpoints are replaced
+ * atomically, so a crash while writing one leaves the previous checkpoint intact.
+ */
+namespace NNModel
+{
+    constexpr char CHECKPOINT_MAGIC[8] = {'H', 'D', 'E', 'C', 'K', 'P', 'T', '\0'};
+    constexpr uint32_t CHECKPOINT_VERSION = 1;
+
+    struct CheckpointHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint32_t layerCount;
+        uint32_t layerSizes[MAX_LAYERS];
+        uint32_t optimizerType;
+        uint32_t stateBufferCount;
+        uint64_t parameterCount;
+        uint32_t epoch;
+        uint32_t padding;
+        uint64_t nextSample;
+        uint64_t samplesPerEpoch;
+        uint64_t batchSize;
+        double lossSum;
+        uint64_t optimizerSteps;
+        uint64_t historyBytes;
+        uint64_t rngStateBytes;
+        uint64_t checksum;
+        uint8_t reserved[24];
+    };
+    static_assert(sizeof(CheckpointHeader) == 160, "checkpoint header layout changed");
+
+    // Where a training run stands; the parameters and optimizer state travel separately
+    struct CheckpointState
+    {
+        std::vector<uint32_t> layerSizes; // neurons per layer, input first
+        uint32_t optimizerType = 0;       // NNOptim::OptimizerType
+        uint32_t epoch = 0;               // epochs completed
+        uint64_t nextSample = 0;          // samples of the following epoch already trained; 0 at an epoch boundary
+        uint64_t samplesPerEpoch = 0;
+        uint64_t batchSize = 0;
+        double lossSum = 0.0;             // loss summed over those nextSample samples
+        uint64_t optimizerSteps = 0;
+        uint64_t historyBytes = 0;        // size of the training database once this point's records were written
+        std::string rngState;             // shuffle generator as it was at the start of the following epoch
+    };
+
+    /**
+     * @brief Writes a checkpoint in one writev, replacing `path` atomically
+     *
+     * @param optimizerState  The optimizer's state buffers, each parameterCount long
+     */
+    bool writeCheckpoint(const std::string &path, const CheckpointState &state, const double *parameters, size_t parameterCount,
+                         const std::vector<const std::vector<double> *> &optimizerState);
+
+    /**
+     * @brief Reads and verifies a checkpoint
+     *
+     * @return False (and logs why) if the file cannot be read, is truncated, is not a checkpoint or fails its checksum
+     */
+    bool readCheckpoint(const std::string &path, CheckpointState &state, std::vector<double> &parameters,
+                        std::vector<std::vector<double>> &optimizerState);
+}
+
+#endif
@@ -0,0 +1,338 @@
+#include "model_file.hpp"
+#include "../../Logging/Logger.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+uint64_t NNModel::checksum(const void *data, size_t bytes)
+{
+    const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+    const uint64_t FNV_PRIME = 1099511628211ULL;
+
+    const unsigned char *input = static_cast<const unsigned char *>(data);
+    // Four interleaved lanes (word i goes to lane i % 4) so the multiplies do not form one serial dependency chain
+    uint64_t lanes[4] = {FNV_OFFSET, FNV_OFFSET ^ 1, FNV_OFFSET ^ 2, FNV_OFFSET ^ 3};
+    size_t words = bytes / sizeof(uint64_t);
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4)
+    {
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            uint64_t word;
+            memcpy(&word, input + (i + lane) * sizeof(uint64_t), sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * FNV_PRIME;
+        }
+    }
+
+    uint64_t hash = FNV_OFFSET;
+    for (uint64_t lane : lanes)
+        hash = (hash ^ lane) * FNV_PRIME;
+    for (size_t b = i * sizeof(uint64_t); b < bytes; ++b)
+        hash = (hash ^ input[b]) * FNV_PRIME;
+    return hash;
+}
+
+/**
+ * @brief Writes a model file: header and padding, then every parameter in a single bulk write
+ *
+ * @param path         Destination file, replaced atomically
+ * @param layerSizes   Neurons per layer, input first
+ * @param parameters   Flat parameter buffer
+ * @param count        Number of parameters
+ * @param transposedFirstLayer  Optional input x hidden copy of the first layer, stored after the parameters
+ *
+ * @return True if the complete file was written and renamed into place
+ */
+bool NNModel::writeModelFile(const string &path, const vector<uint32_t> &layerSizes, const double *parameters, size_t count,
+                             const double *transposedFirstLayer)
+{
+    ModelDescription description;
+    description.layerSizes = layerSizes;
+    description.transposedFirstLayer = transposedFirstLayer;
+    return writeModelFile(path, description, parameters, count * sizeof(double));
+}
+
+/**
+ * @brief Writes a model file with any layout: header and padding, then the data section in the same write
+ *
+ * @param path          Destination file, replaced atomically
+ * @param description   Topology and layout recorded in the header
+ * @param data          Data section
+ * @param bytes         Size of the data section, a multiple of 8
+ *
+ * @return True if the complete file was written and renamed into place
+ */
+bool NNModel::writeModelFile(const string &path, const ModelDescription &description, const void *data, size_t bytes)
+{
+    const vector<uint32_t> &layerSizes = description.layerSizes;
+    if (layerSizes.size() < 2 || layerSizes.size() > MAX_LAYERS || bytes % sizeof(uint64_t) != 0)
+    {
+        LOG_ERROR("writeModelFile: unsupported layer count %zu or data size %zu", layerSizes.size(), bytes);
+        return false;
+    }
+    if (description.transposedFirstLayer && description.layout != Layout::Dense)
+    {
+        LOG_ERROR("writeModelFile: only dense models store a transposed first layer");
+        return false;
+    }
+
+    FileHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.headerSize = sizeof(FileHeader);
+    header.dtype = static_cast<uint32_t>(DType::Float64);
+    header.alignment = DATA_ALIGNMENT;
+    header.layerCount = static_cast<uint32_t>(layerSizes.size());
+    for (size_t i = 0; i < layerSizes.size(); ++i)
+        header.layerSizes[i] = layerSizes[i];
+    header.parameterCount = bytes / sizeof(uint64_t);
+    header.dataOffset = (sizeof(FileHeader) + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+    header.checksum = checksum(data, bytes);
+    header.layout = static_cast<uint32_t>(description.layout);
+    header.nonzeros = description.nonzeros;
+
+    const size_t transposedBytes = static_cast<size_t>(layerSizes[0]) * layerSizes[1] * sizeof(double);
+    const size_t dataEnd = header.dataOffset + bytes;
+    if (description.transposedFirstLayer)
+    {
+        header.transposedOffset = (dataEnd + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+        header.transposedChecksum = checksum(description.transposedFirstLayer, transposedBytes);
+    }
+
+    char prefix[sizeof(FileHeader) + DATA_ALIGNMENT] = {};
+    memcpy(prefix, &header, sizeof(header));
+    static const char padding[DATA_ALIGNMENT] = {};
+    const FilePart parts[4] = {{prefix, static_cast<size_t>(header.dataOffset)},
+                               {data, bytes},
+                               {padding, header.transposedOffset ? header.transposedOffset - dataEnd : 0},
+                               {description.transposedFirstLayer, transposedBytes}};
+    return writeFileAtomically(path, parts, description.transposedFirstLayer ? 4 : 2);
+}
+
+/**
+ * @brief Writes the concatenation of `parts` to path + ".tmp", fsyncs it, renames it over `path` and fsyncs the
+ *        directory, so after a crash `path` holds either the previous file or the complete new one
+ *
+ * @param path   Destination file
+ * @param parts  Pieces of the file, in order, written with one writev
+ * @param count  Number of parts, at most 16
+ *
+ * @return True if the complete file was written and renamed into place
+ */
+bool NNModel::writeFileAtomically(const string &path, const FilePart *parts, size_t count)
+{
+    struct iovec vectors[16];
+    if (count > 16)
+    {
+        LOG_ERROR("writeFileAtomically: %zu parts, at most 16 are supported", count);
+        return false;
+    }
+    size_t remaining = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        vectors[i] = {const_cast<void *>(parts[i].data), parts[i].bytes};
+        remaining += parts[i].bytes;
+    }
+
+    string tempPath = path + ".tmp";
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        LOG_ERROR("writeFileAtomically: cannot create %s: %s", tempPath.c_str(), strerror(errno));
+        return false;
+    }
+
+    // One writev for the whole file; loop only to finish a short write
+    struct iovec *next = vectors;
+    int partsLeft = static_cast<int>(count);
+    bool ok = true;
+    while (remaining > 0)
+    {
+        ssize_t written = writev(fd, next, partsLeft);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("writeFileAtomically: write to %s failed: %s", tempPath.c_str(), strerror(errno));
+            ok = false;
+            break;
+        }
+        remaining -= static_cast<size_t>(written);
+        while (partsLeft > 0 && static_cast<size_t>(written) >= next->iov_len)
+        {
+            written -= static_cast<ssize_t>(next->iov_len);
+            ++next;
+            --partsLeft;
+        }
+        if (partsLeft > 0)
+        {
+            next->iov_base = static_cast<char *>(next->iov_base) + written;
+            next->iov_len -= static_cast<size_t>(written);
+        }
+    }
+
+    if (ok && fsync(fd) != 0)
+    {
+        LOG_ERROR("writeFileAtomically: fsync of %s failed: %s", tempPath.c_str(), strerror(errno));
+        ok = false;
+    }
+    ::close(fd);
+
+    if (ok && rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        LOG_ERROR("writeFileAtomically: cannot rename %s to %s: %s", tempPath.c_str(), path.c_str(), strerror(errno));
+        ok = false;
+    }
+    if (!ok)
+    {
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    // The rename itself is only durable once the directory entry is on disk
+    const size_t slash = path.find_last_of('/');
+    const string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int directoryFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directoryFd >= 0)
+    {
+        fsync(directoryFd);
+        ::close(directoryFd);
+    }
+    return true;
+}
+
+NNModel::MappedModel::~MappedModel()
+{
+    close();
+}
+
+void NNModel::MappedModel::close()
+{
+    if (mapping)
+        munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+    parameterData = nullptr;
+    transposedData = nullptr;
+    count = 0;
+    layers.clear();
+    storedLayout = Layout::Dense;
+    storedNonzeros = 0;
+    legacy = false;
+}
+
+/**
+ * @brief Maps a model file read-only and validates its header and checksum
+ *
+ * @param path  Model file
+ *
+ * @return True if the file is a valid model (or a legacy raw parameter file); errors are logged
+ */
+bool NNModel::MappedModel::open(const string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("Error opening model file %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        LOG_ERROR("Model file %s is empty or unreadable", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        LOG_ERROR("Error mapping model file %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    madvise(mapped, size, MADV_WILLNEED);
+    mapping = mapped;
+    mappingSize = size;
+
+    FileHeader header;
+    if (size < sizeof(FileHeader) || memcmp(mapped, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        if (size % sizeof(double) != 0)
+        {
+            LOG_ERROR("Model file %s has no header and is not a whole number of doubles (%zu bytes)", path.c_str(), size);
+            close();
+            return false;
+        }
+        legacy = true;
+        parameterData = static_cast<const double *>(mapped);
+        count = size / sizeof(double);
+        return true;
+    }
+
+    memcpy(&header, mapped, sizeof(header));
+    if (header.version != FORMAT_VERSION || header.headerSize != sizeof(FileHeader))
+    {
+        LOG_ERROR("Model file %s has unsupported version %u", path.c_str(), header.version);
+        close();
+        return false;
+    }
+    if (header.dtype != static_cast<uint32_t>(DType::Float64) || header.layout > static_cast<uint32_t>(Layout::BlockSparse))
+    {
+        LOG_ERROR("Model file %s has unsupported dtype %u or layout %u", path.c_str(), header.dtype, header.layout);
+        close();
+        return false;
+    }
+    if (header.layerCount < 2 || header.layerCount > MAX_LAYERS || header.dataOffset % alignof(double) != 0 ||
+        header.dataOffset > size || header.parameterCount > (size - header.dataOffset) / sizeof(double))
+    {
+        LOG_ERROR("Model file %s is truncated or has a corrupt header", path.c_str());
+        close();
+        return false;
+    }
+
+    const double *data = reinterpret_cast<const double *>(static_cast<const char *>(mapped) + header.dataOffset);
+    if (checksum(data, header.parameterCount * sizeof(double)) != header.checksum)
+    {
+        LOG_ERROR("Model file %s failed checksum verification", path.c_str());
+        close();
+        return false;
+    }
+
+    if (header.transposedOffset != 0)
+    {
+        const size_t transposedBytes = static_cast<size_t>(header.layerSizes[0]) * header.layerSizes[1] * sizeof(double);
+        if (header.layout != static_cast<uint32_t>(Layout::Dense) || header.transposedOffset % alignof(double) != 0 ||
+            header.transposedOffset > size || transposedBytes > size - header.transposedOffset)
+        {
+            LOG_ERROR("Model file %s is truncated or has a corrupt transposed first layer", path.c_str());
+            close();
+            return false;
+        }
+        const double *transposed = reinterpret_cast<const double *>(static_cast<const char *>(mapped) + header.transposedOffset);
+        if (checksum(transposed, transposedBytes) != header.transposedChecksum)
+        {
+            LOG_ERROR("Model file %s failed checksum verification of its transposed first layer", path.c_str());
+            close();
+            return false;
+        }
+        transposedData = transposed;
+    }
+
+    parameterData = data;
+    count = header.parameterCount;
+    layers.assign(header.layerSizes, header.layerSizes + header.layerCount);
+    storedLayout = static_cast<Layout>(header.layout);
+    storedNonzeros = header.nonzeros;
+    return true;
+}
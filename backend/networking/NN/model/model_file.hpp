@@ -0,0 +1,130 @@
+#ifndef NN_MODEL_FILE_HPP
+#define NN_MODEL_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Model file layout (little-endian):
+ *
+ *   FileHeader (128 bytes)   magic, version, dtype, alignment, layer sizes, parameter count, data offset, checksum
+ *   zero padding             up to dataOffset, a multiple of `alignment`
+ *   parameters               Dense layout: parameterCount values of `dtype`, in FFNeuralNet order:
+ *                            input-to-hidden weights, hidden-to-output weights, hidden biases, output biases.
+ *                            Sparse layouts (written by NNSparse::SparseFFNet): parameterCount 8-byte words holding the
+ *                            compressed first layer followed by the remaining parameters in dense order.
+ *   zero padding             up to transposedOffset, a multiple of `alignment` (dense layout only, optional)
+ *   transposed first layer   input x hidden copy of the input-to-hidden weights for the sparse-input kernel, so
+ *                            mapped models share it through the page cache instead of each building a private one.
+ *                            transposedOffset is 0 when absent (files written before this section existed).
+ *
+ * Files are replaced atomically (written to a temporary file, then renamed), so processes that still have the
+ * previous version mapped keep reading consistent weights.
+ */
+namespace NNModel
+{
+    constexpr char MAGIC[8] = {'H', 'D', 'E', 'N', 'N', 'E', 'T', '\0'};
+    constexpr uint32_t FORMAT_VERSION = 1;
+    constexpr uint32_t DATA_ALIGNMENT = 64;
+    constexpr uint32_t MAX_LAYERS = 7;
+
+    enum class DType : uint32_t
+    {
+        Float64 = 1
+    };
+
+    // How the first layer is stored; files from before this field existed have 0 there and are dense
+    enum class Layout : uint32_t
+    {
+        Dense = 0,
+        CSR = 1,
+        BlockSparse = 2
+    };
+
+    struct ModelDescription
+    {
+        std::vector<uint32_t> layerSizes; // neurons per layer, input first
+        Layout layout = Layout::Dense;
+        uint64_t nonzeros = 0; // stored first-layer values (CSR) or blocks (block-sparse)
+        // Optional layerSizes[0] x layerSizes[1] transposed first layer, stored after the data section (dense only)
+        const double *transposedFirstLayer = nullptr;
+    };
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint32_t dtype;
+        uint32_t alignment;
+        uint32_t layerCount;
+        uint32_t layerSizes[MAX_LAYERS];
+        uint64_t parameterCount;
+        uint64_t dataOffset;
+        uint64_t checksum; // checksum() of the parameter bytes
+        uint32_t layout;
+        uint32_t padding;
+        uint64_t nonzeros;
+        uint64_t transposedOffset;   // 0 if the file has no transposed first layer
+        uint64_t transposedChecksum; // checksum() of the transposed first layer
+        uint8_t reserved[16];
+    };
+    static_assert(sizeof(FileHeader) == 128, "model file header layout changed");
+
+    // FNV-1a over 64-bit words in four interleaved lanes, folded together with any trailing bytes
+    uint64_t checksum(const void *data, size_t bytes);
+
+    struct FilePart
+    {
+        const void *data;
+        size_t bytes;
+    };
+
+    // Replaces `path` with the concatenation of `parts` through a temporary file and a rename
+    bool writeFileAtomically(const std::string &path, const FilePart *parts, size_t count);
+
+    bool writeModelFile(const std::string &path, const std::vector<uint32_t> &layerSizes, const double *parameters, size_t count,
+                        const double *transposedFirstLayer = nullptr);
+    // Any layout; `bytes` must be a multiple of 8
+    bool writeModelFile(const std::string &path, const ModelDescription &description, const void *data, size_t bytes);
+
+    /**
+     * @brief Read-only, shared mapping of a model file. The parameters are used in place: nothing is copied, and
+     *        every process mapping the same file shares one page-cached copy.
+     *        Files without a header (raw doubles, the format before versioning) are mapped as legacy files with no topology.
+     */
+    class MappedModel
+    {
+        void *mapping = nullptr;
+        size_t mappingSize = 0;
+        const double *parameterData = nullptr;
+        const double *transposedData = nullptr;
+        size_t count = 0;
+        std::vector<uint32_t> layers;
+        Layout storedLayout = Layout::Dense;
+        uint64_t storedNonzeros = 0;
+        bool legacy = false;
+
+    public:
+        MappedModel() = default;
+        ~MappedModel();
+        MappedModel(const MappedModel &) = delete;
+        MappedModel &operator=(const MappedModel &) = delete;
+
+        bool open(const std::string &path);
+        void close();
+
+        const double *parameters() const { return parameterData; }
+        size_t parameterCount() const { return count; }
+        // Input x hidden copy of the first layer, or nullptr if the file was saved without one
+        const double *transposedFirstLayer() const { return transposedData; }
+        const std::vector<uint32_t> &layerSizes() const { return layers; }
+        Layout layout() const { return storedLayout; }
+        uint64_t nonzeros() const { return storedNonzeros; }
+        bool isLegacy() const { return legacy; }
+    };
+}
+
+#endif
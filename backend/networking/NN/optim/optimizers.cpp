@@ -0,0 +1,246 @@
+#include "optimizers.hpp"
+#include <cmath>
+#include <numbers>
+
+using namespace std;
+
+/*
+ * Every step below is one streaming loop over parameters, gradients and optimizer state: each element is read once,
+ * written once, and its gradient cleared for the next accumulation. The loops have no cross-iteration dependencies and
+ * use __restrict pointers so GCC vectorizes them (-O3 -fno-math-errno, see the Makefile).
+ */
+
+NNOptim::SGD::SGD(size_t parameterCount, double momentum, bool nesterov, double weightDecay)
+    : momentum{momentum}, nesterov{nesterov}, weightDecay{weightDecay}, velocity(momentum > 0.0 ? parameterCount : 0, 0.0)
+{
+}
+
+void NNOptim::SGD::step(double *params, double *grads, size_t count, double learningRate, double gradientScale)
+{
+    double *__restrict p = params;
+    double *__restrict g = grads;
+    const double decay = weightDecay;
+    ++steps;
+
+    if (velocity.empty())
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            double gradient = g[i] * gradientScale + decay * p[i];
+            p[i] -= learningRate * gradient;
+            g[i] = 0.0;
+        }
+        return;
+    }
+
+    double *__restrict v = velocity.data();
+    const double mu = momentum;
+    if (nesterov)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            double gradient = g[i] * gradientScale + decay * p[i];
+            double updated = mu * v[i] + gradient;
+            v[i] = updated;
+            p[i] -= learningRate * (gradient + mu * updated);
+            g[i] = 0.0;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            double gradient = g[i] * gradientScale + decay * p[i];
+            double updated = mu * v[i] + gradient;
+            v[i] = updated;
+            p[i] -= learningRate * updated;
+            g[i] = 0.0;
+        }
+    }
+}
+
+NNOptim::OptimizerType NNOptim::SGD::type() const
+{
+    if (velocity.empty())
+        return OptimizerType::SGD;
+    return nesterov ? OptimizerType::Nesterov : OptimizerType::Momentum;
+}
+
+vector<vector<double> *> NNOptim::SGD::stateBuffers()
+{
+    if (velocity.empty())
+        return {};
+    return {&velocity};
+}
+
+uint64_t NNOptim::SGD::stepCount() const
+{
+    return steps;
+}
+
+void NNOptim::SGD::setStepCount(uint64_t count)
+{
+    steps = count;
+}
+
+NNOptim::Adam::Adam(size_t parameterCount, double beta1, double beta2, double epsilon, double weightDecay, bool decoupledWeightDecay)
+    : beta1{beta1}, beta2{beta2}, epsilon{epsilon}, weightDecay{weightDecay}, decoupledWeightDecay{decoupledWeightDecay},
+      firstMoment(parameterCount, 0.0), secondMoment(parameterCount, 0.0)
+{
+}
+
+void NNOptim::Adam::step(double *params, double *grads, size_t count, double learningRate, double gradientScale)
+{
+    double *__restrict p = params;
+    double *__restrict g = grads;
+    double *__restrict m = firstMoment.data();
+    double *__restrict v = secondMoment.data();
+    ++steps;
+
+    // Bias correction folded into the step size: lr * sqrt(1 - beta2^t) / (1 - beta1^t)
+    const double b1 = beta1, b2 = beta2;
+    const double correction1 = 1.0 - pow(b1, static_cast<double>(steps));
+    const double correction2 = 1.0 - pow(b2, static_cast<double>(steps));
+    const double stepSize = learningRate * sqrt(correction2) / correction1;
+    const double eps = epsilon * sqrt(correction2);
+    const double l2 = decoupledWeightDecay ? 0.0 : weightDecay;
+    const double shrink = decoupledWeightDecay ? 1.0 - learningRate * weightDecay : 1.0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        double gradient = g[i] * gradientScale + l2 * p[i];
+        double first = b1 * m[i] + (1.0 - b1) * gradient;
+        double second = b2 * v[i] + (1.0 - b2) * gradient * gradient;
+        m[i] = first;
+        v[i] = second;
+        p[i] = p[i] * shrink - stepSize * first / (sqrt(second) + eps);
+        g[i] = 0.0;
+    }
+}
+
+NNOptim::OptimizerType NNOptim::Adam::type() const
+{
+    return decoupledWeightDecay ? OptimizerType::AdamW : OptimizerType::Adam;
+}
+
+vector<vector<double> *> NNOptim::Adam::stateBuffers()
+{
+    return {&firstMoment, &secondMoment};
+}
+
+uint64_t NNOptim::Adam::stepCount() const
+{
+    return steps;
+}
+
+void NNOptim::Adam::setStepCount(uint64_t count)
+{
+    steps = count;
+}
+
+/**
+ * @brief Creates the optimizer described by `config` with zeroed state for `parameterCount` parameters
+ */
+unique_ptr<NNOptim::Optimizer> NNOptim::makeOptimizer(const OptimizerConfig &config, size_t parameterCount)
+{
+    switch (config.type)
+    {
+    case OptimizerType::Momentum:
+        return make_unique<SGD>(parameterCount, config.momentum, false, config.weightDecay);
+    case OptimizerType::Nesterov:
+        return make_unique<SGD>(parameterCount, config.momentum, true, config.weightDecay);
+    case OptimizerType::Adam:
+        return make_unique<Adam>(parameterCount, config.beta1, config.beta2, config.epsilon, config.weightDecay, false);
+    case OptimizerType::AdamW:
+        return make_unique<Adam>(parameterCount, config.beta1, config.beta2, config.epsilon, config.weightDecay, true);
+    case OptimizerType::SGD:
+    default:
+        return make_unique<SGD>(parameterCount, 0.0, false, config.weightDecay);
+    }
+}
+
+bool NNOptim::parseOptimizerType(const string &name, OptimizerType &type)
+{
+    if (name == "sgd")
+        type = OptimizerType::SGD;
+    else if (name == "momentum")
+        type = OptimizerType::Momentum;
+    else if (name == "nesterov")
+        type = OptimizerType::Nesterov;
+    else if (name == "adam")
+        type = OptimizerType::Adam;
+    else if (name == "adamw")
+        type = OptimizerType::AdamW;
+    else
+        return false;
+    return true;
+}
+
+const char *NNOptim::optimizerName(OptimizerType type)
+{
+    switch (type)
+    {
+    case OptimizerType::Momentum:
+        return "momentum";
+    case OptimizerType::Nesterov:
+        return "nesterov";
+    case OptimizerType::Adam:
+        return "adam";
+    case OptimizerType::AdamW:
+        return "adamw";
+    case OptimizerType::SGD:
+    default:
+        return "sgd";
+    }
+}
+
+/**
+ * @brief Learning rate for an optimizer step
+ *
+ * @param baseRate  Rate configured on the optimizer
+ * @param epoch     Zero-based epoch the step belongs to
+ * @param step      Optimizer steps taken so far, used for warmup
+ *
+ * @return Scheduled learning rate
+ */
+double NNOptim::LearningRateSchedule::rate(double baseRate, int epoch, uint64_t step) const
+{
+    double scheduled = baseRate;
+    switch (type)
+    {
+    case ScheduleType::Step:
+        scheduled = baseRate * pow(decayRate, epoch / max(1, stepEpochs));
+        break;
+    case ScheduleType::Exponential:
+        scheduled = baseRate * pow(decayRate, epoch);
+        break;
+    case ScheduleType::Cosine:
+    {
+        double progress = min(1.0, static_cast<double>(epoch) / max(1, totalEpochs));
+        scheduled = minRate + 0.5 * (baseRate - minRate) * (1.0 + cos(numbers::pi * progress));
+        break;
+    }
+    case ScheduleType::Constant:
+    default:
+        break;
+    }
+
+    if (warmupSteps > 0 && step < warmupSteps)
+        scheduled *= static_cast<double>(step + 1) / static_cast<double>(warmupSteps);
+    return scheduled;
+}
+
+bool NNOptim::parseScheduleType(const string &name, ScheduleType &type)
+{
+    if (name == "constant")
+        type = ScheduleType::Constant;
+    else if (name == "step")
+        type = ScheduleType::Step;
+    else if (name == "exponential")
+        type = ScheduleType::Exponential;
+    else if (name == "cosine")
+        type = ScheduleType::Cosine;
+    else
+        return false;
+    return true;
+}
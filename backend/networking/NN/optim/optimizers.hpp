@@ -0,0 +1,121 @@
+#ifndef NN_OPTIMIZERS_HPP
+#define NN_OPTIMIZERS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NNOptim
+{
+    enum class OptimizerType
+    {
+        SGD,
+        Momentum,
+        Nesterov,
+        Adam,
+        AdamW
+    };
+
+    struct OptimizerConfig
+    {
+        OptimizerType type = OptimizerType::SGD;
+        double learningRate = 0.001;
+        double momentum = 0.9;     // SGD momentum / Nesterov
+        double beta1 = 0.9;        // Adam first-moment decay
+        double beta2 = 0.999;      // Adam second-moment decay
+        double epsilon = 1e-8;     // Adam denominator guard
+        double weightDecay = 0.0;  // L2 penalty (SGD, Adam) or decoupled decay (AdamW)
+
+        bool operator==(const OptimizerConfig &) const = default;
+    };
+
+    /**
+     * @brief Updates a flat parameter buffer from a gradient buffer with the same layout.
+     *        Any per-parameter state (velocity, moments) is stored in vectors indexed exactly like the parameters,
+     *        so a step is one streaming pass over params, grads and state. The step also clears the gradients.
+     */
+    class Optimizer
+    {
+    public:
+        virtual ~Optimizer() = default;
+
+        /**
+         * @param params         Parameters to update in place
+         * @param grads          Accumulated gradients (zeroed on return)
+         * @param count          Number of parameters
+         * @param learningRate   Step size for this update (after any schedule)
+         * @param gradientScale  Multiplier applied to every gradient first, e.g. 1/batchSize to average a batch
+         */
+        virtual void step(double *params, double *grads, size_t count, double learningRate, double gradientScale) = 0;
+        virtual OptimizerType type() const = 0;
+
+        // Per-parameter state vectors and step counter, exposed so checkpoints can persist and restore them
+        virtual std::vector<std::vector<double> *> stateBuffers() = 0;
+        virtual uint64_t stepCount() const = 0;
+        virtual void setStepCount(uint64_t steps) = 0;
+    };
+
+    class SGD : public Optimizer
+    {
+        double momentum;
+        bool nesterov;
+        double weightDecay;
+        std::vector<double> velocity;
+        uint64_t steps = 0;
+
+    public:
+        SGD(size_t parameterCount, double momentum, bool nesterov, double weightDecay);
+        void step(double *params, double *grads, size_t count, double learningRate, double gradientScale) override;
+        OptimizerType type() const override;
+        std::vector<std::vector<double> *> stateBuffers() override;
+        uint64_t stepCount() const override;
+        void setStepCount(uint64_t steps) override;
+    };
+
+    class Adam : public Optimizer
+    {
+        double beta1, beta2, epsilon, weightDecay;
+        bool decoupledWeightDecay;
+        std::vector<double> firstMoment;
+        std::vector<double> secondMoment;
+        uint64_t steps = 0;
+
+    public:
+        Adam(size_t parameterCount, double beta1, double beta2, double epsilon, double weightDecay, bool decoupledWeightDecay);
+        void step(double *params, double *grads, size_t count, double learningRate, double gradientScale) override;
+        OptimizerType type() const override;
+        std::vector<std::vector<double> *> stateBuffers() override;
+        uint64_t stepCount() const override;
+        void setStepCount(uint64_t steps) override;
+    };
+
+    std::unique_ptr<Optimizer> makeOptimizer(const OptimizerConfig &config, size_t parameterCount);
+    bool parseOptimizerType(const std::string &name, OptimizerType &type);
+    const char *optimizerName(OptimizerType type);
+
+    enum class ScheduleType
+    {
+        Constant,
+        Step,        // multiply by decayRate every stepEpochs epochs
+        Exponential, // multiply by decayRate every epoch
+        Cosine       // cosine anneal from the base rate to minRate over totalEpochs
+    };
+
+    struct LearningRateSchedule
+    {
+        ScheduleType type = ScheduleType::Constant;
+        double decayRate = 0.5;
+        int stepEpochs = 5;
+        int totalEpochs = 10;
+        double minRate = 0.0;
+        uint64_t warmupSteps = 0; // linear ramp from 0 over the first optimizer steps
+
+        double rate(double baseRate, int epoch, uint64_t step) const;
+    };
+
+    bool parseScheduleType(const std::string &name, ScheduleType &type);
+}
+
+#endif
@@ -0,0 +1,299 @@
+#include "sparse_ff_net.hpp"
+#include "../utils/utils.hpp"
+#include "../../Logging/Logger.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    template <typename T>
+    void appendArray(vector<uint8_t> &out, const vector<T> &values)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(values.data());
+        out.insert(out.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    void alignTo8(vector<uint8_t> &out)
+    {
+        out.resize((out.size() + 7) / 8 * 8, 0);
+    }
+
+    // Reads `count` values of T at `offset` (advanced past them, then to the next 8-byte boundary)
+    template <typename T>
+    bool readArray(const uint8_t *data, size_t size, size_t &offset, size_t count, vector<T> &values)
+    {
+        if (count > (size - offset) / sizeof(T))
+            return false;
+        values.resize(count);
+        memcpy(values.data(), data + offset, count * sizeof(T));
+        offset = (offset + count * sizeof(T) + 7) / 8 * 8;
+        return offset <= size;
+    }
+}
+
+NNSparse::SparseFFNet::SparseFFNet(size_t inputSize, size_t hiddenSize, size_t outputSize, const double *parameters, NNModel::Layout layout)
+    : inputSize{inputSize}, hiddenSize{hiddenSize}, outputSize{outputSize}, layout{layout}
+{
+    if (layout == NNModel::Layout::BlockSparse)
+        blocks = BlockSparseMatrix::fromDense(parameters, static_cast<uint32_t>(hiddenSize), static_cast<uint32_t>(inputSize));
+    else
+        csr = CSRMatrix::fromDense(parameters, static_cast<uint32_t>(hiddenSize), static_cast<uint32_t>(inputSize));
+
+    const double *rest = parameters + hiddenSize * inputSize;
+    outputWeights.assign(rest, rest + outputSize * hiddenSize);
+    rest += outputSize * hiddenSize;
+    hiddenBiases.assign(rest, rest + hiddenSize);
+    rest += hiddenSize;
+    outputBiases.assign(rest, rest + outputSize);
+}
+
+void NNSparse::SparseFFNet::forwardImage(const uint8_t *image, double *input, double *hidden, double *probabilities) const
+{
+    for (size_t i = 0; i < inputSize; ++i)
+    {
+        input[i] = static_cast<double>(image[i]) / 255.0;
+    }
+    if (layout == NNModel::Layout::BlockSparse)
+        blocks.multiply(input, hidden);
+    else
+        csr.multiply(input, hidden);
+    for (size_t j = 0; j < hiddenSize; ++j)
+    {
+        hidden[j] = NNUtils::ActivationFunctions::relu(hidden[j] + hiddenBiases[j]);
+    }
+
+    for (size_t j = 0; j < outputSize; ++j)
+    {
+        const double *weights = outputWeights.data() + j * hiddenSize;
+        double sum = 0.0;
+        for (size_t k = 0; k < hiddenSize; ++k)
+        {
+            sum += weights[k] * hidden[k];
+        }
+        probabilities[j] = sum + outputBiases[j];
+    }
+    NNUtils::ActivationFunctions::softmax(probabilities, probabilities, outputSize);
+}
+
+/**
+ * @brief Complete forward pass for inference
+ *
+ * @param input   Image as pixel bytes
+ *
+ * @return Output probabilities for each class after softmax
+ */
+vector<double> NNSparse::SparseFFNet::performForwardPass(const vector<uint8_t> &input) const
+{
+    thread_local vector<double> scratch;
+    const double *probabilities = performForwardPass(input.data(), scratch);
+    return vector<double>(probabilities, probabilities + outputSize);
+}
+
+/**
+ * @brief Complete forward pass for inference without heap allocations once `scratch` has grown
+ *
+ * @param input    Image as inputSize pixel bytes
+ * @param scratch  Activations; grown on first use and reused
+ *
+ * @return The outputSize probabilities after softmax, stored in `scratch`
+ */
+const double *NNSparse::SparseFFNet::performForwardPass(const uint8_t *input, vector<double> &scratch) const
+{
+    if (scratch.size() < inputSize + hiddenSize + outputSize)
+        scratch.resize(inputSize + hiddenSize + outputSize);
+    double *probabilities = scratch.data() + inputSize + hiddenSize;
+    forwardImage(input, scratch.data(), scratch.data() + inputSize, probabilities);
+    return probabilities;
+}
+
+void NNSparse::SparseFFNet::performForwardPassBatch(const vector<vector<uint8_t>> &images, size_t first, size_t count,
+                                                   double *probabilities, vector<double> &scratch) const
+{
+    if (layout == NNModel::Layout::BlockSparse)
+    {
+        // Block-sparse runs image by image: skipping a block needs its inputs to be zero, which holds far more often
+        // for one image than for a whole batch
+        if (scratch.size() < inputSize + hiddenSize)
+            scratch.resize(inputSize + hiddenSize);
+        for (size_t b = 0; b < count; ++b)
+        {
+            forwardImage(images[first + b].data(), scratch.data(), scratch.data() + inputSize, probabilities + b * outputSize);
+        }
+        return;
+    }
+
+    // CSR activations are stored (units x count), so the inner loops of every layer run over the batch
+    const size_t needed = (inputSize + hiddenSize + outputSize + 4) * count;
+    if (scratch.size() < needed)
+        scratch.resize(needed);
+    double *inputs = scratch.data();
+    double *hidden = inputs + inputSize * count;
+    double *logits = hidden + hiddenSize * count;
+    double *partialSums = logits + outputSize * count;
+
+    for (size_t b = 0; b < count; ++b)
+    {
+        const uint8_t *image = images[first + b].data();
+        for (size_t i = 0; i < inputSize; ++i)
+        {
+            inputs[i * count + b] = static_cast<double>(image[i]) / 255.0;
+        }
+    }
+
+    csr.multiplyBatch(inputs, count, hidden, partialSums);
+    for (size_t j = 0; j < hiddenSize; ++j)
+    {
+        double *row = hidden + j * count;
+        for (size_t b = 0; b < count; ++b)
+        {
+            row[b] = NNUtils::ActivationFunctions::relu(row[b] + hiddenBiases[j]);
+        }
+    }
+
+    for (size_t j = 0; j < outputSize; ++j)
+    {
+        const double *weights = outputWeights.data() + j * hiddenSize;
+        double *__restrict sums = logits + j * count;
+        fill(sums, sums + count, 0.0);
+        for (size_t k = 0; k < hiddenSize; ++k)
+        {
+            const double *__restrict activations = hidden + k * count;
+            for (size_t b = 0; b < count; ++b)
+            {
+                sums[b] += weights[k] * activations[b];
+            }
+        }
+        for (size_t b = 0; b < count; ++b)
+        {
+            probabilities[b * outputSize + j] = sums[b] + outputBiases[j];
+        }
+    }
+    for (size_t b = 0; b < count; ++b)
+    {
+        double *row = probabilities + b * outputSize;
+        NNUtils::ActivationFunctions::softmax(row, row, outputSize);
+    }
+}
+
+size_t NNSparse::SparseFFNet::firstLayerBytes() const
+{
+    if (layout == NNModel::Layout::BlockSparse)
+        return blocks.blockRowOffsets.size() * sizeof(uint32_t) + blocks.blockColumns.size() * sizeof(uint32_t) +
+               blocks.values.size() * sizeof(double);
+    return csr.rowOffsets.size() * sizeof(uint32_t) + csr.columns.size() * sizeof(uint32_t) + csr.values.size() * sizeof(double);
+}
+
+size_t NNSparse::SparseFFNet::modelBytes() const
+{
+    return firstLayerBytes() + (outputWeights.size() + hiddenBiases.size() + outputBiases.size()) * sizeof(double);
+}
+
+// Data section: offsets (uint32), columns (uint32), values (double), then output weights, hidden and output biases;
+// each array starts on an 8-byte boundary
+vector<uint8_t> NNSparse::SparseFFNet::serialize() const
+{
+    vector<uint8_t> data;
+    data.reserve(modelBytes() + 32);
+    if (layout == NNModel::Layout::BlockSparse)
+    {
+        appendArray(data, blocks.blockRowOffsets);
+        alignTo8(data);
+        appendArray(data, blocks.blockColumns);
+        alignTo8(data);
+        appendArray(data, blocks.values);
+    }
+    else
+    {
+        appendArray(data, csr.rowOffsets);
+        alignTo8(data);
+        appendArray(data, csr.columns);
+        alignTo8(data);
+        appendArray(data, csr.values);
+    }
+    appendArray(data, outputWeights);
+    appendArray(data, hiddenBiases);
+    appendArray(data, outputBiases);
+    return data;
+}
+
+bool NNSparse::SparseFFNet::save(const string &filename) const
+{
+    NNModel::ModelDescription description;
+    description.layerSizes = {static_cast<uint32_t>(inputSize), static_cast<uint32_t>(hiddenSize), static_cast<uint32_t>(outputSize)};
+    description.layout = layout;
+    description.nonzeros = layout == NNModel::Layout::BlockSparse ? blocks.blocks() : csr.nonzeros();
+    vector<uint8_t> data = serialize();
+    return NNModel::writeModelFile(filename, description, data.data(), data.size());
+}
+
+/**
+ * @brief Loads a CSR or block-sparse model file written by save()
+ *
+ * @param filename  Model file
+ *
+ * @return True if the file was a valid sparse model; errors are logged
+ */
+bool NNSparse::SparseFFNet::load(const string &filename)
+{
+    NNModel::MappedModel model;
+    if (!model.open(filename))
+        return false;
+    if (model.layout() == NNModel::Layout::Dense || model.layerSizes().size() != 3)
+    {
+        LOG_ERROR("Model file %s is not a sparse 3-layer model; load it with FFNeuralNet", filename.c_str());
+        return false;
+    }
+
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(model.parameters());
+    const size_t size = model.parameterCount() * sizeof(uint64_t);
+    SparseFFNet loaded;
+    loaded.inputSize = model.layerSizes()[0];
+    loaded.hiddenSize = model.layerSizes()[1];
+    loaded.outputSize = model.layerSizes()[2];
+    loaded.layout = model.layout();
+
+    size_t offset = 0;
+    bool ok;
+    if (loaded.layout == NNModel::Layout::BlockSparse)
+    {
+        BlockSparseMatrix &matrix = loaded.blocks;
+        matrix.rows = static_cast<uint32_t>(loaded.hiddenSize);
+        matrix.cols = static_cast<uint32_t>(loaded.inputSize);
+        ok = readArray(data, size, offset, matrix.blockRows() + 1, matrix.blockRowOffsets) &&
+             readArray(data, size, offset, model.nonzeros(), matrix.blockColumns) &&
+             readArray(data, size, offset, model.nonzeros() * BLOCK_ROWS, matrix.values) &&
+             matrix.blockRowOffsets.back() == matrix.blockColumns.size();
+        for (size_t br = 0; ok && br + 1 < matrix.blockRowOffsets.size(); ++br)
+            ok = matrix.blockRowOffsets[br] <= matrix.blockRowOffsets[br + 1];
+        for (size_t b = 0; ok && b < matrix.blockColumns.size(); ++b)
+            ok = matrix.blockColumns[b] < matrix.cols;
+    }
+    else
+    {
+        CSRMatrix &matrix = loaded.csr;
+        matrix.rows = static_cast<uint32_t>(loaded.hiddenSize);
+        matrix.cols = static_cast<uint32_t>(loaded.inputSize);
+        ok = readArray(data, size, offset, static_cast<size_t>(matrix.rows) + 1, matrix.rowOffsets) &&
+             readArray(data, size, offset, model.nonzeros(), matrix.columns) &&
+             readArray(data, size, offset, model.nonzeros(), matrix.values) &&
+             matrix.rowOffsets.back() == matrix.columns.size();
+        for (size_t r = 0; ok && r < matrix.rows; ++r)
+            ok = matrix.rowOffsets[r] <= matrix.rowOffsets[r + 1];
+        for (size_t k = 0; ok && k < matrix.columns.size(); ++k)
+            ok = matrix.columns[k] < matrix.cols;
+    }
+    ok = ok && readArray(data, size, offset, loaded.outputSize * loaded.hiddenSize, loaded.outputWeights) &&
+         readArray(data, size, offset, loaded.hiddenSize, loaded.hiddenBiases) &&
+         readArray(data, size, offset, loaded.outputSize, loaded.outputBiases) &&
+         offset == size;
+    if (!ok)
+    {
+        LOG_ERROR("Sparse model file %s is truncated or inconsistent", filename.c_str());
+        return false;
+    }
+
+    *this = move(loaded);
+    return true;
+}
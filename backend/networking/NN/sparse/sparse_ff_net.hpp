@@ -0,0 +1,62 @@
+#ifndef NN_SPARSE_FF_NET_HPP
+#define NN_SPARSE_FF_NET_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sparse_matrix.hpp"
+#include "../model/model_file.hpp"
+
+namespace NNSparse
+{
+    /**
+     * @brief Inference-only network whose input-to-hidden weights (nearly all of the parameters) are stored in CSR or
+     *        block-sparse form after pruning. The hidden-to-output layer and biases stay dense.
+     *        Produces the same probabilities as FFNeuralNet with the same (pruned) parameters.
+     */
+    class SparseFFNet
+    {
+        size_t inputSize = 0;
+        size_t hiddenSize = 0;
+        size_t outputSize = 0;
+        NNModel::Layout layout = NNModel::Layout::CSR;
+        CSRMatrix csr;
+        BlockSparseMatrix blocks;
+        std::vector<double> outputWeights;
+        std::vector<double> hiddenBiases;
+        std::vector<double> outputBiases;
+
+        std::vector<uint8_t> serialize() const;
+        // One image through both layers; `input` and `hidden` are scratch of inputSize and hiddenSize values
+        void forwardImage(const uint8_t *image, double *input, double *hidden, double *probabilities) const;
+
+    public:
+        SparseFFNet() = default;
+        // `parameters` in FFNeuralNet order; `layout` must be CSR or BlockSparse
+        SparseFFNet(size_t inputSize, size_t hiddenSize, size_t outputSize, const double *parameters, NNModel::Layout layout);
+
+        // Convenience form: runs in a per-thread scratch buffer and returns a new vector
+        std::vector<double> performForwardPass(const std::vector<uint8_t> &input) const;
+        // Allocation-free form; the returned outputSize probabilities live in `scratch` until its next use
+        const double *performForwardPass(const uint8_t *input, std::vector<double> &scratch) const;
+        /**
+         * @brief Forward pass for images [first, first + count). CSR reads each weight once for the whole batch;
+         *        block-sparse keeps its per-image block skipping. Bitwise identical to performForwardPass on each image.
+         *
+         * @param probabilities  Receives count x outputSize probabilities, row-major
+         * @param scratch        Caller-owned buffer, grown on first use and reused (keep one per thread), so steady-state
+         *                       batches make no heap allocations
+         */
+        void performForwardPassBatch(const std::vector<std::vector<uint8_t>> &images, size_t first, size_t count,
+                                     double *probabilities, std::vector<double> &scratch) const;
+
+        bool save(const std::string &filename) const;
+        bool load(const std::string &filename);
+
+        NNModel::Layout getLayout() const { return layout; }
+        size_t firstLayerBytes() const;
+        size_t modelBytes() const;
+    };
+}
+
+#endif
@@ -0,0 +1,204 @@
+#include "sparse_matrix.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace std;
+
+NNSparse::CSRMatrix NNSparse::CSRMatrix::fromDense(const double *dense, uint32_t rows, uint32_t cols)
+{
+    CSRMatrix matrix;
+    matrix.rows = rows;
+    matrix.cols = cols;
+    matrix.rowOffsets.reserve(rows + 1);
+    matrix.rowOffsets.push_back(0);
+    for (uint32_t r = 0; r < rows; ++r)
+    {
+        for (uint32_t c = 0; c < cols; ++c)
+        {
+            double value = dense[static_cast<size_t>(r) * cols + c];
+            if (value != 0.0)
+            {
+                matrix.columns.push_back(c);
+                matrix.values.push_back(value);
+            }
+        }
+        matrix.rowOffsets.push_back(static_cast<uint32_t>(matrix.values.size()));
+    }
+    return matrix;
+}
+
+void NNSparse::CSRMatrix::multiply(const double *input, double *output) const
+{
+    for (uint32_t r = 0; r < rows; ++r)
+    {
+        uint32_t k = rowOffsets[r];
+        const uint32_t end = rowOffsets[r + 1];
+        // Four independent partial sums so consecutive gathers are not serialized on one add
+        double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+        for (; k + 4 <= end; k += 4)
+        {
+            sum0 += values[k] * input[columns[k]];
+            sum1 += values[k + 1] * input[columns[k + 1]];
+            sum2 += values[k + 2] * input[columns[k + 2]];
+            sum3 += values[k + 3] * input[columns[k + 3]];
+        }
+        for (; k < end; ++k)
+        {
+            sum0 += values[k] * input[columns[k]];
+        }
+        output[r] = (sum0 + sum1) + (sum2 + sum3);
+    }
+}
+
+// Same partial sums in the same order as multiply(), so every image's output is bitwise identical to a single pass
+void NNSparse::CSRMatrix::multiplyBatch(const double *inputs, size_t count, double *outputs, double *partials) const
+{
+    double *__restrict sum0 = partials;
+    double *__restrict sum1 = partials + count;
+    double *__restrict sum2 = partials + 2 * count;
+    double *__restrict sum3 = partials + 3 * count;
+    for (uint32_t r = 0; r < rows; ++r)
+    {
+        fill(partials, partials + 4 * count, 0.0);
+        uint32_t k = rowOffsets[r];
+        const uint32_t end = rowOffsets[r + 1];
+        for (; k + 4 <= end; k += 4)
+        {
+            const double *x0 = inputs + static_cast<size_t>(columns[k]) * count;
+            const double *x1 = inputs + static_cast<size_t>(columns[k + 1]) * count;
+            const double *x2 = inputs + static_cast<size_t>(columns[k + 2]) * count;
+            const double *x3 = inputs + static_cast<size_t>(columns[k + 3]) * count;
+            const double v0 = values[k], v1 = values[k + 1], v2 = values[k + 2], v3 = values[k + 3];
+            for (size_t i = 0; i < count; ++i)
+            {
+                sum0[i] += v0 * x0[i];
+                sum1[i] += v1 * x1[i];
+                sum2[i] += v2 * x2[i];
+                sum3[i] += v3 * x3[i];
+            }
+        }
+        for (; k < end; ++k)
+        {
+            const double *x = inputs + static_cast<size_t>(columns[k]) * count;
+            const double v = values[k];
+            for (size_t i = 0; i < count; ++i)
+            {
+                sum0[i] += v * x[i];
+            }
+        }
+        double *__restrict out = outputs + static_cast<size_t>(r) * count;
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = (sum0[i] + sum1[i]) + (sum2[i] + sum3[i]);
+        }
+    }
+}
+
+NNSparse::BlockSparseMatrix NNSparse::BlockSparseMatrix::fromDense(const double *dense, uint32_t rows, uint32_t cols)
+{
+    BlockSparseMatrix matrix;
+    matrix.rows = rows;
+    matrix.cols = cols;
+    const uint32_t blockRowCount = matrix.blockRows();
+    matrix.blockRowOffsets.reserve(blockRowCount + 1);
+    matrix.blockRowOffsets.push_back(0);
+    for (uint32_t br = 0; br < blockRowCount; ++br)
+    {
+        const uint32_t firstRow = br * BLOCK_ROWS;
+        const uint32_t rowsInBlock = min(BLOCK_ROWS, rows - firstRow);
+        for (uint32_t c = 0; c < cols; ++c)
+        {
+            bool nonzero = false;
+            for (uint32_t r = 0; r < rowsInBlock; ++r)
+                nonzero |= dense[static_cast<size_t>(firstRow + r) * cols + c] != 0.0;
+            if (!nonzero)
+                continue;
+
+            matrix.blockColumns.push_back(c);
+            for (uint32_t r = 0; r < BLOCK_ROWS; ++r)
+                matrix.values.push_back(r < rowsInBlock ? dense[static_cast<size_t>(firstRow + r) * cols + c] : 0.0);
+        }
+        matrix.blockRowOffsets.push_back(static_cast<uint32_t>(matrix.blockColumns.size()));
+    }
+    return matrix;
+}
+
+void NNSparse::BlockSparseMatrix::multiply(const double *input, double *output) const
+{
+    const uint32_t blockRowCount = blockRows();
+    for (uint32_t br = 0; br < blockRowCount; ++br)
+    {
+        double accumulator[BLOCK_ROWS] = {};
+        for (uint32_t b = blockRowOffsets[br]; b < blockRowOffsets[br + 1]; ++b)
+        {
+            const double x = input[blockColumns[b]];
+            if (x == 0.0)
+                continue;
+            const double *block = values.data() + static_cast<size_t>(b) * BLOCK_ROWS;
+            for (uint32_t r = 0; r < BLOCK_ROWS; ++r)
+            {
+                accumulator[r] += x * block[r];
+            }
+        }
+
+        const uint32_t firstRow = br * BLOCK_ROWS;
+        const uint32_t rowsInBlock = min(BLOCK_ROWS, rows - firstRow);
+        for (uint32_t r = 0; r < rowsInBlock; ++r)
+        {
+            output[firstRow + r] = accumulator[r];
+        }
+    }
+}
+
+void NNSparse::pruneByMagnitude(double *weights, size_t count, double sparsity, uint8_t *mask)
+{
+    size_t pruned = static_cast<size_t>(clamp(sparsity, 0.0, 1.0) * static_cast<double>(count));
+    vector<size_t> order(count);
+    iota(order.begin(), order.end(), 0);
+    nth_element(order.begin(), order.begin() + pruned, order.end(), [&](size_t a, size_t b)
+                { return fabs(weights[a]) < fabs(weights[b]); });
+
+    fill(mask, mask + count, 1);
+    for (size_t i = 0; i < pruned; ++i)
+    {
+        weights[order[i]] = 0.0;
+        mask[order[i]] = 0;
+    }
+}
+
+void NNSparse::pruneBlocksByMagnitude(double *weights, uint32_t rows, uint32_t cols, double sparsity, uint8_t *mask)
+{
+    const uint32_t blockRowCount = (rows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+    const size_t blockCount = static_cast<size_t>(blockRowCount) * cols;
+    vector<double> norms(blockCount, 0.0);
+    for (uint32_t r = 0; r < rows; ++r)
+    {
+        for (uint32_t c = 0; c < cols; ++c)
+        {
+            double w = weights[static_cast<size_t>(r) * cols + c];
+            norms[static_cast<size_t>(r / BLOCK_ROWS) * cols + c] += w * w;
+        }
+    }
+
+    size_t pruned = static_cast<size_t>(clamp(sparsity, 0.0, 1.0) * static_cast<double>(blockCount));
+    vector<size_t> order(blockCount);
+    iota(order.begin(), order.end(), 0);
+    nth_element(order.begin(), order.begin() + pruned, order.end(), [&](size_t a, size_t b)
+                { return norms[a] < norms[b]; });
+
+    vector<uint8_t> keepBlock(blockCount, 1);
+    for (size_t i = 0; i < pruned; ++i)
+        keepBlock[order[i]] = 0;
+
+    for (uint32_t r = 0; r < rows; ++r)
+    {
+        for (uint32_t c = 0; c < cols; ++c)
+        {
+            size_t index = static_cast<size_t>(r) * cols + c;
+            mask[index] = keepBlock[static_cast<size_t>(r / BLOCK_ROWS) * cols + c];
+            if (!mask[index])
+                weights[index] = 0.0;
+        }
+    }
+}
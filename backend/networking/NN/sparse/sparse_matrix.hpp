@@ -0,0 +1,67 @@
+#ifndef NN_SPARSE_MATRIX_HPP
+#define NN_SPARSE_MATRIX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace NNSparse
+{
+    // Compressed sparse rows: row r's values are values[rowOffsets[r], rowOffsets[r + 1]) at the matching columns
+    struct CSRMatrix
+    {
+        uint32_t rows = 0;
+        uint32_t cols = 0;
+        std::vector<uint32_t> rowOffsets;
+        std::vector<uint32_t> columns;
+        std::vector<double> values;
+
+        static CSRMatrix fromDense(const double *dense, uint32_t rows, uint32_t cols);
+        void multiply(const double *input, double *output) const; // output = A * input
+        // The same for `count` inputs at once, stored column-interleaved: inputs is (cols x count), outputs (rows x
+        // count), so each weight is read once per batch. partials holds 4 * count scratch values.
+        void multiplyBatch(const double *inputs, size_t count, double *outputs, double *partials) const;
+        size_t nonzeros() const { return values.size(); }
+    };
+
+    // Rows per block. A block is one column of BLOCK_ROWS consecutive rows, so the kernel updates BLOCK_ROWS outputs
+    // with one broadcast input value: a straight vertical multiply-add with no gathers or horizontal sums.
+    constexpr uint32_t BLOCK_ROWS = 8;
+
+    // Block-sparse rows: block row br holds blocks [blockRowOffsets[br], blockRowOffsets[br + 1]), block b covers
+    // column blockColumns[b] of rows [br * BLOCK_ROWS, (br + 1) * BLOCK_ROWS) with values[b * BLOCK_ROWS, (b + 1) * BLOCK_ROWS)
+    struct BlockSparseMatrix
+    {
+        uint32_t rows = 0;
+        uint32_t cols = 0;
+        std::vector<uint32_t> blockRowOffsets;
+        std::vector<uint32_t> blockColumns;
+        std::vector<double> values;
+
+        static BlockSparseMatrix fromDense(const double *dense, uint32_t rows, uint32_t cols);
+        // Blocks whose input is zero are skipped, so sparse inputs (MNIST pixels) cost less as well
+        void multiply(const double *input, double *output) const;
+        size_t blocks() const { return blockColumns.size(); }
+        uint32_t blockRows() const { return (rows + BLOCK_ROWS - 1) / BLOCK_ROWS; }
+    };
+
+    /**
+     * @brief Zeroes the smallest-magnitude weights until `sparsity` of them are zero
+     *
+     * @param weights    Row-major weights, pruned in place
+     * @param count      Number of weights
+     * @param sparsity   Target fraction of zero weights (0-1)
+     * @param mask       Receives 1 for kept weights and 0 for pruned ones (`count` entries)
+     */
+    void pruneByMagnitude(double *weights, size_t count, double sparsity, uint8_t *mask);
+
+    /**
+     * @brief Zeroes whole BLOCK_ROWS x 1 blocks with the smallest L2 norm until `sparsity` of the blocks are zero
+     *
+     * @param weights    Row-major (rows x cols) weights, pruned in place
+     * @param mask       Receives 1 for kept weights and 0 for pruned ones (rows * cols entries)
+     */
+    void pruneBlocksByMagnitude(double *weights, uint32_t rows, uint32_t cols, double sparsity, uint8_t *mask);
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef STATIC_FF_NET_HPP
+#define STATIC_FF_NET_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "utils/utils.hpp"
+#include "model/model_file.hpp"
+#include "../Logging/Logger.hpp"
+
+/**
+ * @brief Inference network with its topology fixed at compile time, e.g. StaticFFNet<784, 128, 10> for the MNIST model.
+ *        Every loop bound is a constant and the activation is a policy type, so the layers compile to fixed-length,
+ *        unrolled and vectorized code with no std::function calls or size checks.
+ *        Reads and writes the same model files as FFNeuralNet. With Scalar = double the probabilities are bitwise equal
+ *        to FFNeuralNet's, because each neuron still adds its terms in input order. Scalar = float halves the memory
+ *        traffic and the results differ only by rounding.
+ *
+ * @tparam In          Input layer size
+ * @tparam Hidden      Hidden layer size
+ * @tparam Out         Output layer size (number of classes)
+ * @tparam Activation  Hidden layer activation policy with a static apply(x), e.g. NNUtils::ActivationFunctions::Relu
+ * @tparam Scalar      Type the parameters are stored and computed in
+ */
+template <size_t In, size_t Hidden, size_t Out,
+          typename Activation = NNUtils::ActivationFunctions::Relu,
+          typename Scalar = double>
+class StaticFFNet
+{
+    static_assert(In > 0 && Hidden > 0 && Out > 0, "StaticFFNet layers must not be empty");
+    static_assert(std::is_floating_point_v<Scalar>, "StaticFFNet Scalar must be a floating-point type");
+
+public:
+    static constexpr size_t PARAMETER_COUNT = Hidden * In + Out * Hidden + Hidden + Out;
+    using Probabilities = std::array<Scalar, Out>;
+
+private:
+    // Weights are stored transposed (input-major), so each input scales one contiguous row of next-layer weights:
+    // the inner loop is a fixed-length multiply-add over aligned arrays, and zero inputs skip their row entirely
+    struct Parameters
+    {
+        alignas(64) std::array<Scalar, In * Hidden> inputToHiddenWeights;   // (In x Hidden)
+        alignas(64) std::array<Scalar, Hidden * Out> hiddenToOutputWeights; // (Hidden x Out)
+        alignas(64) std::array<Scalar, Hidden> hiddenBiases;
+        alignas(64) std::array<Scalar, Out> outputBiases;
+    };
+    // On the heap: the 784-128-10 model is about 800 KB
+    std::unique_ptr<Parameters> parameters = std::make_unique<Parameters>();
+
+    template <size_t Inputs, size_t Outputs>
+    static void accumulateLayer(const std::array<Scalar, Inputs> &input, const std::array<Scalar, Inputs * Outputs> &weights,
+                                std::array<Scalar, Outputs> &output)
+    {
+        for (size_t j = 0; j < Inputs; ++j)
+        {
+            const Scalar x = input[j];
+            if (x == Scalar(0))
+                continue; // adds nothing: every sum starts at +0 and the weights are finite
+            const Scalar *row = weights.data() + j * Outputs;
+            for (size_t i = 0; i < Outputs; ++i)
+            {
+                output[i] += row[i] * x;
+            }
+        }
+    }
+
+public:
+    static constexpr size_t getInputSize() { return In; }
+    static constexpr size_t getOutputSize() { return Out; }
+    static constexpr size_t parameterCount() { return PARAMETER_COUNT; }
+
+    /**
+     * @brief Complete forward pass for inference
+     *
+     * @param input  In pixel bytes
+     *
+     * @return Output probabilities for each class after softmax
+     */
+    Probabilities performForwardPass(const uint8_t *input) const
+    {
+        alignas(64) std::array<Scalar, In> inputNormalized;
+        for (size_t i = 0; i < In; ++i)
+        {
+            inputNormalized[i] = static_cast<Scalar>(input[i]) / Scalar(255);
+        }
+
+        alignas(64) std::array<Scalar, Hidden> hidden{};
+        accumulateLayer<In, Hidden>(inputNormalized, parameters->inputToHiddenWeights, hidden);
+        for (size_t i = 0; i < Hidden; ++i)
+        {
+            hidden[i] = Activation::apply(hidden[i] + parameters->hiddenBiases[i]);
+        }
+
+        Probabilities probabilities{};
+        accumulateLayer<Hidden, Out>(hidden, parameters->hiddenToOutputWeights, probabilities);
+        for (size_t i = 0; i < Out; ++i)
+        {
+            probabilities[i] += parameters->outputBiases[i];
+        }
+
+        // The double model shares FFNeuralNet's softmax kernel, which keeps the two bitwise equal
+        if constexpr (std::is_same_v<Scalar, double>)
+        {
+            NNUtils::ActivationFunctions::softmax(probabilities.data(), probabilities.data(), Out);
+            return probabilities;
+        }
+        const Scalar maxLogit = *std::max_element(probabilities.begin(), probabilities.end());
+        Scalar sum = 0;
+        for (size_t i = 0; i < Out; ++i)
+        {
+            probabilities[i] = std::exp(probabilities[i] - maxLogit);
+            sum += probabilities[i];
+        }
+        for (size_t i = 0; i < Out; ++i)
+        {
+            probabilities[i] /= sum;
+        }
+        return probabilities;
+    }
+
+    // `input` must hold In pixels
+    Probabilities performForwardPass(const std::vector<uint8_t> &input) const { return performForwardPass(input.data()); }
+
+    /**
+     * @brief Replaces every parameter
+     *
+     * @param values  PARAMETER_COUNT parameters in the order FFNeuralNet persists them (row-major weights, then biases)
+     */
+    void setParameters(const double *values)
+    {
+        for (size_t i = 0; i < Hidden; ++i)
+            for (size_t j = 0; j < In; ++j)
+                parameters->inputToHiddenWeights[j * Hidden + i] = static_cast<Scalar>(values[i * In + j]);
+        values += Hidden * In;
+        for (size_t i = 0; i < Out; ++i)
+            for (size_t j = 0; j < Hidden; ++j)
+                parameters->hiddenToOutputWeights[j * Out + i] = static_cast<Scalar>(values[i * Hidden + j]);
+        values += Out * Hidden;
+        std::copy(values, values + Hidden, parameters->hiddenBiases.begin());
+        std::copy(values + Hidden, values + Hidden + Out, parameters->outputBiases.begin());
+    }
+
+    // Parameters in persisted order
+    std::vector<double> getParameters() const
+    {
+        std::vector<double> values(PARAMETER_COUNT);
+        double *out = values.data();
+        for (size_t i = 0; i < Hidden; ++i)
+            for (size_t j = 0; j < In; ++j)
+                *out++ = parameters->inputToHiddenWeights[j * Hidden + i];
+        for (size_t i = 0; i < Out; ++i)
+            for (size_t j = 0; j < Hidden; ++j)
+                *out++ = parameters->hiddenToOutputWeights[j * Out + i];
+        out = std::copy(parameters->hiddenBiases.begin(), parameters->hiddenBiases.end(), out);
+        std::copy(parameters->outputBiases.begin(), parameters->outputBiases.end(), out);
+        return values;
+    }
+
+    /**
+     * @brief Saves the parameters as a dense model file, readable by FFNeuralNet
+     *
+     * @param filename  Destination file
+     *
+     * @return True if the file was written
+     */
+    bool saveFinalWeights(const std::string &filename) const
+    {
+        const std::vector<double> values = getParameters();
+        return NNModel::writeModelFile(filename, std::vector<uint32_t>{In, Hidden, Out}, values.data(), values.size());
+    }
+
+    /**
+     * @brief Loads a dense model file (or a legacy headerless file) written by FFNeuralNet or saveFinalWeights
+     *
+     * @param filename  Model file
+     *
+     * @return True if the file matched the compiled topology and was loaded; the network is unchanged otherwise
+     */
+    bool loadPretrainedWeights(const std::string &filename)
+    {
+        NNModel::MappedModel model;
+        if (!model.open(filename))
+            return false;
+
+        if (model.isLegacy())
+        {
+            if (model.parameterCount() != PARAMETER_COUNT)
+            {
+                LOG_ERROR("Weight file %s has no header and %zu values, but a %zux%zux%zu network needs %zu",
+                          filename.c_str(), model.parameterCount(), In, Hidden, Out, PARAMETER_COUNT);
+                return false;
+            }
+            LOG_WARN("Weight file %s uses the legacy headerless format; re-save it to add topology and checksum", filename.c_str());
+        }
+        else if (model.layout() != NNModel::Layout::Dense ||
+                 model.layerSizes() != std::vector<uint32_t>{In, Hidden, Out} ||
+                 model.parameterCount() != PARAMETER_COUNT)
+        {
+            LOG_ERROR("Model file %s is not a dense %zux%zux%zu model", filename.c_str(), In, Hidden, Out);
+            return false;
+        }
+
+        setParameters(model.parameters());
+        return true;
+    }
+};
+
+#endif
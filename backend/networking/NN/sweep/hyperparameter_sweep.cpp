@@ -0,0 +1,265 @@
+#include "hyperparameter_sweep.hpp"
+#include "../utils/work_stealing_pool.hpp"
+#include "../../Logging/Logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+namespace
+{
+    const size_t VALIDATION_BATCH = 64;
+
+    struct Trial
+    {
+        NNSweep::TrialResult result;
+        TrainingConfig training;
+        string checkpointFile;
+        unique_ptr<FFNeuralNet> net; // kept between rungs; released once the trial completes or fails
+    };
+
+    // Train `trial` until it has `targetEpochs` epochs
+    struct Task
+    {
+        size_t trial = 0;
+        int targetEpochs = 0;
+    };
+
+    /**
+     * @brief Average cross-entropy and accuracy of `net` on the validation set
+     *
+     * @return {loss, accuracy}
+     */
+    pair<double, double> validate(const FFNeuralNet &net, const vector<vector<uint8_t>> &images, const vector<uint8_t> &labels,
+                                  size_t classes)
+    {
+        FFNeuralNet::Workspace workspace = net.makeWorkspace(VALIDATION_BATCH);
+        vector<double> probabilities(VALIDATION_BATCH * classes);
+        double loss = 0.0;
+        size_t correct = 0;
+        for (size_t first = 0; first < images.size(); first += VALIDATION_BATCH)
+        {
+            const size_t count = min(VALIDATION_BATCH, images.size() - first);
+            net.performForwardPassBatch(images, first, count, probabilities.data(), workspace);
+            for (size_t b = 0; b < count; ++b)
+            {
+                const double *row = probabilities.data() + b * classes;
+                loss -= log(max(row[labels[first + b]], 1e-300));
+                correct += static_cast<size_t>(max_element(row, row + classes) - row) == labels[first + b];
+            }
+        }
+        return {loss / images.size(), static_cast<double>(correct) / images.size()};
+    }
+}
+
+const char *NNSweep::trialStateName(TrialState state)
+{
+    switch (state)
+    {
+    case TrialState::Completed:
+        return "completed";
+    case TrialState::Stopped:
+        return "stopped";
+    default:
+        return "failed";
+    }
+}
+
+NNSweep::SweepSummary NNSweep::runSweep(const vector<vector<uint8_t>> &trainImages,
+                                        const vector<uint8_t> &trainLabels,
+                                        const vector<vector<uint8_t>> &validationImages,
+                                        const vector<uint8_t> &validationLabels,
+                                        const SweepConfig &config)
+{
+    SweepSummary summary;
+    if (trainImages.empty() || validationImages.empty() || config.trials.empty())
+    {
+        LOG_ERROR("runSweep needs training images, validation images and at least one trial");
+        return summary;
+    }
+    const size_t inputSize = trainImages.front().size();
+    const size_t classes = 10;
+    filesystem::create_directories(config.outputDirectory);
+
+    // Rung boundaries in epochs, shared by every trial: minEpochs * reduction^k below the largest budget
+    int maxBudget = 0;
+    for (const TrialConfig &trialConfig : config.trials)
+        maxBudget = max(maxBudget, trialConfig.epochs);
+    vector<int> rungEpochs;
+    for (long epochs = config.minEpochs; config.minEpochs > 0 && epochs < maxBudget; epochs *= max(2, config.reduction))
+        rungEpochs.push_back(static_cast<int>(epochs));
+    const size_t reduction = static_cast<size_t>(max(2, config.reduction));
+
+    vector<Trial> trials(config.trials.size());
+    for (size_t id = 0; id < trials.size(); ++id)
+    {
+        Trial &trial = trials[id];
+        const string prefix = config.outputDirectory + "/run_" + to_string(id);
+        trial.result.id = id;
+        trial.result.config = config.trials[id];
+        trial.result.trainingDataFile = prefix + "_training_data.dat";
+        trial.result.weightsFile = prefix + "_weights.dat";
+        trial.checkpointFile = prefix + "_checkpoint.dat";
+
+        trial.training = config.training;
+        trial.training.epochs = trial.result.config.epochs;
+        trial.training.optimizer.learningRate = trial.result.config.learningRate;
+        trial.training.schedule.totalEpochs = trial.result.config.epochs;
+        trial.training.trainingDataFile = trial.result.trainingDataFile;
+        trial.training.probabilitiesFile = config.outputDirectory + "/probabilities.dat";
+        trial.training.checkpointFile = trial.checkpointFile;
+        trial.training.checkpointEverySteps = 0;
+        summary.epochBudget += trial.result.config.epochs;
+    }
+
+    // The first rung a trial stops at after `epochs`, or its budget
+    auto nextTarget = [&](const Trial &trial)
+    {
+        for (int rung : rungEpochs)
+            if (rung > trial.result.epochsTrained && rung < trial.result.config.epochs)
+                return rung;
+        return trial.result.config.epochs;
+    };
+
+    // ASHA state: validation losses reported at each rung, the trials paused there waiting for a promotion, the tasks
+    // queued or running, and whether any trial has completed
+    mutex ashaMutex;
+    vector<vector<pair<double, size_t>>> rungLosses(rungEpochs.size());
+    vector<vector<size_t>> paused(rungEpochs.size());
+    size_t inFlight = trials.size();
+    bool anyCompleted = false;
+
+    NNUtils::WorkStealingPool<Task> pool(config.workers);
+    for (size_t id = 0; id < trials.size(); ++id)
+        pool.push(id, {id, nextTarget(trials[id])});
+
+    // Called with ashaMutex held once a task is done. A rung with fewer than `reduction` reports promotes no one, so
+    // when nothing is left to run and no trial has completed, the best paused trial of the highest rung goes on; the
+    // sweep then always ends with a trained model
+    auto promoteIfIdle = [&](size_t worker)
+    {
+        if (inFlight > 0 || anyCompleted)
+            return;
+        for (size_t r = rungEpochs.size(); r-- > 0;)
+        {
+            if (paused[r].empty())
+                continue;
+            vector<pair<double, size_t>> ranked = rungLosses[r];
+            sort(ranked.begin(), ranked.end());
+            for (const auto &[loss, id] : ranked)
+            {
+                auto waiting = find(paused[r].begin(), paused[r].end(), id);
+                if (waiting == paused[r].end())
+                    continue;
+                paused[r].erase(waiting);
+                ++inFlight;
+                pool.push(worker, {id, nextTarget(trials[id])});
+                return;
+            }
+        }
+    };
+
+    auto sweepStart = chrono::steady_clock::now();
+    pool.run([&](Task &task, size_t worker)
+             {
+        Trial &trial = trials[task.trial];
+        TrialResult &result = trial.result;
+        auto start = chrono::steady_clock::now();
+        if (!trial.net)
+        {
+            // Start from an empty history and no checkpoint or weights, whatever an earlier sweep left behind
+            ofstream(result.trainingDataFile, ios::binary | ios::trunc);
+            filesystem::remove(trial.checkpointFile);
+            filesystem::remove(result.weightsFile);
+            trial.net = make_unique<FFNeuralNet>(inputSize, result.config.hiddenSize, classes);
+        }
+
+        // Stop at the rung's epoch boundary, after its checkpoint is written; the next rung's train() resumes from it
+        bool reachedTarget = false;
+        TrainingConfig training = trial.training;
+        training.onProgress = [&](const TrainingProgress &progress)
+        {
+            reachedTarget = progress.epochComplete && progress.epoch >= task.targetEpochs;
+            return !reachedTarget || task.targetEpochs == result.config.epochs;
+        };
+        NNData::InMemorySamples samples(trainImages, trainLabels);
+        if (trial.net->train(samples, training) == TrainingResult::Failed)
+        {
+            LOG_ERROR("Trial %zu failed after %d epochs", result.id, result.epochsTrained);
+            result.state = TrialState::Failed;
+            trial.net.reset();
+            lock_guard<mutex> lock(ashaMutex);
+            --inFlight;
+            promoteIfIdle(worker);
+            return;
+        }
+        result.epochsTrained = task.targetEpochs;
+        tie(result.validationLoss, result.validationAccuracy) = validate(*trial.net, validationImages, validationLabels, classes);
+        LOG_INFO("Trial %zu (hidden %zu, learning rate %g): epoch %d/%d, validation loss %.4f, accuracy %.4f",
+                 result.id, result.config.hiddenSize, result.config.learningRate, result.epochsTrained,
+                 result.config.epochs, result.validationLoss, result.validationAccuracy);
+
+        const bool complete = result.epochsTrained == result.config.epochs;
+        if (complete)
+        {
+            result.state = trial.net->saveFinalWeights(result.weightsFile) ? TrialState::Completed : TrialState::Failed;
+            trial.net.reset();
+        }
+        else
+        {
+            result.state = TrialState::Stopped; // until promoted
+        }
+        result.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        lock_guard<mutex> lock(ashaMutex);
+        --inFlight;
+        anyCompleted = anyCompleted || result.state == TrialState::Completed;
+        const auto rung = find(rungEpochs.begin(), rungEpochs.end(), result.epochsTrained);
+        if (rung == rungEpochs.end())
+        {
+            promoteIfIdle(worker);
+            return;
+        }
+        const size_t k = rung - rungEpochs.begin();
+        rungLosses[k].push_back({result.validationLoss, result.id});
+        if (!complete)
+            paused[k].push_back(result.id);
+
+        // Promote every paused trial now in the best 1/reduction of its rung, the highest rung first. Promoted trials
+        // go on this worker's own queue; idle workers steal them from there.
+        for (size_t r = rungEpochs.size(); r-- > 0;)
+        {
+            vector<pair<double, size_t>> ranked = rungLosses[r];
+            const size_t quota = ranked.size() / reduction;
+            partial_sort(ranked.begin(), ranked.begin() + quota, ranked.end());
+            for (size_t i = 0; i < quota; ++i)
+            {
+                auto waiting = find(paused[r].begin(), paused[r].end(), ranked[i].second);
+                if (waiting == paused[r].end())
+                    continue;
+                paused[r].erase(waiting);
+                ++inFlight;
+                pool.push(worker, {ranked[i].second, nextTarget(trials[ranked[i].second])});
+            }
+        }
+        promoteIfIdle(worker); });
+    summary.seconds = chrono::duration<double>(chrono::steady_clock::now() - sweepStart).count();
+    summary.steals = pool.steals();
+
+    for (Trial &trial : trials)
+    {
+        // Trials never promoted keep only their history
+        if (trial.result.state == TrialState::Stopped)
+            filesystem::remove(trial.checkpointFile);
+        if (trial.result.state != TrialState::Completed)
+            trial.result.weightsFile.clear();
+        summary.epochsTrained += trial.result.epochsTrained;
+        summary.trials.push_back(trial.result);
+    }
+    return summary;
+}
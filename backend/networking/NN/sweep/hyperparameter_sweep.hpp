@@ -0,0 +1,90 @@
+#ifndef NN_HYPERPARAMETER_SWEEP_HPP
+#define NN_HYPERPARAMETER_SWEEP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../ff_neural_net.hpp"
+
+namespace NNSweep
+{
+    // One point of the grid
+    struct TrialConfig
+    {
+        size_t hiddenSize = 128;
+        double learningRate = 0.002;
+        int epochs = 5; // budget; the cosine schedule spans all of it even if the trial is stopped early
+    };
+
+    struct SweepConfig
+    {
+        std::vector<TrialConfig> trials;
+        TrainingConfig training; // batch size, optimizer type, schedule shape and shuffling shared by every trial
+        unsigned workers = 1;    // trials trained at the same time
+        // ASHA: a trial is first judged after minEpochs, then at minEpochs * reduction^k epochs. At each such rung only
+        // the best 1/reduction of the trials that reached it are trained further; 0 minEpochs trains every trial fully.
+        // If that leaves no trial to train before one has completed, the best trial at the highest rung continues.
+        int minEpochs = 1;
+        int reduction = 3;
+        std::string outputDirectory = "mnist/data/sweep";
+    };
+
+    enum class TrialState
+    {
+        Completed, // trained for its whole budget
+        Stopped,   // never promoted past a rung
+        Failed
+    };
+
+    struct TrialResult
+    {
+        size_t id = 0;
+        TrialConfig config;
+        TrialState state = TrialState::Failed;
+        int epochsTrained = 0;
+        double validationLoss = 0.0; // after the last epoch trained
+        double validationAccuracy = 0.0;
+        double seconds = 0.0; // training and validation time across all of the trial's rungs
+        std::string trainingDataFile;
+        std::string weightsFile; // only for completed trials
+    };
+
+    struct SweepSummary
+    {
+        std::vector<TrialResult> trials;
+        uint64_t epochsTrained = 0;
+        uint64_t epochBudget = 0; // epochs a sweep without early stopping would train
+        uint64_t steals = 0;      // tasks a worker took from another worker's queue
+        double seconds = 0.0;
+    };
+
+    const char *trialStateName(TrialState state);
+
+    /**
+     * @brief Trains every trial of the sweep in this process, `workers` at a time. All trials read the same in-memory
+     *        training and validation sets, which are never copied. Each trial's history goes to its own
+     *        TrainingDatabase, run_{id}_training_data.dat in the output directory, and a completed trial's weights to
+     *        run_{id}_weights.dat.
+     *
+     *        Trials are trained one rung at a time. A rung ends at an epoch boundary, where the trial's checkpoint
+     *        (run_{id}_checkpoint.dat) is written, so a promoted trial resumes exactly where it stopped. Each rung is a
+     *        task on a work-stealing pool: a worker continues the trials it promotes itself and steals waiting trials
+     *        from the other workers when it runs out.
+     *
+     * @param trainImages       Training images shared by all trials
+     * @param trainLabels       Their labels
+     * @param validationImages  Held-out images that decide which trials are promoted
+     * @param validationLabels  Their labels
+     * @param config            Grid, shared training settings, workers and ASHA parameters
+     *
+     * @return One result per trial, in grid order, with sweep-wide totals
+     */
+    SweepSummary runSweep(const std::vector<std::vector<uint8_t>> &trainImages,
+                          const std::vector<uint8_t> &trainLabels,
+                          const std::vector<std::vector<uint8_t>> &validationImages,
+                          const std::vector<uint8_t> &validationLabels,
+                          const SweepConfig &config);
+}
+
+#endif
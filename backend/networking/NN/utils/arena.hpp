@@ -0,0 +1,83 @@
+#ifndef NN_ARENA_HPP
+#define NN_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace NNUtils
+{
+    /**
+     * @brief Bump allocator over one 64-byte aligned block. Memory is handed out in order and only released all at
+     *        once, so everything carved from an arena costs the single heap allocation made when it is created.
+     */
+    class Arena
+    {
+    public:
+        static constexpr size_t ALIGNMENT = 64;
+
+        // Bytes `count` T's take in the arena, padded so the next allocation stays aligned
+        template <typename T>
+        static constexpr size_t bytesFor(size_t count)
+        {
+            return (count * sizeof(T) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+
+        Arena() = default;
+        explicit Arena(size_t capacity)
+            : storage{capacity ? static_cast<uint8_t *>(::operator new(capacity, std::align_val_t{ALIGNMENT})) : nullptr},
+              capacity{capacity}
+        {
+        }
+
+        Arena(Arena &&other) noexcept
+            : storage{std::move(other.storage)}, capacity{std::exchange(other.capacity, 0)}, used{std::exchange(other.used, 0)}
+        {
+        }
+
+        Arena &operator=(Arena &&other) noexcept
+        {
+            storage = std::move(other.storage);
+            capacity = std::exchange(other.capacity, 0);
+            used = std::exchange(other.used, 0);
+            return *this;
+        }
+
+        /**
+         * @brief Carves uninitialized memory for `count` values of T
+         *
+         * @return ALIGNMENT-aligned memory, or nullptr when the arena does not have bytesFor<T>(count) bytes left
+         */
+        template <typename T>
+        T *allocate(size_t count)
+        {
+            static_assert(std::is_trivially_destructible_v<T>, "Arena memory is released without running destructors");
+            const size_t bytes = bytesFor<T>(count);
+            if (bytes > capacity - used)
+                return nullptr;
+            T *memory = reinterpret_cast<T *>(storage.get() + used);
+            used += bytes;
+            return memory;
+        }
+
+        // Makes the whole block available again; memory handed out before must no longer be used
+        void reset() { used = 0; }
+        size_t bytesUsed() const { return used; }
+        size_t bytesCapacity() const { return capacity; }
+
+    private:
+        struct AlignedDelete
+        {
+            void operator()(uint8_t *memory) const { ::operator delete(memory, std::align_val_t{ALIGNMENT}); }
+        };
+
+        std::unique_ptr<uint8_t, AlignedDelete> storage;
+        size_t capacity = 0;
+        size_t used = 0;
+    };
+}
+
+#endif
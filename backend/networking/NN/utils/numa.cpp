@@ -0,0 +1,167 @@
+#include "numa.hpp"
+#include "../../Logging/Logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    // From <numaif.h>; the raw syscall avoids a libnuma dependency
+    constexpr int MPOL_BIND_MODE = 2;
+    constexpr unsigned MPOL_MF_MOVE_FLAG = 1u << 1;
+
+    // Appends the CPUs of a kernel cpulist ("0-3,8,10-11") to `cpus`
+    bool parseRangeList(const string &list, vector<int> &cpus)
+    {
+        stringstream stream(list);
+        string item;
+        while (getline(stream, item, ','))
+        {
+            char *end = nullptr;
+            long first = strtol(item.c_str(), &end, 10);
+            long last = first;
+            if (end != item.c_str() && *end == '-')
+            {
+                const char *lastStart = end + 1;
+                last = strtol(lastStart, &end, 10);
+                if (end == lastStart)
+                    return false;
+            }
+            if (item.empty() || *end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE)
+                return false;
+            for (long cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(static_cast<int>(cpu));
+        }
+        return true;
+    }
+}
+
+NNUtils::CpuTopology::CpuTopology()
+{
+    const filesystem::path nodeRoot = "/sys/devices/system/node";
+    error_code error;
+    for (int node = 0; filesystem::exists(nodeRoot / ("node" + to_string(node)), error); ++node)
+    {
+        ifstream file(nodeRoot / ("node" + to_string(node)) / "cpulist");
+        string list;
+        vector<int> cpus;
+        getline(file, list);
+        if (!list.empty() && !parseRangeList(list, cpus))
+            cpus.clear();
+        nodeCpus.push_back(move(cpus));
+    }
+
+    if (nodeCpus.empty())
+    {
+        cpu_set_t allowed;
+        nodeCpus.emplace_back();
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET(cpu, &allowed))
+                    nodeCpus[0].push_back(cpu);
+    }
+
+    for (size_t node = 0; node < nodeCpus.size(); ++node)
+    {
+        for (int cpu : nodeCpus[node])
+        {
+            if (static_cast<size_t>(cpu) >= cpuNodes.size())
+                cpuNodes.resize(cpu + 1, -1);
+            cpuNodes[cpu] = static_cast<int>(node);
+        }
+    }
+}
+
+const NNUtils::CpuTopology &NNUtils::CpuTopology::instance()
+{
+    static const CpuTopology topology;
+    return topology;
+}
+
+int NNUtils::CpuTopology::nodeOfCpu(int cpu) const
+{
+    return cpu >= 0 && static_cast<size_t>(cpu) < cpuNodes.size() ? cpuNodes[cpu] : -1;
+}
+
+size_t NNUtils::CpuTopology::nodesSpanned(const vector<int> &cpus) const
+{
+    vector<int> nodes;
+    for (int cpu : cpus)
+        nodes.push_back(nodeOfCpu(cpu));
+    sort(nodes.begin(), nodes.end());
+    return unique(nodes.begin(), nodes.end()) - nodes.begin();
+}
+
+bool NNUtils::parseCpuSpec(const string &spec, vector<int> &cpus)
+{
+    const CpuTopology &topology = CpuTopology::instance();
+    vector<int> parsed;
+    stringstream stream(spec);
+    string item;
+    while (getline(stream, item, ','))
+    {
+        if (item.rfind("node", 0) == 0)
+        {
+            char *end = nullptr;
+            long node = strtol(item.c_str() + 4, &end, 10);
+            if (end == item.c_str() + 4 || *end != '\0' || node < 0 || static_cast<size_t>(node) >= topology.nodeCount())
+                return false;
+            parsed.insert(parsed.end(), topology.cpusOfNode(node).begin(), topology.cpusOfNode(node).end());
+        }
+        else if (!parseRangeList(item, parsed))
+        {
+            return false;
+        }
+    }
+    if (parsed.empty())
+        return false;
+    cpus.insert(cpus.end(), parsed.begin(), parsed.end());
+    return true;
+}
+
+bool NNUtils::pinCurrentThread(const vector<int> &cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0)
+    {
+        LOG_WARN("Could not pin thread to %zu CPU(s) starting at %d: %s", cpus.size(), cpus.empty() ? -1 : cpus[0], strerror(error));
+        return false;
+    }
+    return true;
+}
+
+int NNUtils::currentNode()
+{
+    return max(0, CpuTopology::instance().nodeOfCpu(sched_getcpu()));
+}
+
+bool NNUtils::bindToNode(const void *memory, size_t bytes, int node)
+{
+    if (bytes == 0 || node < 0 || node >= 63)
+        return false;
+    const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t start = reinterpret_cast<uintptr_t>(memory) & ~(pageSize - 1);
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(memory) + bytes + pageSize - 1) & ~(pageSize - 1);
+    unsigned long nodeMask = 1ul << node;
+    if (syscall(SYS_mbind, start, end - start, MPOL_BIND_MODE, &nodeMask, 64ul, MPOL_MF_MOVE_FLAG) != 0)
+    {
+        LOG_DEBUG("mbind of %zu bytes to node %d failed: %s", bytes, node, strerror(errno));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef NN_NUMA_HPP
+#define NN_NUMA_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace NNUtils
+{
+    /**
+     * @brief NUMA nodes and their CPUs, read once from /sys/devices/system/node. Hosts without NUMA information are
+     *        treated as one node holding every CPU.
+     */
+    class CpuTopology
+    {
+        std::vector<std::vector<int>> nodeCpus;
+        std::vector<int> cpuNodes; // CPU -> node
+
+        CpuTopology();
+
+    public:
+        static const CpuTopology &instance();
+
+        size_t nodeCount() const { return nodeCpus.size(); }
+        const std::vector<int> &cpusOfNode(size_t node) const { return nodeCpus[node]; }
+        // -1 for a CPU the topology does not list
+        int nodeOfCpu(int cpu) const;
+        // Distinct nodes `cpus` belong to
+        size_t nodesSpanned(const std::vector<int> &cpus) const;
+    };
+
+    /**
+     * @brief Parses a CPU list such as "2,3", "0-7,16" or "node1" (every CPU of NUMA node 1); items may be mixed
+     *
+     * @return False if the list is empty or names a CPU or node that does not exist; `cpus` is then unchanged
+     */
+    bool parseCpuSpec(const std::string &spec, std::vector<int> &cpus);
+
+    // Restricts the calling thread to `cpus`; threads it starts afterwards inherit the restriction
+    bool pinCurrentThread(const std::vector<int> &cpus);
+    // NUMA node of the CPU the calling thread is running on
+    int currentNode();
+
+    /**
+     * @brief Places the pages holding [memory, memory + bytes) on `node`, moving any already faulted in.
+     *        Works on whole pages, so neighbouring data on the first and last page moves too.
+     *
+     * @return False if the kernel refused (e.g. no NUMA support); the memory stays where it was
+     */
+    bool bindToNode(const void *memory, size_t bytes, int node);
+}
+
+#endif
@@ -6,30 +6,20 @@
 
 using namespace std;
 
-void NNUtils::initializeWeights(vector<vector<double>> &weights, double min_val, double max_val)
+void NNUtils::initializeWeights(double *weights, size_t count, double min_val, double max_val)
 {
     random_device rd;
     mt19937 gen(rd());
     uniform_real_distribution<double> dist(min_val, max_val);
-    for (auto &row : weights)
+    for (size_t i = 0; i < count; ++i)
     {
-        for (auto &w : row)
-        {
-            w = dist(gen);
-        }
+        weights[i] = dist(gen);
     }
 }
 
-void NNUtils::initializeBiases(vector<double> &biases, double initial_value)
+void NNUtils::initializeBiases(double *biases, size_t count, double initial_value)
 {
-    fill(biases.begin(), biases.end(), initial_value);
-}
-
-static double NNUtils::randomDouble(double min_val, double max_val) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    std::uniform_real_distribution<double> dist(min_val, max_val);
-    return dist(gen);
+    fill(biases, biases + count, initial_value);
 }
 
 double NNUtils::ActivationFunctions::relu(double x)
@@ -44,17 +34,61 @@ double NNUtils::ActivationFunctions::reluDerivative(double x)
 
 vector<double> NNUtils::ActivationFunctions::softmax(const vector<double> &logits)
 {
-    double max_val = *max_element(logits.begin(), logits.end());
     vector<double> exp_values(logits.size());
-    double sum_exp = 0.0;
-    for (size_t i = 0; i < logits.size(); ++i)
+    softmax(logits.data(), exp_values.data(), logits.size());
+    return exp_values;
+}
+
+void NNUtils::ActivationFunctions::softmax(const double *logits, double *probabilities, size_t count)
+{
+    softmaxCrossEntropy(logits, 1, count, nullptr, probabilities, nullptr);
+}
+
+void NNUtils::ActivationFunctions::softmaxCrossEntropy(const double *logits, size_t rows, size_t count, const int *labels,
+                                                        double *output, double *losses)
+{
+    for (size_t r = 0; r < rows; ++r)
+    {
+        const double *z = logits + r * count;
+        double *out = output + r * count;
+        const double maxLogit = *max_element(z, z + count);
+        // Read before `out` overwrites it when output aliases logits
+        const double labelShifted = labels ? z[labels[r]] - maxLogit : 0.0;
+
+        double sum = 0.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = FastMath::expNonPositive(z[i] - maxLogit);
+            sum += out[i];
+        }
+        const double inverseSum = 1.0 / sum;
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] *= inverseSum;
+        }
+
+        if (labels)
+        {
+            // dL/dz = softmax - one_hot(label); sum >= 1 because the largest logit contributes exp(0)
+            out[labels[r]] -= 1.0;
+            if (losses)
+                losses[r] = FastMath::logPositive(sum) - labelShifted;
+        }
+    }
+}
+
+void NNUtils::FastMath::exp(const double *x, double *result, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
     {
-        exp_values[i] = exp(logits[i] - max_val);
-        sum_exp += exp_values[i];
+        result[i] = expNonPositive(x[i]);
     }
-    for (size_t i = 0; i < logits.size(); ++i)
+}
+
+void NNUtils::FastMath::log(const double *x, double *result, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
     {
-        exp_values[i] /= sum_exp;
+        result[i] = logPositive(x[i]);
     }
-    return exp_values;
 }
@@ -5,18 +5,134 @@
 #include <random>
 #include <cmath>
 #include <algorithm>
+#include <bit>
+#include <cstdint>
 
 namespace NNUtils
 {
-    void initializeWeights(std::vector<std::vector<double>> &weights, double min_val, double max_val);
-    void initializeBiases(std::vector<double> &biases, double initial_value = 0.0);
-    static double randomDouble(double min_val, double max_val);
+    void initializeWeights(double *weights, size_t count, double min_val, double max_val);
+    void initializeBiases(double *biases, size_t count, double initial_value = 0.0);
+
+    /**
+     * @brief Polynomial exp and log for the output layer. They use only adds, multiplies, one divide and integer bit
+     *        operations, with no branches or libm calls, so loops over them vectorize (with -fno-trapping-math, which
+     *        lets GCC compute both sides of the range select).
+     *
+     *        Error bounds (checked by `./bench.out fastMath` against the long double expl/logl):
+     *        - expNonPositive: relative error below 1e-15 for x in [-708, 0]. The degree-12 Taylor polynomial on
+     *          |r| <= ln2/2 leaves a remainder below 3.3e-16; the rest is rounding. x < -708 (including -inf) gives 0,
+     *          an absolute error below 3e-308.
+     *        - logPositive: error below 1e-15 for finite normal x > 0, absolute where |log x| <= 1 and relative
+     *          beyond. The series in s = (m-1)/(m+1) with |s| <= 0.172 is cut after s^17, leaving a remainder below
+     *          3e-16.
+     */
+    namespace FastMath
+    {
+        inline double expNonPositive(double x)
+        {
+            constexpr double LOG2E = 1.4426950408889634;
+            constexpr double LN2_HI = 6.93147180369123816490e-01; // ln2 split so n * LN2_HI is exact
+            constexpr double LN2_LO = 1.90821492927058770002e-10;
+            // Adding 1.5 * 2^52 rounds to an integer and leaves it in the low mantissa bits
+            constexpr double ROUND_SHIFT = 6755399441055744.0;
+
+            const double shifted = x * LOG2E + ROUND_SHIFT;
+            const double n = shifted - ROUND_SHIFT;
+            const double r = (x - n * LN2_HI) - n * LN2_LO;
+
+            double p = 1.0 / 479001600.0;
+            p = p * r + 1.0 / 39916800.0;
+            p = p * r + 1.0 / 3628800.0;
+            p = p * r + 1.0 / 362880.0;
+            p = p * r + 1.0 / 40320.0;
+            p = p * r + 1.0 / 5040.0;
+            p = p * r + 1.0 / 720.0;
+            p = p * r + 1.0 / 120.0;
+            p = p * r + 1.0 / 24.0;
+            p = p * r + 1.0 / 6.0;
+            p = p * r + 0.5;
+            p = p * r + 1.0;
+            p = p * r + 1.0;
+
+            // 2^n built from its exponent bits. Below -708 n leaves the normal range, so those results are replaced by
+            // zero afterwards; a select rather than a clamp on x keeps GCC from splitting the loop into a constant path.
+            const uint64_t scale = (std::bit_cast<uint64_t>(shifted) - std::bit_cast<uint64_t>(ROUND_SHIFT) + 1023) << 52;
+            const double result = p * std::bit_cast<double>(scale);
+            return x < -708.0 ? 0.0 : result;
+        }
+
+        inline double logPositive(double x)
+        {
+            constexpr uint64_t ONE_BITS = 0x3FF0000000000000ULL;
+            constexpr uint64_t SQRT_HALF_BITS = 0x3FE6A09E667F3BCDULL;
+            constexpr double LN2_HI = 6.93147180369123816490e-01;
+            constexpr double LN2_LO = 1.90821492927058770002e-10;
+            // 2^52: OR-ing a small integer into its mantissa and subtracting it converts the integer without cvtsi2sd
+            constexpr uint64_t TWO52_BITS = 0x4330000000000000ULL;
+            constexpr double TWO52 = 4503599627370496.0;
+
+            // x = 2^e * m with m in [sqrt(1/2), sqrt(2)); biased is e + 1023
+            const uint64_t bits = std::bit_cast<uint64_t>(x);
+            const uint64_t biased = (bits + (ONE_BITS - SQRT_HALF_BITS)) >> 52;
+            const double m = std::bit_cast<double>(bits - (biased << 52) + ONE_BITS);
+            const double e = (std::bit_cast<double>(biased | TWO52_BITS) - TWO52) - 1023.0;
+
+            // log(m) = 2 * atanh(s) = 2s * (1 + s^2/3 + s^4/5 + ... + s^16/17)
+            const double s = (m - 1.0) / (m + 1.0);
+            const double z = s * s;
+            double p = 2.0 / 17.0;
+            p = p * z + 2.0 / 15.0;
+            p = p * z + 2.0 / 13.0;
+            p = p * z + 2.0 / 11.0;
+            p = p * z + 2.0 / 9.0;
+            p = p * z + 2.0 / 7.0;
+            p = p * z + 2.0 / 5.0;
+            p = p * z + 2.0 / 3.0;
+            return e * LN2_HI + (s * z * p + e * LN2_LO + 2.0 * s);
+        }
+
+        // result[i] = exp(x[i]) for x[i] <= 0 and log(x[i]) for x[i] > 0; result may alias x
+        void exp(const double *x, double *result, size_t count);
+        void log(const double *x, double *result, size_t count);
+    }
 
     namespace ActivationFunctions
     {
         std::vector<double> softmax(const std::vector<double> &logits);
+        void softmax(const double *logits, double *probabilities, size_t count); // probabilities may alias logits
+
+        /**
+         * @brief Fused log-softmax, cross-entropy and gradient for a batch of rows: two passes over each row's logits
+         *        and no allocations. Uses FastMath; for rows of ten classes the probabilities, gradient and loss are within
+         *        4e-15 relative of the exact result for the same double z - max (checked by `./bench.out softmaxCrossEntropy`).
+         *        Probabilities whose exp(z - max) is below exp(-708) are returned as zero.
+         *
+         * @param logits   rows x count logits, row-major
+         * @param rows     Number of rows (images)
+         * @param count    Logits per row (classes)
+         * @param labels   Correct class of each row, or nullptr to only compute the softmax
+         * @param output   rows x count; may alias logits. Without labels, the softmax probabilities. With labels, the
+         *                 gradient of the loss with respect to the logits, softmax - one_hot(label).
+         * @param losses   With labels, receives each row's cross-entropy, computed as log-sum-exp(z - max) -
+         *                 (z[label] - max) so it stays finite when the label's probability underflows
+         */
+        void softmaxCrossEntropy(const double *logits, size_t rows, size_t count, const int *labels, double *output, double *losses);
+
         double relu(double x);
         double reluDerivative(double x);
+
+        // Activation policies for StaticFFNet: apply() is inlined into the layer loops instead of called through std::function
+        struct Relu
+        {
+            template <typename T>
+            static constexpr T apply(T x) { return x > T(0) ? x : T(0); }
+        };
+
+        struct Identity
+        {
+            template <typename T>
+            static constexpr T apply(T x) { return x; }
+        };
     }
 
 }
@@ -0,0 +1,140 @@
+#ifndef NN_WORK_STEALING_POOL_HPP
+#define NN_WORK_STEALING_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NNUtils
+{
+    /**
+     * @brief Runs tasks on a fixed set of worker threads, each with its own deque. A worker takes the newest task of its
+     *        own deque first, so work a task spawns runs next on the same core while its data is still cached. An idle
+     *        worker steals the oldest task of another deque. Tasks are long (whole training epochs), so each deque is a
+     *        plain mutex-protected std::deque rather than a lock-free one.
+     *
+     * @tparam Task  Movable task type passed to the handler
+     */
+    template <typename Task>
+    class WorkStealingPool
+    {
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        // Tasks queued or running; run() ends when this drops to zero
+        std::atomic<size_t> pending{0};
+        // Tasks sitting in a deque, changed under that deque's mutex; idle workers sleep until it is nonzero
+        std::atomic<size_t> queued{0};
+        std::atomic<uint64_t> stolen{0};
+        std::mutex idleMutex;
+        std::condition_variable idle;
+
+        bool take(size_t self, Task &task)
+        {
+            {
+                Worker &own = *workers[self];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.tasks.empty())
+                {
+                    task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            for (size_t offset = 1; offset < workers.size(); ++offset)
+            {
+                Worker &victim = *workers[(self + offset) % workers.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty())
+                {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                    stolen.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(size_t self, const std::function<void(Task &, size_t)> &handler)
+        {
+            Task task;
+            while (true)
+            {
+                if (take(self, task))
+                {
+                    handler(task, self);
+                    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        std::lock_guard<std::mutex> lock(idleMutex);
+                        idle.notify_all();
+                    }
+                    continue;
+                }
+                // Nothing to take: the running tasks may still push more, so wait for a push or for the last of them
+                std::unique_lock<std::mutex> lock(idleMutex);
+                idle.wait(lock, [this]
+                          { return queued.load(std::memory_order_relaxed) > 0 || pending.load(std::memory_order_acquire) == 0; });
+                if (pending.load(std::memory_order_acquire) == 0)
+                    return;
+            }
+        }
+
+    public:
+        explicit WorkStealingPool(size_t workerCount)
+        {
+            for (size_t i = 0; i < std::max<size_t>(1, workerCount); ++i)
+                workers.push_back(std::make_unique<Worker>());
+        }
+
+        size_t size() const { return workers.size(); }
+        uint64_t steals() const { return stolen.load(std::memory_order_relaxed); }
+
+        // Queues a task on `worker`'s deque: from a handler, pass its own worker index; before run(), spread the tasks
+        void push(size_t worker, Task task)
+        {
+            pending.fetch_add(1, std::memory_order_acq_rel);
+            {
+                Worker &target = *workers[worker % workers.size()];
+                std::lock_guard<std::mutex> lock(target.mutex);
+                target.tasks.push_back(std::move(task));
+                queued.fetch_add(1, std::memory_order_relaxed);
+            }
+            // Taking idleMutex orders the notify after any idle worker's check of `queued`, so the wakeup is not lost
+            std::lock_guard<std::mutex> lock(idleMutex);
+            idle.notify_one();
+        }
+
+        /**
+         * @brief Runs every queued task, and every task they push, on size() threads (the calling thread is worker 0)
+         *
+         * @param handler  Called as handler(task, worker) for each task; may push more tasks
+         */
+        void run(const std::function<void(Task &, size_t)> &handler)
+        {
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < workers.size(); ++i)
+                threads.emplace_back([this, i, &handler]
+                                     { work(i, handler); });
+            work(0, handler);
+            for (std::thread &thread : threads)
+                thread.join();
+        }
+    };
+}
+
+#endif
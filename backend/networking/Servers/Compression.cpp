@@ -0,0 +1,161 @@
+#include "Compression.hpp"
+#include "HttpParser.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    string_view trim(string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+            text.remove_prefix(1);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+            text.remove_suffix(1);
+        return text;
+    }
+
+    // q-value of one Accept-Encoding element's parameters, e.g. ";q=0.5"; 1 when absent, -1 when malformed
+    double qValue(string_view parameters)
+    {
+        while (!parameters.empty())
+        {
+            size_t end = parameters.find(';', 1);
+            string_view parameter = trim(parameters.substr(1, end == string_view::npos ? string_view::npos : end - 1));
+            parameters = end == string_view::npos ? string_view() : parameters.substr(end);
+            if (parameter.size() < 2 || (parameter[0] != 'q' && parameter[0] != 'Q') || parameter[1] != '=')
+                continue;
+            double q = -1.0;
+            string_view number = parameter.substr(2);
+            auto [parsedEnd, error] = from_chars(number.data(), number.data() + number.size(), q);
+            if (error != errc() || parsedEnd != number.data() + number.size() || q < 0.0 || q > 1.0)
+                return -1.0;
+            return q;
+        }
+        return 1.0;
+    }
+}
+
+HDE::ContentEncoding HDE::negotiateEncoding(string_view acceptEncoding)
+{
+    // Identity stays acceptable unless excluded, but loses to any coding the client accepts
+    double gzip = -1.0, deflate = -1.0, identity = -1.0, wildcard = -1.0;
+    while (!acceptEncoding.empty())
+    {
+        size_t comma = acceptEncoding.find(',');
+        string_view element = acceptEncoding.substr(0, comma);
+        acceptEncoding = comma == string_view::npos ? string_view() : acceptEncoding.substr(comma + 1);
+
+        size_t semicolon = element.find(';');
+        string_view coding = trim(element.substr(0, semicolon));
+        double q = semicolon == string_view::npos ? 1.0 : qValue(element.substr(semicolon));
+        if (q < 0.0)
+            continue;
+        if (equalsIgnoringCase(coding, "gzip") || equalsIgnoringCase(coding, "x-gzip"))
+            gzip = q;
+        else if (equalsIgnoringCase(coding, "deflate"))
+            deflate = q;
+        else if (equalsIgnoringCase(coding, "identity"))
+            identity = q;
+        else if (coding == "*")
+            wildcard = q;
+    }
+    if (gzip < 0.0)
+        gzip = wildcard;
+    if (deflate < 0.0)
+        deflate = wildcard;
+    if (identity < 0.0)
+        identity = 0.001;
+
+    if (gzip > 0.0 && gzip >= deflate && gzip >= identity)
+        return ContentEncoding::Gzip;
+    if (deflate > 0.0 && deflate >= identity)
+        return ContentEncoding::Deflate;
+    return ContentEncoding::Identity;
+}
+
+const char *HDE::encodingName(ContentEncoding encoding)
+{
+    switch (encoding)
+    {
+    case ContentEncoding::Gzip:
+        return "gzip";
+    case ContentEncoding::Deflate:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+HDE::StreamingCompressor::~StreamingCompressor()
+{
+    if (active)
+        deflateEnd(&stream);
+}
+
+bool HDE::StreamingCompressor::begin(ContentEncoding encoding, int level)
+{
+    if (active)
+        deflateEnd(&stream);
+    active = false;
+    if (encoding == ContentEncoding::Identity)
+        return false;
+
+    memset(&stream, 0, sizeof(stream));
+    // windowBits 15 is the zlib wrapper; adding 16 makes zlib write a gzip header and trailer instead
+    const int windowBits = encoding == ContentEncoding::Gzip ? 15 + 16 : 15;
+    active = deflateInit2(&stream, clamp(level, 1, 9), Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    return active;
+}
+
+// Runs deflate until it has consumed all input and, when finishing, written the trailer
+bool HDE::StreamingCompressor::run(int flush, string &out)
+{
+    while (true)
+    {
+        const size_t used = out.size();
+        const size_t room = max<size_t>(16 * 1024, deflateBound(&stream, stream.avail_in) / 4);
+        out.resize(used + room);
+        stream.next_out = reinterpret_cast<Bytef *>(out.data() + used);
+        stream.avail_out = static_cast<uInt>(room);
+        const int status = deflate(&stream, flush);
+        out.resize(used + room - stream.avail_out);
+
+        if (status == Z_STREAM_ERROR)
+            return false;
+        if (flush == Z_FINISH ? status == Z_STREAM_END : stream.avail_in == 0 && stream.avail_out != 0)
+            return true;
+    }
+}
+
+bool HDE::StreamingCompressor::write(const char *data, size_t length, string &out)
+{
+    if (!active)
+        return false;
+    // avail_in is 32 bits
+    while (length > 0)
+    {
+        const size_t piece = min<size_t>(length, 1u << 30);
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        stream.avail_in = static_cast<uInt>(piece);
+        if (!run(Z_NO_FLUSH, out))
+            return false;
+        data += piece;
+        length -= piece;
+    }
+    return true;
+}
+
+bool HDE::StreamingCompressor::finish(string &out)
+{
+    if (!active)
+        return false;
+    stream.next_in = nullptr;
+    stream.avail_in = 0;
+    const bool finished = run(Z_FINISH, out);
+    deflateEnd(&stream);
+    active = false;
+    return finished;
+}
@@ -0,0 +1,55 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <zlib.h>
+#include <string>
+#include <string_view>
+
+namespace HDE
+{
+    enum class ContentEncoding
+    {
+        Identity,
+        Gzip,
+        Deflate // the zlib format (RFC 1950), which is what HTTP calls deflate
+    };
+
+    /**
+     * @brief Picks a response encoding from an Accept-Encoding header value, e.g. "gzip;q=0.8, deflate": the supported
+     *        coding with the highest q-value, gzip on ties, or identity if the client accepts neither (or sent no header)
+     */
+    ContentEncoding negotiateEncoding(std::string_view acceptEncoding);
+    const char *encodingName(ContentEncoding encoding);
+
+    /**
+     * @brief Incremental gzip or deflate compressor: feed it the response body piece by piece and it appends the
+     *        compressed bytes that are ready, so a response can be sent as chunks while it is still being compressed
+     */
+    class StreamingCompressor
+    {
+        z_stream stream;
+        bool active = false;
+
+        bool run(int flush, std::string &out);
+
+    public:
+        StreamingCompressor() = default;
+        ~StreamingCompressor();
+        StreamingCompressor(const StreamingCompressor &) = delete;
+        StreamingCompressor &operator=(const StreamingCompressor &) = delete;
+
+        /**
+         * @brief Starts a new stream, discarding any unfinished one
+         *
+         * @param level  zlib level, 1 (fastest) to 9 (smallest)
+         * @return False for ContentEncoding::Identity or if zlib cannot allocate its state
+         */
+        bool begin(ContentEncoding encoding, int level);
+        // Compresses `length` bytes and appends the output zlib has ready to `out`; it may hold some back until finish()
+        bool write(const char *data, size_t length, std::string &out);
+        // Appends the rest of the output and the trailer (gzip CRC-32 and size, or zlib Adler-32), ending the stream
+        bool finish(std::string &out);
+    };
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include "HistoryResponder.hpp"
+#include "TrainingJson.hpp"
+#include "../Database/Database.hpp"
+#include "../Logging/Logger.hpp"
+#include "../Tracing/Trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    // Compressed output is sent once this much is ready, and the JSON is fed to zlib in pieces of STREAM_INPUT_BYTES
+    constexpr size_t STREAM_CHUNK_BYTES = 64 * 1024;
+    constexpr size_t STREAM_INPUT_BYTES = 256 * 1024;
+
+    // Sends all of [data, data + length) unless the client has gone; adds what was sent to `sent`
+    bool sendAll(int clientSocket, const char *data, size_t length, size_t &sent)
+    {
+        size_t offset = 0;
+        while (offset < length)
+        {
+            ssize_t result = send(clientSocket, data + offset, length - offset, MSG_NOSIGNAL);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                LOG_WARN("Failed to send history response: %s", strerror(errno));
+                return false;
+            }
+            offset += static_cast<size_t>(result);
+            sent += static_cast<size_t>(result);
+        }
+        return true;
+    }
+
+    // One HTTP/1.1 chunk: size in hex, data, CRLF
+    bool sendChunk(int clientSocket, const char *data, size_t length, size_t &sent)
+    {
+        char size[24];
+        int sizeLength = snprintf(size, sizeof(size), "%zx\r\n", length);
+        string chunk;
+        chunk.reserve(sizeLength + length + 2);
+        chunk.append(size, sizeLength).append(data, length).append("\r\n");
+        return sendAll(clientSocket, chunk.data(), chunk.size(), sent);
+    }
+
+    // Status line and headers up to, but not including, the framing header
+    string responseHead(HDE::ContentEncoding encoding)
+    {
+        string head = "HTTP/1.1 200 OK\r\n"
+                      "Content-Type: application/json\r\n"
+                      "Access-Control-Allow-Origin: http://localhost:3000\r\n"
+                      "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+                      "Access-Control-Allow-Headers: Content-Type\r\n"
+                      "Vary: Accept-Encoding\r\n";
+        if (encoding != HDE::ContentEncoding::Identity)
+            head += string("Content-Encoding: ") + HDE::encodingName(encoding) + "\r\n";
+        return head;
+    }
+
+    int64_t modifiedNanoseconds(const struct stat &info)
+    {
+        return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    }
+}
+
+HDE::HistoryResponderConfig HDE::historyConfigFromEnvironment()
+{
+    HistoryResponderConfig config;
+    if (const char *level = getenv("COMPRESSION_LEVEL"))
+    {
+        char *end = nullptr;
+        long value = strtol(level, &end, 10);
+        if (end != level && *end == '\0' && value >= 0 && value <= 9)
+            config.compressionLevel = static_cast<int>(value);
+        else
+            LOG_WARN("Ignoring invalid COMPRESSION_LEVEL \"%s\"; expected 0 (off) to 9", level);
+    }
+    if (const char *workers = getenv("COMPRESSION_WORKERS"))
+        config.workers = static_cast<unsigned>(max<unsigned long>(1, strtoul(workers, nullptr, 10)));
+    return config;
+}
+
+HDE::HistoryResponder::HistoryResponder(HistoryResponderConfig config)
+    : config(move(config)),
+      cacheHits(Metrics::Registry::instance().counter("http_history_cache_total", "History requests answered from the response cache or built.", "result=\"hit\"")),
+      cacheMisses(Metrics::Registry::instance().counter("http_history_cache_total", "History requests answered from the response cache or built.", "result=\"miss\""))
+{
+}
+
+// Queued requests are still answered before the workers exit
+HDE::HistoryResponder::~HistoryResponder()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (thread &worker : workers)
+        worker.join();
+}
+
+HDE::ContentEncoding HDE::HistoryResponder::choose(ContentEncoding accepted) const
+{
+    return config.compressionLevel == 0 ? ContentEncoding::Identity : accepted;
+}
+
+// Missing files count as version -1, so creating one also invalidates the cache
+HDE::HistoryResponder::FilesVersion HDE::HistoryResponder::currentVersion() const
+{
+    FilesVersion version;
+    struct stat info;
+    if (stat(config.trainingFile.c_str(), &info) == 0)
+    {
+        version.trainingModified = modifiedNanoseconds(info);
+        version.trainingSize = info.st_size;
+    }
+    if (stat(config.probabilityFile.c_str(), &info) == 0)
+    {
+        version.probabilityModified = modifiedNanoseconds(info);
+        version.probabilitySize = info.st_size;
+    }
+    return version;
+}
+
+shared_ptr<const string> HDE::HistoryResponder::cached(ContentEncoding encoding, const FilesVersion &version)
+{
+    lock_guard<mutex> lock(cacheMutex);
+    const CachedResponse &entry = cache[static_cast<int>(encoding)];
+    return entry.response && entry.version == version ? entry.response : nullptr;
+}
+
+shared_ptr<const string> HDE::HistoryResponder::findCached(ContentEncoding encoding)
+{
+    shared_ptr<const string> response = cached(encoding, currentVersion());
+    if (response)
+        cacheHits.add();
+    return response;
+}
+
+void HDE::HistoryResponder::submit(int clientSocket, ContentEncoding encoding, bool chunked, OnClose onClose)
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        // Started on first use rather than in the constructor: threads inherit the CPUs of the thread that creates
+        // them, and the accept loop is only pinned (or moved off the training CPUs) after the server is constructed
+        if (workers.empty())
+            for (unsigned i = 0; i < max(1u, config.workers); ++i)
+                workers.emplace_back(&HistoryResponder::runWorker, this);
+        queue.push_back({clientSocket, encoding, chunked, move(onClose)});
+    }
+    queueReady.notify_one();
+}
+
+void HDE::HistoryResponder::runWorker()
+{
+    while (true)
+    {
+        Request request;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [&]
+                            { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            request = move(queue.front());
+            queue.pop_front();
+        }
+        respond(request);
+    }
+}
+
+/**
+ * @brief Sends the response for one request: from the cache if another worker built it while this request was queued,
+ *        otherwise built here. A compressed body goes out in chunks as zlib produces it (HTTP/1.1 clients), and the
+ *        finished response is cached with a Content-Length.
+ */
+void HDE::HistoryResponder::respond(const Request &request)
+{
+    size_t sent = 0;
+    const FilesVersion version = currentVersion(); // taken before reading, so a concurrent write invalidates the entry
+    if (shared_ptr<const string> response = cached(request.encoding, version))
+    {
+        cacheHits.add();
+        sendAll(request.clientSocket, response->data(), response->size(), sent);
+        close(request.clientSocket);
+        request.onClose(sent);
+        return;
+    }
+    cacheMisses.add();
+
+    const string encoding = encodingName(request.encoding);
+    Metrics::ScopedTimer timer(Metrics::Registry::instance().histogram("http_history_build_seconds", "Time to load, render, compress and send a history response that was not cached, by encoding.",
+                                                                      "encoding=\"" + encoding + "\""));
+    string json;
+    {
+        TRACE_SPAN("history.render");
+        TrainingDatabase db(config.trainingFile, config.probabilityFile);
+        auto [trainingRecords, probabilityData] = db.loadAllTrainingData();
+        json = renderTrainingJson(trainingRecords, probabilityData);
+    }
+
+    const string head = responseHead(request.encoding);
+    string body;
+    bool connected = true;
+    if (request.encoding == ContentEncoding::Identity)
+    {
+        body = move(json);
+    }
+    else
+    {
+        TRACE_SPAN("history.compress");
+        StreamingCompressor compressor;
+        if (!compressor.begin(request.encoding, config.compressionLevel))
+        {
+            LOG_ERROR("Failed to start %s compression", encoding.c_str());
+            close(request.clientSocket);
+            request.onClose(sent);
+            return;
+        }
+        if (request.chunked)
+        {
+            const string chunkedHead = head + "Transfer-Encoding: chunked\r\n\r\n";
+            connected = sendAll(request.clientSocket, chunkedHead.data(), chunkedHead.size(), sent);
+        }
+
+        size_t streamed = 0;
+        for (size_t offset = 0; offset < json.size(); offset += STREAM_INPUT_BYTES)
+        {
+            compressor.write(json.data() + offset, min(STREAM_INPUT_BYTES, json.size() - offset), body);
+            if (request.chunked && connected && body.size() - streamed >= STREAM_CHUNK_BYTES)
+            {
+                connected = sendChunk(request.clientSocket, body.data() + streamed, body.size() - streamed, sent);
+                streamed = body.size();
+            }
+        }
+        compressor.finish(body);
+        if (request.chunked && connected)
+        {
+            if (body.size() > streamed)
+                connected = sendChunk(request.clientSocket, body.data() + streamed, body.size() - streamed, sent);
+            if (connected)
+                sendAll(request.clientSocket, "0\r\n\r\n", 5, sent);
+        }
+    }
+
+    auto response = make_shared<string>(head + "Content-Length: " + to_string(body.size()) + "\r\n\r\n");
+    response->append(body);
+    if (request.encoding == ContentEncoding::Identity || !request.chunked)
+        sendAll(request.clientSocket, response->data(), response->size(), sent);
+    close(request.clientSocket);
+    request.onClose(sent);
+
+    lock_guard<mutex> lock(cacheMutex);
+    cache[static_cast<int>(request.encoding)] = {version, move(response)};
+}
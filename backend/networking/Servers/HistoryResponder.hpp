@@ -0,0 +1,103 @@
+#ifndef HISTORY_RESPONDER_HPP
+#define HISTORY_RESPONDER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Compression.hpp"
+#include "../Metrics/Metrics.hpp"
+
+namespace HDE
+{
+    struct HistoryResponderConfig
+    {
+        std::string trainingFile = "./NN/mnist/data/training_data.dat";
+        std::string probabilityFile = "./NN/mnist/data/probabilities.dat";
+        int compressionLevel = 6; // zlib level, 1 (fastest) to 9 (smallest); 0 always sends identity
+        unsigned workers = 2;
+    };
+
+    // The defaults, overridden by COMPRESSION_LEVEL and COMPRESSION_WORKERS
+    HistoryResponderConfig historyConfigFromEnvironment();
+
+    /**
+     * @brief Answers GET requests for the training history JSON. Building a response (loading the files, rendering the
+     *        JSON and compressing it) runs on worker threads, so the accept loop never waits for it. Compressed
+     *        responses stream out as chunks while the rest is still being compressed. Every finished response is
+     *        cached per encoding until the history files change, so repeated requests are a single send.
+     */
+    class HistoryResponder
+    {
+    public:
+        using OnClose = std::function<void(size_t bytesSent)>;
+
+    private:
+        // What the cached responses were built from: the files' modification times and sizes
+        struct FilesVersion
+        {
+            int64_t trainingModified = -1, probabilityModified = -1;
+            int64_t trainingSize = -1, probabilitySize = -1;
+            bool operator==(const FilesVersion &) const = default;
+        };
+
+        struct CachedResponse
+        {
+            FilesVersion version;
+            std::shared_ptr<const std::string> response;
+        };
+
+        struct Request
+        {
+            int clientSocket;
+            ContentEncoding encoding;
+            bool chunked;
+            OnClose onClose;
+        };
+
+        HistoryResponderConfig config;
+
+        std::mutex cacheMutex;
+        CachedResponse cache[3]; // indexed by ContentEncoding
+
+        std::mutex queueMutex;
+        std::condition_variable queueReady;
+        std::deque<Request> queue;
+        bool stopping = false;
+        std::vector<std::thread> workers;
+
+        Metrics::Counter &cacheHits;
+        Metrics::Counter &cacheMisses;
+
+        FilesVersion currentVersion() const;
+        std::shared_ptr<const std::string> cached(ContentEncoding encoding, const FilesVersion &version);
+        void runWorker();
+        void respond(const Request &request);
+
+    public:
+        explicit HistoryResponder(HistoryResponderConfig config);
+        ~HistoryResponder();
+        HistoryResponder(const HistoryResponder &) = delete;
+        HistoryResponder &operator=(const HistoryResponder &) = delete;
+
+        // Falls back to identity when compression is turned off
+        ContentEncoding choose(ContentEncoding accepted) const;
+
+        // The whole cached response (headers and body) if the history files are unchanged since it was built
+        std::shared_ptr<const std::string> findCached(ContentEncoding encoding);
+
+        /**
+         * @brief Queues a request. A worker sends the response, closes the socket and calls onClose.
+         *
+         * @param chunked  Whether the client speaks HTTP/1.1. If so, compressed responses stream as chunks.
+         */
+        void submit(int clientSocket, ContentEncoding encoding, bool chunked, OnClose onClose);
+    };
+};
+
+#endif
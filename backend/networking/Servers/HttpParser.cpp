@@ -0,0 +1,440 @@
+#include "HttpParser.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    // tchar from RFC 9110: the characters allowed in methods and header names
+    constexpr array<bool, 256> TOKEN_CHARS = []
+    {
+        array<bool, 256> table{};
+        for (int c = '0'; c <= '9'; ++c)
+            table[c] = true;
+        for (int c = 'a'; c <= 'z'; ++c)
+            table[c] = table[c - 'a' + 'A'] = true;
+        for (unsigned char c : string_view("!#$%&'*+-.^_`|~"))
+            table[c] = true;
+        return table;
+    }();
+
+    bool isToken(char c)
+    {
+        return TOKEN_CHARS[static_cast<unsigned char>(c)];
+    }
+
+    char lowerAscii(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    bool isControl(unsigned char c)
+    {
+        return (c < 0x20 && c != '\t') || c == 0x7f;
+    }
+
+    /**
+     * @brief First control character other than HT in [p, end), or end. CR and LF are control characters, so this
+     *        finds the end of a line and rejects stray control bytes in the same pass, 16 bytes at a time.
+     */
+    const char *findControl(const char *p, const char *end)
+    {
+#ifdef __SSE2__
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i del = _mm_set1_epi8(0x7f);
+        const __m128i highestControl = _mm_set1_epi8(0x1f);
+        for (; end - p >= 16; p += 16)
+        {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(bytes, highestControl), bytes); // bytes <= 0x1f, unsigned
+            control = _mm_andnot_si128(_mm_cmpeq_epi8(bytes, tab), control);
+            control = _mm_or_si128(control, _mm_cmpeq_epi8(bytes, del));
+            const int mask = _mm_movemask_epi8(control);
+            if (mask != 0)
+                return p + __builtin_ctz(mask);
+        }
+#endif
+        for (; p < end; ++p)
+            if (isControl(static_cast<unsigned char>(*p)))
+                return p;
+        return end;
+    }
+
+    // End of the header name at the start of `line` if it is followed by ':', else nullptr
+    const char *headerNameEnd(const char *line, size_t length)
+    {
+        const char *end = line + length;
+        const char *cursor = line;
+        while (cursor < end && isToken(*cursor))
+            ++cursor;
+        return cursor != line && cursor < end && *cursor == ':' ? cursor : nullptr;
+    }
+
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        c = lowerAscii(c);
+        return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+    }
+}
+
+bool HDE::equalsIgnoringCase(string_view a, string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (lowerAscii(a[i]) != lowerAscii(b[i]))
+            return false;
+    return true;
+}
+
+HDE::HttpParser::HttpParser(size_t maxRequestBytes)
+    : maxRequestBytes(static_cast<uint32_t>(min<size_t>(maxRequestBytes, numeric_limits<uint32_t>::max() - 1)))
+{
+}
+
+void HDE::HttpParser::reset()
+{
+    base = nullptr;
+    state = State::Incomplete;
+    phase = Phase::RequestLine;
+    errorStatus = 0;
+    cursor = scanned = 0;
+    methodOffset = targetOffset = versionOffset = 0;
+    methodLength = versionLength = 0;
+    targetLength = 0;
+    headerCount = 0;
+    contentLength = 0;
+    hasContentLength = chunked = false;
+    chunkRemaining = 0;
+    bodyOffset = bodyLength = 0;
+}
+
+HDE::HttpHeader HDE::HttpParser::getHeader(size_t index) const
+{
+    const HeaderSpan &span = headers[index];
+    return {view(span.nameOffset, span.nameLength), view(span.valueOffset, span.valueLength)};
+}
+
+string_view HDE::HttpParser::findHeader(string_view name) const
+{
+    for (uint32_t i = 0; i < headerCount; ++i)
+    {
+        const HeaderSpan &span = headers[i];
+        if (span.nameLength == name.size() && equalsIgnoringCase(view(span.nameOffset, span.nameLength), name))
+            return view(span.valueOffset, span.valueLength);
+    }
+    return {};
+}
+
+HDE::HttpParser::State HDE::HttpParser::fail(int status)
+{
+    state = State::Error;
+    errorStatus = status;
+    return state;
+}
+
+// Finds the end of the line starting at `cursor`, resuming the scan where the previous call ran out of bytes
+HDE::HttpParser::Line HDE::HttpParser::nextLine(const char *data, size_t length, uint32_t &contentEnd, uint32_t &lineEnd)
+{
+    const char *end = data + length;
+    const char *hit = findControl(data + scanned, end);
+    if (hit == end)
+    {
+        scanned = static_cast<uint32_t>(length);
+        return Line::Incomplete;
+    }
+    contentEnd = static_cast<uint32_t>(hit - data);
+    if (*hit == '\n')
+    {
+        lineEnd = contentEnd + 1;
+    }
+    else if (*hit == '\r')
+    {
+        if (hit + 1 == end)
+        {
+            scanned = contentEnd; // look at the CR again once the next byte is here
+            return Line::Incomplete;
+        }
+        if (hit[1] != '\n')
+            return Line::Invalid;
+        lineEnd = contentEnd + 2;
+    }
+    else
+    {
+        return Line::Invalid;
+    }
+    return Line::Found;
+}
+
+// METHOD SP request-target SP HTTP/1.x
+bool HDE::HttpParser::parseRequestLine(const char *line, size_t length)
+{
+    const char *end = line + length;
+    const char *methodEnd = line;
+    while (methodEnd < end && isToken(*methodEnd))
+        ++methodEnd;
+    if (methodEnd == line || methodEnd == end || *methodEnd != ' ' || methodEnd - line > numeric_limits<uint16_t>::max())
+    {
+        fail(400);
+        return false;
+    }
+
+    const char *target = methodEnd + 1;
+    const char *targetEnd = static_cast<const char *>(memchr(target, ' ', end - target));
+    if (!targetEnd || targetEnd == target || memchr(target, '\t', targetEnd - target))
+    {
+        fail(400);
+        return false;
+    }
+
+    const string_view version(targetEnd + 1, end - targetEnd - 1);
+    if (version != "HTTP/1.1" && version != "HTTP/1.0")
+    {
+        const bool otherVersion = version.size() == 8 && version.substr(0, 5) == "HTTP/" && version[6] == '.';
+        fail(otherVersion ? 505 : 400);
+        return false;
+    }
+
+    methodOffset = static_cast<uint32_t>(line - base);
+    methodLength = static_cast<uint16_t>(methodEnd - line);
+    targetOffset = static_cast<uint32_t>(target - base);
+    targetLength = static_cast<uint32_t>(targetEnd - target);
+    versionOffset = static_cast<uint32_t>(version.data() - base);
+    versionLength = static_cast<uint16_t>(version.size());
+    return true;
+}
+
+// name ":" OWS value OWS
+bool HDE::HttpParser::parseHeaderLine(const char *line, size_t length)
+{
+    // Leading whitespace is obsolete line folding (or a smuggling attempt); RFC 9112 allows rejecting it
+    const char *nameEnd = headerNameEnd(line, length);
+    if (!nameEnd)
+    {
+        fail(400);
+        return false;
+    }
+    if (headerCount == MAX_HEADERS)
+    {
+        fail(431);
+        return false;
+    }
+
+    const char *value = nameEnd + 1;
+    const char *valueEnd = line + length;
+    while (value < valueEnd && (*value == ' ' || *value == '\t'))
+        ++value;
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+        --valueEnd;
+
+    headers[headerCount++] = {static_cast<uint32_t>(line - base), static_cast<uint32_t>(value - base),
+                              static_cast<uint32_t>(valueEnd - value), static_cast<uint16_t>(nameEnd - line)};
+    return parseFramingHeader(string_view(line, nameEnd - line), string_view(value, valueEnd - value));
+}
+
+// Records Content-Length and Transfer-Encoding as their lines arrive, so finishing the headers needs no second pass
+bool HDE::HttpParser::parseFramingHeader(string_view name, string_view value)
+{
+    if (equalsIgnoringCase(name, "content-length"))
+    {
+        if (value.empty())
+        {
+            fail(400);
+            return false;
+        }
+        // Saturates instead of overflowing; anything that large fails the size check in finishHeaders
+        uint64_t length = 0;
+        for (char c : value)
+        {
+            if (c < '0' || c > '9')
+            {
+                fail(400);
+                return false;
+            }
+            length = min<uint64_t>(length * 10 + static_cast<uint64_t>(c - '0'), uint64_t{1} << 48);
+        }
+        if (hasContentLength && length != contentLength)
+        {
+            fail(400);
+            return false;
+        }
+        hasContentLength = true;
+        contentLength = length;
+    }
+    else if (equalsIgnoringCase(name, "transfer-encoding"))
+    {
+        // Only "chunked" on its own; codings like gzip would need decompressing first
+        if (!equalsIgnoringCase(value, "chunked"))
+        {
+            fail(501);
+            return false;
+        }
+        chunked = true;
+    }
+    return true;
+}
+
+// Works out how the body is framed once the blank line after the headers has been read
+bool HDE::HttpParser::finishHeaders()
+{
+    // Both framings at once is the classic request smuggling setup
+    if (chunked && hasContentLength)
+    {
+        fail(400);
+        return false;
+    }
+    if (contentLength > maxRequestBytes - cursor)
+    {
+        fail(413);
+        return false;
+    }
+
+    bodyOffset = cursor;
+    bodyLength = 0;
+    if (chunked)
+        phase = Phase::ChunkSize;
+    else
+        phase = contentLength > 0 ? Phase::Body : Phase::Done;
+    return true;
+}
+
+// chunk-size [ ";" extensions ], extensions ignored
+bool HDE::HttpParser::parseChunkSize(const char *line, size_t length)
+{
+    size_t i = 0;
+    uint64_t size = 0;
+    for (int digit; i < length && (digit = hexValue(line[i])) >= 0; ++i)
+    {
+        if (size > maxRequestBytes)
+        {
+            fail(413);
+            return false;
+        }
+        size = size * 16 + static_cast<uint64_t>(digit);
+    }
+    if (i == 0)
+    {
+        fail(400);
+        return false;
+    }
+    while (i < length && (line[i] == ' ' || line[i] == '\t'))
+        ++i;
+    if (i < length && line[i] != ';')
+    {
+        fail(400);
+        return false;
+    }
+
+    if (size == 0)
+    {
+        phase = Phase::Trailers;
+        return true;
+    }
+    if (size > maxRequestBytes - bodyLength)
+    {
+        fail(413);
+        return false;
+    }
+    chunkRemaining = size;
+    phase = Phase::ChunkData;
+    return true;
+}
+
+HDE::HttpParser::State HDE::HttpParser::parse(char *data, size_t length)
+{
+    base = data;
+    if (state != State::Incomplete)
+        return state;
+
+    const size_t available = min<size_t>(length, maxRequestBytes);
+    while (phase != Phase::Done)
+    {
+        if (phase == Phase::Body)
+        {
+            if (available - cursor < contentLength)
+                break;
+            bodyLength = static_cast<uint32_t>(contentLength);
+            cursor += bodyLength;
+            phase = Phase::Done;
+            break;
+        }
+        if (phase == Phase::ChunkData)
+        {
+            // Move what has arrived of this chunk down to the end of the decoded body
+            const uint32_t take = static_cast<uint32_t>(min<uint64_t>(chunkRemaining, available - cursor));
+            memmove(data + bodyOffset + bodyLength, data + cursor, take);
+            bodyLength += take;
+            cursor += take;
+            scanned = cursor;
+            chunkRemaining -= take;
+            if (chunkRemaining > 0)
+                break;
+            phase = Phase::ChunkDataEnd;
+            continue;
+        }
+
+        uint32_t contentEnd = 0, lineEnd = 0;
+        const Line found = nextLine(data, available, contentEnd, lineEnd);
+        if (found == Line::Invalid)
+            return fail(400);
+        if (found == Line::Incomplete)
+            break;
+        if (phase <= Phase::Headers && lineEnd > MAX_HEADER_BYTES)
+            return fail(431);
+
+        const char *line = data + cursor;
+        const size_t lineLength = contentEnd - cursor;
+        cursor = scanned = lineEnd;
+        switch (phase)
+        {
+        case Phase::RequestLine:
+            // Empty lines before the request line are skipped (RFC 9112 section 2.2)
+            if (lineLength > 0 && parseRequestLine(line, lineLength))
+                phase = Phase::Headers;
+            break;
+        case Phase::Headers:
+            if (lineLength == 0)
+                finishHeaders();
+            else
+                parseHeaderLine(line, lineLength);
+            break;
+        case Phase::ChunkSize:
+            parseChunkSize(line, lineLength);
+            break;
+        case Phase::ChunkDataEnd:
+            if (lineLength != 0)
+                return fail(400);
+            phase = Phase::ChunkSize;
+            break;
+        case Phase::Trailers:
+            if (lineLength == 0)
+                phase = Phase::Done;
+            else if (!headerNameEnd(line, lineLength))
+                return fail(400);
+            break;
+        default:
+            break;
+        }
+        if (state == State::Error)
+            return state;
+    }
+
+    if (phase == Phase::Done)
+    {
+        state = State::Complete;
+        return state;
+    }
+    if (phase <= Phase::Headers && scanned > MAX_HEADER_BYTES)
+        return fail(431);
+    if (length >= maxRequestBytes)
+        return fail(413);
+    return state;
+}
@@ -0,0 +1,137 @@
+#ifndef HTTP_PARSER_HPP
+#define HTTP_PARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace HDE
+{
+    struct HttpHeader
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    // ASCII case-insensitive comparison, for header names and tokens
+    bool equalsIgnoringCase(std::string_view a, std::string_view b);
+
+    /**
+     * @brief Resumable HTTP/1.1 request parser. Feed it the bytes received so far; it picks up where the previous call
+     *        stopped, so each byte is scanned once however the request is split across reads. It keeps offsets rather
+     *        than pointers, so the caller may grow or move its buffer between calls, and it never allocates: the
+     *        accessors return views into the buffer passed to the last parse().
+     *
+     *        Handles the request line, up to MAX_HEADERS headers, Content-Length bodies and chunked bodies. Chunked
+     *        bodies are decoded in place: chunk data is moved down over the size lines, so getBody() is contiguous.
+     *        Chunk extensions and trailers are checked and dropped. Lines may end in CRLF or a bare LF.
+     */
+    class HttpParser
+    {
+    public:
+        enum class State
+        {
+            Incomplete, // more bytes are needed
+            Complete,
+            Error // see getErrorStatus()
+        };
+
+        static constexpr size_t MAX_HEADERS = 64;
+        static constexpr size_t MAX_HEADER_BYTES = 64 * 1024;
+
+        // Requests (headers and raw body) larger than maxRequestBytes fail with 413; at most 4 GiB - 1
+        explicit HttpParser(size_t maxRequestBytes = 1 << 20);
+
+        // Starts over for a new request
+        void reset();
+
+        /**
+         * @brief Parses `length` bytes of request, of which the first bytes are those passed to the previous call
+         *        (the caller only appends). Bytes after the end of a complete request are left alone.
+         *
+         * @param data    Request buffer; chunked bodies are decoded into it
+         * @param length  Bytes received so far
+         * @return Complete once the whole request, body included, is in `data`
+         */
+        State parse(char *data, size_t length);
+
+        State getState() const { return state; }
+        // 400 malformed, 413 too large, 431 headers too large, 501 unsupported transfer coding, 505 not HTTP/1.x
+        int getErrorStatus() const { return errorStatus; }
+
+        std::string_view getMethod() const { return view(methodOffset, methodLength); }
+        std::string_view getTarget() const { return view(targetOffset, targetLength); }
+        std::string_view getVersion() const { return view(versionOffset, versionLength); }
+        size_t getHeaderCount() const { return headerCount; }
+        HttpHeader getHeader(size_t index) const;
+        // Value of the first header called `name` (any case), or an empty view
+        std::string_view findHeader(std::string_view name) const;
+        bool headersComplete() const { return phase > Phase::Headers; }
+        uint64_t getContentLength() const { return contentLength; }
+        bool isChunked() const { return chunked; }
+        // Body of a complete request, decoded if it was chunked
+        std::string_view getBody() const { return view(bodyOffset, bodyLength); }
+        // Bytes of the buffer the request took, where a pipelined next request would start
+        size_t getConsumed() const { return cursor; }
+
+    private:
+        enum class Phase : uint8_t
+        {
+            RequestLine,
+            Headers,
+            Body,
+            ChunkSize,
+            ChunkData,
+            ChunkDataEnd,
+            Trailers,
+            Done
+        };
+
+        struct HeaderSpan
+        {
+            uint32_t nameOffset;
+            uint32_t valueOffset;
+            uint32_t valueLength;
+            uint16_t nameLength;
+        };
+
+        enum class Line
+        {
+            Found,
+            Incomplete,
+            Invalid
+        };
+
+        const char *base = nullptr;
+        uint32_t maxRequestBytes;
+        State state = State::Incomplete;
+        Phase phase = Phase::RequestLine;
+        int errorStatus = 0;
+        uint32_t cursor = 0;  // start of the first unparsed byte
+        uint32_t scanned = 0; // bytes of the current line already checked for its end
+
+        uint32_t methodOffset = 0, targetOffset = 0, versionOffset = 0;
+        uint16_t methodLength = 0, versionLength = 0;
+        uint32_t targetLength = 0;
+        HeaderSpan headers[MAX_HEADERS];
+        uint32_t headerCount = 0;
+
+        uint64_t contentLength = 0;
+        bool hasContentLength = false;
+        bool chunked = false;
+        uint64_t chunkRemaining = 0;
+        uint32_t bodyOffset = 0;
+        uint32_t bodyLength = 0;
+
+        std::string_view view(uint32_t offset, size_t length) const { return {base ? base + offset : "", length}; }
+        Line nextLine(const char *data, size_t length, uint32_t &contentEnd, uint32_t &lineEnd);
+        bool parseRequestLine(const char *line, size_t length);
+        bool parseHeaderLine(const char *line, size_t length);
+        bool parseFramingHeader(std::string_view name, std::string_view value);
+        bool finishHeaders();
+        bool parseChunkSize(const char *line, size_t length);
+        State fail(int status);
+    };
+};
+
+#endif
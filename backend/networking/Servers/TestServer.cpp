@@ -1,19 +1,258 @@
 #include "TestServer.hpp"
-#include "../Database/Database.hpp"
+#include "../Logging/Logger.hpp"
+#include "../Metrics/Metrics.hpp"
+#include "../Tracing/Trace.hpp"
+#include "../NN/utils/numa.hpp"
+#include "../Sockets/IoUring.hpp"
+#include "Compression.hpp"
 #include <iostream>
 #include <string>
-#include <sstream>
 #include <vector>
 #include <cstring>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <cstdlib>
+#include <cerrno>
 #include <ctime>
+#include <unordered_map>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 
 using namespace std;
 
-HDE::TestServer::TestServer() : SimpleServer{AF_INET, SOCK_STREAM, 0, 80, INADDR_ANY, 10}
+namespace
 {
+    struct RouteMetrics
+    {
+        Metrics::Counter &requests;
+        Metrics::Counter &bytesSent;
+        Metrics::Histogram &latency;
+    };
+
+    // Per-thread cache in front of the registry so recording a request never takes the registry lock
+    RouteMetrics &routeMetrics(const string &route)
+    {
+        thread_local unordered_map<string, RouteMetrics> cache;
+        auto it = cache.find(route);
+        if (it != cache.end())
+            return it->second;
+
+        Metrics::Registry &registry = Metrics::Registry::instance();
+        string labels = "route=\"" + route + "\"";
+        RouteMetrics metrics{
+            registry.counter("http_requests_total", "Requests handled, by route.", labels),
+            registry.counter("http_response_bytes_total", "Response bytes sent, by route.", labels),
+            registry.histogram("http_request_duration_seconds", "Time from accept() returning to the response being sent, by route.", labels)};
+        return cache.emplace(route, metrics).first->second;
+    }
+
+    Metrics::Gauge &activeConnections()
+    {
+        static Metrics::Gauge &gauge = Metrics::Registry::instance().gauge("http_active_connections", "Client connections currently open.");
+        return gauge;
+    }
+
+    void recordRequest(const string &route, size_t bytesSent, chrono::steady_clock::time_point acceptedAt)
+    {
+        RouteMetrics &metrics = routeMetrics(route);
+        metrics.requests.add();
+        metrics.bytesSent.add(bytesSent);
+        metrics.latency.recordDuration(chrono::steady_clock::now() - acceptedAt);
+        activeConnections().add(-1);
+    }
+
+    Metrics::Counter &sendErrors()
+    {
+        static Metrics::Counter &counter = Metrics::Registry::instance().counter("http_send_errors_total", "Responses cut short because sending them failed.");
+        return counter;
+    }
+
+    // Counts the syscalls the accept loop makes for client I/O, so the two backends can be compared per request
+    Metrics::Counter &ioSyscallCounter(const string &backend)
+    {
+        return Metrics::Registry::instance().counter("http_io_syscalls_total", "Syscalls the accept loop made for client I/O: accept, read, send and close, or io_uring_enter.",
+                                                     "backend=\"" + backend + "\"");
+    }
+
+    // send() may write only part of a large response, so keep going until all of it is out; returns the bytes sent
+    size_t sendAll(int clientSocket, const string &response, uint64_t *sendCalls = nullptr)
+    {
+        size_t offset = 0;
+        while (offset < response.length())
+        {
+            if (sendCalls)
+                ++*sendCalls;
+            ssize_t sent = send(clientSocket, response.data() + offset, response.length() - offset, MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                LOG_WARN("Failed to send response: %s", strerror(errno));
+                sendErrors().add();
+                break;
+            }
+            offset += static_cast<size_t>(sent);
+        }
+        return offset;
+    }
+
+    string httpResponse(const string &status, const string &contentType, const string &body)
+    {
+        return "HTTP/1.1 " + status + "\r\n"
+                                      "Content-Type: " +
+               contentType + "\r\n"
+                             "Access-Control-Allow-Origin: http://localhost:3000\r\n"
+                             "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+                             "Access-Control-Allow-Headers: Content-Type\r\n"
+                             "Content-Length: " +
+               to_string(body.length()) + "\r\n"
+                                          "\r\n" +
+               body;
+    }
+
+    string jsonMessage(const string &message)
+    {
+        return "{\"message\": \"" + message + "\"}";
+    }
+
+    string lowercase(string text)
+    {
+        transform(text.begin(), text.end(), text.begin(), [](unsigned char c)
+                  { return static_cast<char>(tolower(c)); });
+        return text;
+    }
+
+    // Status line for a request HttpParser rejected
+    string requestErrorStatus(int status)
+    {
+        switch (status)
+        {
+        case 413:
+            return "413 Content Too Large";
+        case 431:
+            return "431 Request Header Fields Too Large";
+        case 501:
+            return "501 Not Implemented";
+        case 505:
+            return "505 HTTP Version Not Supported";
+        default:
+            return "400 Bad Request";
+        }
+    }
+
+    constexpr size_t INITIAL_REQUEST_BUFFER_BYTES = 4096;
+
+    // Makes room for at least `needed` bytes, doubling so a large body costs a few reallocations; never past `limit`
+    void growRequestBuffer(vector<char> &buffer, size_t needed, size_t limit)
+    {
+        if (buffer.size() < needed)
+            buffer.resize(min(max({needed, buffer.size() * 2, INITIAL_REQUEST_BUFFER_BYTES}), limit));
+    }
+
+    // io_uring completions carry the operation in the upper half of user_data and the client socket in the lower
+    enum class UringOperation : uint64_t
+    {
+        Accept = 1,
+        Receive,
+        Send,
+        Close
+    };
+
+    uint64_t uringTag(UringOperation operation, int socket)
+    {
+        return (static_cast<uint64_t>(operation) << 32) | static_cast<uint32_t>(socket);
+    }
+
+    constexpr unsigned URING_ENTRIES = 256;
+    constexpr uint16_t RECEIVE_BUFFER_GROUP = 0;
+    constexpr unsigned RECEIVE_BUFFERS = 256;
+    constexpr unsigned RECEIVE_BUFFER_BYTES = 4096;
+
+    struct UringConnection
+    {
+        chrono::steady_clock::time_point acceptedAt;
+        vector<char> buffer;
+        size_t requestLength = 0;
+        HDE::HttpParser request;
+        string response; // must stay put until its send completes
+        shared_ptr<const string> sharedResponse;
+        string route = "invalid";
+        size_t bytesSent = 0;
+    };
+
+    /**
+     * @brief Reads the image of a predict request: raw pixel bytes (Content-Type: application/octet-stream) or the
+     *        first JSON array of 0-255 integers in the body, e.g. {"pixels": [0, 0, 12, ...]}
+     *
+     * @return False if the body holds no valid image
+     */
+    bool parsePixels(bool octetStream, string_view body, vector<uint8_t> &pixels)
+    {
+        if (octetStream)
+        {
+            pixels.assign(body.begin(), body.end());
+            return true;
+        }
+
+        const char *end = body.data() + body.size();
+        const char *cursor = find(body.data(), end, '[');
+        if (cursor == end)
+            return false;
+        ++cursor;
+        while (cursor < end)
+        {
+            while (cursor < end && (isspace(static_cast<unsigned char>(*cursor)) || *cursor == ','))
+                ++cursor;
+            if (cursor < end && *cursor == ']')
+                return true;
+            if (cursor == end || !isdigit(static_cast<unsigned char>(*cursor)))
+                return false;
+            unsigned value = 0;
+            while (cursor < end && isdigit(static_cast<unsigned char>(*cursor)) && value <= 255)
+                value = value * 10 + static_cast<unsigned>(*cursor++ - '0');
+            if (value > 255)
+                return false;
+            pixels.push_back(static_cast<uint8_t>(value));
+        }
+        return false;
+    }
+}
+
+// The accept backlog is SOMAXCONN so bursts from load tests queue in the kernel instead of being dropped
+HDE::TestServer::TestServer(int port, const string &modelConfig)
+    : SimpleServer{AF_INET, SOCK_STREAM, 0, port, INADDR_ANY, SOMAXCONN}, jobs{Jobs::poolConfigFromEnvironment()},
+      history{historyConfigFromEnvironment()}
+{
+    // The accept loop runs on SERVER_CPUS (e.g. "0-3" or "node0") if set, and otherwise leaves the training CPUs to
+    // training. Model workers started below inherit its CPUs unless models.conf pins them.
+    vector<int> serverCpus;
+    const char *serverCpuSpec = getenv("SERVER_CPUS");
+    if (serverCpuSpec && NNUtils::parseCpuSpec(serverCpuSpec, serverCpus))
+    {
+        NNUtils::pinCurrentThread(serverCpus);
+    }
+    else
+    {
+        if (serverCpuSpec)
+            LOG_WARN("Ignoring invalid SERVER_CPUS \"%s\"; expected e.g. 0-3 or node0", serverCpuSpec);
+        Jobs::avoidCpus(jobs.getCpus());
+    }
+
+    // SERVER_IO=io_uring serves connections from one io_uring event loop instead of blocking accept/read/send/close
+    const char *ioBackend = getenv("SERVER_IO");
+    useIoUring = ioBackend && string(ioBackend) == "io_uring";
+    if (ioBackend && !useIoUring && string(ioBackend) != "blocking")
+        LOG_WARN("Ignoring unknown SERVER_IO \"%s\"; expected io_uring or blocking", ioBackend);
+
+    if (models.loadConfig(modelConfig) == 0)
+    {
+        LOG_INFO("No models loaded from %s; serving the trained MNIST model as \"mnist\"", modelConfig.c_str());
+        Serving::ModelConfig mnist;
+        mnist.name = "mnist";
+        mnist.weightsFile = "./NN/mnist/data/weights.dat";
+        models.add(mnist);
+    }
     startServer();
 }
 
@@ -22,110 +261,330 @@ void HDE::TestServer::acceptClientConnection()
     struct sockaddr_in address = getSocket()->getAddress();
     int arrLen = sizeof(address);
 
-    newSocket = accept(getSocket()->getSock(), (struct sockaddr *)&address, (socklen_t *)&arrLen);
+    {
+        TRACE_SPAN("accept"); // includes time spent waiting for a client
+        newSocket = accept(getSocket()->getSock(), (struct sockaddr *)&address, (socklen_t *)&arrLen);
+    }
+    ++ioSyscalls;
     if (newSocket < 0)
     {
-        cerr << "Failed to accept connection!" << endl;
+        LOG_ERROR("Failed to accept connection: %s", strerror(errno));
         return;
     }
+    acceptedAt = chrono::steady_clock::now();
+    bytesSent = 0;
+    handedOff = false;
+    route = "invalid";
+    activeConnections().add(1);
+}
 
-    memset(buffer, 0, sizeof(buffer)); // Clear buffer
-    read(newSocket, buffer, 30000);
+// Reads until the parser has the whole request, body included, or has rejected it
+void HDE::TestServer::readRequest()
+{
+    TRACE_SPAN("read");
+    request.reset();
+    requestLength = 0;
+    while (request.getState() == HttpParser::State::Incomplete)
+    {
+        // The parser fails a request with 413 once it reaches MAX_REQUEST_BYTES, so the buffer never fills up
+        growRequestBuffer(buffer, requestLength + 1, MAX_REQUEST_BYTES);
+        ++ioSyscalls;
+        ssize_t received = read(newSocket, buffer.data() + requestLength, buffer.size() - requestLength);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            break;
+        requestLength += static_cast<size_t>(received);
+        request.parse(buffer.data(), requestLength);
+    }
 }
 
 void HDE::TestServer::processRequestAndRespond()
 {
-    string request(buffer);
-    cout << "Received Request:\n"
-         << request << endl;
+    readRequest();
+    routeRequest();
+}
 
-    stringstream requestStream(request);
-    string method, path, protocol;
+// Dispatches the request parsed into `request` to its handler; shared by the blocking and io_uring loops
+void HDE::TestServer::routeRequest()
+{
+    LOG_DEBUG("Received Request:\n%.*s", static_cast<int>(requestLength), buffer.data());
+    if (request.getState() == HttpParser::State::Error)
+    {
+        LOG_WARN("Rejecting malformed request with status %d", request.getErrorStatus());
+        sendRequestError(request.getErrorStatus());
+        return;
+    }
+    if (request.getState() != HttpParser::State::Complete)
+    {
+        LOG_WARN("Client closed the connection before sending a whole request");
+        sendErrorResponse();
+        return;
+    }
 
-    requestStream >> method >> path >> protocol;
-    this->method = method;
+    const string_view path = request.getTarget();
+    method.assign(request.getMethod());
 
-    if (method == "GET")
+    if (method == "GET" && path == "/metrics")
     {
-        cout << "Handling GET request" << endl;
+        route = "metrics";
+        handleMetricsRequest(newSocket);
+    }
+    else if (method == "GET" && path == "/debug/trace")
+    {
+        route = "trace";
+        handleTraceRequest(newSocket);
+    }
+    else if (method == "GET" && path == "/models")
+    {
+        route = "models";
+        handleModelsRequest(newSocket);
+    }
+    else if (method == "POST" && path.rfind("/models/", 0) == 0)
+    {
+        route = "predict";
+        handlePredictRequest(path);
+    }
+    else if (path == "/jobs" || path.rfind("/jobs/", 0) == 0)
+    {
+        route = "jobs";
+        handleJobsRequest(path);
+    }
+    else if (method == "GET")
+    {
+        route = "history";
+        LOG_DEBUG("Handling GET request for %.*s", static_cast<int>(path.size()), path.data());
         handleTrainingRequest(newSocket);
     }
     else if (method == "POST")
     {
-        cout << "Handling POST request" << endl;
-        handlePostRequest(request);
+        LOG_DEBUG("Handling POST request for %.*s", static_cast<int>(path.size()), path.data());
+        route = "post";
+        handlePostRequest();
     }
     else
     {
-        cout << "Unsupported request method: " << method << endl;
+        LOG_WARN("Unsupported request method: %s", method.c_str());
         sendErrorResponse();
     }
 }
 
+/**
+ * @brief Headers of a raw request, keyed by lowercased name; for repeated headers the last one wins
+ *
+ * @param rawRequest  Request line and headers, optionally followed by a body
+ * @return Empty unless the request line and all headers are present and well-formed
+ */
+unordered_map<string, string> HDE::TestServer::parseHeaders(const string &rawRequest)
+{
+    unordered_map<string, string> headers;
+    string copy = rawRequest; // the parser decodes chunked bodies in place
+    HttpParser parser(copy.size() + 1);
+    parser.parse(copy.data(), copy.size());
+    if (!parser.headersComplete() || parser.getState() == HttpParser::State::Error)
+        return headers;
+    for (size_t i = 0; i < parser.getHeaderCount(); ++i)
+    {
+        HttpHeader header = parser.getHeader(i);
+        headers[lowercase(string(header.name))] = string(header.value);
+    }
+    return headers;
+}
+
+/**
+ * @brief Serves the training history and inference probabilities as JSON, compressed with gzip or deflate if the
+ *        client's Accept-Encoding allows. A response cached since the history files last changed is sent from here;
+ *        otherwise a history worker builds and sends it, then closes the connection.
+ *
+ * @param clientSocket Socket of the connected client
+ */
 void HDE::TestServer::handleTrainingRequest(int clientSocket)
 {
-    TrainingDatabase db("./NN/mnist/data/training_data.dat", "./NN/mnist/data/probabilities.dat");
-    auto [trainingRecords, probabilityData] = db.loadAllTrainingData();
+    const ContentEncoding encoding = history.choose(negotiateEncoding(request.findHeader("accept-encoding")));
+    if (shared_ptr<const string> cached = history.findCached(encoding))
+    {
+        sendSharedResponse(clientSocket, move(cached));
+        return;
+    }
+    history.submit(clientSocket, encoding, request.getVersion() == "HTTP/1.1", [acceptedAt = acceptedAt](size_t sent)
+                   { recordRequest("history", sent, acceptedAt); });
+    handedOff = true;
+}
+
+/**
+ * @brief Serves every registered metric in the Prometheus text exposition format
+ *
+ * @param clientSocket Socket of the connected client
+ */
+void HDE::TestServer::handleMetricsRequest(int clientSocket)
+{
+    TRACE_SPAN("metrics.render");
+    string body = Metrics::Registry::instance().render();
+    string response =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " +
+        to_string(body.length()) + "\r\n"
+                                   "\r\n" +
+        body;
+
+    sendResponse(clientSocket, response);
+}
+
+/**
+ * @brief Serves the spans buffered so far as Chrome trace-event JSON (open in chrome://tracing or Perfetto).
+ *        Spans are only recorded when sampling is on, e.g. TRACE_SAMPLE_RATE=100 traces 1 in 100 requests.
+ *
+ * @param clientSocket Socket of the connected client
+ */
+void HDE::TestServer::handleTraceRequest(int clientSocket)
+{
+    string body = Tracing::exportChromeTrace();
+    string response =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: " +
+        to_string(body.length()) + "\r\n"
+                                   "\r\n" +
+        body;
 
-    string jsonResponse = "{";
+    sendResponse(clientSocket, response);
+}
+
+/**
+ * @brief Lists the served models with their topology, precision and batching settings
+ *
+ * @param clientSocket Socket of the connected client
+ */
+void HDE::TestServer::handleModelsRequest(int clientSocket)
+{
+    sendResponse(clientSocket, httpResponse("200 OK", "application/json", models.describeJson()));
+}
 
-    jsonResponse += "\"probabilities\": [";
-    for (size_t i = 0; i < probabilityData.size(); i++)
+/**
+ * @brief Queues the image in a POST /models/{name}/predict request on that model. A model worker runs it in a batch,
+ *        then sends {"model", "version", "prediction", "probabilities"} and closes the connection. When the model's
+ *        queue is full the request is answered with 503 and counted under the "predict_rejected" route.
+ *
+ * @param path  Request path; {name} is "name" (highest version) or "name@version"
+ */
+void HDE::TestServer::handlePredictRequest(string_view path)
+{
+    const string_view prefix = "/models/", suffix = "/predict";
+    Serving::ServedModel *served = nullptr;
+    if (path.size() > prefix.size() + suffix.size() && path.ends_with(suffix))
+        served = models.find(string(path.substr(prefix.size(), path.size() - prefix.size() - suffix.size())));
+    if (!served)
     {
-        jsonResponse += "[";
-        for (size_t j = 0; j < probabilityData[i].size(); j++)
-        {
-            jsonResponse += to_string(probabilityData[i][j]);
-            if (j < probabilityData[i].size() - 1)
-                jsonResponse += ",";
-        }
-        jsonResponse += "]";
-        if (i < probabilityData.size() - 1)
-            jsonResponse += ",";
+        sendResponse(newSocket, httpResponse("404 Not Found", "application/json", jsonMessage("Unknown model; see GET /models")));
+        return;
     }
-    jsonResponse += "],";
 
-    jsonResponse += "\"trainingHistory\": [";
-    for (size_t i = 0; i < trainingRecords.size(); ++i)
+    const string_view contentType = request.findHeader("content-type");
+    const bool octetStream = equalsIgnoringCase(contentType.substr(0, strlen("application/octet-stream")), "application/octet-stream");
+    Serving::PredictRequest predict;
+    if (!parsePixels(octetStream, request.getBody(), predict.pixels) ||
+        predict.pixels.size() != served->getModel().inputSize())
     {
-        const auto &record = trainingRecords[i];
-
-        jsonResponse += "{";
-        jsonResponse += "\"epoch\": " + to_string(record.epoch) + ",";
-        jsonResponse += "\"loss\": " + to_string(record.loss) + ",";
-        jsonResponse += "\"weights\": [";
+        sendResponse(newSocket, httpResponse("400 Bad Request", "application/json",
+                                             jsonMessage("Expected " + to_string(served->getModel().inputSize()) + " pixels (0-255)")));
+        return;
+    }
 
-        for (size_t j = 0; j < record.weights.size(); ++j)
+    const Serving::ModelConfig &config = served->getConfig();
+    predict.respond = [clientSocket = newSocket, acceptedAt = acceptedAt, name = config.name, version = config.version](const double *probabilities, size_t count)
+    {
+        size_t predicted = max_element(probabilities, probabilities + count) - probabilities;
+        string body = "{\"model\":\"" + name + "\",\"version\":" + to_string(version) +
+                      ",\"prediction\":" + to_string(predicted) + ",\"probabilities\":[";
+        char number[32];
+        for (size_t i = 0; i < count; ++i)
         {
-            jsonResponse += to_string(record.weights[j]);
-            if (j < record.weights.size() - 1)
-                jsonResponse += ",";
+            snprintf(number, sizeof(number), "%s%.9g", i ? "," : "", probabilities[i]);
+            body += number;
         }
+        body += "]}";
 
-        jsonResponse += "]";
-        jsonResponse += "}";
+        size_t sent = sendAll(clientSocket, httpResponse("200 OK", "application/json", body));
+        close(clientSocket);
+        recordRequest("predict", sent, acceptedAt);
+    };
+    handedOff = served->submit(move(predict));
+    if (!handedOff)
+    {
+        // The request was valid; the model's queue is full or shutting down, so the client may retry later
+        route = "predict_rejected";
+        sendResponse(newSocket, httpResponse("503 Service Unavailable", "application/json",
+                                             jsonMessage("Model queue is full; retry later")));
+    }
+}
 
-        if (i < trainingRecords.size() - 1)
-            jsonResponse += ",";
+/**
+ * @brief Training jobs:
+ *        POST /jobs                 queues a job from a JSON config (see Jobs::parseJobConfig), 202 with its state
+ *        GET  /jobs                 lists every job
+ *        GET  /jobs/{id}            one job's state and progress
+ *        GET  /jobs/{id}/events     streams progress as server-sent events until the job finishes
+ *        POST /jobs/{id}/cancel     cancels a queued or running job
+ *
+ * @param path  Request path
+ */
+void HDE::TestServer::handleJobsRequest(string_view path)
+{
+    if (path == "/jobs")
+    {
+        if (method == "GET")
+        {
+            sendResponse(newSocket, httpResponse("200 OK", "application/json", jobs.listJson()));
+            return;
+        }
+        Jobs::JobConfig config;
+        string error;
+        if (method != "POST" || !Jobs::parseJobConfig(string(request.getBody()), config, error))
+        {
+            sendResponse(newSocket, httpResponse("400 Bad Request", "application/json", jsonMessage(error.empty() ? "Use GET or POST /jobs" : error)));
+            return;
+        }
+        sendResponse(newSocket, httpResponse("202 Accepted", "application/json", jobs.submit(move(config))->toJson()));
+        return;
     }
-    jsonResponse += "]";
-    jsonResponse += "}";
 
-    string response =
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: application/json\r\n"
-        "Access-Control-Allow-Origin: http://localhost:3000\r\n"
-        "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
-        "Access-Control-Allow-Headers: Content-Type\r\n"
-        "Content-Length: " +
-        to_string(jsonResponse.length()) + "\r\n"
-                                                "\r\n" +
-        jsonResponse;
+    const string_view rest = path.substr(strlen("/jobs/"));
+    uint64_t id = 0;
+    const auto [idEnd, idError] = from_chars(rest.data(), rest.data() + rest.size(), id);
+    const bool validId = idError == errc() && idEnd != rest.data();
+    const string_view action = validId ? rest.substr(idEnd - rest.data()) : "invalid";
+    shared_ptr<Jobs::TrainingJob> job = validId ? jobs.find(id) : nullptr;
+    if (!job)
+    {
+        sendResponse(newSocket, httpResponse("404 Not Found", "application/json", jsonMessage("Unknown job; see GET /jobs")));
+        return;
+    }
 
-    send(clientSocket, response.c_str(), response.length(), 0);
+    if (method == "GET" && action.empty())
+    {
+        sendResponse(newSocket, httpResponse("200 OK", "application/json", job->toJson()));
+    }
+    else if (method == "GET" && action == "/events")
+    {
+        route = "job_events";
+        handedOff = jobs.subscribe(id, newSocket, [acceptedAt = acceptedAt](size_t sent)
+                                   { recordRequest("job_events", sent, acceptedAt); });
+    }
+    else if (method == "POST" && action == "/cancel")
+    {
+        if (jobs.cancel(id))
+            sendResponse(newSocket, httpResponse("200 OK", "application/json", job->toJson()));
+        else
+            sendResponse(newSocket, httpResponse("409 Conflict", "application/json", jsonMessage("Job already finished")));
+    }
+    else
+    {
+        sendErrorResponse();
+    }
 }
 
-void HDE::TestServer::handlePostRequest(const string &request)
+void HDE::TestServer::handlePostRequest()
 {
     string response =
         "HTTP/1.1 200 OK\r\n"
@@ -137,7 +596,7 @@ void HDE::TestServer::handlePostRequest(const string &request)
         "\r\n"
         "{\"message\": \"Dummy training data saved!\"}";
 
-    send(newSocket, response.c_str(), response.length(), 0);
+    sendResponse(newSocket, response);
 }
 
 void HDE::TestServer::sendErrorResponse()
@@ -152,22 +611,226 @@ void HDE::TestServer::sendErrorResponse()
         "\r\n"
         "Invalid Request";
 
-    send(newSocket, response.c_str(), response.length(), 0);
+    sendResponse(newSocket, response);
+}
+
+// Answers a request HttpParser rejected, e.g. 413 for one over MAX_REQUEST_BYTES
+void HDE::TestServer::sendRequestError(int status)
+{
+    const string statusLine = requestErrorStatus(status);
+    sendResponse(newSocket, httpResponse(statusLine, "application/json", jsonMessage(statusLine.substr(4))));
+}
+
+void HDE::TestServer::sendResponse(int clientSocket, const string &response)
+{
+    if (deferSends)
+    {
+        deferredResponse += response;
+        return;
+    }
+    TRACE_SPAN("send");
+    bytesSent += sendAll(clientSocket, response, &ioSyscalls);
+}
+
+void HDE::TestServer::sendSharedResponse(int clientSocket, shared_ptr<const string> response)
+{
+    if (deferSends && deferredResponse.empty())
+    {
+        deferredSharedResponse = move(response);
+        return;
+    }
+    sendResponse(clientSocket, *response);
 }
 
 void HDE::TestServer::closeConnection()
 {
-    close(newSocket);
+    if (newSocket < 0 || handedOff)
+        return;
+    {
+        TRACE_SPAN("close");
+        close(newSocket);
+    }
+    ++ioSyscalls;
+    recordRequest(route, bytesSent, acceptedAt);
 }
 
 void HDE::TestServer::startServer()
 {
+    LOG_INFO("Server listening on port %d", ntohs(getSocket()->getAddress().sin_port));
+    if (useIoUring && serveWithIoUring())
+        return;
+
+    Metrics::Counter &syscalls = ioSyscallCounter("blocking");
     while (true)
     {
-        cout << "Waiting for client connections..." << endl;
-        acceptClientConnection();          
-        processRequestAndRespond(); 
-        closeConnection();
-        cout << "Finished handling request." << endl;
+        LOG_DEBUG("Waiting for client connections...");
+        acceptClientConnection();
+        if (newSocket >= 0)
+        {
+            TRACE_SPAN("request");
+            processRequestAndRespond();
+            closeConnection();
+            LOG_DEBUG("Finished handling request.");
+        }
+        syscalls.add(ioSyscalls);
+        ioSyscalls = 0;
     }
 }
+
+/**
+ * @brief Serves every connection from one io_uring: a multishot accept on the listening socket, receives into
+ *        buffers from a provided-buffer ring, and each response written by sends (resubmitted until it is all out)
+ *        followed by the close of its socket.
+ *        Many connections are in flight at once and each loop iteration is one io_uring_enter, however many
+ *        operations it submits and completes. Request handlers are the blocking loop's; their sends are collected
+ *        and submitted once they return. Predict and job-event connections are handed off exactly as before.
+ *
+ * @return False if io_uring is unavailable (or fails before serving), so the caller falls back to the blocking loop
+ */
+bool HDE::TestServer::serveWithIoUring()
+{
+    unordered_map<int, UringConnection> connections; // outlives the ring, whose pending sends point into it
+    IoUring ring;
+    const int listener = getSocket()->getSock();
+    if (!ring.setup(URING_ENTRIES) || !ring.registerBufferRing(RECEIVE_BUFFER_GROUP, RECEIVE_BUFFERS, RECEIVE_BUFFER_BYTES) ||
+        !ring.prepareMultishotAccept(listener, uringTag(UringOperation::Accept, listener)))
+    {
+        LOG_WARN("io_uring is unavailable (%s); using blocking sockets", strerror(errno));
+        return false;
+    }
+    LOG_INFO("Serving connections with io_uring");
+
+    Metrics::Counter &syscalls = ioSyscallCounter("io_uring");
+    uint64_t countedEnters = 0;
+    bool failed = false;
+
+    auto handleCompletion = [&](const io_uring_cqe &completion)
+    {
+        const UringOperation operation = static_cast<UringOperation>(completion.user_data >> 32);
+        const int socket = static_cast<int>(completion.user_data & 0xffffffffu);
+        if (operation == UringOperation::Accept)
+        {
+            // A multishot accept stops after an error; start a new one
+            if (!(completion.flags & IORING_CQE_F_MORE))
+                failed |= !ring.prepareMultishotAccept(listener, uringTag(UringOperation::Accept, listener));
+            if (completion.res < 0)
+            {
+                LOG_ERROR("Failed to accept connection: %s", strerror(-completion.res));
+                return;
+            }
+            UringConnection &connection = connections[completion.res];
+            connection.acceptedAt = chrono::steady_clock::now();
+            connection.request = HttpParser(MAX_REQUEST_BYTES);
+            activeConnections().add(1);
+            failed |= !ring.prepareBufferedRecv(completion.res, uringTag(UringOperation::Receive, completion.res));
+            return;
+        }
+
+        auto it = connections.find(socket);
+        if (it == connections.end())
+            return;
+        UringConnection &connection = it->second;
+
+        if (operation == UringOperation::Receive)
+        {
+            if (completion.res == -ENOBUFS)
+            {
+                // Every receive buffer holds unprocessed data; they are recycled as this loop consumes them
+                failed |= !ring.prepareBufferedRecv(socket, uringTag(UringOperation::Receive, socket));
+                return;
+            }
+            if (completion.res > 0)
+            {
+                const uint16_t id = static_cast<uint16_t>(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+                // Bytes past MAX_REQUEST_BYTES are dropped: the parser has failed the request with 413 by then
+                const size_t kept = min(static_cast<size_t>(completion.res), MAX_REQUEST_BYTES - connection.requestLength);
+                growRequestBuffer(connection.buffer, connection.requestLength + kept, MAX_REQUEST_BYTES);
+                memcpy(connection.buffer.data() + connection.requestLength, ring.buffer(id), kept);
+                connection.requestLength += kept;
+                ring.recycleBuffer(id);
+                connection.request.parse(connection.buffer.data(), connection.requestLength);
+            }
+            if (completion.res > 0 && connection.request.getState() == HttpParser::State::Incomplete)
+            {
+                failed |= !ring.prepareBufferedRecv(socket, uringTag(UringOperation::Receive, socket));
+                return;
+            }
+
+            if (connection.requestLength > 0)
+            {
+                // Swapping keeps the heap block in place, so the parser's views stay valid
+                buffer.swap(connection.buffer);
+                requestLength = connection.requestLength;
+                request = connection.request;
+                newSocket = socket;
+                acceptedAt = connection.acceptedAt;
+                route = "invalid";
+                bytesSent = 0;
+                handedOff = false;
+                deferredResponse.clear();
+                deferredSharedResponse.reset();
+                deferSends = true;
+                {
+                    TRACE_SPAN("request");
+                    routeRequest();
+                }
+                deferSends = false;
+                if (handedOff)
+                {
+                    connections.erase(it); // the model worker or job now owns the socket
+                    return;
+                }
+                connection.route = route;
+                connection.response = move(deferredResponse);
+                connection.sharedResponse = move(deferredSharedResponse);
+            }
+            const string &response = connection.sharedResponse ? *connection.sharedResponse : connection.response;
+            if (!response.empty())
+                failed |= !ring.prepareSend(socket, response.data(), response.size(), uringTag(UringOperation::Send, socket));
+            else
+                failed |= !ring.prepareClose(socket, uringTag(UringOperation::Close, socket));
+        }
+        else if (operation == UringOperation::Send)
+        {
+            // The close waits for the whole response: a kernel that ignores MSG_WAITALL for sends completes short,
+            // and the rest goes out in another send
+            const string &response = connection.sharedResponse ? *connection.sharedResponse : connection.response;
+            if (completion.res > 0)
+                connection.bytesSent += static_cast<size_t>(completion.res);
+            if (completion.res > 0 && connection.bytesSent < response.size())
+            {
+                failed |= !ring.prepareSend(socket, response.data() + connection.bytesSent, response.size() - connection.bytesSent,
+                                            uringTag(UringOperation::Send, socket));
+                return;
+            }
+            if (connection.bytesSent < response.size())
+            {
+                LOG_WARN("Failed to send response: %s", completion.res < 0 ? strerror(-completion.res) : "connection closed");
+                sendErrors().add();
+            }
+            failed |= !ring.prepareClose(socket, uringTag(UringOperation::Close, socket));
+        }
+        else if (operation == UringOperation::Close)
+        {
+            recordRequest(connection.route, connection.bytesSent, connection.acceptedAt);
+            connections.erase(it);
+        }
+    };
+
+    while (!failed)
+    {
+        if (!ring.submitAndWait(1))
+        {
+            LOG_ERROR("io_uring_enter failed: %s", strerror(errno));
+            break;
+        }
+        ring.forEachCompletion(handleCompletion);
+        syscalls.add(ring.getEnterCalls() - countedEnters);
+        countedEnters = ring.getEnterCalls();
+    }
+
+    LOG_ERROR("The io_uring loop stopped with %zu connection(s) open; falling back to blocking sockets", connections.size());
+    for (auto &[socket, connection] : connections)
+        close(socket);
+    return false;
+}
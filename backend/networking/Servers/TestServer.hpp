@@ -3,27 +3,64 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include "SimpleServer.hpp"
+#include "HttpParser.hpp"
+#include "HistoryResponder.hpp"
 #include "../Database/Database.hpp"
+#include "../Serving/ModelRegistry.hpp"
+#include "../Jobs/TrainingJobs.hpp"
 
 namespace HDE
 {
     class TestServer : public SimpleServer
     {
+        static constexpr size_t MAX_REQUEST_BYTES = 1 << 20; // larger requests get 413
         int newSocket;
         std::string method;
-        char buffer[30000] = {0};
+        std::vector<char> buffer; // grows up to MAX_REQUEST_BYTES and keeps its capacity between requests
+        size_t requestLength = 0;
+        HttpParser request{MAX_REQUEST_BYTES};
+        std::chrono::steady_clock::time_point acceptedAt;
+        std::string route;
+        size_t bytesSent = 0;
+        bool handedOff = false; // a model worker or training job answers and closes the connection
+        bool useIoUring = false;   // SERVER_IO=io_uring
+        bool deferSends = false;   // the io_uring loop sends what the handlers produce once they return
+        std::string deferredResponse;
+        std::shared_ptr<const std::string> deferredSharedResponse; // a cached response, sent without copying it
+        uint64_t ioSyscalls = 0;   // client I/O syscalls of the current request on the blocking path
+        Jobs::JobManager jobs;  // constructed first: request threads started later stay off its CPUs
+        Serving::ModelRegistry models;
+        HistoryResponder history;
         void acceptClientConnection() override;
+        void readRequest();
         void processRequestAndRespond() override;
+        void routeRequest();
+        bool serveWithIoUring();
         void closeConnection() override;
         void handleTrainingRequest(int);
-        void handlePostRequest(const std::string &);
+        void handleMetricsRequest(int);
+        void handleTraceRequest(int);
+        void handleModelsRequest(int);
+        void handlePredictRequest(std::string_view path);
+        void handleJobsRequest(std::string_view path);
+        void sendResponse(int, const std::string &);
+        void sendSharedResponse(int, std::shared_ptr<const std::string>);
+        void handlePostRequest();
         void sendErrorResponse();
+        void sendRequestError(int status);
 
     public:
-        TestServer();
+        TestServer(int port = 80, const std::string &modelConfig = "models.conf");
         void startServer() override;
-        std::unordered_map<std::string, std::string> parseHeaders(const std::string &request);
+        std::unordered_map<std::string, std::string> parseHeaders(const std::string &rawRequest);
         std::string jsonResponse(const std::string &message);
     };
 };
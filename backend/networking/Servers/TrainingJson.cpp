@@ -0,0 +1,62 @@
+#include "TrainingJson.hpp"
+
+using namespace std;
+
+/**
+ * @brief Builds the JSON document returned by GET requests
+ *
+ * @param trainingRecords   Per-epoch loss and flattened network parameters from the training database
+ * @param probabilityData   Output probabilities saved by the last inference run
+ *
+ * @return JSON object with "probabilities" and "trainingHistory" arrays
+ */
+string HDE::renderTrainingJson(
+    const vector<TrainingDatabase::TrainingRecord> &trainingRecords,
+    const vector<vector<double>> &probabilityData)
+{
+    string jsonResponse = "{";
+
+    jsonResponse += "\"probabilities\": [";
+    for (size_t i = 0; i < probabilityData.size(); i++)
+    {
+        jsonResponse += "[";
+        for (size_t j = 0; j < probabilityData[i].size(); j++)
+        {
+            jsonResponse += to_string(probabilityData[i][j]);
+            if (j < probabilityData[i].size() - 1)
+                jsonResponse += ",";
+        }
+        jsonResponse += "]";
+        if (i < probabilityData.size() - 1)
+            jsonResponse += ",";
+    }
+    jsonResponse += "],";
+
+    jsonResponse += "\"trainingHistory\": [";
+    for (size_t i = 0; i < trainingRecords.size(); ++i)
+    {
+        const auto &record = trainingRecords[i];
+
+        jsonResponse += "{";
+        jsonResponse += "\"epoch\": " + to_string(record.epoch) + ",";
+        jsonResponse += "\"loss\": " + to_string(record.loss) + ",";
+        jsonResponse += "\"weights\": [";
+
+        for (size_t j = 0; j < record.weights.size(); ++j)
+        {
+            jsonResponse += to_string(record.weights[j]);
+            if (j < record.weights.size() - 1)
+                jsonResponse += ",";
+        }
+
+        jsonResponse += "]";
+        jsonResponse += "}";
+
+        if (i < trainingRecords.size() - 1)
+            jsonResponse += ",";
+    }
+    jsonResponse += "]";
+    jsonResponse += "}";
+
+    return jsonResponse;
+}
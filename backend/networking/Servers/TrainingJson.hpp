@@ -0,0 +1,16 @@
+#ifndef TRAINING_JSON_HPP
+#define TRAINING_JSON_HPP
+
+#include <string>
+#include <vector>
+#include "../Database/Database.hpp"
+
+namespace HDE
+{
+    // Renders inference probabilities and per-epoch training history as the JSON body served to the frontend
+    std::string renderTrainingJson(
+        const std::vector<TrainingDatabase::TrainingRecord> &trainingRecords,
+        const std::vector<std::vector<double>> &probabilityData);
+};
+
+#endif
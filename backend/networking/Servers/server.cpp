@@ -1,6 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include "TestServer.hpp"
 
-int main() {
-    HDE::TestServer server;
-}
\ No newline at end of file
+// Usage: ./server.exe [port] [model-config]   (defaults to port 80 and models.conf)
+int main(int argc, char *argv[]) {
+    int port = argc > 1 ? atoi(argv[1]) : 80;
+    const char *modelConfig = argc > 2 ? argv[2] : "models.conf";
+    HDE::TestServer server(port, modelConfig);
+}
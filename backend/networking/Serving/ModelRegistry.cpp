@@ -0,0 +1,483 @@
+#include "ModelRegistry.hpp"
+#include "../NN/ff_neural_net.hpp"
+#include "../NN/static_ff_net.hpp"
+#include "../NN/sparse/sparse_ff_net.hpp"
+#include "../NN/model/model_file.hpp"
+#include "../NN/utils/numa.hpp"
+#include "../Logging/Logger.hpp"
+#include "../Tracing/Trace.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+    string topologyName(const vector<uint32_t> &layerSizes)
+    {
+        string topology;
+        for (uint32_t size : layerSizes)
+            topology += (topology.empty() ? "" : "x") + to_string(size);
+        return topology;
+    }
+
+    // Weights used in place from the shared read-only mapping; each worker thread runs in its own
+    // FFNeuralNet per-thread workspace, so concurrent batches share nothing writable
+    class DenseModel : public Serving::InferenceModel
+    {
+        FFNeuralNet net;
+        vector<uint32_t> layerSizes;
+        string topology;
+
+    public:
+        explicit DenseModel(const vector<uint32_t> &layerSizes)
+            : net(layerSizes[0], layerSizes[1], layerSizes[2]), layerSizes{layerSizes}, topology{topologyName(layerSizes)} {}
+
+        bool load(shared_ptr<const NNModel::MappedModel> mapped, const string &filename)
+        {
+            return net.useMappedWeights(move(mapped), filename);
+        }
+
+        size_t inputSize() const override { return net.getInputSize(); }
+        size_t outputSize() const override { return net.getOutputSize(); }
+        string description() const override { return topology + " dense float64"; }
+
+        unique_ptr<const Serving::InferenceModel> replicate() const override
+        {
+            auto copy = make_unique<DenseModel>(layerSizes);
+            copy->net.setParameters(vector<double>(net.getParameters(), net.getParameters() + net.parameterCount()));
+            return copy;
+        }
+
+        void predictBatch(const vector<vector<uint8_t>> &images, double *probabilities) const override
+        {
+            net.performForwardPassBatch(images, 0, images.size(), probabilities);
+        }
+    };
+
+    // float32 inference is compiled for the production MNIST topology only
+    using MnistFloatNet = StaticFFNet<784, 128, 10, NNUtils::ActivationFunctions::Relu, float>;
+
+    class Float32Model : public Serving::InferenceModel
+    {
+        MnistFloatNet net;
+
+    public:
+        explicit Float32Model(const double *parameters) { net.setParameters(parameters); }
+
+        size_t inputSize() const override { return MnistFloatNet::getInputSize(); }
+        size_t outputSize() const override { return MnistFloatNet::getOutputSize(); }
+        string description() const override { return "784x128x10 dense float32"; }
+
+        unique_ptr<const Serving::InferenceModel> replicate() const override
+        {
+            return make_unique<Float32Model>(net.getParameters().data());
+        }
+
+        // One image at a time: the kernel skips each image's zero pixels, which on MNIST beats sharing weight reads
+        // across the batch. Activations live on the stack, so nothing is allocated.
+        void predictBatch(const vector<vector<uint8_t>> &images, double *probabilities) const override
+        {
+            for (size_t i = 0; i < images.size(); ++i)
+            {
+                MnistFloatNet::Probabilities output = net.performForwardPass(images[i]);
+                copy(output.begin(), output.end(), probabilities + i * output.size());
+            }
+        }
+    };
+
+    class SparseModel : public Serving::InferenceModel
+    {
+        NNSparse::SparseFFNet net;
+        string topology;
+        size_t inputCount;
+        size_t outputCount;
+
+    public:
+        SparseModel(NNSparse::SparseFFNet loaded, const vector<uint32_t> &layerSizes)
+            : net{move(loaded)}, topology{topologyName(layerSizes)}, inputCount{layerSizes[0]}, outputCount{layerSizes[2]} {}
+
+        size_t inputSize() const override { return inputCount; }
+        size_t outputSize() const override { return outputCount; }
+        string description() const override
+        {
+            return topology + (net.getLayout() == NNModel::Layout::BlockSparse ? " block-sparse" : " csr") + " float64";
+        }
+
+        unique_ptr<const Serving::InferenceModel> replicate() const override { return make_unique<SparseModel>(*this); }
+
+        void predictBatch(const vector<vector<uint8_t>> &images, double *probabilities) const override
+        {
+            // One scratch buffer per worker thread, grown to the largest batch and then reused
+            thread_local vector<double> scratch;
+            net.performForwardPassBatch(images, 0, images.size(), probabilities, scratch);
+        }
+    };
+
+    /**
+     * @brief Builds the inference implementation a model file and precision call for
+     *
+     * @param config  Registry entry (for the file name and precision)
+     * @param mapped  The opened model file, possibly shared with other entries
+     *
+     * @return The model, or nullptr (with the reason logged) if the file cannot be served as configured
+     */
+    unique_ptr<const Serving::InferenceModel> makeInferenceModel(const Serving::ModelConfig &config,
+                                                                 shared_ptr<const NNModel::MappedModel> mapped)
+    {
+        const string &file = config.weightsFile;
+        if (mapped->isLegacy() || mapped->layerSizes().size() != 3)
+        {
+            LOG_ERROR("Model %s: %s must be a 3-layer model file with a header (re-save legacy weights first)",
+                      config.name.c_str(), file.c_str());
+            return nullptr;
+        }
+        const vector<uint32_t> layerSizes = mapped->layerSizes();
+
+        if (mapped->layout() != NNModel::Layout::Dense)
+        {
+            if (config.precision != Serving::Precision::Float64)
+            {
+                LOG_ERROR("Model %s: sparse model files are served in float64 only", config.name.c_str());
+                return nullptr;
+            }
+            NNSparse::SparseFFNet sparse;
+            if (!sparse.load(file))
+                return nullptr;
+            return make_unique<SparseModel>(move(sparse), layerSizes);
+        }
+
+        if (config.precision == Serving::Precision::Float32)
+        {
+            if (layerSizes != vector<uint32_t>{MnistFloatNet::getInputSize(), 128, MnistFloatNet::getOutputSize()})
+            {
+                LOG_ERROR("Model %s: float32 serving is compiled for 784x128x10, not %s",
+                          config.name.c_str(), topologyName(layerSizes).c_str());
+                return nullptr;
+            }
+            return make_unique<Float32Model>(mapped->parameters());
+        }
+
+        auto dense = make_unique<DenseModel>(layerSizes);
+        if (!dense->load(move(mapped), file))
+            return nullptr;
+        return dense;
+    }
+
+    string modelLabels(const Serving::ModelConfig &config)
+    {
+        return "model=\"" + config.name + "\",version=\"" + to_string(config.version) + "\"";
+    }
+
+    // Applies one key=value setting from a configuration line
+    bool applySetting(Serving::ModelConfig &config, const string &key, const string &value)
+    {
+        if (key == "precision")
+            return Serving::parsePrecision(value, config.precision);
+        if (key == "cpus")
+            return NNUtils::parseCpuSpec(value, config.cpus);
+
+        char *end = nullptr;
+        long number = strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || number < 0)
+            return false;
+        if (key == "batch" && number > 0)
+            config.maxBatch = static_cast<size_t>(number);
+        else if (key == "delay_us")
+            config.maxDelay = chrono::microseconds(number);
+        else if (key == "workers" && number > 0)
+            config.workers = static_cast<unsigned>(number);
+        else if (key == "queue" && number > 0)
+            config.maxQueue = static_cast<size_t>(number);
+        else
+            return false;
+        return true;
+    }
+}
+
+bool Serving::parsePrecision(const string &name, Precision &precision)
+{
+    if (name == "float64")
+        precision = Precision::Float64;
+    else if (name == "float32")
+        precision = Precision::Float32;
+    else
+        return false;
+    return true;
+}
+
+const char *Serving::precisionName(Precision precision)
+{
+    return precision == Precision::Float32 ? "float32" : "float64";
+}
+
+Serving::ServedModel::ServedModel(ModelConfig config, unique_ptr<const InferenceModel> model)
+    : config{move(config)}, model{move(model)},
+      replicatePerNode{!this->config.cpus.empty() && NNUtils::CpuTopology::instance().nodesSpanned(this->config.cpus) > 1},
+      predictions{Metrics::Registry::instance().counter("model_predictions_total", "Images classified, by model.", modelLabels(this->config))},
+      batches{Metrics::Registry::instance().counter("model_batches_total", "Batched forward passes run, by model.", modelLabels(this->config))},
+      queueDepth{Metrics::Registry::instance().gauge("model_queue_depth", "Requests waiting for a model worker, by model.", modelLabels(this->config))},
+      queueWait{Metrics::Registry::instance().histogram("model_queue_wait_seconds", "Time a request waited before its batch started, by model.",
+                                                        modelLabels(this->config))},
+      batchTime{Metrics::Registry::instance().histogram("model_batch_seconds", "Time spent in one batched forward pass, by model.",
+                                                        modelLabels(this->config))}
+{
+    for (unsigned i = 0; i < this->config.workers; ++i)
+        workers.emplace_back(&ServedModel::runWorker, this, i);
+}
+
+// Queued requests are still answered before the workers exit
+Serving::ServedModel::~ServedModel()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (thread &worker : workers)
+        worker.join();
+}
+
+bool Serving::ServedModel::submit(PredictRequest request)
+{
+    if (request.pixels.size() != model->inputSize())
+        return false;
+
+    request.enqueuedAt = chrono::steady_clock::now();
+    bool fullBatch;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        // The workers have exited (or are about to) once stopping is set, so nothing would answer the request
+        if (stopping || queue.size() >= config.maxQueue)
+            return false;
+        queue.push_back(move(request));
+        fullBatch = queue.size() >= config.maxBatch;
+        queueDepth.set(static_cast<double>(queue.size()));
+    }
+    // A full batch ends every worker's wait for more requests
+    if (fullBatch)
+        queueReady.notify_all();
+    else
+        queueReady.notify_one();
+    return true;
+}
+
+/**
+ * @brief The model replica for a NUMA node, built by the first worker that asks for it. Workers are pinned before they
+ *        ask, so the replica's pages are first touched, and placed, on their node.
+ *
+ * @param node  NUMA node the calling worker runs on
+ */
+const Serving::InferenceModel &Serving::ServedModel::nodeReplica(int node)
+{
+    lock_guard<mutex> lock(replicaMutex);
+    unique_ptr<const InferenceModel> &replica = replicas[node];
+    if (!replica)
+    {
+        replica = model->replicate();
+        LOG_INFO("Model %s@%d: replicated weights on NUMA node %d", config.name.c_str(), config.version, node);
+    }
+    return *replica;
+}
+
+size_t Serving::ServedModel::pendingRequests()
+{
+    lock_guard<mutex> lock(queueMutex);
+    return queue.size();
+}
+
+/**
+ * @brief Worker loop: takes up to maxBatch requests, waiting at most maxDelay after the oldest one arrived for a
+ *        partial batch to fill, runs them as one batch and answers each request
+ *
+ * @param index  Worker number, which picks the CPU the worker is pinned to
+ */
+void Serving::ServedModel::runWorker(unsigned index)
+{
+    if (!config.cpus.empty())
+        NNUtils::pinCurrentThread({config.cpus[index % config.cpus.size()]});
+    const InferenceModel &model = replicatePerNode ? nodeReplica(NNUtils::currentNode()) : *this->model;
+
+    const size_t outputSize = model.outputSize();
+    vector<PredictRequest> batch;
+    batch.reserve(config.maxBatch);
+    vector<vector<uint8_t>> images;
+    vector<double> probabilities(config.maxBatch * outputSize);
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [&]
+                            { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return; // stopping
+
+            if (queue.size() < config.maxBatch && !stopping)
+            {
+                auto deadline = queue.front().enqueuedAt + config.maxDelay;
+                queueReady.wait_until(lock, deadline, [&]
+                                      { return stopping || queue.size() >= config.maxBatch; });
+            }
+
+            // Another worker may have taken the requests while this one waited
+            size_t count = min(queue.size(), config.maxBatch);
+            for (size_t i = 0; i < count; ++i)
+            {
+                batch.push_back(move(queue.front()));
+                queue.pop_front();
+            }
+            queueDepth.set(static_cast<double>(queue.size()));
+        }
+        if (batch.empty())
+            continue;
+
+        auto start = chrono::steady_clock::now();
+        images.resize(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            images[i] = move(batch[i].pixels);
+            queueWait.recordDuration(start - batch[i].enqueuedAt);
+        }
+        {
+            TRACE_SPAN("model.batch");
+            Metrics::ScopedTimer timer(batchTime);
+            model.predictBatch(images, probabilities.data());
+        }
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            batch[i].respond(probabilities.data() + i * outputSize, outputSize);
+        }
+        predictions.add(batch.size());
+        batches.add();
+        batch.clear();
+    }
+}
+
+size_t Serving::ModelRegistry::loadConfig(const string &path)
+{
+    ifstream file(path);
+    if (!file.is_open())
+    {
+        LOG_WARN("Cannot open model configuration %s", path.c_str());
+        return 0;
+    }
+
+    size_t loaded = 0;
+    string line;
+    for (int lineNumber = 1; getline(file, line); ++lineNumber)
+    {
+        line = line.substr(0, line.find('#'));
+        stringstream fields(line);
+        ModelConfig config;
+        if (!(fields >> config.name))
+            continue; // blank or comment
+
+        bool valid = static_cast<bool>(fields >> config.version >> config.weightsFile) &&
+                     config.name.find('@') == string::npos && config.name.find('/') == string::npos;
+        string setting;
+        while (valid && fields >> setting)
+        {
+            size_t equals = setting.find('=');
+            valid = equals != string::npos && applySetting(config, setting.substr(0, equals), setting.substr(equals + 1));
+        }
+        if (!valid)
+        {
+            LOG_ERROR("%s:%d: expected \"name version weights-file [precision=float64|float32] [batch=N] [delay_us=N] "
+                      "[workers=N] [queue=N] [cpus=A,B-C|nodeN]\"",
+                      path.c_str(), lineNumber);
+            continue;
+        }
+        loaded += add(config) ? 1 : 0;
+    }
+    return loaded;
+}
+
+/**
+ * @brief Loads a model and starts its workers. Entries that use the same file share one read-only mapping.
+ *
+ * @param config  Model name, version, weights file and serving settings
+ *
+ * @return True if the model was loaded; false (logged) if the file is invalid or the name and version are taken
+ */
+bool Serving::ModelRegistry::add(const ModelConfig &config)
+{
+    if (models[config.name].count(config.version))
+    {
+        LOG_ERROR("Model %s@%d is already loaded", config.name.c_str(), config.version);
+        return false;
+    }
+
+    shared_ptr<const NNModel::MappedModel> &mapped = mappedFiles[config.weightsFile];
+    if (!mapped)
+    {
+        auto opened = make_shared<NNModel::MappedModel>();
+        if (!opened->open(config.weightsFile))
+        {
+            mappedFiles.erase(config.weightsFile);
+            return false;
+        }
+        mapped = move(opened);
+    }
+
+    unique_ptr<const InferenceModel> model = makeInferenceModel(config, mapped);
+    if (!model)
+        return false;
+
+    LOG_INFO("Serving model %s@%d (%s) from %s: batch %zu, delay %lld us, %u worker(s)", config.name.c_str(), config.version,
+             model->description().c_str(), config.weightsFile.c_str(), config.maxBatch,
+             static_cast<long long>(config.maxDelay.count()), config.workers);
+    models[config.name][config.version] = make_unique<ServedModel>(config, move(model));
+    return true;
+}
+
+/**
+ * @brief Looks up a model by "name" (its highest version) or "name@version"
+ *
+ * @return The model, or nullptr if none matches
+ */
+Serving::ServedModel *Serving::ModelRegistry::find(const string &nameAndVersion)
+{
+    size_t at = nameAndVersion.find('@');
+    auto versions = models.find(nameAndVersion.substr(0, at));
+    if (versions == models.end() || versions->second.empty())
+        return nullptr;
+    if (at == string::npos)
+        return versions->second.rbegin()->second.get();
+
+    char *end = nullptr;
+    long version = strtol(nameAndVersion.c_str() + at + 1, &end, 10);
+    if (end == nameAndVersion.c_str() + at + 1 || *end != '\0')
+        return nullptr;
+    auto model = versions->second.find(static_cast<int>(version));
+    return model == versions->second.end() ? nullptr : model->second.get();
+}
+
+size_t Serving::ModelRegistry::size() const
+{
+    size_t count = 0;
+    for (const auto &[name, versions] : models)
+        count += versions.size();
+    return count;
+}
+
+string Serving::ModelRegistry::describeJson()
+{
+    string json = "[";
+    for (auto &[name, versions] : models)
+    {
+        for (auto &[version, served] : versions)
+        {
+            const ModelConfig &config = served->getConfig();
+            json += (json.size() > 1 ? "," : "");
+            json += "{\"name\":\"" + name + "\",\"version\":" + to_string(version) +
+                    ",\"model\":\"" + served->getModel().description() + "\",\"precision\":\"" + precisionName(config.precision) +
+                    "\",\"batch\":" + to_string(config.maxBatch) + ",\"delay_us\":" + to_string(config.maxDelay.count()) +
+                    ",\"workers\":" + to_string(config.workers) + ",\"max_queue\":" + to_string(config.maxQueue) +
+                    ",\"queued\":" + to_string(served->pendingRequests()) + "}";
+        }
+    }
+    return json + "]";
+}
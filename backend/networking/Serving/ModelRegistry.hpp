@@ -0,0 +1,147 @@
+#ifndef MODEL_REGISTRY_HPP
+#define MODEL_REGISTRY_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Metrics/Metrics.hpp"
+
+namespace NNModel
+{
+    class MappedModel;
+}
+
+namespace Serving
+{
+    enum class Precision
+    {
+        Float64,
+        Float32
+    };
+
+    /**
+     * @brief One model as listed in the registry configuration, e.g.
+     *        mnist 2 ./NN/mnist/data/weights.dat precision=float32 batch=32 delay_us=500 workers=2 cpus=2,3
+     */
+    struct ModelConfig
+    {
+        std::string name;
+        int version = 1;
+        std::string weightsFile;
+        Precision precision = Precision::Float64;
+        size_t maxBatch = 32;                    // requests run together in one batched forward pass
+        std::chrono::microseconds maxDelay{500}; // how long a worker waits for a partial batch to fill
+        unsigned workers = 1;
+        size_t maxQueue = 1024; // queued requests beyond this are rejected (503) instead of waiting without bound
+        std::vector<int> cpus; // worker i is pinned to cpus[i % cpus.size()]; empty leaves workers unpinned. "node1" lists a NUMA node's CPUs
+    };
+
+    // Read-only inference on a batch of images; safe to call from several threads at once. Dense float64 and CSR models
+    // read each weight once per batch; float32 and block-sparse models run image by image, since skipping zero pixels
+    // per image is faster for them. None allocates once a worker has seen its largest batch.
+    class InferenceModel
+    {
+    public:
+        virtual ~InferenceModel() = default;
+        virtual size_t inputSize() const = 0;
+        virtual size_t outputSize() const = 0;
+        virtual std::string description() const = 0; // topology, layout and precision, e.g. "784x128x10 dense float64"
+        // `probabilities` receives images.size() x outputSize() values, row-major
+        virtual void predictBatch(const std::vector<std::vector<uint8_t>> &images, double *probabilities) const = 0;
+        // Private copy of the weights, allocated and first written by the calling thread so it lands on that thread's NUMA node
+        virtual std::unique_ptr<const InferenceModel> replicate() const = 0;
+    };
+
+    struct PredictRequest
+    {
+        std::vector<uint8_t> pixels;
+        std::chrono::steady_clock::time_point enqueuedAt;
+        // Called on a model worker thread with the request's outputSize() probabilities
+        std::function<void(const double *probabilities, size_t count)> respond;
+    };
+
+    /**
+     * @brief A loaded model with its own request queue and worker threads. Workers take up to maxBatch queued
+     *        requests (waiting at most maxDelay for a partial batch), run them as one batch and answer each request.
+     *        Workers share the model's weights read-only. When they are pinned to CPUs on more than one NUMA node, the
+     *        first worker on each node builds a node-local replica and the workers on that node share it.
+     */
+    class ServedModel
+    {
+        ModelConfig config;
+        std::unique_ptr<const InferenceModel> model;
+
+        std::mutex queueMutex;
+        std::condition_variable queueReady;
+        std::deque<PredictRequest> queue;
+        bool stopping = false;
+        std::vector<std::thread> workers;
+
+        const bool replicatePerNode;
+        std::mutex replicaMutex;
+        std::map<int, std::unique_ptr<const InferenceModel>> replicas; // NUMA node -> replica
+
+        Metrics::Counter &predictions;
+        Metrics::Counter &batches;
+        Metrics::Gauge &queueDepth;
+        Metrics::Histogram &queueWait;
+        Metrics::Histogram &batchTime;
+
+        void runWorker(unsigned index);
+        const InferenceModel &nodeReplica(int node);
+
+    public:
+        ServedModel(ModelConfig config, std::unique_ptr<const InferenceModel> model);
+        ~ServedModel();
+        ServedModel(const ServedModel &) = delete;
+        ServedModel &operator=(const ServedModel &) = delete;
+
+        // False if the image has the wrong size, the queue is full or the model is shutting down; `request.respond` is
+        // then never called
+        bool submit(PredictRequest request);
+
+        const ModelConfig &getConfig() const { return config; }
+        const InferenceModel &getModel() const { return *model; }
+        size_t pendingRequests();
+    };
+
+    /**
+     * @brief Named, versioned models served side by side, e.g. for A/B tests. A model is addressed as "name" (its
+     *        highest loaded version) or "name@version".
+     */
+    class ModelRegistry
+    {
+        // name -> version -> model
+        std::map<std::string, std::map<int, std::unique_ptr<ServedModel>>> models;
+        // weights file -> its mapping, shared by every entry (and worker) that serves it
+        std::map<std::string, std::shared_ptr<const NNModel::MappedModel>> mappedFiles;
+
+    public:
+        /**
+         * @brief Loads every model listed in a configuration file: one model per line, "name version weights-file"
+         *        followed by optional key=value settings (precision, batch, delay_us, workers, queue, cpus). '#' starts a comment.
+         *
+         * @return Number of models loaded; invalid lines and files are logged and skipped
+         */
+        size_t loadConfig(const std::string &path);
+        bool add(const ModelConfig &config);
+
+        ServedModel *find(const std::string &nameAndVersion);
+        size_t size() const;
+        // JSON array describing every model, for GET /models
+        std::string describeJson();
+    };
+
+    bool parsePrecision(const std::string &name, Precision &precision);
+    const char *precisionName(Precision precision);
+}
+
+#endif
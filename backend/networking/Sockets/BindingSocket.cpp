@@ -3,6 +3,10 @@
 // Inherits from SimpleSocket and binds the socket to an IP and port (bind())
 HDE::BindingSocket::BindingSocket(int domain, int service, int protocol, int port, u_long interface) : SimpleSocket{domain, service, protocol, port, interface}
 {
+    // Allow restarting the server right away while old connections sit in TIME_WAIT
+    int reuse = 1;
+    setsockopt(getSock(), SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     setConnection(connectToNetwork(getSock(), getAddress()));
     validateSocketOperation(getConnection());
 };
@@ -1,7 +1,20 @@
 #include "ConnectingSocket.hpp"
+#include <cerrno>
 
 // client socket that connects to a server.
-HDE::ConnectingSocket::ConnectingSocket(int domain, int service, int protocol, int port, u_long interface) : SimpleSocket{domain, service, protocol, port, interface}
+HDE::ConnectingSocket::ConnectingSocket(int domain, int service, int protocol, int port, u_long interface) : ConnectingSocket{domain, service, protocol, port, interface, false}
+{
+}
+
+/**
+ * @brief Client socket that connects to a server, optionally without blocking.
+ *
+ * @param nonBlocking   When true the socket is created with SOCK_NONBLOCK and connect() returns immediately.
+ *                      Completion must then be awaited with poll()/epoll() for writability and checked with SO_ERROR.
+ *                      Failures are recorded in getConnectErrno() instead of terminating the process, since
+ *                      load generators and peers retrying a connection must survive a refused connection.
+ */
+HDE::ConnectingSocket::ConnectingSocket(int domain, int service, int protocol, int port, u_long interface, bool nonBlocking) : SimpleSocket{domain, nonBlocking ? service | SOCK_NONBLOCK : service, protocol, port, interface}, nonBlocking{nonBlocking}
 {
     setConnection(connectToNetwork(getSock(), getAddress()));
     validateSocketOperation(getConnection());
@@ -11,3 +24,25 @@ int HDE::ConnectingSocket::connectToNetwork(int sock, struct sockaddr_in address
 {
     return connect(sock, (struct sockaddr *)&address, sizeof(address));
 }
+
+void HDE::ConnectingSocket::validateSocketOperation(int sockOrConnection)
+{
+    if (!nonBlocking)
+    {
+        SimpleSocket::validateSocketOperation(sockOrConnection);
+        return;
+    }
+    // EINPROGRESS just means the handshake is still running
+    connectErrno = (sockOrConnection < 0 && errno != EINPROGRESS) ? errno : 0;
+}
+
+// Below are gettors and settors
+bool HDE::ConnectingSocket::isNonBlocking()
+{
+    return nonBlocking;
+}
+
+int HDE::ConnectingSocket::getConnectErrno()
+{
+    return connectErrno;
+}
@@ -5,10 +5,19 @@
 
 namespace HDE {
     class ConnectingSocket : public SimpleSocket {
+        bool nonBlocking;
+        int connectErrno = 0;
+
         public:
         ConnectingSocket(int, int, int, int, u_long);
+        ConnectingSocket(int, int, int, int, u_long, bool nonBlocking);
         int connectToNetwork(int, struct sockaddr_in) override;
+        void validateSocketOperation(int) override;
+
+        // Below are gettors and settors
+        bool isNonBlocking();
+        int getConnectErrno();
     };
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,219 @@
+#include "IoUring.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+HDE::IoUring::~IoUring()
+{
+    unmap();
+    if (bufferRing)
+        munmap(bufferRing, bufferRingBytes);
+}
+
+void HDE::IoUring::unmap()
+{
+    if (sqes)
+        munmap(sqes, sqesBytes);
+    if (cqRing && cqRing != sqRing)
+        munmap(cqRing, cqRingBytes);
+    if (sqRing)
+        munmap(sqRing, sqRingBytes);
+    if (ringFd >= 0)
+        close(ringFd);
+    sqes = nullptr;
+    sqRing = cqRing = nullptr;
+    ringFd = -1;
+}
+
+bool HDE::IoUring::setup(unsigned entries)
+{
+    // A single issuer with deferred task work runs completions only when this thread enters the kernel (Linux 6.1+);
+    // older kernels reject the flags, so retry without them
+    io_uring_params params;
+    const unsigned flagSets[] = {IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN, 0};
+    for (unsigned flags : flagSets)
+    {
+        memset(&params, 0, sizeof(params));
+        params.flags = flags;
+        ringFd = static_cast<int>(syscall(SYS_io_uring_setup, entries, &params));
+        if (ringFd >= 0 || errno != EINVAL)
+            break;
+    }
+    if (ringFd < 0)
+        return false;
+
+    sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap)
+        sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+
+    sqRing = mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+    {
+        sqRing = nullptr;
+        unmap();
+        return false;
+    }
+    cqRing = singleMap ? sqRing : mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqeMemory = cqRing == MAP_FAILED ? MAP_FAILED : mmap(nullptr, sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (cqRing == MAP_FAILED || sqeMemory == MAP_FAILED)
+    {
+        int error = errno;
+        if (cqRing == MAP_FAILED)
+            cqRing = nullptr;
+        unmap();
+        errno = error;
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe *>(sqeMemory);
+
+    char *sq = static_cast<char *>(sqRing);
+    char *cq = static_cast<char *>(cqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    localTail = *sqTail;
+    return true;
+}
+
+bool HDE::IoUring::registerBufferRing(uint16_t group, unsigned count, unsigned size)
+{
+    if (ringFd < 0 || count == 0 || (count & (count - 1)) != 0 || count > 32768)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    bufferRingBytes = count * sizeof(io_uring_buf);
+    void *memory = mmap(nullptr, bufferRingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return false;
+
+    io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<uint64_t>(memory);
+    registration.ring_entries = count;
+    registration.bgid = group;
+    if (syscall(SYS_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0)
+    {
+        int error = errno;
+        munmap(memory, bufferRingBytes);
+        errno = error;
+        return false;
+    }
+
+    bufferRing = static_cast<io_uring_buf *>(memory);
+    bufferCount = count;
+    bufferSize = size;
+    bufferGroup = group;
+    bufferMemory.assign(static_cast<size_t>(count) * size, 0);
+    for (unsigned id = 0; id < count; ++id)
+        recycleBuffer(static_cast<uint16_t>(id));
+    return true;
+}
+
+void HDE::IoUring::recycleBuffer(uint16_t id)
+{
+    io_uring_buf &entry = bufferRing[bufferRingTail & (bufferCount - 1)];
+    entry.addr = reinterpret_cast<uint64_t>(buffer(id));
+    entry.len = bufferSize;
+    entry.bid = id;
+    __atomic_store_n(&bufferRing[0].resv, ++bufferRingTail, __ATOMIC_RELEASE);
+}
+
+// Next free submission entry, zeroed; flushes the queue to the kernel first if it is full
+io_uring_sqe *HDE::IoUring::nextSqe()
+{
+    if (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries && !submitAndWait(0))
+        return nullptr;
+    if (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+        return nullptr;
+
+    const unsigned index = localTail & sqMask;
+    io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    ++localTail;
+    ++unsubmitted;
+    return sqe;
+}
+
+bool HDE::IoUring::prepareMultishotAccept(int listeningSocket, uint64_t userData)
+{
+    io_uring_sqe *sqe = nextSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listeningSocket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool HDE::IoUring::prepareBufferedRecv(int socket, uint64_t userData)
+{
+    io_uring_sqe *sqe = nextSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = socket;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufferGroup;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool HDE::IoUring::prepareSend(int socket, const void *data, size_t length, uint64_t userData)
+{
+    io_uring_sqe *sqe = nextSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = socket;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL; // newer kernels retry short sends, so one completion usually covers it
+    sqe->user_data = userData;
+    return true;
+}
+
+bool HDE::IoUring::prepareClose(int socket, uint64_t userData)
+{
+    io_uring_sqe *sqe = nextSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = socket;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool HDE::IoUring::submitAndWait(unsigned waitFor)
+{
+    __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+    while (true)
+    {
+        ++enterCalls;
+        long submitted = syscall(SYS_io_uring_enter, ringFd, unsubmitted, waitFor, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (submitted >= 0)
+        {
+            unsubmitted -= static_cast<unsigned>(submitted);
+            return true;
+        }
+        if (errno == EINTR)
+            continue;
+        // The completion queue is full: the caller has to consume completions before more can be submitted
+        return errno == EBUSY || errno == EAGAIN;
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef IO_URING_HPP
+#define IO_URING_HPP
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace HDE
+{
+    /**
+     * @brief Minimal io_uring ring set up with the raw syscalls (no liburing): a submission queue, a completion queue
+     *        and optionally one provided-buffer ring that receives pick their buffer from.
+     *        Not thread-safe; one thread owns the ring.
+     */
+    class IoUring
+    {
+        int ringFd = -1;
+        void *sqRing = nullptr;
+        void *cqRing = nullptr;
+        size_t sqRingBytes = 0;
+        size_t cqRingBytes = 0;
+        io_uring_sqe *sqes = nullptr;
+        size_t sqesBytes = 0;
+
+        unsigned *sqHead = nullptr;
+        unsigned *sqTail = nullptr;
+        unsigned *sqArray = nullptr;
+        unsigned sqMask = 0;
+        unsigned sqEntries = 0;
+        unsigned *cqHead = nullptr;
+        unsigned *cqTail = nullptr;
+        unsigned cqMask = 0;
+        io_uring_cqe *cqes = nullptr;
+
+        unsigned localTail = 0;   // SQEs prepared so far; published to *sqTail on submit
+        unsigned unsubmitted = 0; // prepared SQEs the kernel has not consumed yet
+        uint64_t enterCalls = 0;
+
+        // The kernel's io_uring_buf_ring: entries from offset 0, with the tail overlaid on entry 0's resv field.
+        // Addressed as a plain array because the header's flexible-array macro puts `bufs` at offset 8 in C++.
+        io_uring_buf *bufferRing = nullptr;
+        size_t bufferRingBytes = 0;
+        uint16_t bufferRingTail = 0;
+        unsigned bufferCount = 0;
+        unsigned bufferSize = 0;
+        uint16_t bufferGroup = 0;
+        std::vector<char> bufferMemory;
+
+        io_uring_sqe *nextSqe();
+        void unmap();
+
+    public:
+        IoUring() = default;
+        ~IoUring();
+        IoUring(const IoUring &) = delete;
+        IoUring &operator=(const IoUring &) = delete;
+
+        /**
+         * @brief Creates the ring with room for `entries` submissions
+         *
+         * @return False (errno set) if the kernel has no io_uring or it is disabled, e.g. by seccomp or
+         *         /proc/sys/kernel/io_uring_disabled
+         */
+        bool setup(unsigned entries);
+
+        /**
+         * @brief Registers `count` (a power of two) receive buffers of `size` bytes as buffer group `group`, so
+         *        receives only take a buffer once data has arrived (Linux 5.19+)
+         */
+        bool registerBufferRing(uint16_t group, unsigned count, unsigned size);
+        const char *buffer(uint16_t id) const { return bufferMemory.data() + static_cast<size_t>(id) * bufferSize; }
+        // Hands a buffer a receive completion selected back to the kernel
+        void recycleBuffer(uint16_t id);
+
+        // Each prepare call queues one request tagged with `userData`; false if the submission queue is full even after
+        // flushing it to the kernel
+        bool prepareMultishotAccept(int listeningSocket, uint64_t userData);
+        bool prepareBufferedRecv(int socket, uint64_t userData);
+        // May complete with fewer than `length` bytes on kernels that ignore MSG_WAITALL for sends; resubmit the rest
+        bool prepareSend(int socket, const void *data, size_t length, uint64_t userData);
+        bool prepareClose(int socket, uint64_t userData);
+
+        /**
+         * @brief Submits every prepared request and waits until at least `waitFor` completions are ready
+         *
+         * @return False on an unexpected io_uring_enter error
+         */
+        bool submitAndWait(unsigned waitFor);
+
+        // Calls handle(const io_uring_cqe &) for every ready completion and returns how many there were
+        template <typename Handler>
+        unsigned forEachCompletion(Handler &&handle)
+        {
+            unsigned head = *cqHead;
+            const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            unsigned seen = 0;
+            for (; head != tail; ++head, ++seen)
+                handle(cqes[head & cqMask]);
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            return seen;
+        }
+
+        uint64_t getEnterCalls() const { return enterCalls; }
+    };
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "SimpleSocket.hpp"
+#include <unistd.h>
 
 /**
  * @brief Creates a raw socket using socket()
@@ -28,6 +29,12 @@ HDE::SimpleSocket::SimpleSocket(int domain, int service, int protocol, int port,
     validateSocketOperation(sock);
 }
 
+HDE::SimpleSocket::~SimpleSocket()
+{
+    if (sock >= 0)
+        close(sock);
+}
+
 void HDE::SimpleSocket::validateSocketOperation(int sockOrConnection)
 {
     if (sockOrConnection < 0)
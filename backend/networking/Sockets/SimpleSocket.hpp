@@ -15,11 +15,14 @@ namespace HDE
 
     public:
         SimpleSocket(int, int, int, int, u_long);
+        virtual ~SimpleSocket();
+        SimpleSocket(const SimpleSocket &) = delete;
+        SimpleSocket &operator=(const SimpleSocket &) = delete;
 
         virtual int connectToNetwork(int, struct sockaddr_in) = 0;
 
         // Test return value of socket(), bind(), connect(), listen() for success or failure status
-        void validateSocketOperation(int); 
+        virtual void validateSocketOperation(int);
 
         // Below are gettors and settors
         struct sockaddr_in getAddress();
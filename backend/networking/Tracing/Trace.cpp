@@ -0,0 +1,190 @@
+#include "Trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    constexpr size_t EVENT_CAPACITY = 1 << 16; // per thread, must be a power of two
+    // The oldest events may be overwritten by their thread while an export is reading them, so skip that margin
+    constexpr size_t EXPORT_MARGIN = 1024;
+
+    struct Event
+    {
+        const char *name;
+        uint64_t start;
+        uint64_t end;
+        uint32_t depth;
+    };
+
+    // Written only by its owning thread; `head` is published with release semantics for the exporter
+    struct ThreadBuffer
+    {
+        uint32_t threadId = 0;
+        atomic<uint64_t> head{0};
+        Event events[EVENT_CAPACITY];
+    };
+
+    struct ThreadState
+    {
+        uint32_t depth = 0;
+        uint64_t roots = 0;
+        bool rootSampled = false;
+        ThreadBuffer *buffer = nullptr;
+    };
+
+    thread_local ThreadState threadState;
+
+    uint32_t initialSampleRate()
+    {
+        const char *rate = getenv("TRACE_SAMPLE_RATE");
+        return rate ? static_cast<uint32_t>(strtoul(rate, nullptr, 10)) : 0;
+    }
+
+    atomic<uint32_t> sampleRate{initialSampleRate()};
+
+    // Trace time zero, captured at static initialization so every span starts after it
+    const uint64_t originTimestamp = Tracing::timestamp();
+    const chrono::steady_clock::time_point originTime = chrono::steady_clock::now();
+
+    struct BufferRegistry
+    {
+        mutex registryMutex;
+        vector<unique_ptr<ThreadBuffer>> buffers; // kept after their thread exits so its spans can still be exported
+        uint32_t nextThreadId = 1;
+    };
+
+    BufferRegistry &bufferRegistry()
+    {
+        static BufferRegistry registry;
+        return registry;
+    }
+
+    ThreadBuffer *registerThreadBuffer()
+    {
+        BufferRegistry &registry = bufferRegistry();
+        auto buffer = make_unique<ThreadBuffer>();
+        lock_guard<mutex> lock(registry.registryMutex);
+        buffer->threadId = registry.nextThreadId++;
+        registry.buffers.push_back(move(buffer));
+        return registry.buffers.back().get();
+    }
+
+    // Timestamp ticks per nanosecond, measured against steady_clock since trace time zero
+    double ticksPerNanosecond()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        auto elapsed = chrono::steady_clock::now() - originTime;
+        if (elapsed < chrono::milliseconds(10))
+        {
+            this_thread::sleep_for(chrono::milliseconds(10) - elapsed);
+        }
+        uint64_t ticks = Tracing::timestamp() - originTimestamp;
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - originTime).count();
+        return static_cast<double>(ticks) / ns;
+#else
+        return 1.0;
+#endif
+    }
+}
+
+void Tracing::setSampleRate(uint32_t rate)
+{
+    sampleRate.store(rate, memory_order_relaxed);
+}
+
+uint32_t Tracing::getSampleRate()
+{
+    return sampleRate.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Decides whether a new span is recorded. The sampling decision is made once per root span and
+ *        inherited by everything nested under it, so sampled traces are always complete.
+ *
+ * @param entered   Set to true when the span was counted in the thread's nesting depth
+ *
+ * @return True if the span should be timed and stored
+ */
+bool Tracing::beginSpan(bool &entered)
+{
+    ThreadState &state = threadState;
+    if (state.depth == 0)
+    {
+        uint32_t rate = sampleRate.load(memory_order_relaxed);
+        if (rate == 0)
+            return false;
+        state.rootSampled = (state.roots++ % rate) == 0;
+    }
+    ++state.depth;
+    entered = true;
+    return state.rootSampled;
+}
+
+void Tracing::endSpan(const char *name, uint64_t start, bool recording)
+{
+    ThreadState &state = threadState;
+    --state.depth;
+    if (!recording)
+        return;
+
+    uint64_t end = timestamp();
+    if (!state.buffer)
+        state.buffer = registerThreadBuffer();
+
+    ThreadBuffer &buffer = *state.buffer;
+    uint64_t index = buffer.head.load(memory_order_relaxed);
+    buffer.events[index & (EVENT_CAPACITY - 1)] = {name, start, end, state.depth};
+    buffer.head.store(index + 1, memory_order_release);
+}
+
+string Tracing::exportChromeTrace()
+{
+    BufferRegistry &registry = bufferRegistry();
+    double ticksPerNs = ticksPerNanosecond();
+
+    vector<ThreadBuffer *> buffers;
+    {
+        lock_guard<mutex> lock(registry.registryMutex);
+        for (auto &buffer : registry.buffers)
+            buffers.push_back(buffer.get());
+    }
+
+    string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    char event[256];
+    for (ThreadBuffer *buffer : buffers)
+    {
+        uint64_t head = buffer->head.load(memory_order_acquire);
+        uint64_t from = head > EVENT_CAPACITY - EXPORT_MARGIN ? head - (EVENT_CAPACITY - EXPORT_MARGIN) : 0;
+        for (uint64_t i = from; i < head; ++i)
+        {
+            const Event &span = buffer->events[i & (EVENT_CAPACITY - 1)];
+            double startUs = static_cast<double>(span.start - originTimestamp) / ticksPerNs / 1000.0;
+            double durationUs = static_cast<double>(span.end - span.start) / ticksPerNs / 1000.0;
+            snprintf(event, sizeof(event),
+                     "%s{\"name\":\"%s\",\"cat\":\"hde\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"depth\":%u}}",
+                     first ? "" : ",", span.name, startUs, durationUs, buffer->threadId, span.depth);
+            json += event;
+            first = false;
+        }
+    }
+    json += "]}";
+    return json;
+}
+
+bool Tracing::writeChromeTrace(const string &path)
+{
+    ofstream file(path, ios::trunc);
+    if (!file)
+        return false;
+    file << exportChromeTrace();
+    return static_cast<bool>(file);
+}
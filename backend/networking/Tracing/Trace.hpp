@@ -0,0 +1,85 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Build with -DTRACING_ENABLED=0 to compile every TRACE_SPAN away
+#ifndef TRACING_ENABLED
+#define TRACING_ENABLED 1
+#endif
+
+namespace Tracing
+{
+    // Raw timestamp: the TSC on x86 (a few ns to read, no syscall), steady_clock nanoseconds elsewhere
+    inline uint64_t timestamp()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    /**
+     * @brief Records 1 in `rate` root spans (and everything nested under them) per thread; 0 disables tracing.
+     *        Defaults to the TRACE_SAMPLE_RATE environment variable, or 0 when it is unset.
+     */
+    void setSampleRate(uint32_t rate);
+    uint32_t getSampleRate();
+
+    // Returns true if the span should be recorded; `entered` tells the caller whether endSpan must be called
+    bool beginSpan(bool &entered);
+    void endSpan(const char *name, uint64_t start, bool recording);
+
+    // Chrome trace-event JSON ({"traceEvents": [...]}) of the spans currently buffered on every thread,
+    // loadable in chrome://tracing or https://ui.perfetto.dev
+    std::string exportChromeTrace();
+    bool writeChromeTrace(const std::string &path);
+
+    class Span
+    {
+        const char *name;
+        uint64_t start = 0;
+        bool entered = false;
+        bool recording;
+
+    public:
+        explicit Span(const char *spanName) : name{spanName}, recording{beginSpan(entered)}
+        {
+            if (recording)
+                start = timestamp();
+        }
+
+        ~Span()
+        {
+            if (entered)
+                endSpan(name, start, recording);
+        }
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+    };
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if TRACING_ENABLED
+// Times the enclosing scope. `name` must be a string literal (only the pointer is stored).
+#define TRACE_SPAN(name) ::Tracing::Span TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) \
+    do                   \
+    {                    \
+    } while (0)
+#endif
+
+#endif
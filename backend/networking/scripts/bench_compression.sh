@@ -0,0 +1,58 @@
+#!/usr/bin/env bash
+# History compression benchmark: for each Accept-Encoding, starts server.exe with an empty response cache and drives
+# GET / (the training history) with loadgen.exe while a second loadgen drives GET /models, so the models p99 shows
+# whether building and compressing history responses on the worker threads slows the accept loop down. Prints one
+# JSON line per encoding with bytes_per_response, the history results and models_p99_ms.
+#
+# Environment overrides: PORT, CONNECTIONS, DURATION, WARMUP, ENCODINGS, COMPRESSION_LEVEL, COMPRESSION_WORKERS
+# Run from backend/networking after `make` and after training has written NN/mnist/data, e.g.
+# DURATION=5 ./scripts/bench_compression.sh
+set -euo pipefail
+
+cd "$(dirname "$0")/.."
+
+PORT="${PORT:-8091}"
+CONNECTIONS="${CONNECTIONS:-4}"
+DURATION="${DURATION:-5}"
+WARMUP="${WARMUP:-0}"
+ENCODINGS="${ENCODINGS:-identity gzip deflate}"
+
+if [[ ! -x ./server.exe || ! -x ./loadgen.exe ]]; then
+    echo "Build first: make server.exe loadgen.exe" >&2
+    exit 1
+fi
+
+SERVER_PID=""
+trap '[[ -n "$SERVER_PID" ]] && kill "$SERVER_PID" 2>/dev/null; wait 2>/dev/null || true' EXIT
+
+# Value of one field of a loadgen JSON line
+json_field() {
+    sed -n "s/.*\"$2\":\\([0-9.]*\\).*/\\1/p" <<< "$1"
+}
+
+for encoding in $ENCODINGS; do
+    LOG_LEVEL=warn ./server.exe "$PORT" > "/tmp/bench_compression_$encoding.log" 2>&1 &
+    SERVER_PID=$!
+    for _ in $(seq 1 50); do
+        if (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then
+            break
+        fi
+        sleep 0.1
+    done
+
+    ./loadgen.exe --port "$PORT" --connections 1 --duration "$DURATION" --warmup "$WARMUP" \
+        --target models=GET:/models > "/tmp/bench_compression_models.json" 2>/dev/null &
+    MODELS_PID=$!
+    history="$(./loadgen.exe --port "$PORT" --connections "$CONNECTIONS" --duration "$DURATION" --warmup "$WARMUP" \
+        --header "Accept-Encoding: $encoding" --target history=GET:/ 2>/dev/null)"
+    wait "$MODELS_PID"
+    models="$(cat /tmp/bench_compression_models.json)"
+    kill "$SERVER_PID"
+    wait "$SERVER_PID" 2>/dev/null || true
+    SERVER_PID=""
+
+    per_response="$(awk -v b="$(json_field "$history" bytes_received)" -v c="$(json_field "$history" completed)" \
+        'BEGIN { printf "%d", (c > 0 ? b / c : 0) }')"
+    echo "{\"encoding\":\"$encoding\",\"bytes_per_response\":$per_response,\"models_p99_ms\":$(json_field "$models" p99_ms),${history#\{}"
+    sleep 1
+done
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+# Distributed training benchmark: trains the same MNIST subset with 1, 2 and 4 trainer processes on localhost and
+# prints one JSON line per world size, with scaling efficiency = T(1) / (N * T(N)) for the same total samples.
+# Extra arguments (e.g. --fp16) are passed to every trainer.
+#
+# Environment overrides: WORLDS, BASE_PORT, EPOCHS, TRAIN_COUNT, BATCH
+# Run from backend/networking/NN after `make train_distributed.out`, e.g. WORLDS="1 2 3" ../scripts/bench_distributed.sh --fp16
+set -euo pipefail
+
+cd "$(dirname "$0")/../NN"
+
+WORLDS="${WORLDS:-1 2 4}"
+BASE_PORT="${BASE_PORT:-9300}"
+EPOCHS="${EPOCHS:-2}"
+TRAIN_COUNT="${TRAIN_COUNT:-6000}"
+BATCH="${BATCH:-16}"
+
+if [[ ! -x ./train_distributed.out ]]; then
+    echo "Build first: make train_distributed.out" >&2
+    exit 1
+fi
+
+mkdir -p mnist/data
+BENCH_WEIGHTS="mnist/data/weights_distributed_bench.dat"
+PIDS=()
+trap 'kill "${PIDS[@]}" 2>/dev/null || true; rm -f "$BENCH_WEIGHTS"' EXIT
+
+BASELINE=""
+for world in $WORLDS; do
+    peers=""
+    for ((rank = 0; rank < world; ++rank)); do
+        peers+="${peers:+,}127.0.0.1:$((BASE_PORT + rank))"
+    done
+
+    PIDS=()
+    for ((rank = 1; rank < world; ++rank)); do
+        LOG_LEVEL=warn ./train_distributed.out --rank "$rank" --peers "$peers" --epochs "$EPOCHS" \
+            --train-count "$TRAIN_COUNT" --batch "$BATCH" "$@" &
+        PIDS+=($!)
+    done
+    summary="$(LOG_LEVEL=warn ./train_distributed.out --rank 0 --peers "$peers" --epochs "$EPOCHS" \
+        --train-count "$TRAIN_COUNT" --batch "$BATCH" --output "$BENCH_WEIGHTS" "$@")"
+    for pid in "${PIDS[@]}"; do
+        wait "$pid"
+    done
+
+    seconds="$(sed 's/.*"seconds":\([0-9.]*\).*/\1/' <<< "$summary")"
+    BASELINE="${BASELINE:-$seconds}"
+    efficiency="$(awk -v t1="$BASELINE" -v tn="$seconds" -v n="$world" 'BEGIN { printf "%.3f", t1 / (n * tn) }')"
+    echo "${summary%\}},\"scaling_efficiency\":$efficiency}"
+    # Let the kernel release the ports before the next world size reuses them
+    BASE_PORT=$((BASE_PORT + world))
+done
@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+# I/O backend benchmark: runs server.exe with SERVER_IO=blocking and then SERVER_IO=io_uring, drives each with
+# loadgen.exe in closed-loop mode, and prints one JSON line per backend and target with the loadgen results plus
+# syscalls_per_request, read from the server's http_io_syscalls_total counter.
+#
+# Environment overrides: PORT, CONNECTIONS, DURATION, WARMUP, TARGETS, BACKENDS
+# Run from backend/networking after `make`, e.g. DURATION=5 ./scripts/bench_io.sh
+set -euo pipefail
+
+cd "$(dirname "$0")/.."
+
+PORT="${PORT:-8090}"
+CONNECTIONS="${CONNECTIONS:-16}"
+DURATION="${DURATION:-5}"
+WARMUP="${WARMUP:-1}"
+TARGETS="${TARGETS:-models=GET:/models}"
+BACKENDS="${BACKENDS:-blocking io_uring}"
+
+if [[ ! -x ./server.exe || ! -x ./loadgen.exe ]]; then
+    echo "Build first: make server.exe loadgen.exe" >&2
+    exit 1
+fi
+
+SERVER_PID=""
+trap '[[ -n "$SERVER_PID" ]] && kill "$SERVER_PID" 2>/dev/null; wait 2>/dev/null || true' EXIT
+
+# Sum of a counter's samples in the server's /metrics output
+metric_sum() {
+    local name="$1"
+    exec 3<>"/dev/tcp/127.0.0.1/$PORT"
+    printf 'GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n' >&3
+    awk -v name="$name" 'index($0, name) == 1 { sum += $NF } END { printf "%d", sum }' <&3
+    exec 3<&-
+}
+
+for backend in $BACKENDS; do
+    for target in $TARGETS; do
+        SERVER_IO="$backend" LOG_LEVEL=warn ./server.exe "$PORT" > "/tmp/bench_io_$backend.log" 2>&1 &
+        SERVER_PID=$!
+        for _ in $(seq 1 50); do
+            if (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then
+                break
+            fi
+            sleep 0.1
+        done
+
+        result="$(./loadgen.exe --port "$PORT" --connections "$CONNECTIONS" --duration "$DURATION" --warmup "$WARMUP" \
+            --target "$target" 2>/dev/null)"
+        syscalls="$(metric_sum 'http_io_syscalls_total')"
+        requests="$(metric_sum 'http_requests_total')"
+        kill "$SERVER_PID"
+        wait "$SERVER_PID" 2>/dev/null || true
+        SERVER_PID=""
+
+        per_request="$(awk -v s="$syscalls" -v r="$requests" 'BEGIN { printf "%.2f", (r > 0 ? s / r : 0) }')"
+        echo "{\"backend\":\"$backend\",\"syscalls_per_request\":$per_request,${result#\{}"
+        # The next server binds the same port; let the old connections drain
+        sleep 1
+    done
+done
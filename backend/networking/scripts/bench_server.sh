@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+# End-to-end server benchmark: starts server.exe on a local port, drives each endpoint with loadgen.exe in
+# closed-loop and open-loop mode, and appends one JSON line per run to bench_results/<git-rev>-<timestamp>.jsonl.
+#
+# The predict target posts one MNIST image (raw pixel bytes, PREDICT_IMAGE) to the first model in models.conf, so
+# NN/mnist/data/weights.dat must exist (run NN/train.out first).
+#
+# Environment overrides: PORT, CONNECTIONS, DURATION, WARMUP, RATE (open-loop requests/sec), MODEL, PREDICT_IMAGE,
+# TARGETS
+# Run from backend/networking after `make`, e.g. DURATION=5 RATE=200 ./scripts/bench_server.sh
+set -euo pipefail
+
+cd "$(dirname "$0")/.."
+
+PORT="${PORT:-8089}"
+CONNECTIONS="${CONNECTIONS:-16}"
+DURATION="${DURATION:-10}"
+WARMUP="${WARMUP:-2}"
+RATE="${RATE:-100}"
+MODEL="${MODEL:-mnist}"
+PREDICT_IMAGE="${PREDICT_IMAGE:-bench_results/predict_image.bin}"
+TARGETS="${TARGETS:-history=GET:/ metrics=GET:/metrics predict=POST:/models/$MODEL/predict@$PREDICT_IMAGE}"
+
+if [[ ! -x ./server.exe || ! -x ./loadgen.exe ]]; then
+    echo "Build first: make server.exe loadgen.exe" >&2
+    exit 1
+fi
+
+mkdir -p bench_results
+REVISION="$(git rev-parse --short HEAD 2>/dev/null || echo unknown)"
+OUTPUT="bench_results/${REVISION}-$(date +%Y%m%d-%H%M%S).jsonl"
+
+# The first test image (after the 16-byte IDX header), or a blank image if the dataset is not downloaded
+if [[ ! -s "$PREDICT_IMAGE" ]]; then
+    MNIST_IMAGES="../../data/mnist/t10k-images-idx3-ubyte/t10k-images-idx3-ubyte"
+    if [[ -f "$MNIST_IMAGES" ]]; then
+        dd if="$MNIST_IMAGES" of="$PREDICT_IMAGE" bs=16 skip=1 count=49 status=none
+    else
+        dd if=/dev/zero of="$PREDICT_IMAGE" bs=16 count=49 status=none
+    fi
+fi
+
+LOG_LEVEL=warn ./server.exe "$PORT" > bench_results/server.log 2>&1 &
+SERVER_PID=$!
+trap 'kill "$SERVER_PID" 2>/dev/null || true; wait "$SERVER_PID" 2>/dev/null || true' EXIT
+
+for _ in $(seq 1 50); do
+    if (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then
+        break
+    fi
+    sleep 0.1
+done
+
+TARGET_ARGS=()
+for target in $TARGETS; do
+    TARGET_ARGS+=(--target "$target")
+done
+
+echo "Benchmarking server.exe (rev $REVISION) on port $PORT" >&2
+./loadgen.exe --port "$PORT" --connections "$CONNECTIONS" --duration "$DURATION" --warmup "$WARMUP" \
+    "${TARGET_ARGS[@]}" | sed "s/^{/{\"rev\":\"$REVISION\",/" >> "$OUTPUT"
+./loadgen.exe --port "$PORT" --connections "$CONNECTIONS" --duration "$DURATION" --warmup "$WARMUP" \
+    --rate "$RATE" "${TARGET_ARGS[@]}" | sed "s/^{/{\"rev\":\"$REVISION\",/" >> "$OUTPUT"
+
+echo "Results written to $OUTPUT" >&2